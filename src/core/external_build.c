@@ -0,0 +1,312 @@
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64
+
+#include "merkle_tree.h"
+#include "../hash/hash_functions.h"
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// On-disk tree: a header, then every digest in heap order, root first.
+// The builder writes it bottom-up, one level at a time, and reads each
+// level back from the file to hash the one above, so only its chunk
+// buffers are ever resident.
+#define TREE_FILE_MAGIC "MRKLTREE"
+#define TREE_FILE_VERSION 1
+#define TREE_FILE_HEADER_SIZE 32
+
+struct merkle_tree_file {
+    int fd;
+    uint64_t num_leaves;
+    hash_type_t hash_type;
+    uint8_t arity;
+    uint8_t arity_log2;
+    uint8_t depth;
+};
+
+static inline off_t file_level_offset(uint8_t arity_log2, uint8_t level) {
+    return TREE_FILE_HEADER_SIZE + (off_t)heap_level_offset(arity_log2, level) * SHA256_HASH_SIZE;
+}
+
+static bool pread_full(int fd, uint8_t* buffer, size_t size, off_t offset) {
+    while (size > 0) {
+        ssize_t n = pread(fd, buffer, size, offset);
+        if (n <= 0) {
+            return false;
+        }
+        buffer += n;
+        size -= (size_t)n;
+        offset += n;
+    }
+    return true;
+}
+
+static bool pwrite_full(int fd, const uint8_t* buffer, size_t size, off_t offset) {
+    while (size > 0) {
+        ssize_t n = pwrite(fd, buffer, size, offset);
+        if (n <= 0) {
+            return false;
+        }
+        buffer += n;
+        size -= (size_t)n;
+        offset += n;
+    }
+    return true;
+}
+
+// Hash the leaves into the bottom level as the ingestion pipeline hands
+// over their chunks. Each chunk is wrapped in a borrowed view tree so large
+// chunks are hashed in parallel while the next ones are read.
+static merkle_error_t external_hash_leaves(merkle_ingest_t* ingest, int out, const merkle_tree_t* shape,
+                                           uint64_t chunk_leaves) {
+    size_t hashes_size = chunk_leaves * SHA256_HASH_SIZE;
+    uint8_t* hashes = (uint8_t*)malloc(hashes_size);
+    if (!hashes) {
+        return MERKLE_ERROR_MEMORY_ALLOCATION;
+    }
+    merkle_memory_account_alloc(MERKLE_MEM_LEVELS, hashes_size);
+    
+    merkle_error_t err = MERKLE_SUCCESS;
+    off_t offset = file_level_offset(shape->arity_log2, shape->depth);
+    merkle_tree_t view = *shape;
+    uint64_t leaf = 0;
+    size_t size = 0;
+    const uint8_t* chunk;
+    while (err == MERKLE_SUCCESS && (chunk = merkle_ingest_next(ingest, &size)) != NULL) {
+        view.leaf_data = (uint8_t*)chunk;
+        view.num_leaves = size / shape->leaf_data_size;
+        merkle_hash_leaves(&view, NULL, hashes);
+        if (!pwrite_full(out, hashes, view.num_leaves * SHA256_HASH_SIZE, offset)) {
+            err = MERKLE_ERROR_IO;
+        }
+        offset += (off_t)(view.num_leaves * SHA256_HASH_SIZE);
+        leaf += view.num_leaves;
+    }
+    
+    free(hashes);
+    merkle_memory_account_free(MERKLE_MEM_LEVELS, hashes_size);
+    return err == MERKLE_SUCCESS && leaf != shape->num_leaves ? MERKLE_ERROR_IO : err;
+}
+
+// Hash level `level + 1` of the file into level `level`, a chunk of
+// sibling groups at a time
+static merkle_error_t external_hash_level(int fd, const merkle_tree_t* shape, uint8_t level, uint8_t* buffer,
+                                          size_t memory_limit) {
+    size_t group = (size_t)shape->arity * SHA256_HASH_SIZE;
+    uint64_t chunk_nodes = memory_limit / (group + SHA256_HASH_SIZE);
+    uint64_t level_nodes = (uint64_t)1 << (shape->arity_log2 * level);
+    uint8_t* hashes = buffer + chunk_nodes * group;
+    off_t in_offset = file_level_offset(shape->arity_log2, level + 1);
+    off_t out_offset = file_level_offset(shape->arity_log2, level);
+    
+    for (uint64_t node = 0; node < level_nodes; node += chunk_nodes) {
+        uint64_t count = level_nodes - node < chunk_nodes ? level_nodes - node : chunk_nodes;
+        if (!pread_full(fd, buffer, count * group, in_offset)) {
+            return MERKLE_ERROR_IO;
+        }
+        for (uint64_t i = 0; i < count; i++) {
+            shape->hash_function(buffer + i * group, group, hashes + i * SHA256_HASH_SIZE);
+        }
+        if (!pwrite_full(fd, hashes, count * SHA256_HASH_SIZE, out_offset)) {
+            return MERKLE_ERROR_IO;
+        }
+        in_offset += (off_t)(count * group);
+        out_offset += (off_t)(count * SHA256_HASH_SIZE);
+    }
+    return MERKLE_SUCCESS;
+}
+
+// Build the tree over the fixed-size leaves of input_path into the tree
+// file output_path, holding about memory_limit bytes of buffers: first the
+// ingestion ring and the leaf hashes of one chunk, then the level chunks.
+// The leaf count is the input size over leaf_size and must be a power of arity.
+merkle_error_t merkle_tree_build_external(const char* input_path, size_t leaf_size, hash_type_t hash_type,
+                                          uint8_t arity, const char* output_path, size_t memory_limit,
+                                          uint8_t* root_hash) {
+    if (!input_path || !output_path || leaf_size == 0) {
+        return MERKLE_ERROR_INVALID_TREE;
+    }
+    if (memory_limit == 0) {
+        memory_limit = MERKLE_EXTERNAL_DEFAULT_MEMORY;
+    }
+    uint64_t chunk_leaves = memory_limit / (MERKLE_INGEST_BUFFERS * leaf_size + SHA256_HASH_SIZE);
+    if (memory_limit < MERKLE_EXTERNAL_MIN_MEMORY || chunk_leaves == 0) {
+        return MERKLE_ERROR_INVALID_SIZE;
+    }
+    
+    merkle_ingest_t* ingest = merkle_ingest_open(input_path, chunk_leaves * leaf_size, true);
+    if (!ingest) {
+        return MERKLE_ERROR_IO;
+    }
+    uint64_t input_size = merkle_ingest_size(ingest);
+    if (input_size == 0 || input_size % leaf_size != 0) {
+        merkle_ingest_close(ingest);
+        return MERKLE_ERROR_INVALID_SIZE;
+    }
+    
+    // The shape of the tree, without nodes or leaves
+    merkle_tree_t shape;
+    memset(&shape, 0, sizeof(shape));
+    shape.num_leaves = input_size / leaf_size;
+    merkle_error_t err = validate_kary_parameters(shape.num_leaves, hash_type, arity);
+    hash_algorithm_t* algorithm = get_hash_algorithm(hash_type);
+    if (err != MERKLE_SUCCESS || !algorithm) {
+        merkle_ingest_close(ingest);
+        return err != MERKLE_SUCCESS ? err : MERKLE_ERROR_INVALID_HASH_TYPE;
+    }
+    shape.arity = arity;
+    shape.arity_log2 = (uint8_t)__builtin_ctz(arity);
+    shape.depth = calculate_tree_depth(shape.num_leaves) / shape.arity_log2;
+    shape.hash_type = hash_type;
+    shape.hash_function = algorithm->hash;
+    shape.leaf_data_size = leaf_size;
+    
+    int out = open(output_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) {
+        merkle_ingest_close(ingest);
+        return MERKLE_ERROR_IO;
+    }
+    err = external_hash_leaves(ingest, out, &shape, chunk_leaves);
+    merkle_ingest_close(ingest);
+    
+    uint8_t* buffer = err == MERKLE_SUCCESS ? (uint8_t*)malloc(memory_limit) : NULL;
+    if (buffer) {
+        merkle_memory_account_alloc(MERKLE_MEM_LEVELS, memory_limit);
+    } else if (err == MERKLE_SUCCESS) {
+        err = MERKLE_ERROR_MEMORY_ALLOCATION;
+    }
+    
+    uint8_t header[TREE_FILE_HEADER_SIZE] = {0};
+    uint32_t words[4] = {TREE_FILE_VERSION, (uint32_t)hash_type, arity, shape.depth};
+    memcpy(header, TREE_FILE_MAGIC, 8);
+    memcpy(header + 8, words, sizeof(words));
+    memcpy(header + 24, &shape.num_leaves, sizeof(uint64_t));
+    
+    for (int level = shape.depth - 1; level >= 0 && err == MERKLE_SUCCESS; level--) {
+        err = external_hash_level(out, &shape, (uint8_t)level, buffer, memory_limit);
+    }
+    
+    // The header goes last, so a file cut short by a failure never opens
+    if (err == MERKLE_SUCCESS && (!pwrite_full(out, header, sizeof(header), 0) || fsync(out) != 0)) {
+        err = MERKLE_ERROR_IO;
+    }
+    if (err == MERKLE_SUCCESS && root_hash &&
+        !pread_full(out, root_hash, SHA256_HASH_SIZE, file_level_offset(shape.arity_log2, 0))) {
+        err = MERKLE_ERROR_IO;
+    }
+    
+    if (buffer) {
+        free(buffer);
+        merkle_memory_account_free(MERKLE_MEM_LEVELS, memory_limit);
+    }
+    if (close(out) != 0 && err == MERKLE_SUCCESS) {
+        err = MERKLE_ERROR_IO;
+    }
+    return err;
+}
+
+merkle_tree_file_t* merkle_tree_file_open(const char* path) {
+    if (!path) {
+        return NULL;
+    }
+    
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    
+    uint8_t header[TREE_FILE_HEADER_SIZE];
+    uint32_t words[4];
+    uint64_t num_leaves = 0;
+    struct stat st;
+    bool valid = pread_full(fd, header, sizeof(header), 0) && memcmp(header, TREE_FILE_MAGIC, 8) == 0;
+    if (valid) {
+        memcpy(words, header + 8, sizeof(words));
+        memcpy(&num_leaves, header + 24, sizeof(uint64_t));
+        valid = words[0] == TREE_FILE_VERSION && words[2] <= MERKLE_MAX_ARITY &&
+                validate_kary_parameters(num_leaves, (hash_type_t)words[1], (uint8_t)words[2]) == MERKLE_SUCCESS &&
+                words[3] == calculate_tree_depth(num_leaves) / (uint32_t)__builtin_ctz(words[2]);
+    }
+    if (valid) {
+        // Every digest the header promises must be there
+        uint8_t arity_log2 = (uint8_t)__builtin_ctz(words[2]);
+        valid = fstat(fd, &st) == 0 && st.st_size >= file_level_offset(arity_log2, (uint8_t)(words[3] + 1));
+    }
+    
+    merkle_tree_file_t* file = valid ? (merkle_tree_file_t*)calloc(1, sizeof(merkle_tree_file_t)) : NULL;
+    if (!file) {
+        close(fd);
+        return NULL;
+    }
+    file->fd = fd;
+    file->num_leaves = num_leaves;
+    file->hash_type = (hash_type_t)words[1];
+    file->arity = (uint8_t)words[2];
+    file->arity_log2 = (uint8_t)__builtin_ctz(words[2]);
+    file->depth = (uint8_t)words[3];
+    return file;
+}
+
+void merkle_tree_file_close(merkle_tree_file_t* file) {
+    if (file) {
+        close(file->fd);
+        free(file);
+    }
+}
+
+uint64_t merkle_tree_file_num_leaves(const merkle_tree_file_t* file) {
+    return file ? file->num_leaves : 0;
+}
+
+// Fill a caller-owned proof (release with merkle_proof_clear) with one
+// read per level: each reads the whole sibling group, own digest included.
+merkle_error_t merkle_tree_file_proof(const merkle_tree_file_t* file, uint64_t leaf_index, merkle_proof_t* proof) {
+    if (!file || !proof) {
+        return MERKLE_ERROR_INVALID_TREE;
+    }
+    if (leaf_index >= file->num_leaves) {
+        return MERKLE_ERROR_LEAF_OUT_OF_BOUNDS;
+    }
+    
+    memset(proof, 0, sizeof(merkle_proof_t));
+    proof->leaf_index = leaf_index;
+    proof->hash_type = file->hash_type;
+    proof->arity = file->arity;
+    proof->num_siblings = (uint64_t)file->depth * (file->arity - 1u);
+    proof->proof_size = merkle_proof_serialized_size(proof->num_siblings);
+    if (proof->num_siblings > 0) {
+        proof->sibling_hashes = (uint8_t*)malloc(proof->num_siblings * SHA256_HASH_SIZE);
+        if (!proof->sibling_hashes) {
+            return MERKLE_ERROR_MEMORY_ALLOCATION;
+        }
+        merkle_memory_account_alloc(MERKLE_MEM_PROOF, proof->num_siblings * SHA256_HASH_SIZE);
+    }
+    
+    uint8_t group[MERKLE_MAX_ARITY * SHA256_HASH_SIZE];
+    size_t group_size = (size_t)file->arity * SHA256_HASH_SIZE;
+    bool ok = pread_full(file->fd, proof->root_hash, SHA256_HASH_SIZE, file_level_offset(file->arity_log2, 0)) &&
+              pread_full(file->fd, proof->leaf_hash, SHA256_HASH_SIZE,
+                         file_level_offset(file->arity_log2, file->depth) +
+                         (off_t)(leaf_index * SHA256_HASH_SIZE));
+    for (uint8_t level = file->depth; level > 0 && ok; level--) {
+        uint64_t index = leaf_index >> (file->arity_log2 * (file->depth - level));
+        uint64_t first = index & ~(uint64_t)(file->arity - 1);
+        ok = pread_full(file->fd, group, group_size,
+                        file_level_offset(file->arity_log2, level) + (off_t)(first * SHA256_HASH_SIZE));
+        if (!ok) {
+            break;
+        }
+        uint8_t* siblings = proof->sibling_hashes + (size_t)(file->depth - level) * (group_size - SHA256_HASH_SIZE);
+        size_t before = (size_t)(index - first) * SHA256_HASH_SIZE;
+        memcpy(siblings, group, before);
+        memcpy(siblings + before, group + before + SHA256_HASH_SIZE, group_size - before - SHA256_HASH_SIZE);
+    }
+    
+    if (!ok) {
+        merkle_proof_clear(proof);
+        return MERKLE_ERROR_IO;
+    }
+    return MERKLE_SUCCESS;
+}
@@ -0,0 +1,244 @@
+#include "merkle_tree.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#define HOT_WORDS (SHA256_HASH_SIZE / sizeof(uint64_t))
+
+// Digests of the top levels in heap order: level d, node i at
+// (k^d - 1) / (k - 1) + i, so the k siblings of a group sit side by side.
+// Random proofs touch every one of these levels, so keeping them in one
+// dense array lets the top of each path come from L1/L2 instead of nodes
+// scattered through the pool. The nodes one level further down are kept
+// too, so a proof resumes its pointer walk there.
+//
+// The array describes exactly one root at a time. Writers (tree updates,
+// or the MVCC writer after a path copy) bracket their stores with a
+// sequence counter; readers copy under it and fall back to the pointer
+// walk if it moved or the array describes another root.
+struct merkle_hot {
+    _Atomic uint32_t sequence;           // Odd while a writer is storing
+    uint8_t depth;                       // Deepest level held
+    uint8_t arity_log2;
+    size_t level_offset[MERKLE_HOT_DEPTH + 2];  // Heap-order start of each level
+    _Atomic(const merkle_node_t*) root;  // Root the digests were taken from
+    _Atomic uint64_t* digests;           // Levels 0..depth, cache-line aligned
+    _Atomic(const merkle_node_t*)* frontier;  // k^depth nodes at `depth`
+    size_t bytes;
+};
+
+static inline size_t hot_slot(const merkle_hot_t* hot, uint8_t level, uint64_t index) {
+    return (hot->level_offset[level] + (size_t)index) * HOT_WORDS;
+}
+
+// Word by word: staging a digest in a local array and copying it out whole
+// stalls store forwarding on every load
+static void hot_store(_Atomic uint64_t* dst, const uint8_t* hash) {
+    for (size_t i = 0; i < HOT_WORDS; i++) {
+        uint64_t word;
+        memcpy(&word, hash + i * sizeof(uint64_t), sizeof(word));
+        atomic_store_explicit(&dst[i], word, memory_order_relaxed);
+    }
+}
+
+static void hot_load(uint8_t* hash, _Atomic uint64_t* src) {
+    for (size_t i = 0; i < HOT_WORDS; i++) {
+        uint64_t word = atomic_load_explicit(&src[i], memory_order_relaxed);
+        memcpy(hash + i * sizeof(uint64_t), &word, sizeof(word));
+    }
+}
+
+static void hot_write_begin(merkle_hot_t* hot) {
+    uint32_t sequence = atomic_load_explicit(&hot->sequence, memory_order_relaxed);
+    atomic_store_explicit(&hot->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static void hot_write_end(merkle_hot_t* hot) {
+    uint32_t sequence = atomic_load_explicit(&hot->sequence, memory_order_relaxed);
+    atomic_store_explicit(&hot->sequence, sequence + 1, memory_order_release);
+}
+
+static void hot_fill(merkle_hot_t* hot, const merkle_node_t* node, uint8_t level, uint64_t index) {
+    hot_store(hot->digests + hot_slot(hot, level, index), node->hash);
+    if (level == hot->depth) {
+        atomic_store_explicit(&hot->frontier[index], node, memory_order_relaxed);
+        return;
+    }
+    uint64_t arity = (uint64_t)1 << hot->arity_log2;
+    for (uint64_t c = 0; c < arity; c++) {
+        hot_fill(hot, node->children[c], level + 1, index * arity + c);
+    }
+}
+
+static merkle_hot_t* hot_create(uint8_t depth, uint8_t arity_log2) {
+    merkle_hot_t* hot = (merkle_hot_t*)calloc(1, sizeof(merkle_hot_t));
+    if (!hot) {
+        return NULL;
+    }
+    
+    // aligned_alloc wants a multiple of the alignment
+    size_t frontier_count = (size_t)1 << (arity_log2 * depth);
+    size_t digest_bytes = (heap_level_offset(arity_log2, depth + 1) * SHA256_HASH_SIZE + 63) & ~(size_t)63;
+    size_t frontier_bytes = frontier_count * sizeof(merkle_node_t*);
+    hot->digests = (_Atomic uint64_t*)aligned_alloc(64, digest_bytes);
+    hot->frontier = (_Atomic(const merkle_node_t*)*)calloc(frontier_count, sizeof(merkle_node_t*));
+    if (!hot->digests || !hot->frontier) {
+        free((void*)hot->digests);
+        free((void*)hot->frontier);
+        free(hot);
+        return NULL;
+    }
+    
+    hot->depth = depth;
+    hot->arity_log2 = arity_log2;
+    for (uint8_t level = 0; level <= depth + 1; level++) {
+        hot->level_offset[level] = heap_level_offset(arity_log2, level);
+    }
+    hot->bytes = sizeof(merkle_hot_t) + digest_bytes + frontier_bytes;
+    atomic_init(&hot->sequence, 0);
+    atomic_init(&hot->root, NULL);
+    merkle_memory_account_alloc(MERKLE_MEM_LEVELS, hot->bytes);
+    return hot;
+}
+
+// Take the top levels of a freshly built tree, down to its bottom stored
+// level at most. The array is allocated on the first build and reused by
+// rebuilds, which keep the shape. Trees without it (a single leaf or
+// bucket, hot depth 0, or allocation failed) use the pointer walk.
+size_t merkle_hot_build(merkle_tree_t* tree) {
+    uint8_t stored = tree ? tree->depth - tree->pruned_height : 0;
+    uint8_t depth = tree ? tree->hot_depth / tree->arity_log2 : 0;
+    if (!tree || !tree->root || stored == 0 || depth == 0) {
+        return 0;
+    }
+    
+    size_t added = 0;
+    if (!tree->hot) {
+        tree->hot = hot_create(stored < depth ? stored : depth, tree->arity_log2);
+        if (!tree->hot) {
+            return 0;
+        }
+        added = tree->hot->bytes;
+    }
+    
+    merkle_hot_t* hot = tree->hot;
+    hot_write_begin(hot);
+    hot_fill(hot, tree->root, 0, 0);
+    atomic_store_explicit(&hot->root, tree->root, memory_order_relaxed);
+    hot_write_end(hot);
+    
+    return added;
+}
+
+size_t merkle_hot_destroy(merkle_tree_t* tree) {
+    if (!tree || !tree->hot) {
+        return 0;
+    }
+    
+    size_t bytes = tree->hot->bytes;
+    free((void*)tree->hot->digests);
+    free((void*)tree->hot->frontier);
+    free(tree->hot);
+    tree->hot = NULL;
+    merkle_memory_account_free(MERKLE_MEM_LEVELS, bytes);
+    return bytes;
+}
+
+// Refresh the digests along one leaf's path. path[d] is the node at level d
+// of the new version (root first); old_root is the root it replaces, which
+// is the same node for an in-place update. Nothing changes unless the array
+// described old_root.
+void merkle_hot_update_path(merkle_tree_t* tree, const merkle_node_t* old_root, uint64_t leaf_index,
+                            merkle_node_t* const* path) {
+    merkle_hot_t* hot = tree ? tree->hot : NULL;
+    if (!hot || atomic_load_explicit(&hot->root, memory_order_relaxed) != old_root) {
+        return;
+    }
+    
+    uint8_t bits = hot->arity_log2;
+    hot_write_begin(hot);
+    for (uint8_t level = 0; level <= hot->depth; level++) {
+        uint64_t index = leaf_index >> (bits * (tree->depth - level));
+        hot_store(hot->digests + hot_slot(hot, level, index), path[level]->hash);
+    }
+    atomic_store_explicit(&hot->frontier[leaf_index >> (bits * (tree->depth - hot->depth))], path[hot->depth],
+                          memory_order_relaxed);
+    atomic_store_explicit(&hot->root, path[0], memory_order_relaxed);
+    hot_write_end(hot);
+}
+
+static void hot_refresh(merkle_hot_t* hot, const uint64_t* dirty, const merkle_node_t* node,
+                        uint8_t level, uint64_t index) {
+    uint64_t bit = hot->level_offset[level] + index;
+    if (!(dirty[bit >> 6] & (1ULL << (bit & 63)))) {
+        return;
+    }
+    
+    hot_store(hot->digests + hot_slot(hot, level, index), node->hash);
+    if (level < hot->depth) {
+        uint64_t arity = (uint64_t)1 << hot->arity_log2;
+        for (uint64_t c = 0; c < arity; c++) {
+            hot_refresh(hot, dirty, node->children[c], level + 1, index * arity + c);
+        }
+    }
+}
+
+// Re-take the digests of nodes rehashed in place by a deferred flush
+void merkle_hot_refresh(merkle_tree_t* tree, const uint64_t* dirty) {
+    merkle_hot_t* hot = tree ? tree->hot : NULL;
+    if (!hot || !dirty || atomic_load_explicit(&hot->root, memory_order_relaxed) != tree->root) {
+        return;
+    }
+    
+    hot_write_begin(hot);
+    hot_refresh(hot, dirty, tree->root, 0, 0);
+    hot_write_end(hot);
+}
+
+uint8_t merkle_hot_depth(const merkle_tree_t* tree) {
+    return tree && tree->hot ? tree->hot->depth : 0;
+}
+
+// Copy the siblings of the top levels of leaf_index's path into siblings
+// (proof layout: leaf to root, k - 1 per level in child order, so level d
+// lands in group depth - d) and hand
+// back the path's node at the deepest hot level. Returns the number of
+// levels covered, or 0 if root is not what the array holds right now.
+uint8_t merkle_hot_read_path(const merkle_tree_t* tree, const merkle_node_t* root, uint64_t leaf_index,
+                             uint8_t* siblings, const merkle_node_t** node) {
+    merkle_hot_t* hot = tree ? tree->hot : NULL;
+    if (!hot) {
+        return 0;
+    }
+    
+    uint32_t sequence = atomic_load_explicit(&hot->sequence, memory_order_acquire);
+    if ((sequence & 1) != 0 || atomic_load_explicit(&hot->root, memory_order_relaxed) != root) {
+        return 0;
+    }
+    
+    uint8_t depth = tree->depth;
+    uint8_t bits = hot->arity_log2;
+    uint64_t arity = (uint64_t)1 << bits;
+    for (uint8_t level = 1; level <= hot->depth; level++) {
+        uint64_t index = leaf_index >> (bits * (depth - level));
+        uint64_t first = index & ~(arity - 1);
+        uint8_t* group = siblings + (size_t)(depth - level) * (arity - 1) * SHA256_HASH_SIZE;
+        for (uint64_t sibling = first; sibling < first + arity; sibling++) {
+            if (sibling != index) {
+                hot_load(group, hot->digests + hot_slot(hot, level, sibling));
+                group += SHA256_HASH_SIZE;
+            }
+        }
+    }
+    const merkle_node_t* frontier = atomic_load_explicit(&hot->frontier[leaf_index >> (bits * (depth - hot->depth))],
+                                                         memory_order_relaxed);
+    
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&hot->sequence, memory_order_relaxed) != sequence) {
+        return 0;
+    }
+    
+    *node = frontier;
+    return hot->depth;
+}
@@ -0,0 +1,194 @@
+#define _GNU_SOURCE
+
+#include "merkle_tree.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#if defined(__linux__) && defined(MERKLE_ENABLE_TIMING)
+#define MERKLE_HW_SUPPORTED 1
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#ifdef MERKLE_HW_SUPPORTED
+
+// perf event per counter. The generic cache events map to the last-level
+// cache on x86 and most ARM/RISC-V PMUs.
+static const uint64_t k_hw_event_config[MERKLE_HW_NUM_COUNTERS] = {
+    [MERKLE_HW_CYCLES] = PERF_COUNT_HW_CPU_CYCLES,
+    [MERKLE_HW_INSTRUCTIONS] = PERF_COUNT_HW_INSTRUCTIONS,
+    [MERKLE_HW_LLC_REFERENCES] = PERF_COUNT_HW_CACHE_REFERENCES,
+    [MERKLE_HW_LLC_MISSES] = PERF_COUNT_HW_CACHE_MISSES,
+};
+
+// Per-thread counter group. Counters run from open onward and operations
+// read the group before and after, so there is no ioctl on the hot path.
+typedef struct {
+    int state;                               // 0 unopened, 1 open, -1 unavailable
+    int fds[MERKLE_HW_NUM_COUNTERS];
+    int order[MERKLE_HW_NUM_COUNTERS];       // Counter behind each group slot
+    int num_open;
+} hw_thread_group_t;
+
+typedef struct {
+    uint64_t nr;
+    uint64_t time_enabled;
+    uint64_t time_running;
+    uint64_t values[MERKLE_HW_NUM_COUNTERS];
+} hw_group_read_t;
+
+static _Atomic bool g_hw_enabled = false;
+static pthread_key_t g_hw_key;
+static pthread_once_t g_hw_once = PTHREAD_ONCE_INIT;
+static _Thread_local hw_thread_group_t t_group;
+
+static void hw_group_close(void* arg) {
+    hw_thread_group_t* group = (hw_thread_group_t*)arg;
+    
+    for (int i = 0; i < group->num_open; i++) {
+        close(group->fds[i]);
+    }
+    group->num_open = 0;
+    group->state = 0;
+}
+
+static void hw_key_init(void) {
+    pthread_key_create(&g_hw_key, hw_group_close);
+}
+
+static int hw_event_open(uint64_t config, int group_fd) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.exclude_kernel = 1;   // Allowed at perf_event_paranoid <= 2
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+    
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+static hw_thread_group_t* hw_group_get(void) {
+    hw_thread_group_t* group = &t_group;
+    if (group->state != 0) {
+        return group->state > 0 ? group : NULL;
+    }
+    
+    // Cycles lead the group; members the PMU lacks are left out
+    for (int c = 0; c < MERKLE_HW_NUM_COUNTERS; c++) {
+        int leader = group->num_open > 0 ? group->fds[0] : -1;
+        int fd = hw_event_open(k_hw_event_config[c], leader);
+        if (fd < 0) {
+            continue;
+        }
+        group->fds[group->num_open] = fd;
+        group->order[group->num_open] = c;
+        group->num_open++;
+    }
+    
+    if (group->num_open == 0) {
+        group->state = -1;
+        return NULL;
+    }
+    
+    pthread_once(&g_hw_once, hw_key_init);
+    pthread_setspecific(g_hw_key, group);
+    
+    group->state = 1;
+    return group;
+}
+
+bool merkle_hw_counters_enable(bool enable) {
+    atomic_store_explicit(&g_hw_enabled, enable, memory_order_relaxed);
+    if (!enable) {
+        return false;
+    }
+    
+    return hw_group_get() != NULL;
+}
+
+bool merkle_hw_counters_enabled(void) {
+    return atomic_load_explicit(&g_hw_enabled, memory_order_relaxed);
+}
+
+bool merkle_hw_counters_read(merkle_hw_sample_t* sample) {
+    if (!sample) return false;
+    memset(sample, 0, sizeof(*sample));
+    
+    if (!atomic_load_explicit(&g_hw_enabled, memory_order_relaxed)) {
+        return false;
+    }
+    
+    hw_thread_group_t* group = hw_group_get();
+    if (!group) {
+        return false;
+    }
+    
+    hw_group_read_t data;
+    ssize_t expected = (ssize_t)(3 + group->num_open) * (ssize_t)sizeof(uint64_t);
+    if (read(group->fds[0], &data, sizeof(data)) < expected) {
+        return false;
+    }
+    
+    sample->time_enabled = data.time_enabled;
+    sample->time_running = data.time_running;
+    for (int i = 0; i < group->num_open; i++) {
+        sample->values[group->order[i]] = data.values[i];
+        sample->valid_mask |= 1u << group->order[i];
+    }
+    
+    return true;
+}
+
+#else
+
+bool merkle_hw_counters_enable(bool enable) {
+    (void)enable;
+    return false;
+}
+
+bool merkle_hw_counters_enabled(void) {
+    return false;
+}
+
+bool merkle_hw_counters_read(merkle_hw_sample_t* sample) {
+    if (sample) {
+        memset(sample, 0, sizeof(*sample));
+    }
+    return false;
+}
+
+#endif
+
+bool merkle_hw_counters_delta(const merkle_hw_sample_t* start, const merkle_hw_sample_t* end,
+                              merkle_hw_sample_t* delta) {
+    if (!start || !end || !delta) return false;
+    memset(delta, 0, sizeof(*delta));
+    
+    delta->valid_mask = start->valid_mask & end->valid_mask;
+    if (delta->valid_mask == 0) {
+        return false;
+    }
+    
+    delta->time_enabled = end->time_enabled - start->time_enabled;
+    delta->time_running = end->time_running - start->time_running;
+    
+    // Scale up when the PMU was multiplexed for part of the interval
+    bool scale = delta->time_running > 0 && delta->time_running < delta->time_enabled;
+    for (int c = 0; c < MERKLE_HW_NUM_COUNTERS; c++) {
+        if (!(delta->valid_mask & (1u << c))) continue;
+        
+        uint64_t value = end->values[c] - start->values[c];
+        if (scale) {
+            value = (uint64_t)((double)value * (double)delta->time_enabled / (double)delta->time_running);
+        }
+        delta->values[c] = value;
+    }
+    
+    return true;
+}
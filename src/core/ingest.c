@@ -0,0 +1,341 @@
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
+
+#include "merkle_tree.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define INGEST_IO_URING 1
+#endif
+#endif
+
+#define INGEST_ALIGNMENT 4096
+
+// Sequential file ingestion through a ring of MERKLE_INGEST_BUFFERS
+// aligned chunk buffers. With io_uring, a read is queued for every
+// buffer the consumer is not holding, so the disk fills the next chunks
+// while the current one is hashed; a buffer handed out by
+// merkle_ingest_next is queued again for the chunk R ahead on the
+// following call. Kernels without io_uring (or with it disabled) get
+// pread, with the next chunk hinted to readahead so the page cache still
+// fills behind the hashing.
+typedef struct {
+    uint8_t* data;
+    uint64_t offset;
+    size_t length;
+    struct iovec iov;
+    bool pending;                    // Read queued, completion not reaped
+    ssize_t result;
+} ingest_slot_t;
+
+#ifdef INGEST_IO_URING
+typedef struct {
+    int fd;
+    void* sq_map;
+    void* cq_map;
+    size_t sq_map_size;
+    size_t cq_map_size;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+    _Atomic uint32_t* sq_tail;
+    uint32_t* sq_mask;
+    uint32_t* sq_array;
+    _Atomic uint32_t* cq_head;
+    _Atomic uint32_t* cq_tail;
+    uint32_t* cq_mask;
+    struct io_uring_cqe* cqes;
+} ingest_ring_t;
+#endif
+
+struct merkle_ingest {
+    int fd;
+    uint64_t size;
+    size_t chunk_bytes;
+    uint64_t next_offset;            // Start of the next chunk to queue
+    uint64_t chunks_read;            // Chunks handed to the consumer
+    bool holding;                    // The consumer holds the last chunk's buffer
+    bool failed;
+    bool async;
+    ingest_slot_t slots[MERKLE_INGEST_BUFFERS];
+#ifdef INGEST_IO_URING
+    ingest_ring_t ring;
+#endif
+};
+
+static bool ingest_pread(int fd, uint8_t* buffer, size_t size, uint64_t offset) {
+    while (size > 0) {
+        ssize_t n = pread(fd, buffer, size, (off_t)offset);
+        if (n <= 0) {
+            return false;
+        }
+        buffer += n;
+        size -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return true;
+}
+
+#ifdef INGEST_IO_URING
+static bool ring_setup(ingest_ring_t* ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) {
+        return false;
+    }
+    
+    ring->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    ring->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single && ring->cq_map_size > ring->sq_map_size) {
+        ring->sq_map_size = ring->cq_map_size;
+    }
+    ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                        IORING_OFF_SQ_RING);
+    ring->cq_map = single ? ring->sq_map
+                          : mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                 ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe*)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                                            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sq_map == MAP_FAILED || ring->cq_map == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        if (ring->sqes != MAP_FAILED) munmap(ring->sqes, ring->sqes_size);
+        if (!single && ring->cq_map != MAP_FAILED) munmap(ring->cq_map, ring->cq_map_size);
+        if (ring->sq_map != MAP_FAILED) munmap(ring->sq_map, ring->sq_map_size);
+        close(ring->fd);
+        return false;
+    }
+    
+    uint8_t* sq = (uint8_t*)ring->sq_map;
+    uint8_t* cq = (uint8_t*)ring->cq_map;
+    ring->sq_tail = (_Atomic uint32_t*)(sq + params.sq_off.tail);
+    ring->sq_mask = (uint32_t*)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (uint32_t*)(sq + params.sq_off.array);
+    ring->cq_head = (_Atomic uint32_t*)(cq + params.cq_off.head);
+    ring->cq_tail = (_Atomic uint32_t*)(cq + params.cq_off.tail);
+    ring->cq_mask = (uint32_t*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    return true;
+}
+
+static void ring_teardown(ingest_ring_t* ring) {
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_map != ring->sq_map) {
+        munmap(ring->cq_map, ring->cq_map_size);
+    }
+    munmap(ring->sq_map, ring->sq_map_size);
+    close(ring->fd);
+}
+
+// Queue one read into a slot; we are the only submitter and reaper
+static bool ring_submit(merkle_ingest_t* ingest, unsigned slot_index) {
+    ingest_ring_t* ring = &ingest->ring;
+    ingest_slot_t* slot = &ingest->slots[slot_index];
+    uint32_t tail = atomic_load_explicit(ring->sq_tail, memory_order_relaxed);
+    uint32_t index = tail & *ring->sq_mask;
+    
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    slot->iov.iov_base = slot->data;
+    slot->iov.iov_len = slot->length;
+    sqe->opcode = IORING_OP_READV;   // 5.1+, unlike IORING_OP_READ
+    sqe->fd = ingest->fd;
+    sqe->addr = (uint64_t)(uintptr_t)&slot->iov;
+    sqe->len = 1;
+    sqe->off = slot->offset;
+    sqe->user_data = slot_index;
+    ring->sq_array[index] = index;
+    atomic_store_explicit(ring->sq_tail, tail + 1, memory_order_release);
+    
+    if (syscall(__NR_io_uring_enter, ring->fd, 1, 0, 0, NULL, 0) != 1) {
+        atomic_store_explicit(ring->sq_tail, tail, memory_order_relaxed);
+        return false;
+    }
+    slot->pending = true;
+    return true;
+}
+
+// Reap completions until the slot's read has finished
+static void ring_wait(merkle_ingest_t* ingest, unsigned slot_index) {
+    ingest_ring_t* ring = &ingest->ring;
+    while (ingest->slots[slot_index].pending) {
+        uint32_t head = atomic_load_explicit(ring->cq_head, memory_order_relaxed);
+        uint32_t tail = atomic_load_explicit(ring->cq_tail, memory_order_acquire);
+        if (head == tail) {
+            if (syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+                errno != EINTR) {
+                // The ring is unusable; fail whatever was still queued on it
+                for (unsigned i = 0; i < MERKLE_INGEST_BUFFERS; i++) {
+                    if (ingest->slots[i].pending) {
+                        ingest->slots[i].pending = false;
+                        ingest->slots[i].result = -1;
+                    }
+                }
+            }
+            continue;
+        }
+        for (; head != tail; head++) {
+            const struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cq_mask];
+            ingest_slot_t* slot = &ingest->slots[cqe->user_data];
+            slot->result = cqe->res;
+            slot->pending = false;
+        }
+        atomic_store_explicit(ring->cq_head, head, memory_order_release);
+    }
+}
+#endif
+
+// Aim the next free slot at the next chunk of the file and start its read
+static void ingest_queue(merkle_ingest_t* ingest, unsigned slot_index) {
+    ingest_slot_t* slot = &ingest->slots[slot_index];
+    slot->offset = ingest->next_offset;
+    slot->length = ingest->size - slot->offset < ingest->chunk_bytes ? (size_t)(ingest->size - slot->offset)
+                                                                     : ingest->chunk_bytes;
+    slot->result = 0;
+    ingest->next_offset += slot->length;
+#ifdef INGEST_IO_URING
+    if (ingest->async && !ring_submit(ingest, slot_index)) {
+        // Carry on with pread once the reads already queued have landed
+        for (unsigned i = 0; i < MERKLE_INGEST_BUFFERS; i++) {
+            ring_wait(ingest, i);
+        }
+        ring_teardown(&ingest->ring);
+        ingest->async = false;
+    }
+#endif
+    if (!ingest->async) {
+        posix_fadvise(ingest->fd, (off_t)slot->offset, (off_t)slot->length, POSIX_FADV_WILLNEED);
+    }
+}
+
+merkle_ingest_t* merkle_ingest_open(const char* path, size_t chunk_bytes, bool async) {
+    if (!path || chunk_bytes == 0) {
+        return NULL;
+    }
+    
+    merkle_ingest_t* ingest = (merkle_ingest_t*)calloc(1, sizeof(merkle_ingest_t));
+    if (!ingest) {
+        return NULL;
+    }
+    struct stat st;
+    ingest->fd = open(path, O_RDONLY);
+    if (ingest->fd < 0 || fstat(ingest->fd, &st) != 0) {
+        if (ingest->fd >= 0) close(ingest->fd);
+        free(ingest);
+        return NULL;
+    }
+    ingest->size = (uint64_t)st.st_size;
+    ingest->chunk_bytes = chunk_bytes;
+    posix_fadvise(ingest->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    
+    size_t buffer_bytes = (chunk_bytes + INGEST_ALIGNMENT - 1) & ~(size_t)(INGEST_ALIGNMENT - 1);
+    for (unsigned i = 0; i < MERKLE_INGEST_BUFFERS; i++) {
+        ingest->slots[i].data = (uint8_t*)aligned_alloc(INGEST_ALIGNMENT, buffer_bytes);
+        if (!ingest->slots[i].data) {
+            for (unsigned j = 0; j < i; j++) {
+                free(ingest->slots[j].data);
+            }
+            close(ingest->fd);
+            free(ingest);
+            return NULL;
+        }
+    }
+    merkle_memory_account_alloc(MERKLE_MEM_LEVELS, MERKLE_INGEST_BUFFERS * buffer_bytes);
+
+#ifdef INGEST_IO_URING
+    ingest->async = async && ring_setup(&ingest->ring, MERKLE_INGEST_BUFFERS);
+#else
+    (void)async;
+#endif
+    for (unsigned i = 0; i < MERKLE_INGEST_BUFFERS && ingest->next_offset < ingest->size; i++) {
+        ingest_queue(ingest, i);
+    }
+    return ingest;
+}
+
+uint64_t merkle_ingest_size(const merkle_ingest_t* ingest) {
+    return ingest ? ingest->size : 0;
+}
+
+bool merkle_ingest_async(const merkle_ingest_t* ingest) {
+    return ingest && ingest->async;
+}
+
+// Hand out the next chunk in file order; the buffer stays valid until the
+// next call. NULL at the end of the file or after a failed read.
+const uint8_t* merkle_ingest_next(merkle_ingest_t* ingest, size_t* size) {
+    if (!ingest || !size || ingest->failed) {
+        return NULL;
+    }
+    
+    // The buffer handed out last is free again: queue the chunk R ahead into it
+    if (ingest->holding) {
+        ingest->holding = false;
+        if (ingest->next_offset < ingest->size) {
+            ingest_queue(ingest, (unsigned)((ingest->chunks_read - 1) % MERKLE_INGEST_BUFFERS));
+        }
+    }
+    
+    unsigned slot_index = (unsigned)(ingest->chunks_read % MERKLE_INGEST_BUFFERS);
+    ingest_slot_t* slot = &ingest->slots[slot_index];
+    if (ingest->chunks_read * ingest->chunk_bytes >= ingest->size) {
+        return NULL;
+    }
+
+#ifdef INGEST_IO_URING
+    if (slot->pending) {
+        ring_wait(ingest, slot_index);
+    }
+#endif
+    // Short or failed async reads, and every read without io_uring, finish here
+    size_t done = slot->result > 0 ? (size_t)slot->result : 0;
+    if (slot->result < 0 || !ingest_pread(ingest->fd, slot->data + done, slot->length - done, slot->offset + done)) {
+        ingest->failed = true;
+        return NULL;
+    }
+    slot->result = (ssize_t)slot->length;
+    
+    ingest->chunks_read++;
+    ingest->holding = true;
+    *size = slot->length;
+    return slot->data;
+}
+
+// Release the ring once no read can still land in its buffers. Returns
+// MERKLE_ERROR_IO if any read failed.
+merkle_error_t merkle_ingest_close(merkle_ingest_t* ingest) {
+    if (!ingest) {
+        return MERKLE_ERROR_INVALID_TREE;
+    }
+
+#ifdef INGEST_IO_URING
+    if (ingest->async) {
+        for (unsigned i = 0; i < MERKLE_INGEST_BUFFERS; i++) {
+            ring_wait(ingest, i);
+        }
+        ring_teardown(&ingest->ring);
+    }
+#endif
+    
+    size_t buffer_bytes = (ingest->chunk_bytes + INGEST_ALIGNMENT - 1) & ~(size_t)(INGEST_ALIGNMENT - 1);
+    for (unsigned i = 0; i < MERKLE_INGEST_BUFFERS; i++) {
+        free(ingest->slots[i].data);
+    }
+    merkle_memory_account_free(MERKLE_MEM_LEVELS, MERKLE_INGEST_BUFFERS * buffer_bytes);
+    
+    merkle_error_t err = ingest->failed ? MERKLE_ERROR_IO : MERKLE_SUCCESS;
+    close(ingest->fd);
+    free(ingest);
+    return err;
+}
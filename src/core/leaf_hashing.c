@@ -0,0 +1,80 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "merkle_tree.h"
+#include <pthread.h>
+#include <unistd.h>
+
+#define LEAF_HASH_MAX_THREADS 8
+#define LEAF_HASH_THREAD_BYTES (4u << 20)   // Less work per thread than this is not worth a thread
+
+typedef struct {
+    const merkle_tree_t* tree;
+    merkle_node_t* const* leaves;
+    uint8_t* hashes;
+    uint64_t begin;
+    uint64_t end;
+} leaf_hash_range_t;
+
+static void leaf_hash_range(const leaf_hash_range_t* range) {
+    const merkle_tree_t* tree = range->tree;
+    for (uint64_t i = range->begin; i < range->end; i++) {
+        size_t size = 0;
+        const uint8_t* data = merkle_tree_leaf(tree, i, &size);
+        uint8_t* out = range->leaves ? range->leaves[i]->hash : range->hashes + i * SHA256_HASH_SIZE;
+        tree->hash_function(data, size, out);
+    }
+}
+
+static void* leaf_hash_worker(void* arg) {
+    leaf_hash_range(arg);
+    return NULL;
+}
+
+static inline uint64_t leaf_bytes(const merkle_tree_t* tree, uint64_t leaf_index) {
+    return tree->records ? tree->records[leaf_index].size : tree->leaf_data_size;
+}
+
+// Records differ in size by orders of magnitude, so the leaves are split
+// into ranges of about equal bytes rather than equal counts; the calling
+// thread takes the last range itself.
+void merkle_hash_leaves(const merkle_tree_t* tree, merkle_node_t* const* leaves, uint8_t* hashes) {
+    uint64_t total = tree->records ? tree->leaf_data_used : tree->num_leaves * tree->leaf_data_size;
+    
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t threads = total / LEAF_HASH_THREAD_BYTES;
+    if (online > 0 && threads > (uint64_t)online) threads = (uint64_t)online;
+    if (threads > LEAF_HASH_MAX_THREADS) threads = LEAF_HASH_MAX_THREADS;
+    
+    leaf_hash_range_t ranges[LEAF_HASH_MAX_THREADS];
+    if (threads <= 1) {
+        ranges[0] = (leaf_hash_range_t){tree, leaves, hashes, 0, tree->num_leaves};
+        leaf_hash_range(&ranges[0]);
+        return;
+    }
+    
+    pthread_t workers[LEAF_HASH_MAX_THREADS];
+    bool started[LEAF_HASH_MAX_THREADS] = {false};
+    uint64_t leaf = 0;
+    uint64_t bytes = 0;
+    for (uint64_t t = 0; t < threads; t++) {
+        ranges[t] = (leaf_hash_range_t){tree, leaves, hashes, leaf, tree->num_leaves};
+        if (t + 1 < threads) {
+            uint64_t target = total / threads * (t + 1);
+            while (leaf < tree->num_leaves && bytes < target) {
+                bytes += leaf_bytes(tree, leaf++);
+            }
+            ranges[t].end = leaf;
+            started[t] = pthread_create(&workers[t], NULL, leaf_hash_worker, &ranges[t]) == 0;
+            if (!started[t]) {
+                leaf_hash_range(&ranges[t]);
+            }
+        }
+    }
+    
+    leaf_hash_range(&ranges[threads - 1]);
+    for (uint64_t t = 0; t + 1 < threads; t++) {
+        if (started[t]) {
+            pthread_join(workers[t], NULL);
+        }
+    }
+}
@@ -2,9 +2,198 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+// Per-thread accounting shard. Only the owning thread writes the counters,
+// so updates are plain relaxed load/store pairs with no locked instructions.
+typedef struct memory_shard {
+    _Atomic int64_t live[MERKLE_MEM_NUM_CATEGORIES];
+    _Atomic int64_t peak[MERKLE_MEM_NUM_CATEGORIES];
+    _Atomic int64_t total_live;
+    _Atomic int64_t total_peak;
+    struct memory_shard* next;
+} memory_shard_t;
+
+static pthread_mutex_t g_shard_lock = PTHREAD_MUTEX_INITIALIZER;
+static memory_shard_t* g_shards = NULL;
+static int64_t g_retired_live[MERKLE_MEM_NUM_CATEGORIES];  // Live bytes left by exited threads
+static int64_t g_global_peak[MERKLE_MEM_NUM_CATEGORIES];
+static int64_t g_global_total_peak = 0;
+static pthread_key_t g_shard_key;
+static pthread_once_t g_shard_once = PTHREAD_ONCE_INIT;
+static _Thread_local memory_shard_t* t_shard = NULL;
+static _Thread_local bool t_shard_retired = false;
+
+// Fold an exiting thread's live bytes into the retired totals. Destructors
+// of other keys may still account after this; they go straight to the
+// retired totals (see memory_shard_get).
+static void memory_shard_retire(void* arg) {
+    memory_shard_t* shard = (memory_shard_t*)arg;
+    
+    pthread_mutex_lock(&g_shard_lock);
+    for (int c = 0; c < MERKLE_MEM_NUM_CATEGORIES; c++) {
+        g_retired_live[c] += atomic_load_explicit(&shard->live[c], memory_order_relaxed);
+    }
+    
+    memory_shard_t** link = &g_shards;
+    while (*link && *link != shard) {
+        link = &(*link)->next;
+    }
+    if (*link) {
+        *link = shard->next;
+    }
+    pthread_mutex_unlock(&g_shard_lock);
+    
+    free(shard);
+    t_shard = NULL;
+    t_shard_retired = true;
+}
+
+static void memory_shard_key_init(void) {
+    pthread_key_create(&g_shard_key, memory_shard_retire);
+}
+
+// NULL once the thread's shard has been retired, or if it cannot be
+// allocated; callers then account against the retired totals
+static memory_shard_t* memory_shard_get(void) {
+    if (t_shard || t_shard_retired) {
+        return t_shard;
+    }
+    
+    memory_shard_t* shard = (memory_shard_t*)calloc(1, sizeof(memory_shard_t));
+    if (!shard) {
+        return NULL;
+    }
+    
+    pthread_once(&g_shard_once, memory_shard_key_init);
+    pthread_setspecific(g_shard_key, shard);
+    
+    pthread_mutex_lock(&g_shard_lock);
+    shard->next = g_shards;
+    g_shards = shard;
+    pthread_mutex_unlock(&g_shard_lock);
+    
+    t_shard = shard;
+    return shard;
+}
+
+static void memory_retired_add(merkle_mem_category_t category, int64_t delta) {
+    pthread_mutex_lock(&g_shard_lock);
+    g_retired_live[category] += delta;
+    pthread_mutex_unlock(&g_shard_lock);
+}
+
+static inline int64_t shard_add(_Atomic int64_t* counter, int64_t delta) {
+    int64_t value = atomic_load_explicit(counter, memory_order_relaxed) + delta;
+    atomic_store_explicit(counter, value, memory_order_relaxed);
+    return value;
+}
+
+static inline void shard_raise(_Atomic int64_t* peak, int64_t value) {
+    if (value > atomic_load_explicit(peak, memory_order_relaxed)) {
+        atomic_store_explicit(peak, value, memory_order_relaxed);
+    }
+}
+
+// Memory accounting implementation
+void merkle_memory_account_alloc(merkle_mem_category_t category, size_t bytes) {
+    if (category >= MERKLE_MEM_NUM_CATEGORIES || bytes == 0) return;
+    
+    memory_shard_t* shard = memory_shard_get();
+    if (!shard) {
+        memory_retired_add(category, (int64_t)bytes);
+        return;
+    }
+    
+    shard_raise(&shard->peak[category], shard_add(&shard->live[category], (int64_t)bytes));
+    shard_raise(&shard->total_peak, shard_add(&shard->total_live, (int64_t)bytes));
+}
+
+void merkle_memory_account_free(merkle_mem_category_t category, size_t bytes) {
+    if (category >= MERKLE_MEM_NUM_CATEGORIES || bytes == 0) return;
+    
+    memory_shard_t* shard = memory_shard_get();
+    if (!shard) {
+        memory_retired_add(category, -(int64_t)bytes);
+        return;
+    }
+    
+    shard_add(&shard->live[category], -(int64_t)bytes);
+    shard_add(&shard->total_live, -(int64_t)bytes);
+}
+
+merkle_memory_stats_t merkle_memory_get_thread_stats(void) {
+    merkle_memory_stats_t stats = {0};
+    
+    memory_shard_t* shard = memory_shard_get();
+    if (!shard) return stats;
+    
+    for (int c = 0; c < MERKLE_MEM_NUM_CATEGORIES; c++) {
+        stats.live_bytes[c] = atomic_load_explicit(&shard->live[c], memory_order_relaxed);
+        stats.peak_bytes[c] = atomic_load_explicit(&shard->peak[c], memory_order_relaxed);
+    }
+    stats.total_live_bytes = atomic_load_explicit(&shard->total_live, memory_order_relaxed);
+    stats.total_peak_bytes = atomic_load_explicit(&shard->total_peak, memory_order_relaxed);
+    
+    return stats;
+}
+
+merkle_memory_stats_t merkle_memory_get_global_stats(void) {
+    merkle_memory_stats_t stats = {0};
+    
+    pthread_mutex_lock(&g_shard_lock);
+    for (int c = 0; c < MERKLE_MEM_NUM_CATEGORIES; c++) {
+        stats.live_bytes[c] = g_retired_live[c];
+    }
+    for (memory_shard_t* shard = g_shards; shard; shard = shard->next) {
+        for (int c = 0; c < MERKLE_MEM_NUM_CATEGORIES; c++) {
+            stats.live_bytes[c] += atomic_load_explicit(&shard->live[c], memory_order_relaxed);
+        }
+    }
+    
+    for (int c = 0; c < MERKLE_MEM_NUM_CATEGORIES; c++) {
+        stats.total_live_bytes += stats.live_bytes[c];
+        if (stats.live_bytes[c] > g_global_peak[c]) {
+            g_global_peak[c] = stats.live_bytes[c];
+        }
+        stats.peak_bytes[c] = g_global_peak[c];
+    }
+    if (stats.total_live_bytes > g_global_total_peak) {
+        g_global_total_peak = stats.total_live_bytes;
+    }
+    stats.total_peak_bytes = g_global_total_peak;
+    pthread_mutex_unlock(&g_shard_lock);
+    
+    return stats;
+}
+
+void merkle_memory_reset_peak(void) {
+    pthread_mutex_lock(&g_shard_lock);
+    g_global_total_peak = 0;
+    for (int c = 0; c < MERKLE_MEM_NUM_CATEGORIES; c++) {
+        g_global_peak[c] = 0;
+    }
+    pthread_mutex_unlock(&g_shard_lock);
+    
+    // Only the calling thread's shard can be reset without racing its owner
+    memory_shard_t* shard = memory_shard_get();
+    if (!shard) return;
+    
+    for (int c = 0; c < MERKLE_MEM_NUM_CATEGORIES; c++) {
+        atomic_store_explicit(&shard->peak[c],
+                              atomic_load_explicit(&shard->live[c], memory_order_relaxed),
+                              memory_order_relaxed);
+    }
+    atomic_store_explicit(&shard->total_peak,
+                          atomic_load_explicit(&shard->total_live, memory_order_relaxed),
+                          memory_order_relaxed);
+}
 
 // Memory pool implementation
 memory_pool_t* memory_pool_create(size_t size) {
+    if (size == 0) return NULL;
+    
     memory_pool_t* pool = (memory_pool_t*)malloc(sizeof(memory_pool_t));
     if (!pool) return NULL;
     
@@ -18,6 +207,8 @@ memory_pool_t* memory_pool_create(size_t size) {
     pool->used = 0;
     pool->next = NULL;
     
+    merkle_memory_account_alloc(MERKLE_MEM_POOL, sizeof(memory_pool_t) + size);
+    
     return pool;
 }
 
@@ -26,7 +217,9 @@ void memory_pool_destroy(memory_pool_t* pool) {
     
     if (pool->pool) {
         free(pool->pool);
+        merkle_memory_account_free(MERKLE_MEM_POOL, pool->size);
     }
+    merkle_memory_account_free(MERKLE_MEM_POOL, sizeof(memory_pool_t));
     
     if (pool->next) {
         memory_pool_destroy(pool->next);
@@ -72,6 +265,16 @@ void memory_pool_reset(memory_pool_t* pool) {
     }
 }
 
+size_t memory_pool_footprint(const memory_pool_t* pool) {
+    size_t bytes = 0;
+    
+    for (; pool; pool = pool->next) {
+        bytes += sizeof(memory_pool_t) + pool->size;
+    }
+    
+    return bytes;
+}
+
 // Utility functions
 uint8_t calculate_tree_depth(uint64_t num_leaves) {
     uint8_t depth = 0;
@@ -89,48 +292,40 @@ bool is_power_of_two(uint64_t num) {
     return (num & (num - 1)) == 0;
 }
 
-merkle_error_t validate_tree_parameters(uint64_t num_leaves, hash_type_t hash_type) {
-    if (num_leaves == 0 || num_leaves > (1ULL << MAX_TREE_DEPTH)) {
+// Arity 2, 4, 8 or 16, and num_leaves a power of it
+merkle_error_t validate_kary_parameters(uint64_t num_leaves, hash_type_t hash_type, uint8_t arity) {
+    if (arity < 2 || arity > MERKLE_MAX_ARITY || !is_power_of_two(arity)) {
         return MERKLE_ERROR_INVALID_SIZE;
     }
     
-    if (!is_power_of_two(num_leaves)) {
-        return MERKLE_ERROR_INVALID_SIZE;
+    merkle_error_t err = validate_tree_parameters(num_leaves, hash_type);
+    if (err != MERKLE_SUCCESS) {
+        return err;
     }
     
-    if (hash_type >= HASH_CUSTOM) {
-        return MERKLE_ERROR_INVALID_HASH_TYPE;
+    if (calculate_tree_depth(num_leaves) % __builtin_ctz(arity) != 0) {
+        return MERKLE_ERROR_INVALID_SIZE;
     }
     
     return MERKLE_SUCCESS;
 }
 
-// Performance monitoring implementation
-static void performance_reset_internal(merkle_tree_t* tree) {
-    if (!tree) return;
-    
-    // Reset performance counters (implement based on your performance monitoring needs)
-    // This is a placeholder - you'll need to implement actual performance tracking
+uint64_t heap_level_offset(uint8_t arity_log2, uint8_t level) {
+    return ((1ULL << (arity_log2 * level)) - 1) / ((1ULL << arity_log2) - 1);
 }
 
-void merkle_performance_reset(merkle_tree_t* tree) {
-    performance_reset_internal(tree);
-}
-
-merkle_performance_metrics_t merkle_performance_get_metrics(merkle_tree_t* tree) {
-    merkle_performance_metrics_t metrics = {0};
+merkle_error_t validate_tree_parameters(uint64_t num_leaves, hash_type_t hash_type) {
+    if (num_leaves == 0 || num_leaves > (1ULL << MAX_TREE_DEPTH)) {
+        return MERKLE_ERROR_INVALID_SIZE;
+    }
     
-    if (!tree) return metrics;
+    if (!is_power_of_two(num_leaves)) {
+        return MERKLE_ERROR_INVALID_SIZE;
+    }
     
-    // This is a placeholder implementation
-    // You need to implement actual performance tracking
-    metrics.construction_time_ns = 0;
-    metrics.proof_generation_time_ns = 0;
-    metrics.verification_time_ns = 0;
-    metrics.peak_memory_usage = 0;
-    metrics.cache_misses = 0;
-    metrics.cache_hits = 0;
+    if (hash_type >= HASH_CUSTOM) {
+        return MERKLE_ERROR_INVALID_HASH_TYPE;
+    }
     
-    return metrics;
+    return MERKLE_SUCCESS;
 }
-
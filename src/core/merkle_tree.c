@@ -4,10 +4,131 @@
 #include <string.h>
 #include <assert.h>
 
-// Create a new Merkle tree
+// Per-tree byte accounting; process and thread counters are charged at the allocation site
+static void tree_memory_add(merkle_tree_t* tree, size_t bytes) {
+    tree->memory_live_bytes += bytes;
+    if (tree->memory_live_bytes > tree->memory_peak_bytes) {
+        tree->memory_peak_bytes = tree->memory_live_bytes;
+    }
+}
+
+static void tree_memory_sub(merkle_tree_t* tree, size_t bytes) {
+    tree->memory_live_bytes -= bytes;
+}
+
+// Allocate/free a temporary level index, charged to the tree's level storage
+static merkle_node_t** level_index_alloc(merkle_tree_t* tree, uint64_t count) {
+    size_t bytes = count * sizeof(merkle_node_t*);
+    merkle_node_t** level = (merkle_node_t**)malloc(bytes);
+    if (level) {
+        merkle_memory_account_alloc(MERKLE_MEM_LEVELS, bytes);
+        tree_memory_add(tree, bytes);
+    }
+    return level;
+}
+
+static void level_index_free(merkle_tree_t* tree, merkle_node_t** level, uint64_t count) {
+    if (!level) return;
+    
+    size_t bytes = count * sizeof(merkle_node_t*);
+    free(level);
+    merkle_memory_account_free(MERKLE_MEM_LEVELS, bytes);
+    tree_memory_sub(tree, bytes);
+}
+
+// Release the stored leaves: free a copy, forget a borrowed buffer
+static void tree_release_leaf_data(merkle_tree_t* tree) {
+    if (tree->records) {
+        size_t bytes = tree->num_leaves * sizeof(merkle_record_t);
+        free(tree->records);
+        tree->records = NULL;
+        merkle_memory_account_free(MERKLE_MEM_LEVELS, bytes);
+        tree_memory_sub(tree, bytes);
+    }
+    if (tree->leaf_data && tree->leaf_data_owned) {
+        free(tree->leaf_data);
+        merkle_memory_account_free(MERKLE_MEM_LEVELS, tree->leaf_data_capacity);
+        tree_memory_sub(tree, tree->leaf_data_capacity);
+    }
+    tree->leaf_data = NULL;
+    tree->leaf_data_owned = false;
+    tree->leaf_data_used = 0;
+    tree->leaf_data_capacity = 0;
+}
+
+// Allocate the tree's own copy of `size` bytes of leaves
+static merkle_error_t tree_alloc_leaf_copy(merkle_tree_t* tree, size_t size) {
+    size_t capacity = size ? size : 1;
+    tree->leaf_data = (uint8_t*)malloc(capacity);
+    if (!tree->leaf_data) {
+        return MERKLE_ERROR_MEMORY_ALLOCATION;
+    }
+    tree->leaf_data_owned = true;
+    tree->leaf_data_used = size;
+    tree->leaf_data_capacity = capacity;
+    merkle_memory_account_alloc(MERKLE_MEM_LEVELS, capacity);
+    tree_memory_add(tree, capacity);
+    return MERKLE_SUCCESS;
+}
+
+// Keep the input the way leaf_storage asks: copied, or borrowed (a
+// hash-only build borrows it just while the leaves are hashed)
+static merkle_error_t tree_store_input(merkle_tree_t* tree, const uint8_t* data, size_t size) {
+    if (tree->leaf_storage != MERKLE_LEAVES_COPY) {
+        tree->leaf_data = (uint8_t*)data;
+        tree->leaf_data_used = size;
+        return MERKLE_SUCCESS;
+    }
+    
+    merkle_error_t err = tree_alloc_leaf_copy(tree, size);
+    if (err == MERKLE_SUCCESS) {
+        memcpy(tree->leaf_data, data, size);
+    }
+    return err;
+}
+
+// Deepest level with nodes: the leaves, or the buckets of a pruned tree
+static inline uint8_t tree_bottom_level(const merkle_tree_t* tree) {
+    return tree->depth - tree->pruned_height;
+}
+
+// Dirty bitmap: one bit per stored node in heap order
+static size_t dirty_bitmap_bytes(const merkle_tree_t* tree) {
+    uint64_t bits = heap_level_offset(tree->arity_log2, tree_bottom_level(tree) + 1);
+    return ((bits + 63) / 64) * sizeof(uint64_t);
+}
+
+static inline bool dirty_test(const uint64_t* dirty, uint64_t bit) {
+    return (dirty[bit >> 6] >> (bit & 63)) & 1;
+}
+
+// Charge pool chunks added since the last sync to the tree
+static void tree_sync_pool_footprint(merkle_tree_t* tree, size_t* charged) {
+    size_t footprint = memory_pool_footprint(tree->node_pool);
+    if (footprint > *charged) {
+        tree_memory_add(tree, footprint - *charged);
+        *charged = footprint;
+    }
+}
+
+// Hash the concatenated child digests of an internal node in one call
+void merkle_node_hash_children(const merkle_tree_t* tree, merkle_node_t* node) {
+    uint8_t combined_data[MERKLE_MAX_ARITY * SHA256_HASH_SIZE];
+    for (uint8_t i = 0; i < tree->arity; i++) {
+        memcpy(combined_data + (size_t)i * SHA256_HASH_SIZE, node->children[i]->hash, SHA256_HASH_SIZE);
+    }
+    tree->hash_function(combined_data, (size_t)tree->arity * SHA256_HASH_SIZE, node->hash);
+}
+
+// Create a new binary Merkle tree
 merkle_tree_t* merkle_tree_create(uint64_t num_leaves, hash_type_t hash_type) {
+    return merkle_tree_create_kary(num_leaves, hash_type, 2);
+}
+
+// Create a new Merkle tree with `arity` children per internal node
+merkle_tree_t* merkle_tree_create_kary(uint64_t num_leaves, hash_type_t hash_type, uint8_t arity) {
     // Validate parameters
-    merkle_error_t err = validate_tree_parameters(num_leaves, hash_type);
+    merkle_error_t err = validate_kary_parameters(num_leaves, hash_type, arity);
     if (err != MERKLE_SUCCESS) {
         return NULL;
     }
@@ -21,9 +142,13 @@ merkle_tree_t* merkle_tree_create(uint64_t num_leaves, hash_type_t hash_type) {
     // Initialize tree
     memset(tree, 0, sizeof(merkle_tree_t));
     tree->num_leaves = num_leaves;
-    tree->depth = calculate_tree_depth(num_leaves);
+    tree->arity = arity;
+    tree->arity_log2 = (uint8_t)__builtin_ctz(arity);
+    tree->depth = calculate_tree_depth(num_leaves) / tree->arity_log2;
+    tree->node_size = sizeof(merkle_node_t) + (size_t)arity * sizeof(merkle_node_t*);
     tree->hash_type = hash_type;
     tree->leaf_data_size = 32; // Default leaf size for SHA-256
+    tree->hot_depth = MERKLE_HOT_DEPTH;
     
     // Set hash function
     switch (hash_type) {
@@ -39,14 +164,21 @@ merkle_tree_t* merkle_tree_create(uint64_t num_leaves, hash_type_t hash_type) {
     }
     
     // Create memory pool for nodes
-    size_t max_nodes = 2 * num_leaves; // Maximum possible nodes in binary tree
-    size_t pool_size = max_nodes * sizeof(merkle_node_t);
+    size_t max_nodes = heap_level_offset(tree->arity_log2, tree->depth + 1);
+    size_t pool_size = max_nodes * tree->node_size;
     tree->node_pool = memory_pool_create(pool_size);
     if (!tree->node_pool) {
         free(tree);
         return NULL;
     }
     
+    merkle_memory_account_alloc(MERKLE_MEM_LEVELS, sizeof(merkle_tree_t));
+    tree_memory_add(tree, sizeof(merkle_tree_t) + memory_pool_footprint(tree->node_pool));
+
+#ifdef MERKLE_ENABLE_TIMING
+    tree->timing = merkle_timing_create();
+#endif
+    
     return tree;
 }
 
@@ -60,122 +192,184 @@ void merkle_tree_destroy(merkle_tree_t* tree) {
         memory_pool_destroy(tree->node_pool);
     }
     
-    if (tree->leaf_data) {
-        free(tree->leaf_data);
+    tree_release_leaf_data(tree);
+    tree_memory_sub(tree, merkle_hot_destroy(tree));
+    if (tree->leaf_hashes) {
+        free(tree->leaf_hashes);
+        merkle_memory_account_free(MERKLE_MEM_LEVELS, tree->num_leaves * SHA256_HASH_SIZE);
     }
+    if (tree->dirty) {
+        free(tree->dirty);
+        merkle_memory_account_free(MERKLE_MEM_LEVELS, dirty_bitmap_bytes(tree));
+    }
+    merkle_timing_destroy(tree->timing);
     
+    merkle_memory_account_free(MERKLE_MEM_LEVELS, sizeof(merkle_tree_t));
     free(tree);
 }
 
-// Build a Merkle tree from leaf data
-merkle_error_t merkle_tree_build(merkle_tree_t* tree, const uint8_t* data, size_t data_size) {
-    if (!tree || !data) {
-        return MERKLE_ERROR_INVALID_TREE;
+// Drop the previous build, if any, and whatever it had pending
+static void tree_reset_build(merkle_tree_t* tree) {
+    tree_release_leaf_data(tree);
+    memory_pool_reset(tree->node_pool);
+    tree->root = NULL;
+    if (tree->dirty) {
+        memset(tree->dirty, 0, dirty_bitmap_bytes(tree));
+        tree->dirty_leaves = 0;
+    }
+}
+
+// Hash the leaves chunk by chunk as a file arrives, into their nodes or
+// the packed hashes of a pruned tree, keeping a copy if the tree owns one
+static merkle_error_t tree_hash_ingested(merkle_tree_t* tree, merkle_node_t** leaf_nodes, merkle_ingest_t* ingest) {
+    merkle_tree_t view = *tree;
+    view.records = NULL;
+    uint64_t leaf = 0;
+    size_t size = 0;
+    const uint8_t* chunk;
+    while ((chunk = merkle_ingest_next(ingest, &size)) != NULL) {
+        view.leaf_data = (uint8_t*)chunk;
+        view.num_leaves = size / tree->leaf_data_size;
+        if (tree->leaf_data_owned) {
+            memcpy(tree->leaf_data + leaf * tree->leaf_data_size, chunk, size);
+        }
+        if (tree->pruned_height > 0) {
+            merkle_hash_leaves(&view, NULL, tree->leaf_hashes + leaf * SHA256_HASH_SIZE);
+        } else {
+            merkle_hash_leaves(&view, leaf_nodes + leaf, NULL);
+        }
+        leaf += view.num_leaves;
+    }
+    return leaf == tree->num_leaves ? MERKLE_SUCCESS : MERKLE_ERROR_IO;
+}
+
+// Create the bottom stored level (the leaves, or one node per bucket of a
+// pruned tree) and hash it
+static merkle_error_t tree_build_bottom(merkle_tree_t* tree, merkle_node_t** leaf_nodes, uint64_t bottom_size,
+                                        merkle_ingest_t* ingest) {
+    uint8_t bucket_bits = tree->arity_log2 * tree->pruned_height;
+    for (uint64_t i = 0; i < bottom_size; i++) {
+        merkle_node_t* leaf = (merkle_node_t*)memory_pool_alloc(tree->node_pool, tree->node_size);
+        if (!leaf) {
+            return MERKLE_ERROR_MEMORY_ALLOCATION;
+        }
+        
+        memset(leaf, 0, tree->node_size);
+        leaf->is_leaf = tree->pruned_height == 0;
+        leaf->leaf_index = i << bucket_bits;
+        leaf->depth = tree_bottom_level(tree);
+        leaf_nodes[i] = leaf;
     }
     
-    // Validate data size
-    if (data_size != tree->num_leaves * tree->leaf_data_size) {
-        return MERKLE_ERROR_INVALID_TREE;
+    // Compute hashes for the leaves, in parallel for large inputs
+    if (ingest) {
+        merkle_error_t err = tree_hash_ingested(tree, leaf_nodes, ingest);
+        if (err != MERKLE_SUCCESS) {
+            return err;
+        }
+    } else if (tree->pruned_height > 0) {
+        merkle_hash_leaves(tree, NULL, tree->leaf_hashes);
+    } else {
+        merkle_hash_leaves(tree, leaf_nodes, NULL);
+    }
+    if (tree->pruned_height > 0) {
+        for (uint64_t i = 0; i < bottom_size; i++) {
+            merkle_bucket_rehash(tree, leaf_nodes[i], i);
+        }
+    }
+    return MERKLE_SUCCESS;
+}
+
+// Create the nodes over the stored leaves (or the leaves ingest delivers),
+// hash them and build the levels above. On failure the stored leaves are
+// released again.
+static merkle_error_t tree_build_nodes(merkle_tree_t* tree, size_t pool_charged, merkle_ingest_t* ingest) {
+    // A pruned tree hashes its leaves into the packed array, kept across rebuilds
+    if (tree->pruned_height > 0 && !tree->leaf_hashes) {
+        size_t bytes = tree->num_leaves * SHA256_HASH_SIZE;
+        tree->leaf_hashes = (uint8_t*)malloc(bytes);
+        if (!tree->leaf_hashes) {
+            tree_release_leaf_data(tree);
+            return MERKLE_ERROR_MEMORY_ALLOCATION;
+        }
+        merkle_memory_account_alloc(MERKLE_MEM_LEVELS, bytes);
+        tree_memory_add(tree, bytes);
     }
     
-    // Store leaf data
-    tree->leaf_data = (uint8_t*)malloc(data_size);
-    if (!tree->leaf_data) {
-        return MERKLE_ERROR_MEMORY_ALLOCATION;
+    // Large unpruned builds hand whole subtrees to worker threads instead
+    // and continue from their roots
+    uint64_t subtrees = tree->pruned_height == 0 && !ingest ? merkle_subtree_count(tree) : 1;
+    uint64_t bottom_size = tree->num_leaves >> (tree->arity_log2 * tree->pruned_height);
+    uint8_t level_depth = tree_bottom_level(tree);
+    if (subtrees > 1) {
+        bottom_size = subtrees;
+        level_depth = tree->depth - (uint8_t)(__builtin_ctzll(subtrees) / tree->arity_log2);
     }
-    memcpy(tree->leaf_data, data, data_size);
+    tree->subtree_bits = 0;
     
-    // Create leaf nodes
-    merkle_node_t** leaf_nodes = (merkle_node_t**)malloc(tree->num_leaves * sizeof(merkle_node_t*));
+    merkle_node_t** leaf_nodes = level_index_alloc(tree, bottom_size);
     if (!leaf_nodes) {
-        free(tree->leaf_data);
-        tree->leaf_data = NULL;
+        tree_release_leaf_data(tree);
         return MERKLE_ERROR_MEMORY_ALLOCATION;
     }
-    
-    // Create leaf nodes
-    for (uint64_t i = 0; i < tree->num_leaves; i++) {
-        merkle_node_t* leaf = (merkle_node_t*)memory_pool_alloc(tree->node_pool, sizeof(merkle_node_t));
-        if (!leaf) {
-            // Cleanup on failure
-            for (uint64_t j = 0; j < i; j++) {
-                free(leaf_nodes[j]);
-            }
-            free(leaf_nodes);
-            free(tree->leaf_data);
-            tree->leaf_data = NULL;
-            return MERKLE_ERROR_MEMORY_ALLOCATION;
-        }
-        
-        memset(leaf, 0, sizeof(merkle_node_t));
-        leaf->is_leaf = true;
-        leaf->leaf_index = i;
-        leaf->depth = tree->depth;
-        
-        // Compute hash for leaf
-        const uint8_t* leaf_data_ptr = data + i * tree->leaf_data_size;
-        tree->hash_function(leaf_data_ptr, tree->leaf_data_size, leaf->hash);
-        
-        leaf_nodes[i] = leaf;
+    merkle_error_t err = subtrees > 1 ? merkle_build_subtrees(tree, leaf_nodes, subtrees)
+                                      : tree_build_bottom(tree, leaf_nodes, bottom_size, ingest);
+    if (err != MERKLE_SUCCESS) {
+        // Cleanup on failure; nodes are owned by the pool
+        level_index_free(tree, leaf_nodes, bottom_size);
+        memory_pool_reset(tree->node_pool);
+        tree_release_leaf_data(tree);
+        tree_sync_pool_footprint(tree, &pool_charged);
+        return err;
     }
     
     // Build internal nodes bottom-up
-    uint64_t current_level_size = tree->num_leaves;
+    uint64_t current_level_size = bottom_size;
     merkle_node_t** current_level = leaf_nodes;
     
     while (current_level_size > 1) {
-        uint64_t next_level_size = current_level_size / 2;
-        merkle_node_t** next_level = (merkle_node_t**)malloc(next_level_size * sizeof(merkle_node_t*));
+        uint64_t next_level_size = current_level_size >> tree->arity_log2;
+        merkle_node_t** next_level = level_index_alloc(tree, next_level_size);
         
         if (!next_level) {
             // Cleanup on failure
-            for (uint64_t i = 0; i < current_level_size; i++) {
-                free(current_level[i]);
-            }
-            free(current_level);
-            free(leaf_nodes);
-            free(tree->leaf_data);
-            tree->leaf_data = NULL;
+            level_index_free(tree, current_level, current_level_size);
+            memory_pool_reset(tree->node_pool);
+            tree_release_leaf_data(tree);
+            tree_sync_pool_footprint(tree, &pool_charged);
             return MERKLE_ERROR_MEMORY_ALLOCATION;
         }
         
+        level_depth--;
+        
         // Create parent nodes
         for (uint64_t i = 0; i < next_level_size; i++) {
-            merkle_node_t* parent = (merkle_node_t*)memory_pool_alloc(tree->node_pool, sizeof(merkle_node_t));
+            merkle_node_t* parent = (merkle_node_t*)memory_pool_alloc(tree->node_pool, tree->node_size);
             if (!parent) {
                 // Cleanup on failure
-                for (uint64_t j = 0; j < next_level_size; j++) {
-                    free(next_level[j]);
-                }
-                free(next_level);
-                for (uint64_t j = 0; j < current_level_size; j++) {
-                    free(current_level[j]);
-                }
-                free(current_level);
-                free(leaf_nodes);
-                free(tree->leaf_data);
-                tree->leaf_data = NULL;
+                level_index_free(tree, next_level, next_level_size);
+                level_index_free(tree, current_level, current_level_size);
+                memory_pool_reset(tree->node_pool);
+                tree_release_leaf_data(tree);
+                tree_sync_pool_footprint(tree, &pool_charged);
                 return MERKLE_ERROR_MEMORY_ALLOCATION;
             }
             
-            memset(parent, 0, sizeof(merkle_node_t));
-            parent->left = current_level[2 * i];
-            parent->right = current_level[2 * i + 1];
-            parent->left->parent = parent;
-            parent->right->parent = parent;
-            parent->depth = tree->depth - i - 1;
+            memset(parent, 0, tree->node_size);
+            for (uint8_t c = 0; c < tree->arity; c++) {
+                parent->children[c] = current_level[i * tree->arity + c];
+                parent->children[c]->parent = parent;
+            }
+            parent->depth = level_depth;
             
             // Compute hash for parent
-            uint8_t combined_data[64]; // 32 + 32 for two child hashes
-            memcpy(combined_data, parent->left->hash, 32);
-            memcpy(combined_data + 32, parent->right->hash, 32);
-            tree->hash_function(combined_data, 64, parent->hash);
+            merkle_node_hash_children(tree, parent);
             
             next_level[i] = parent;
         }
         
         // Move to next level
-        free(current_level);
+        level_index_free(tree, current_level, current_level_size);
         current_level = next_level;
         current_level_size = next_level_size;
     }
@@ -184,14 +378,264 @@ merkle_error_t merkle_tree_build(merkle_tree_t* tree, const uint8_t* data, size_
     tree->root = current_level[0];
     
     // Clean up
-    free(current_level);
-    free(leaf_nodes);
+    if (tree->leaf_storage == MERKLE_LEAVES_HASH_ONLY) {
+        tree_release_leaf_data(tree);
+    }
+    level_index_free(tree, current_level, current_level_size);
+    tree_sync_pool_footprint(tree, &pool_charged);
+    tree_memory_add(tree, merkle_hot_build(tree));
+    
+    return MERKLE_SUCCESS;
+}
+
+// Build a Merkle tree from leaf data
+merkle_error_t merkle_tree_build(merkle_tree_t* tree, const uint8_t* data, size_t data_size) {
+    if (!tree || !data) {
+        return MERKLE_ERROR_INVALID_TREE;
+    }
+    
+    // Validate data size
+    if (data_size != tree->num_leaves * tree->leaf_data_size) {
+        return MERKLE_ERROR_INVALID_TREE;
+    }
+    
+    MERKLE_TIMING_START(build_start);
+    MERKLE_HW_START(build_hw);
+    
+    tree_reset_build(tree);
+    size_t pool_charged = memory_pool_footprint(tree->node_pool);
+    
+    // Store leaf data
+    tree->variable_leaves = false;
+    merkle_error_t err = tree_store_input(tree, data, data_size);
+    if (err == MERKLE_SUCCESS) {
+        err = tree_build_nodes(tree, pool_charged, NULL);
+    }
+    if (err != MERKLE_SUCCESS) {
+        return err;
+    }
+    
+    MERKLE_HW_RECORD(tree, MERKLE_OP_BUILD, build_hw);
+    MERKLE_TIMING_RECORD(tree, MERKLE_OP_BUILD, build_start);
+    
+    return MERKLE_SUCCESS;
+}
+
+// Build a Merkle tree over variable-size records: leaf i is
+// payload[offsets[i], offsets[i + 1]), so offsets has num_leaves + 1
+// non-decreasing entries. Records are hashed as they are, unpadded.
+merkle_error_t merkle_tree_build_records(merkle_tree_t* tree, const uint8_t* payload, const uint64_t* offsets) {
+    if (!tree || !payload || !offsets) {
+        return MERKLE_ERROR_INVALID_TREE;
+    }
+    
+    for (uint64_t i = 0; i < tree->num_leaves; i++) {
+        if (offsets[i + 1] < offsets[i]) {
+            return MERKLE_ERROR_INVALID_SIZE;
+        }
+    }
+    
+    MERKLE_TIMING_START(build_start);
+    MERKLE_HW_START(build_hw);
+    
+    tree_reset_build(tree);
+    size_t pool_charged = memory_pool_footprint(tree->node_pool);
+    
+    // Store the records packed, rebased to the start of the payload
+    size_t records_size = tree->num_leaves * sizeof(merkle_record_t);
+    tree->records = (merkle_record_t*)malloc(records_size);
+    if (!tree->records) {
+        return MERKLE_ERROR_MEMORY_ALLOCATION;
+    }
+    for (uint64_t i = 0; i < tree->num_leaves; i++) {
+        tree->records[i].offset = offsets[i] - offsets[0];
+        tree->records[i].size = offsets[i + 1] - offsets[i];
+    }
+    merkle_memory_account_alloc(MERKLE_MEM_LEVELS, records_size);
+    tree_memory_add(tree, records_size);
+    tree->variable_leaves = true;
+    
+    merkle_error_t err = tree_store_input(tree, payload + offsets[0], offsets[tree->num_leaves] - offsets[0]);
+    if (err == MERKLE_SUCCESS) {
+        err = tree_build_nodes(tree, pool_charged, NULL);
+    } else {
+        tree_release_leaf_data(tree);
+    }
+    if (err != MERKLE_SUCCESS) {
+        return err;
+    }
+    
+    MERKLE_HW_RECORD(tree, MERKLE_OP_BUILD, build_hw);
+    MERKLE_TIMING_RECORD(tree, MERKLE_OP_BUILD, build_start);
+    
+    return MERKLE_SUCCESS;
+}
+
+// Build from a file of leaves, hashing each chunk while the next ones are
+// read (see merkle_ingest_open). Nothing is borrowed from a file, so only
+// copy storage keeps the leaves.
+merkle_error_t merkle_tree_build_file(merkle_tree_t* tree, const char* path) {
+    if (!tree || !path) {
+        return MERKLE_ERROR_INVALID_TREE;
+    }
+    
+    size_t chunk = MERKLE_INGEST_CHUNK_BYTES / tree->leaf_data_size * tree->leaf_data_size;
+    merkle_ingest_t* ingest = merkle_ingest_open(path, chunk ? chunk : tree->leaf_data_size, true);
+    if (!ingest) {
+        return MERKLE_ERROR_IO;
+    }
+    size_t data_size = tree->num_leaves * tree->leaf_data_size;
+    if (merkle_ingest_size(ingest) != data_size) {
+        merkle_ingest_close(ingest);
+        return MERKLE_ERROR_INVALID_TREE;
+    }
+    
+    MERKLE_TIMING_START(build_start);
+    MERKLE_HW_START(build_hw);
+    
+    tree_reset_build(tree);
+    size_t pool_charged = memory_pool_footprint(tree->node_pool);
+    
+    tree->variable_leaves = false;
+    merkle_error_t err = MERKLE_SUCCESS;
+    if (tree->leaf_storage == MERKLE_LEAVES_COPY) {
+        err = tree_alloc_leaf_copy(tree, data_size);
+    }
+    if (err == MERKLE_SUCCESS) {
+        err = tree_build_nodes(tree, pool_charged, ingest);
+    }
+    merkle_ingest_close(ingest);
+    if (err != MERKLE_SUCCESS) {
+        return err;
+    }
+    
+    MERKLE_HW_RECORD(tree, MERKLE_OP_BUILD, build_hw);
+    MERKLE_TIMING_RECORD(tree, MERKLE_OP_BUILD, build_start);
+    
+    return MERKLE_SUCCESS;
+}
+
+merkle_error_t merkle_tree_set_leaf_storage(merkle_tree_t* tree, merkle_leaf_storage_t storage) {
+    if (!tree) {
+        return MERKLE_ERROR_INVALID_TREE;
+    }
+    if (storage > MERKLE_LEAVES_HASH_ONLY) {
+        return MERKLE_ERROR_INVALID_SIZE;
+    }
+    
+    // Pending deferred updates may still need the stored leaves
+    if (storage == MERKLE_LEAVES_HASH_ONLY) {
+        merkle_error_t err = merkle_tree_flush(tree);
+        if (err != MERKLE_SUCCESS) {
+            return err;
+        }
+        tree_release_leaf_data(tree);
+    }
+    tree->leaf_storage = storage;
+    return MERKLE_SUCCESS;
+}
+
+merkle_error_t merkle_tree_set_pruned_height(merkle_tree_t* tree, uint8_t height) {
+    if (!tree || tree->root || tree->dirty) {
+        return MERKLE_ERROR_INVALID_TREE;
+    }
+    if (height > tree->depth || height * tree->arity_log2 > MERKLE_MAX_PRUNED_BITS) {
+        return MERKLE_ERROR_INVALID_SIZE;
+    }
+    
+    // The pool was sized up front for every level
+    size_t max_nodes = heap_level_offset(tree->arity_log2, tree->depth - height + 1);
+    memory_pool_t* pool = memory_pool_create(max_nodes * tree->node_size);
+    if (!pool) {
+        return MERKLE_ERROR_MEMORY_ALLOCATION;
+    }
+    tree_memory_sub(tree, memory_pool_footprint(tree->node_pool));
+    memory_pool_destroy(tree->node_pool);
+    tree->node_pool = pool;
+    tree_memory_add(tree, memory_pool_footprint(pool));
+    tree->pruned_height = height;
+    return MERKLE_SUCCESS;
+}
+
+merkle_error_t merkle_tree_set_hot_depth(merkle_tree_t* tree, uint8_t levels) {
+    if (!tree || tree->dirty) {
+        return MERKLE_ERROR_INVALID_TREE;
+    }
+    if (levels > MERKLE_HOT_DEPTH) {
+        return MERKLE_ERROR_INVALID_SIZE;
+    }
     
+    tree_memory_sub(tree, merkle_hot_destroy(tree));
+    tree->hot_depth = levels;
+    if (tree->root) {
+        tree_memory_add(tree, merkle_hot_build(tree));
+    }
+    return MERKLE_SUCCESS;
+}
+
+// Stored data of one leaf
+const uint8_t* merkle_tree_leaf(const merkle_tree_t* tree, uint64_t leaf_index, size_t* size) {
+    if (!tree || !tree->leaf_data || leaf_index >= tree->num_leaves) {
+        return NULL;
+    }
+    
+    if (tree->records) {
+        *size = tree->records[leaf_index].size;
+        return tree->leaf_data + tree->records[leaf_index].offset;
+    }
+    *size = tree->leaf_data_size;
+    return tree->leaf_data + leaf_index * tree->leaf_data_size;
+}
+
+// Replace the stored data of one leaf. A record that no longer fits its
+// old span moves to the end of the buffer; the span it left is reclaimed
+// by the next build. Borrowed and hash-only leaves are never written.
+merkle_error_t merkle_tree_store_leaf(merkle_tree_t* tree, uint64_t leaf_index, const uint8_t* data, size_t size) {
+    if (!tree->variable_leaves && size != tree->leaf_data_size) {
+        return MERKLE_ERROR_INVALID_SIZE;
+    }
+    if (!tree->leaf_data_owned) {
+        return MERKLE_SUCCESS;
+    }
+    if (!tree->records) {
+        memcpy(tree->leaf_data + leaf_index * tree->leaf_data_size, data, size);
+        return MERKLE_SUCCESS;
+    }
+    
+    merkle_record_t* record = &tree->records[leaf_index];
+    if (size > record->size) {
+        if (tree->leaf_data_used + size > tree->leaf_data_capacity) {
+            size_t capacity = tree->leaf_data_capacity;
+            while (capacity < tree->leaf_data_used + size) {
+                capacity *= 2;
+            }
+            uint8_t* grown = (uint8_t*)realloc(tree->leaf_data, capacity);
+            if (!grown) {
+                return MERKLE_ERROR_MEMORY_ALLOCATION;
+            }
+            merkle_memory_account_alloc(MERKLE_MEM_LEVELS, capacity - tree->leaf_data_capacity);
+            tree_memory_add(tree, capacity - tree->leaf_data_capacity);
+            tree->leaf_data = grown;
+            tree->leaf_data_capacity = capacity;
+        }
+        record->offset = tree->leaf_data_used;
+        tree->leaf_data_used += size;
+    }
+    memcpy(tree->leaf_data + record->offset, data, size);
+    record->size = size;
     return MERKLE_SUCCESS;
 }
 
 // Update a leaf in the tree
 merkle_error_t merkle_tree_update_leaf(merkle_tree_t* tree, uint64_t leaf_index, const uint8_t* data) {
+    if (!tree) {
+        return MERKLE_ERROR_INVALID_TREE;
+    }
+    return merkle_tree_update_record(tree, leaf_index, data, tree->leaf_data_size);
+}
+
+// Update a leaf with data of any size; fixed-size trees take leaf_data_size only
+merkle_error_t merkle_tree_update_record(merkle_tree_t* tree, uint64_t leaf_index, const uint8_t* data, size_t size) {
     if (!tree || !data) {
         return MERKLE_ERROR_INVALID_TREE;
     }
@@ -200,17 +644,148 @@ merkle_error_t merkle_tree_update_leaf(merkle_tree_t* tree, uint64_t leaf_index,
         return MERKLE_ERROR_LEAF_OUT_OF_BOUNDS;
     }
     
-    // For simplicity, we'll rebuild the entire tree for leaf updates
-    // In a more optimized implementation, you would only update the affected path
+    if (!tree->root) {
+        return MERKLE_ERROR_INVALID_TREE;
+    }
     
     // Update leaf data
-    memcpy(tree->leaf_data + leaf_index * tree->leaf_data_size, data, tree->leaf_data_size);
+    merkle_error_t err = merkle_tree_store_leaf(tree, leaf_index, data, size);
+    if (err != MERKLE_SUCCESS) {
+        return err;
+    }
+    
+    // Walk down to the leaf (or its bucket), following the index digits MSB first
+    uint8_t bottom = tree_bottom_level(tree);
+    uint64_t bucket = leaf_index >> (tree->arity_log2 * tree->pruned_height);
+    merkle_node_t* path[MAX_TREE_DEPTH + 1];
+    path[0] = tree->root;
+    for (uint8_t level = 0; level < bottom; level++) {
+        uint64_t child = (leaf_index >> (tree->arity_log2 * (tree->depth - level - 1))) & (tree->arity - 1);
+        path[level + 1] = path[level]->children[child];
+    }
+    
+    // Without a stored copy to rehash from later, the leaf is hashed now;
+    // so is every leaf of a pruned tree, which keeps no leaf nodes
+    bool stored = tree->leaf_data_owned;
+    if (tree->pruned_height > 0) {
+        tree->hash_function(data, size, tree->leaf_hashes + leaf_index * SHA256_HASH_SIZE);
+    } else if (!tree->dirty || !stored) {
+        tree->hash_function(data, size, path[tree->depth]->hash);
+    }
+    
+    // Deferred: mark the path up to the first node already marked, whose
+    // ancestors are marked too
+    if (tree->dirty) {
+        for (int level = bottom; level >= 0; level--) {
+            uint64_t bit = heap_level_offset(tree->arity_log2, (uint8_t)level) +
+                           (leaf_index >> (tree->arity_log2 * (tree->depth - level)));
+            if (dirty_test(tree->dirty, bit)) {
+                break;
+            }
+            tree->dirty[bit >> 6] |= 1ULL << (bit & 63);
+            if (level == bottom) {
+                tree->dirty_leaves++;
+            }
+        }
+        return MERKLE_SUCCESS;
+    }
+    
+    // Rehash only the path from the leaf to the root
+    if (tree->pruned_height > 0) {
+        merkle_bucket_rehash(tree, path[bottom], bucket);
+    }
+    for (merkle_node_t* node = path[bottom]->parent; node; node = node->parent) {
+        merkle_node_hash_children(tree, node);
+    }
+    merkle_hot_update_path(tree, tree->root, leaf_index, path);
+    
+    return MERKLE_SUCCESS;
+}
+
+// Levels 0..n that may hold hot digests, and so keep their dirty bits
+// until the hot array has been refreshed from them
+static uint8_t tree_hot_levels(const merkle_tree_t* tree) {
+    uint8_t levels = tree->hot_depth / tree->arity_log2;
+    return tree_bottom_level(tree) < levels ? tree_bottom_level(tree) : levels;
+}
+
+// Rehash a dirty subtree bottom-up, skipping clean children. Bits of the
+// hot levels stay set until the hot array has been refreshed from them.
+static void tree_flush_node(merkle_tree_t* tree, merkle_node_t* node, uint8_t level, uint64_t index) {
+    uint64_t bit = heap_level_offset(tree->arity_log2, level) + index;
+    if (!dirty_test(tree->dirty, bit)) {
+        return;
+    }
     
-    // Rebuild tree (simplified approach)
-    // In production, you'd want to optimize this to only update the path from leaf to root
+    if (level == tree_bottom_level(tree) && tree->pruned_height > 0) {
+        merkle_bucket_rehash(tree, node, index);
+    } else if (level == tree->depth) {
+        size_t size = 0;
+        const uint8_t* data = merkle_tree_leaf(tree, index, &size);
+        if (tree->leaf_data_owned) {
+            tree->hash_function(data, size, node->hash);
+        }
+    } else {
+        for (uint8_t c = 0; c < tree->arity; c++) {
+            tree_flush_node(tree, node->children[c], level + 1, index * tree->arity + c);
+        }
+        merkle_node_hash_children(tree, node);
+    }
     
-    // For now, we'll just update the leaf hash and mark parent hashes as needing update
-    // This is a placeholder for the full tree rebuild
+    if (level > tree_hot_levels(tree)) {
+        tree->dirty[bit >> 6] &= ~(1ULL << (bit & 63));
+    }
+}
+
+merkle_error_t merkle_tree_set_deferred(merkle_tree_t* tree, bool deferred) {
+    if (!tree) {
+        return MERKLE_ERROR_INVALID_TREE;
+    }
+    
+    if (deferred && !tree->dirty) {
+        size_t bytes = dirty_bitmap_bytes(tree);
+        tree->dirty = (uint64_t*)calloc(1, bytes);
+        if (!tree->dirty) {
+            return MERKLE_ERROR_MEMORY_ALLOCATION;
+        }
+        merkle_memory_account_alloc(MERKLE_MEM_LEVELS, bytes);
+        tree_memory_add(tree, bytes);
+        tree->dirty_leaves = 0;
+    } else if (!deferred && tree->dirty) {
+        merkle_error_t err = merkle_tree_flush(tree);
+        if (err != MERKLE_SUCCESS) {
+            return err;
+        }
+        
+        size_t bytes = dirty_bitmap_bytes(tree);
+        free(tree->dirty);
+        tree->dirty = NULL;
+        merkle_memory_account_free(MERKLE_MEM_LEVELS, bytes);
+        tree_memory_sub(tree, bytes);
+    }
+    
+    return MERKLE_SUCCESS;
+}
+
+// Bring every hash up to date; a no-op unless deferred updates are pending
+merkle_error_t merkle_tree_flush(merkle_tree_t* tree) {
+    if (!tree) {
+        return MERKLE_ERROR_INVALID_TREE;
+    }
+    if (!tree->dirty || tree->dirty_leaves == 0) {
+        return MERKLE_SUCCESS;
+    }
+    if (!tree->root) {
+        return MERKLE_ERROR_INVALID_TREE;
+    }
+    
+    tree_flush_node(tree, tree->root, 0, 0);
+    merkle_hot_refresh(tree, tree->dirty);
+    
+    // Only the hot levels can still be marked
+    uint64_t top_bits = heap_level_offset(tree->arity_log2, tree_hot_levels(tree) + 1);
+    memset(tree->dirty, 0, ((top_bits + 63) / 64) * sizeof(uint64_t));
+    tree->dirty_leaves = 0;
     
     return MERKLE_SUCCESS;
 }
@@ -225,8 +800,18 @@ merkle_error_t merkle_tree_get_root_hash(merkle_tree_t* tree, uint8_t* hash) {
         return MERKLE_ERROR_INVALID_TREE;
     }
     
+    // A stale root is never handed out as current
+    merkle_error_t err = merkle_tree_flush(tree);
+    if (err != MERKLE_SUCCESS) {
+        return err;
+    }
+    
     memcpy(hash, tree->root->hash, SHA256_HASH_SIZE);
     return MERKLE_SUCCESS;
 }
 
+uint64_t merkle_tree_proof_siblings(const merkle_tree_t* tree) {
+    return tree ? (uint64_t)tree->depth * (tree->arity - 1u) : 0;
+}
+
 
@@ -11,9 +11,36 @@
 // Hash size for SHA-256
 #define SHA256_HASH_SIZE 32
 
+// Children per internal node: 2 by default, up to 16
+#define MERKLE_MAX_ARITY 16
+
+// Most siblings any proof can carry (a 16-ary tree of 2^32 leaves: 8 levels of 15)
+#define MERKLE_MAX_PROOF_SIBLINGS 120
+
 // Memory pool configuration
 #define MEMORY_POOL_SIZE (1024 * 1024)  // 1MB pool
 
+// Levels 0..11 of each binary tree (4095 digests, 128 KB) are kept in a dense
+// hot array; a k-ary tree keeps the levels covering as many leaf index bits
+#define MERKLE_HOT_DEPTH 11
+
+// Pruned trees recompute buckets of up to 2^8 leaves (h * log2(arity) <= 8)
+#define MERKLE_MAX_PRUNED_BITS 8
+#define MERKLE_BUCKET_BYTES ((1u << MERKLE_MAX_PRUNED_BITS) * SHA256_HASH_SIZE)
+
+// Worker threads (and subtrees) of one parallel build at most
+#define MERKLE_MAX_BUILD_THREADS 64
+
+// Buffer budget of the out-of-core builder
+#define MERKLE_EXTERNAL_DEFAULT_MEMORY (64u * 1024 * 1024)
+#define MERKLE_EXTERNAL_MIN_MEMORY (64u * 1024)
+
+// Chunk buffers in flight while a file is ingested, and the chunk size
+// file builds use (large enough for merkle_hash_leaves to spread each
+// chunk over threads)
+#define MERKLE_INGEST_BUFFERS 4
+#define MERKLE_INGEST_CHUNK_BYTES (16u * 1024 * 1024)
+
 // Hash function types
 typedef enum {
     HASH_SHA256,
@@ -26,6 +53,10 @@ typedef struct merkle_node merkle_node_t;
 typedef struct merkle_tree merkle_tree_t;
 typedef struct merkle_proof merkle_proof_t;
 typedef struct memory_pool memory_pool_t;
+typedef struct merkle_timing merkle_timing_t;
+typedef struct merkle_hot merkle_hot_t;
+typedef struct merkle_tree_file merkle_tree_file_t;
+typedef struct merkle_ingest merkle_ingest_t;
 
 // Hash function interface
 typedef void (*hash_func_t)(const uint8_t* data, size_t len, uint8_t* output);
@@ -38,37 +69,76 @@ struct memory_pool {
     struct memory_pool* next;
 };
 
-// Merkle tree node structure
+// Merkle tree node structure. Every node of a tree is tree->node_size
+// bytes, with room for tree->arity children (unused by leaves).
 struct merkle_node {
     uint8_t hash[SHA256_HASH_SIZE];  // Hash value
-    merkle_node_t* left;             // Left child
-    merkle_node_t* right;            // Right child
     merkle_node_t* parent;           // Parent node
-    bool is_leaf;                    // Is this a leaf node?
     uint64_t leaf_index;             // Index if leaf node
+    bool is_leaf;                    // Is this a leaf node?
     uint8_t depth;                   // Depth in tree
+    merkle_node_t* children[];       // Children, in leaf index order
 };
 
+// Where a tree keeps its leaves once built. Proofs and updates only need
+// the leaf hashes; a copy is kept by default so the leaves can be read
+// back (merkle_tree_leaf) and deferred flushes rehash from it.
+typedef enum {
+    MERKLE_LEAVES_COPY = 0,          // Private copy; updates write it
+    MERKLE_LEAVES_BORROW,            // Caller's buffer (e.g. an mmap), never written;
+                                     // must stay valid until the next build or destroy
+    MERKLE_LEAVES_HASH_ONLY          // Nothing beyond the leaf hashes
+} merkle_leaf_storage_t;
+
+// Span of one variable-size leaf in leaf_data
+typedef struct {
+    uint64_t offset;
+    uint64_t size;
+} merkle_record_t;
+
 // Merkle tree structure
 struct merkle_tree {
     merkle_node_t* root;             // Root node
     uint64_t num_leaves;             // Number of leaf nodes
     uint8_t depth;                   // Tree depth
+    uint8_t arity;                   // Children per internal node (power of two)
+    uint8_t arity_log2;              // Leaf index bits consumed per level
+    size_t node_size;                // Bytes per node, children included
     hash_func_t hash_function;       // Hash function to use
     hash_type_t hash_type;           // Type of hash function
     memory_pool_t* node_pool;        // Memory pool for nodes
-    uint8_t* leaf_data;              // Leaf data buffer
-    size_t leaf_data_size;           // Size of each leaf
+    uint8_t* leaf_data;              // Leaf data buffer (NULL for hash-only leaves)
+    merkle_leaf_storage_t leaf_storage;  // How the next build keeps its input
+    bool leaf_data_owned;            // leaf_data is a copy, not borrowed
+    size_t leaf_data_size;           // Size of each leaf (fixed-size leaves)
+    bool variable_leaves;            // Built from records: leaves of any size
+    merkle_record_t* records;        // Per-leaf spans of stored records
+    size_t leaf_data_used;           // Bytes of leaf_data in use
+    size_t leaf_data_capacity;       // Bytes allocated for an owned copy
+    size_t memory_live_bytes;        // Bytes currently owned by this tree
+    size_t memory_peak_bytes;        // High-water mark of memory_live_bytes
+    merkle_timing_t* timing;         // Latency counters (NULL unless MERKLE_ENABLE_TIMING)
+    merkle_hot_t* hot;               // Top-of-tree digests for proofs (NULL for a single leaf)
+    uint8_t hot_depth;               // Binary levels the hot array may hold (0: none)
+    uint64_t* dirty;                 // Heap-order bitmap of stale nodes; non-NULL while updates are deferred
+    uint64_t dirty_leaves;           // Leaves updated since the last flush
+    uint8_t pruned_height;           // Levels below depth - pruned_height are not stored
+    uint8_t* leaf_hashes;            // Packed leaf hashes of a pruned tree
+    uint32_t build_threads;          // Subtree workers per build; 0 picks from CPUs and size
+    uint8_t subtree_bits;            // Leaf index bits naming a NUMA-placed subtree (0: not placed)
+    int8_t subtree_numa[MERKLE_MAX_BUILD_THREADS];  // Node holding each subtree
 };
 
 // Merkle proof structure
 struct merkle_proof {
     uint8_t leaf_hash[SHA256_HASH_SIZE]; // Hash of the leaf
     uint64_t leaf_index;                 // Index of the leaf
-    uint8_t* sibling_hashes;             // Array of sibling hashes
+    uint8_t* sibling_hashes;             // arity - 1 per level, leaf to root
     uint64_t num_siblings;               // Number of sibling nodes
     uint8_t root_hash[SHA256_HASH_SIZE]; // Expected root hash
     uint64_t proof_size;                 // Total proof size in bytes
+    hash_type_t hash_type;               // Hash used to fold the path
+    uint32_t arity;                      // Children per node of the tree it came from
 };
 
 // Error codes
@@ -79,7 +149,8 @@ typedef enum {
     MERKLE_ERROR_INVALID_HASH_TYPE,
     MERKLE_ERROR_INVALID_TREE,
     MERKLE_ERROR_LEAF_OUT_OF_BOUNDS,
-    MERKLE_ERROR_INVALID_PROOF
+    MERKLE_ERROR_INVALID_PROOF,
+    MERKLE_ERROR_IO
 } merkle_error_t;
 
 // Memory pool functions
@@ -87,41 +158,329 @@ memory_pool_t* memory_pool_create(size_t size);
 void memory_pool_destroy(memory_pool_t* pool);
 void* memory_pool_alloc(memory_pool_t* pool, size_t size);
 void memory_pool_reset(memory_pool_t* pool);
+size_t memory_pool_footprint(const memory_pool_t* pool);
+
+// Memory accounting categories
+typedef enum {
+    MERKLE_MEM_POOL = 0,             // memory_pool_t chunks
+    MERKLE_MEM_LEVELS,               // Tree level storage (tree, leaf copy, level indices)
+    MERKLE_MEM_PROOF,                // Proof structures and sibling arrays
+    MERKLE_MEM_METRICS,              // Latency counters and histograms
+    MERKLE_MEM_NUM_CATEGORIES
+} merkle_mem_category_t;
+
+// Live/peak byte counters. Per-thread values are signed because memory
+// allocated on one thread may be released on another.
+typedef struct {
+    int64_t live_bytes[MERKLE_MEM_NUM_CATEGORIES];
+    int64_t peak_bytes[MERKLE_MEM_NUM_CATEGORIES];
+    int64_t total_live_bytes;
+    int64_t total_peak_bytes;
+} merkle_memory_stats_t;
+
+// Accounting is sharded per thread: charging only touches the calling
+// thread's counters. Global stats sum the shards; the global peak is
+// sampled when the stats are read, per-thread and per-tree peaks are exact.
+void merkle_memory_account_alloc(merkle_mem_category_t category, size_t bytes);
+void merkle_memory_account_free(merkle_mem_category_t category, size_t bytes);
+merkle_memory_stats_t merkle_memory_get_thread_stats(void);
+merkle_memory_stats_t merkle_memory_get_global_stats(void);
+void merkle_memory_reset_peak(void);
 
-// Merkle tree functions
+// Merkle tree functions. A k-ary tree (k = 2, 4, 8 or 16) needs a power
+// of k leaves; each internal node hashes its k child digests in one call.
 merkle_tree_t* merkle_tree_create(uint64_t num_leaves, hash_type_t hash_type);
+merkle_tree_t* merkle_tree_create_kary(uint64_t num_leaves, hash_type_t hash_type, uint8_t arity);
 void merkle_tree_destroy(merkle_tree_t* tree);
 merkle_error_t merkle_tree_build(merkle_tree_t* tree, const uint8_t* data, size_t data_size);
 merkle_error_t merkle_tree_update_leaf(merkle_tree_t* tree, uint64_t leaf_index, const uint8_t* data);
+
+// Takes effect at the next build. Switching to hash-only also drops the
+// leaves stored now; merkle_tree_leaf then returns NULL.
+merkle_error_t merkle_tree_set_leaf_storage(merkle_tree_t* tree, merkle_leaf_storage_t storage);
+
+// Variable-size leaves. Leaf i is payload[offsets[i], offsets[i + 1]), so
+// offsets holds num_leaves + 1 non-decreasing entries; each record is
+// hashed as stored, without padding. Fixed-size trees accept records of
+// exactly leaf_data_size.
+merkle_error_t merkle_tree_build_records(merkle_tree_t* tree, const uint8_t* payload, const uint64_t* offsets);
+merkle_error_t merkle_tree_update_record(merkle_tree_t* tree, uint64_t leaf_index, const uint8_t* data, size_t size);
+const uint8_t* merkle_tree_leaf(const merkle_tree_t* tree, uint64_t leaf_index, size_t* size);
 merkle_error_t merkle_tree_get_root_hash(merkle_tree_t* tree, uint8_t* hash);
+uint64_t merkle_tree_proof_siblings(const merkle_tree_t* tree);  // depth * (arity - 1)
+void merkle_node_hash_children(const merkle_tree_t* tree, merkle_node_t* node);
+
+// Deferred updates. While on, merkle_tree_update_leaf stores the leaf and
+// marks its path dirty (node i of level d is bit heap_level_offset(d) + i).
+// The first read that needs a hash (root, proof, or an explicit flush)
+// rehashes the union of the dirty paths in one pass, so a burst of
+// overlapping updates pays for each shared node once. Turning it off flushes, as does handing
+// the tree to merkle_mvcc_create or merkle_mvcc_replace.
+merkle_error_t merkle_tree_set_deferred(merkle_tree_t* tree, bool deferred);
+merkle_error_t merkle_tree_flush(merkle_tree_t* tree);
+
+// Pruned levels. Nodes are kept only down to level depth - height; below
+// that, the tree keeps its leaf hashes packed and rehashes the bucket of
+// arity^height leaves under a stored node whenever a proof or update needs
+// it. Roots and proofs are unchanged. Set before the first build (and
+// before deferring updates); the node pool shrinks to the stored levels.
+// Pruned trees cannot be handed to MVCC, whose versions would share the
+// one array of leaf hashes.
+merkle_error_t merkle_tree_set_pruned_height(merkle_tree_t* tree, uint8_t height);
+const uint8_t* merkle_bucket_build(const merkle_tree_t* tree, uint64_t bucket, uint8_t* levels);
+void merkle_bucket_rehash(const merkle_tree_t* tree, merkle_node_t* node, uint64_t bucket);
+void merkle_bucket_siblings(const merkle_tree_t* tree, const uint8_t* levels, uint64_t leaf_index,
+                            uint8_t* siblings);
+
+// Out-of-core build. Reads the fixed-size leaves of input_path in order
+// and writes the whole tree to output_path: a header, then every digest in
+// heap order, root first. Each level is written into its place in the
+// output and read back in chunks to hash the level above, so resident
+// memory stays within memory_limit (0: MERKLE_EXTERNAL_DEFAULT_MEMORY)
+// whatever the leaf count. A tree file serves proofs with one read per level.
+merkle_error_t merkle_tree_build_external(const char* input_path, size_t leaf_size, hash_type_t hash_type,
+                                          uint8_t arity, const char* output_path, size_t memory_limit,
+                                          uint8_t* root_hash);
+merkle_tree_file_t* merkle_tree_file_open(const char* path);
+void merkle_tree_file_close(merkle_tree_file_t* file);
+uint64_t merkle_tree_file_num_leaves(const merkle_tree_file_t* file);
+merkle_error_t merkle_tree_file_proof(const merkle_tree_file_t* file, uint64_t leaf_index, merkle_proof_t* proof);
+
+// Parallel, NUMA-aware builds. A large build splits into arity^s subtrees,
+// one per worker thread; each worker builds its subtree whole into its own
+// part of the node pool, so on a multi-node host (workers pinned to the
+// nodes in turn) first touch leaves each subtree on its builder's node and
+// only the s levels above are shared. Proof-serving threads can be routed
+// to the node of a leaf with merkle_numa_bind_thread.
+merkle_error_t merkle_tree_set_build_threads(merkle_tree_t* tree, uint32_t threads);  // 0: automatic
+int merkle_tree_leaf_numa_node(const merkle_tree_t* tree, uint64_t leaf_index);       // -1: not placed
+int merkle_numa_node_count(void);
+bool merkle_numa_bind_thread(int node);
+uint64_t merkle_subtree_count(const merkle_tree_t* tree);
+merkle_error_t merkle_build_subtrees(merkle_tree_t* tree, merkle_node_t** roots, uint64_t count);
+
+// Build from a file of fixed-size leaves (num_leaves * leaf_data_size
+// bytes) without reading it into memory first: chunks are hashed as they
+// arrive while the next ones are read. Copy storage keeps the leaves;
+// borrowed and hash-only storage keep only their hashes.
+merkle_error_t merkle_tree_build_file(merkle_tree_t* tree, const char* path);
+
+// File ingestion pipeline. Reads a file front to back into a ring of
+// MERKLE_INGEST_BUFFERS aligned chunk buffers, through io_uring when async
+// is set and the kernel allows it, with pread otherwise. Each chunk handed
+// out stays valid until the next call; the reads of the chunks after it
+// are in flight meanwhile.
+merkle_ingest_t* merkle_ingest_open(const char* path, size_t chunk_bytes, bool async);
+uint64_t merkle_ingest_size(const merkle_ingest_t* ingest);
+bool merkle_ingest_async(const merkle_ingest_t* ingest);     // io_uring in use
+const uint8_t* merkle_ingest_next(merkle_ingest_t* ingest, size_t* size);
+merkle_error_t merkle_ingest_close(merkle_ingest_t* ingest);  // MERKLE_ERROR_IO if a read failed
 
 // Proof generation and verification
 merkle_proof_t* merkle_proof_create(merkle_tree_t* tree, uint64_t leaf_index);
 void merkle_proof_destroy(merkle_proof_t* proof);
+void merkle_proof_clear(merkle_proof_t* proof);
 merkle_error_t merkle_proof_serialize(merkle_proof_t* proof, uint8_t* buffer, size_t buffer_size);
 merkle_error_t merkle_proof_deserialize(const uint8_t* buffer, size_t buffer_size, merkle_proof_t* proof);
 
 // Verification functions
-bool merkle_proof_verify(merkle_proof_t* proof, const uint8_t* leaf_data);
+bool merkle_proof_verify(merkle_proof_t* proof, const uint8_t* leaf_data);  // 32-byte leaf
+bool merkle_proof_verify_record(merkle_proof_t* proof, uint64_t num_leaves, const uint8_t* data, size_t size);
 bool merkle_proof_verify_batch(merkle_proof_t** proofs, const uint8_t** leaf_data, size_t num_proofs);
 
+// Versioned trees (MVCC). An update copies the leaf-to-root path it changes
+// and publishes the new root with one atomic store, so readers never wait:
+// they pin a snapshot, walk it without locks and unpin. Replaced nodes are
+// reclaimed by epoch once no pinned reader can still reach them. Writers
+// serialize among themselves; the wrapped tree's own root is not updated.
+typedef struct merkle_mvcc merkle_mvcc_t;
+
+typedef struct {
+    const merkle_node_t* root;           // Root of this version
+    merkle_tree_t* tree;                 // Shape, hash and timing; not its root
+    uint64_t version;                    // 1 for the initial build, +1 per update
+    uint32_t slot;                       // Reader slot holding the pin
+} merkle_snapshot_t;
+
+merkle_mvcc_t* merkle_mvcc_create(merkle_tree_t* tree);  // Takes ownership of a built tree
+void merkle_mvcc_destroy(merkle_mvcc_t* mvcc);           // No snapshot may be pinned
+void merkle_mvcc_pin(merkle_mvcc_t* mvcc, merkle_snapshot_t* snapshot);
+void merkle_mvcc_unpin(merkle_mvcc_t* mvcc, merkle_snapshot_t* snapshot);
+uint64_t merkle_mvcc_version(merkle_mvcc_t* mvcc);
+merkle_error_t merkle_mvcc_update_leaf(merkle_mvcc_t* mvcc, uint64_t leaf_index, const uint8_t* data);
+merkle_error_t merkle_mvcc_update_record(merkle_mvcc_t* mvcc, uint64_t leaf_index, const uint8_t* data,
+                                         size_t size);
+merkle_error_t merkle_mvcc_replace(merkle_mvcc_t* mvcc, merkle_tree_t* tree);  // Publish a rebuilt tree
+
+// Proofs against a pinned snapshot. The check compares the proof's root and
+// leaf hash with the snapshot and folds its path, without the leaf data.
+merkle_proof_t* merkle_snapshot_proof_create(const merkle_snapshot_t* snapshot, uint64_t leaf_index);
+bool merkle_snapshot_proof_check(const merkle_snapshot_t* snapshot, const merkle_proof_t* proof);
+
+// Serialized proofs without an intermediate merkle_proof_t. The serialized
+// hash_type word carries the hash type in its low byte and log2(arity) - 1
+// in the next, so binary proofs read the same as before k-ary trees. The
+// batch writer visits leaf_indices[order[k]] for k in [0, count) (order
+// NULL: in place) and writes each proof to its slot, out + order[k] *
+// serialized_size. It walks a few paths at once, prefetching each one's
+// next level, so random batches overlap their cache misses; in ascending
+// leaf order neighbours also share the hot top of their paths.
+size_t merkle_proof_serialized_size(uint64_t num_siblings);
+merkle_error_t merkle_snapshot_serialize_proofs(const merkle_snapshot_t* snapshot, const uint64_t* leaf_indices,
+                                                const uint64_t* order, uint64_t count, uint8_t* out);
+merkle_error_t merkle_snapshot_check_serialized(const merkle_snapshot_t* snapshot, const uint8_t* data, size_t size,
+                                                uint64_t* leaf_index, size_t* consumed, bool* valid);
+
+// Bulk export: the serialized proof of every leaf (or of a contiguous
+// range), in leaf order, from one pass over the tree and one staging
+// buffer. The writer receives whole proofs, a chunk at a time, and can
+// fail the export with its own error; a buffer writer is filled in place
+// and fails up front with MERKLE_ERROR_INVALID_SIZE if the proofs do not fit.
+typedef merkle_error_t (*merkle_proof_write_t)(void* context, const uint8_t* data, size_t size);
+
+typedef struct {
+    merkle_proof_write_t write;
+    void* context;
+} merkle_proof_writer_t;
+
+typedef struct {
+    uint8_t* data;
+    size_t capacity;
+    size_t used;                         // Advanced past each export
+} merkle_proof_buffer_t;
+
+merkle_proof_writer_t merkle_proof_writer_fd(int fd);  // MERKLE_ERROR_IO on a failed write
+merkle_proof_writer_t merkle_proof_writer_buffer(merkle_proof_buffer_t* buffer);
+merkle_error_t merkle_tree_export_proofs(merkle_tree_t* tree, uint64_t first_leaf, uint64_t count,
+                                         const merkle_proof_writer_t* writer);
+merkle_error_t merkle_tree_export_all_proofs(merkle_tree_t* tree, const merkle_proof_writer_t* writer);
+
+// Hot top-of-tree digests. Build and update keep them in step with the
+// tree (the MVCC writer with each new version); proof walks read the top
+// of the path from them when they describe the root being walked. Build
+// and destroy return the bytes they added to or released from the tree.
+size_t merkle_hot_build(merkle_tree_t* tree);
+size_t merkle_hot_destroy(merkle_tree_t* tree);
+void merkle_hot_update_path(merkle_tree_t* tree, const merkle_node_t* old_root, uint64_t leaf_index,
+                            merkle_node_t* const* path);
+void merkle_hot_refresh(merkle_tree_t* tree, const uint64_t* dirty);  // Nodes marked in a heap-order bitmap
+uint8_t merkle_hot_depth(const merkle_tree_t* tree);
+// Cap the hot array at `levels` binary levels (MERKLE_HOT_DEPTH, the
+// default, at most; 0 turns it off). A built tree rebuilds its array at
+// the new depth. Not while updates are deferred.
+merkle_error_t merkle_tree_set_hot_depth(merkle_tree_t* tree, uint8_t levels);
+uint8_t merkle_hot_read_path(const merkle_tree_t* tree, const merkle_node_t* root, uint64_t leaf_index,
+                             uint8_t* siblings, const merkle_node_t** node);
+
+// Leaf storage internals. merkle_hash_leaves hashes every stored leaf into
+// its node (or, with leaves NULL, packed into hashes), spreading large
+// inputs over threads in ranges of equal bytes.
+merkle_error_t merkle_tree_store_leaf(merkle_tree_t* tree, uint64_t leaf_index, const uint8_t* data, size_t size);
+void merkle_hash_leaves(const merkle_tree_t* tree, merkle_node_t* const* leaves, uint8_t* hashes);
+
 // Utility functions
 uint8_t calculate_tree_depth(uint64_t num_leaves);
 bool is_power_of_two(uint64_t num);
 merkle_error_t validate_tree_parameters(uint64_t num_leaves, hash_type_t hash_type);
+merkle_error_t validate_kary_parameters(uint64_t num_leaves, hash_type_t hash_type, uint8_t arity);
+uint64_t heap_level_offset(uint8_t arity_log2, uint8_t level);  // Nodes above `level`: (k^level - 1) / (k - 1)
 
 // Performance monitoring
 typedef struct {
-    uint64_t construction_time_ns;
-    uint64_t proof_generation_time_ns;
-    uint64_t verification_time_ns;
+    uint64_t construction_time_ns;       // Mean build latency for this tree
+    uint64_t proof_generation_time_ns;   // Mean proof latency for this tree
+    uint64_t verification_time_ns;       // Mean verify latency (process-wide, proofs carry no tree)
     size_t peak_memory_usage;
     uint64_t cache_misses;
     uint64_t cache_hits;
 } merkle_performance_metrics_t;
 
+// Instrumented operations
+typedef enum {
+    MERKLE_OP_BUILD = 0,
+    MERKLE_OP_PROOF,
+    MERKLE_OP_VERIFY,
+    MERKLE_NUM_OPS
+} merkle_op_t;
+
+// Latency summary; percentiles are histogram bucket upper bounds (<= 12.5% error)
+typedef struct {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+} merkle_latency_stats_t;
+
+// Hardware counters (Linux perf_event_open, user space only). Collection is
+// off until merkle_hw_counters_enable(true); build and proof then record the
+// counters of the calling thread next to their latencies.
+typedef enum {
+    MERKLE_HW_CYCLES = 0,
+    MERKLE_HW_INSTRUCTIONS,
+    MERKLE_HW_LLC_REFERENCES,
+    MERKLE_HW_LLC_MISSES,
+    MERKLE_HW_NUM_COUNTERS
+} merkle_hw_counter_t;
+
+typedef struct {
+    uint64_t values[MERKLE_HW_NUM_COUNTERS];
+    uint64_t time_enabled;
+    uint64_t time_running;
+    uint32_t valid_mask;                      // Bit per counter the PMU supplied
+} merkle_hw_sample_t;
+
+// Totals over `samples` measured operations
+typedef struct {
+    uint64_t samples;
+    uint64_t values[MERKLE_HW_NUM_COUNTERS];
+    uint32_t valid_mask;
+} merkle_hw_stats_t;
+
+// Returns whether counters could be opened on the calling thread. Needs
+// MERKLE_ENABLE_TIMING and perf_event_paranoid <= 2; false elsewhere.
+bool merkle_hw_counters_enable(bool enable);
+bool merkle_hw_counters_enabled(void);
+bool merkle_hw_counters_read(merkle_hw_sample_t* sample);
+bool merkle_hw_counters_delta(const merkle_hw_sample_t* start, const merkle_hw_sample_t* end,
+                              merkle_hw_sample_t* delta);
+
 void merkle_performance_reset(merkle_tree_t* tree);
 merkle_performance_metrics_t merkle_performance_get_metrics(merkle_tree_t* tree);
 
+// Latency for one operation; a NULL tree returns the process-wide counters
+merkle_latency_stats_t merkle_performance_get_latency(merkle_tree_t* tree, merkle_op_t op);
+
+// Hardware counter totals for one operation; a NULL tree returns the
+// process-wide totals
+merkle_hw_stats_t merkle_performance_get_hw_counters(merkle_tree_t* tree, merkle_op_t op);
+
+// Timing internals. Building with -DMERKLE_ENABLE_TIMING records build, proof
+// and verify latencies into per-tree and process-wide counters sharded per
+// thread; without it the hooks compile to nothing.
+merkle_timing_t* merkle_timing_create(void);
+void merkle_timing_destroy(merkle_timing_t* timing);
+uint64_t merkle_timing_now_ns(void);
+void merkle_timing_record(merkle_tree_t* tree, merkle_op_t op, uint64_t elapsed_ns);
+void merkle_hw_record(merkle_tree_t* tree, merkle_op_t op, const merkle_hw_sample_t* start);
+
+#ifdef MERKLE_ENABLE_TIMING
+#define MERKLE_TIMING_START(var) uint64_t var = merkle_timing_now_ns()
+#define MERKLE_TIMING_RECORD(tree, op, var) \
+    merkle_timing_record((tree), (op), merkle_timing_now_ns() - (var))
+#define MERKLE_HW_START(var) \
+    merkle_hw_sample_t var; \
+    bool var##_valid = merkle_hw_counters_read(&var)
+#define MERKLE_HW_RECORD(tree, op, var) \
+    do { if (var##_valid) merkle_hw_record((tree), (op), &var); } while (0)
+#else
+#define MERKLE_TIMING_START(var) do {} while (0)
+#define MERKLE_TIMING_RECORD(tree, op, var) do {} while (0)
+#define MERKLE_HW_START(var) do {} while (0)
+#define MERKLE_HW_RECORD(tree, op, var) do {} while (0)
+#endif
+
 #endif // MERKLE_TREE_H
 
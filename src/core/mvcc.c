@@ -0,0 +1,352 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "merkle_tree.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+#define MVCC_READER_SLOTS 128
+#define MVCC_PATH_POOL_PATHS 64          // Path copies per path-pool chunk
+
+// One published version. Readers only look at root/tree/version; the rest
+// is writer bookkeeping, touched after the version is unpublished.
+typedef struct mvcc_version {
+    merkle_node_t* root;
+    merkle_tree_t* tree;
+    uint64_t version;
+    uint64_t generation;                 // Bumped by every whole-tree replace
+    uint64_t retire_epoch;
+    merkle_tree_t* dead_tree;            // Tree (and path pool) a replace made unreachable
+    memory_pool_t* dead_pool;
+    uint32_t num_obsolete;
+    merkle_node_t* obsolete[MAX_TREE_DEPTH + 1];  // Path the next version copied
+    struct mvcc_version* next_retired;
+} mvcc_version_t;
+
+// A reader announces the epoch it entered in; 0 marks a free slot
+typedef struct {
+    _Alignas(64) _Atomic uint64_t epoch;
+} mvcc_reader_slot_t;
+
+struct merkle_mvcc {
+    _Atomic(mvcc_version_t*) current;
+    _Atomic uint64_t global_epoch;
+    mvcc_reader_slot_t readers[MVCC_READER_SLOTS];
+    
+    // Writer state, guarded by writer_lock
+    pthread_mutex_t writer_lock;
+    uint64_t generation;
+    memory_pool_t* path_pool;            // Path copies for the current generation
+    merkle_node_t* free_nodes;           // Reclaimed nodes, linked through children[0]
+    mvcc_version_t* retired_head;        // Oldest first
+    mvcc_version_t* retired_tail;
+};
+
+static _Atomic uint32_t g_mvcc_next_slot = 0;
+static _Thread_local int t_mvcc_slot = -1;
+
+static mvcc_version_t* mvcc_version_alloc(void) {
+    mvcc_version_t* version = (mvcc_version_t*)calloc(1, sizeof(mvcc_version_t));
+    if (version) {
+        merkle_memory_account_alloc(MERKLE_MEM_LEVELS, sizeof(mvcc_version_t));
+    }
+    return version;
+}
+
+static void mvcc_version_free(mvcc_version_t* version) {
+    free(version);
+    merkle_memory_account_free(MERKLE_MEM_LEVELS, sizeof(mvcc_version_t));
+}
+
+// Every node of a generation has its tree's node_size, so recycled nodes
+// fit any path copy of the same generation
+static merkle_node_t* mvcc_node_alloc(merkle_mvcc_t* mvcc, const merkle_tree_t* tree) {
+    merkle_node_t* node = mvcc->free_nodes;
+    if (node) {
+        mvcc->free_nodes = node->children[0];
+        return node;
+    }
+    
+    if (!mvcc->path_pool) {
+        mvcc->path_pool = memory_pool_create((size_t)MVCC_PATH_POOL_PATHS * (tree->depth + 1) * tree->node_size);
+        if (!mvcc->path_pool) {
+            return NULL;
+        }
+    }
+    return (merkle_node_t*)memory_pool_alloc(mvcc->path_pool, tree->node_size);
+}
+
+static void mvcc_node_recycle(merkle_mvcc_t* mvcc, merkle_node_t* node) {
+    node->children[0] = mvcc->free_nodes;
+    mvcc->free_nodes = node;
+}
+
+// Free what a retired version kept alive. Obsolete nodes of an older
+// generation belong to a tree that is going away and are simply dropped.
+static void mvcc_version_release(merkle_mvcc_t* mvcc, mvcc_version_t* version) {
+    if (version->generation == mvcc->generation) {
+        for (uint32_t i = 0; i < version->num_obsolete; i++) {
+            mvcc_node_recycle(mvcc, version->obsolete[i]);
+        }
+    }
+    if (version->dead_tree) {
+        merkle_tree_destroy(version->dead_tree);
+        memory_pool_destroy(version->dead_pool);
+    }
+    mvcc_version_free(version);
+}
+
+// Tag an unpublished version with the epoch it left in and open the next
+// epoch; readers that enter from now on can no longer reach it
+static void mvcc_retire(merkle_mvcc_t* mvcc, mvcc_version_t* version) {
+    version->retire_epoch = atomic_fetch_add_explicit(&mvcc->global_epoch, 1, memory_order_seq_cst);
+    version->next_retired = NULL;
+    
+    if (mvcc->retired_tail) {
+        mvcc->retired_tail->next_retired = version;
+    } else {
+        mvcc->retired_head = version;
+    }
+    mvcc->retired_tail = version;
+}
+
+// Release every retired version older than the oldest pinned reader
+static void mvcc_reclaim(merkle_mvcc_t* mvcc) {
+    uint64_t oldest = atomic_load_explicit(&mvcc->global_epoch, memory_order_seq_cst);
+    for (int i = 0; i < MVCC_READER_SLOTS; i++) {
+        uint64_t epoch = atomic_load_explicit(&mvcc->readers[i].epoch, memory_order_seq_cst);
+        if (epoch != 0 && epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+    
+    while (mvcc->retired_head && mvcc->retired_head->retire_epoch < oldest) {
+        mvcc_version_t* version = mvcc->retired_head;
+        mvcc->retired_head = version->next_retired;
+        mvcc_version_release(mvcc, version);
+    }
+    if (!mvcc->retired_head) {
+        mvcc->retired_tail = NULL;
+    }
+}
+
+merkle_mvcc_t* merkle_mvcc_create(merkle_tree_t* tree) {
+    if (!tree || !tree->root || tree->pruned_height > 0 || merkle_tree_set_deferred(tree, false) != MERKLE_SUCCESS) {
+        return NULL;
+    }
+    
+    merkle_mvcc_t* mvcc = (merkle_mvcc_t*)calloc(1, sizeof(merkle_mvcc_t));
+    if (!mvcc) {
+        return NULL;
+    }
+    
+    mvcc_version_t* version = mvcc_version_alloc();
+    if (!version || pthread_mutex_init(&mvcc->writer_lock, NULL) != 0) {
+        if (version) mvcc_version_free(version);
+        free(mvcc);
+        return NULL;
+    }
+    
+    version->root = tree->root;
+    version->tree = tree;
+    version->version = 1;
+    
+    atomic_init(&mvcc->current, version);
+    atomic_init(&mvcc->global_epoch, 1);
+    for (int i = 0; i < MVCC_READER_SLOTS; i++) {
+        atomic_init(&mvcc->readers[i].epoch, 0);
+    }
+    
+    merkle_memory_account_alloc(MERKLE_MEM_LEVELS, sizeof(merkle_mvcc_t));
+    return mvcc;
+}
+
+void merkle_mvcc_destroy(merkle_mvcc_t* mvcc) {
+    if (!mvcc) return;
+    
+    // No reader is pinned, so everything retired can go, oldest first
+    while (mvcc->retired_head) {
+        mvcc_version_t* version = mvcc->retired_head;
+        mvcc->retired_head = version->next_retired;
+        mvcc_version_release(mvcc, version);
+    }
+    
+    mvcc_version_t* current = atomic_load_explicit(&mvcc->current, memory_order_relaxed);
+    merkle_tree_destroy(current->tree);
+    memory_pool_destroy(mvcc->path_pool);
+    mvcc_version_free(current);
+    
+    pthread_mutex_destroy(&mvcc->writer_lock);
+    free(mvcc);
+    merkle_memory_account_free(MERKLE_MEM_LEVELS, sizeof(merkle_mvcc_t));
+}
+
+void merkle_mvcc_pin(merkle_mvcc_t* mvcc, merkle_snapshot_t* snapshot) {
+    if (t_mvcc_slot < 0) {
+        t_mvcc_slot = (int)(atomic_fetch_add_explicit(&g_mvcc_next_slot, 1, memory_order_relaxed) % MVCC_READER_SLOTS);
+    }
+    
+    // Claim a free slot, starting at this thread's own so pins rarely collide
+    uint32_t slot = (uint32_t)t_mvcc_slot;
+    for (;;) {
+        uint64_t expected = 0;
+        uint64_t epoch = atomic_load_explicit(&mvcc->global_epoch, memory_order_seq_cst);
+        if (atomic_compare_exchange_strong_explicit(&mvcc->readers[slot].epoch, &expected, epoch,
+                                                    memory_order_seq_cst, memory_order_relaxed)) {
+            break;
+        }
+        slot = (slot + 1) % MVCC_READER_SLOTS;
+        if (slot == (uint32_t)t_mvcc_slot) {
+            sched_yield();  // Every slot busy: more pinned readers than slots
+        }
+    }
+    
+    // Loaded after the announcement, so the writer sees us before freeing it
+    mvcc_version_t* version = atomic_load_explicit(&mvcc->current, memory_order_seq_cst);
+    snapshot->root = version->root;
+    snapshot->tree = version->tree;
+    snapshot->version = version->version;
+    snapshot->slot = slot;
+}
+
+void merkle_mvcc_unpin(merkle_mvcc_t* mvcc, merkle_snapshot_t* snapshot) {
+    atomic_store_explicit(&mvcc->readers[snapshot->slot].epoch, 0, memory_order_release);
+    snapshot->root = NULL;
+}
+
+uint64_t merkle_mvcc_version(merkle_mvcc_t* mvcc) {
+    if (!mvcc) return 0;
+    
+    // Pinned so the version cannot be reclaimed under the read
+    merkle_snapshot_t snapshot;
+    merkle_mvcc_pin(mvcc, &snapshot);
+    uint64_t version = snapshot.version;
+    merkle_mvcc_unpin(mvcc, &snapshot);
+    return version;
+}
+
+// leaf_sized: data is one leaf of the current tree's leaf_data_size, read
+// under the writer lock since a replace may change it
+static merkle_error_t mvcc_update(merkle_mvcc_t* mvcc, uint64_t leaf_index, const uint8_t* data, size_t size,
+                                  bool leaf_sized) {
+    if (!mvcc || !data) {
+        return MERKLE_ERROR_INVALID_TREE;
+    }
+    
+    pthread_mutex_lock(&mvcc->writer_lock);
+    
+    mvcc_version_t* current = atomic_load_explicit(&mvcc->current, memory_order_relaxed);
+    merkle_tree_t* tree = current->tree;
+    if (leaf_sized) {
+        size = tree->leaf_data_size;
+    }
+    if (leaf_index >= tree->num_leaves) {
+        pthread_mutex_unlock(&mvcc->writer_lock);
+        return MERKLE_ERROR_LEAF_OUT_OF_BOUNDS;
+    }
+    
+    // Old path from the root down to the leaf, MSB of the index first
+    merkle_node_t* path[MAX_TREE_DEPTH + 1];
+    uint8_t child[MAX_TREE_DEPTH];
+    path[0] = current->root;
+    for (uint8_t level = 0; level < tree->depth; level++) {
+        child[level] = (leaf_index >> (tree->arity_log2 * (tree->depth - level - 1))) & (tree->arity - 1);
+        path[level + 1] = path[level]->children[child[level]];
+    }
+    
+    merkle_node_t* copies[MAX_TREE_DEPTH + 1];
+    mvcc_version_t* next = mvcc_version_alloc();
+    int allocated = 0;
+    for (; next && allocated <= tree->depth; allocated++) {
+        copies[allocated] = mvcc_node_alloc(mvcc, tree);
+        if (!copies[allocated]) break;
+    }
+    
+    // Readers never look at the stored leaves, so the writer keeps them current
+    merkle_error_t err = !next || allocated <= tree->depth ? MERKLE_ERROR_MEMORY_ALLOCATION : MERKLE_SUCCESS;
+    if (err == MERKLE_SUCCESS) {
+        err = merkle_tree_store_leaf(tree, leaf_index, data, size);
+    }
+    if (err != MERKLE_SUCCESS) {
+        while (allocated > 0) {
+            mvcc_node_recycle(mvcc, copies[--allocated]);
+        }
+        if (next) mvcc_version_free(next);
+        pthread_mutex_unlock(&mvcc->writer_lock);
+        return err;
+    }
+    
+    // Copy the path bottom-up; everything off the path stays shared
+    memcpy(copies[tree->depth], path[tree->depth], tree->node_size);
+    tree->hash_function(data, size, copies[tree->depth]->hash);
+    
+    for (int level = tree->depth - 1; level >= 0; level--) {
+        merkle_node_t* node = copies[level];
+        memcpy(node, path[level], tree->node_size);
+        node->children[child[level]] = copies[level + 1];
+        copies[level + 1]->parent = node;
+        merkle_node_hash_children(tree, node);
+    }
+    copies[0]->parent = NULL;
+    merkle_hot_update_path(tree, current->root, leaf_index, copies);
+    
+    next->root = copies[0];
+    next->tree = tree;
+    next->version = current->version + 1;
+    next->generation = mvcc->generation;
+    atomic_store_explicit(&mvcc->current, next, memory_order_seq_cst);
+    
+    // The old path dies with the last reader of the old version
+    memcpy(current->obsolete, path, (size_t)(tree->depth + 1) * sizeof(merkle_node_t*));
+    current->num_obsolete = tree->depth + 1u;
+    mvcc_retire(mvcc, current);
+    mvcc_reclaim(mvcc);
+    
+    pthread_mutex_unlock(&mvcc->writer_lock);
+    return MERKLE_SUCCESS;
+}
+
+merkle_error_t merkle_mvcc_update_leaf(merkle_mvcc_t* mvcc, uint64_t leaf_index, const uint8_t* data) {
+    return mvcc_update(mvcc, leaf_index, data, 0, true);
+}
+
+merkle_error_t merkle_mvcc_update_record(merkle_mvcc_t* mvcc, uint64_t leaf_index, const uint8_t* data,
+                                         size_t size) {
+    return mvcc_update(mvcc, leaf_index, data, size, false);
+}
+
+merkle_error_t merkle_mvcc_replace(merkle_mvcc_t* mvcc, merkle_tree_t* tree) {
+    if (!mvcc || !tree || !tree->root || tree->pruned_height > 0 ||
+        merkle_tree_set_deferred(tree, false) != MERKLE_SUCCESS) {
+        return MERKLE_ERROR_INVALID_TREE;
+    }
+    
+    mvcc_version_t* next = mvcc_version_alloc();
+    if (!next) {
+        return MERKLE_ERROR_MEMORY_ALLOCATION;
+    }
+    
+    pthread_mutex_lock(&mvcc->writer_lock);
+    
+    mvcc_version_t* current = atomic_load_explicit(&mvcc->current, memory_order_relaxed);
+    
+    next->root = tree->root;
+    next->tree = tree;
+    next->version = current->version + 1;
+    next->generation = ++mvcc->generation;
+    atomic_store_explicit(&mvcc->current, next, memory_order_seq_cst);
+    
+    // The whole old generation goes with the last version that used it;
+    // nodes recycled so far belong to it too
+    current->dead_tree = current->tree;
+    current->dead_pool = mvcc->path_pool;
+    mvcc->path_pool = NULL;
+    mvcc->free_nodes = NULL;
+    mvcc_retire(mvcc, current);
+    mvcc_reclaim(mvcc);
+    
+    pthread_mutex_unlock(&mvcc->writer_lock);
+    return MERKLE_SUCCESS;
+}
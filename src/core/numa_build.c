@@ -0,0 +1,227 @@
+#define _GNU_SOURCE
+
+#include "merkle_tree.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#define SUBTREE_MIN_BYTES (4u << 20)   // Leaf bytes below which a worker thread does not pay off
+#define NUMA_MAX_NODES 64
+
+// Parallel subtree builds. The leaves split into k^s equal subtrees, each
+// built whole (leaf hashes, links and internal hashes) by one worker into
+// its own slab of the node pool; the caller then links the s levels above
+// the subtree roots. On a multi-node host workers are pinned to the nodes
+// in order, and since the pool is not touched before the workers write
+// their slabs, first touch places every subtree on the node that built it.
+// Only the few levels above the subtree roots are shared across nodes.
+
+typedef struct {
+    int count;
+    cpu_set_t cpus[NUMA_MAX_NODES];
+} numa_topology_t;
+
+static numa_topology_t g_topology;
+static pthread_once_t g_topology_once = PTHREAD_ONCE_INIT;
+
+// Parse a sysfs cpulist such as "0-15,32-47"
+static bool numa_parse_cpulist(const char* list, cpu_set_t* set) {
+    CPU_ZERO(set);
+    bool any = false;
+    while (*list && *list != '\n') {
+        char* end = NULL;
+        long first = strtol(list, &end, 10);
+        long last = first;
+        if (end == list) {
+            return false;
+        }
+        if (*end == '-') {
+            list = end + 1;
+            last = strtol(list, &end, 10);
+        }
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+            CPU_SET((int)cpu, set);
+            any = true;
+        }
+        list = *end == ',' ? end + 1 : end;
+    }
+    return any;
+}
+
+// Nodes that have CPUs, numbered densely in sysfs order
+static void numa_topology_load(void) {
+    for (int node = 0; node < NUMA_MAX_NODES && g_topology.count < NUMA_MAX_NODES; node++) {
+        char path[64];
+        char list[4096];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        FILE* file = fopen(path, "r");
+        if (!file) {
+            continue;
+        }
+        bool parsed = fgets(list, sizeof(list), file) && numa_parse_cpulist(list, &g_topology.cpus[g_topology.count]);
+        fclose(file);
+        if (parsed) {
+            g_topology.count++;
+        }
+    }
+}
+
+int merkle_numa_node_count(void) {
+    pthread_once(&g_topology_once, numa_topology_load);
+    return g_topology.count > 0 ? g_topology.count : 1;
+}
+
+// Pin the calling thread to the CPUs of one node (as numbered by
+// merkle_tree_leaf_numa_node), e.g. a proof-serving thread for the
+// subtrees that node owns
+bool merkle_numa_bind_thread(int node) {
+    pthread_once(&g_topology_once, numa_topology_load);
+    if (node < 0 || node >= g_topology.count) {
+        return false;
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &g_topology.cpus[node]) == 0;
+}
+
+// Node whose memory holds the subtree of leaf_index, or -1 when the tree
+// was not built across nodes
+int merkle_tree_leaf_numa_node(const merkle_tree_t* tree, uint64_t leaf_index) {
+    if (!tree || !tree->root || tree->subtree_bits == 0 || leaf_index >= tree->num_leaves) {
+        return -1;
+    }
+    return tree->subtree_numa[leaf_index >> (tree->arity_log2 * tree->depth - tree->subtree_bits)];
+}
+
+merkle_error_t merkle_tree_set_build_threads(merkle_tree_t* tree, uint32_t threads) {
+    if (!tree) {
+        return MERKLE_ERROR_INVALID_TREE;
+    }
+    if (threads > MERKLE_MAX_BUILD_THREADS) {
+        return MERKLE_ERROR_INVALID_SIZE;
+    }
+    tree->build_threads = threads;
+    return MERKLE_SUCCESS;
+}
+
+// Subtrees the next build splits into: the largest power of the arity
+// within the thread budget (and, unless the budget was set explicitly,
+// with at least SUBTREE_MIN_BYTES of leaves each). 1 means a serial build.
+uint64_t merkle_subtree_count(const merkle_tree_t* tree) {
+    uint64_t threads = tree->build_threads;
+    if (threads == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        uint64_t total = tree->records ? tree->leaf_data_used : tree->num_leaves * tree->leaf_data_size;
+        threads = online > 0 ? (uint64_t)online : 1;
+        if (threads > total / SUBTREE_MIN_BYTES) threads = total / SUBTREE_MIN_BYTES;
+        if (threads > MERKLE_MAX_BUILD_THREADS) threads = MERKLE_MAX_BUILD_THREADS;
+    }
+    
+    uint64_t count = 1;
+    for (uint8_t level = 0; level < tree->depth && count * tree->arity <= threads; level++) {
+        count *= tree->arity;
+    }
+    return count;
+}
+
+typedef struct {
+    merkle_tree_t* tree;
+    uint64_t index;
+    uint8_t height;                  // Levels below the subtree root
+    uint8_t* slab;                   // Its nodes, bottom level first
+    int numa_node;                   // -1: not pinned
+    merkle_node_t* root;
+} subtree_job_t;
+
+static void subtree_build(subtree_job_t* job) {
+    const merkle_tree_t* tree = job->tree;
+    size_t node_size = tree->node_size;
+    uint64_t width = (uint64_t)1 << (tree->arity_log2 * job->height);
+    uint64_t first_leaf = job->index * width;
+    
+    uint8_t* below = job->slab;
+    for (uint64_t i = 0; i < width; i++) {
+        merkle_node_t* leaf = (merkle_node_t*)(below + i * node_size);
+        memset(leaf, 0, node_size);
+        leaf->is_leaf = true;
+        leaf->leaf_index = first_leaf + i;
+        leaf->depth = tree->depth;
+        size_t size = 0;
+        const uint8_t* data = merkle_tree_leaf(tree, first_leaf + i, &size);
+        tree->hash_function(data, size, leaf->hash);
+    }
+    
+    for (uint8_t height = 1; height <= job->height; height++) {
+        uint8_t* level = below + width * node_size;
+        width >>= tree->arity_log2;
+        for (uint64_t i = 0; i < width; i++) {
+            merkle_node_t* parent = (merkle_node_t*)(level + i * node_size);
+            memset(parent, 0, node_size);
+            for (uint8_t c = 0; c < tree->arity; c++) {
+                parent->children[c] = (merkle_node_t*)(below + (i * tree->arity + c) * node_size);
+                parent->children[c]->parent = parent;
+            }
+            parent->depth = tree->depth - height;
+            merkle_node_hash_children(tree, parent);
+        }
+        below = level;
+    }
+    job->root = (merkle_node_t*)below;
+}
+
+static void* subtree_worker(void* arg) {
+    subtree_job_t* job = (subtree_job_t*)arg;
+    if (job->numa_node >= 0) {
+        merkle_numa_bind_thread(job->numa_node);
+    }
+    subtree_build(job);
+    return NULL;
+}
+
+// Build `count` subtrees (from merkle_subtree_count) on worker threads and
+// hand back their roots. The caller only waits, so its own affinity is
+// left alone; a worker that cannot start is built inline, unpinned.
+merkle_error_t merkle_build_subtrees(merkle_tree_t* tree, merkle_node_t** roots, uint64_t count) {
+    uint8_t top = (uint8_t)(__builtin_ctzll(count) / tree->arity_log2);
+    uint8_t height = tree->depth - top;
+    size_t slab_bytes = heap_level_offset(tree->arity_log2, height + 1) * tree->node_size;
+    uint8_t* slabs = (uint8_t*)memory_pool_alloc(tree->node_pool, count * slab_bytes);
+    subtree_job_t* jobs = (subtree_job_t*)calloc(count, sizeof(subtree_job_t));
+    pthread_t* workers = (pthread_t*)calloc(count, sizeof(pthread_t));
+    bool* started = (bool*)calloc(count, sizeof(bool));
+    if (!slabs || !jobs || !workers || !started) {
+        free(jobs);
+        free(workers);
+        free(started);
+        return MERKLE_ERROR_MEMORY_ALLOCATION;
+    }
+    
+    int nodes = merkle_numa_node_count();
+    for (uint64_t t = 0; t < count; t++) {
+        int node = nodes > 1 ? (int)(t * (uint64_t)nodes / count) : -1;
+        jobs[t] = (subtree_job_t){tree, t, height, slabs + t * slab_bytes, node, NULL};
+        tree->subtree_numa[t] = (int8_t)node;
+    }
+    tree->subtree_bits = nodes > 1 ? (uint8_t)(top * tree->arity_log2) : 0;
+    
+    for (uint64_t t = 0; t < count; t++) {
+        started[t] = pthread_create(&workers[t], NULL, subtree_worker, &jobs[t]) == 0;
+        if (!started[t]) {
+            subtree_build(&jobs[t]);
+        }
+    }
+    for (uint64_t t = 0; t < count; t++) {
+        if (started[t]) {
+            pthread_join(workers[t], NULL);
+        }
+    }
+    
+    for (uint64_t t = 0; t < count; t++) {
+        roots[t] = jobs[t].root;
+    }
+    free(jobs);
+    free(workers);
+    free(started);
+    return MERKLE_SUCCESS;
+}
@@ -0,0 +1,360 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "merkle_tree.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+
+// Timing shards per counter set. Threads map onto shards by a per-thread
+// slot; more threads than shards share a shard through atomic adds.
+#define MERKLE_TIMING_SHARDS 64
+
+// Log-linear histogram: 8 sub-buckets per power of two (12.5% resolution)
+#define TIMING_SUB_BITS 3
+#define TIMING_SUB_COUNT (1u << TIMING_SUB_BITS)
+#define TIMING_BUCKETS ((64 - TIMING_SUB_BITS + 1) * TIMING_SUB_COUNT)
+
+typedef struct {
+    _Atomic uint64_t count;
+    _Atomic uint64_t total_ns;
+    _Atomic uint64_t min_ns_plus_one;    // 0 means no samples yet
+    _Atomic uint64_t max_ns;
+    _Atomic uint64_t buckets[TIMING_BUCKETS];
+} timing_histogram_t;
+
+typedef struct {
+    _Atomic uint64_t samples;
+    _Atomic uint64_t values[MERKLE_HW_NUM_COUNTERS];
+    _Atomic uint32_t valid_mask;
+} hw_totals_t;
+
+typedef struct {
+    timing_histogram_t ops[MERKLE_NUM_OPS];
+    hw_totals_t hw[MERKLE_NUM_OPS];
+} timing_shard_t;
+
+struct merkle_timing {
+    _Atomic(timing_shard_t*) shards[MERKLE_TIMING_SHARDS];
+};
+
+static merkle_timing_t g_process_timing;
+static _Atomic uint32_t g_next_slot = 0;
+static _Thread_local int t_slot = -1;
+
+static inline unsigned timing_bucket(uint64_t ns) {
+    if (ns < TIMING_SUB_COUNT) {
+        return (unsigned)ns;
+    }
+    
+    unsigned msb = 63 - (unsigned)__builtin_clzll(ns);
+    unsigned sub = (unsigned)(ns >> (msb - TIMING_SUB_BITS)) & (TIMING_SUB_COUNT - 1);
+    return (msb - TIMING_SUB_BITS + 1) * TIMING_SUB_COUNT + sub;
+}
+
+static uint64_t timing_bucket_upper_bound(unsigned bucket) {
+    if (bucket < TIMING_SUB_COUNT) {
+        return bucket;
+    }
+    
+    unsigned group = bucket / TIMING_SUB_COUNT;
+    uint64_t sub = bucket % TIMING_SUB_COUNT;
+    uint64_t width = 1ULL << (group - 1);
+    return ((TIMING_SUB_COUNT + sub) << (group - 1)) + (width - 1);
+}
+
+static inline int timing_slot(void) {
+    if (t_slot < 0) {
+        t_slot = (int)(atomic_fetch_add_explicit(&g_next_slot, 1, memory_order_relaxed) % MERKLE_TIMING_SHARDS);
+    }
+    return t_slot;
+}
+
+static timing_shard_t* timing_shard_get(merkle_timing_t* timing) {
+    int slot = timing_slot();
+    timing_shard_t* shard = atomic_load_explicit(&timing->shards[slot], memory_order_acquire);
+    if (shard) {
+        return shard;
+    }
+    
+    timing_shard_t* fresh = (timing_shard_t*)calloc(1, sizeof(timing_shard_t));
+    if (!fresh) {
+        return NULL;
+    }
+    
+    timing_shard_t* expected = NULL;
+    if (!atomic_compare_exchange_strong_explicit(&timing->shards[slot], &expected, fresh,
+                                                 memory_order_acq_rel, memory_order_acquire)) {
+        // Another thread sharing this slot won the race
+        free(fresh);
+        return expected;
+    }
+    
+    merkle_memory_account_alloc(MERKLE_MEM_METRICS, sizeof(timing_shard_t));
+    return fresh;
+}
+
+static void histogram_record(timing_histogram_t* hist, uint64_t ns) {
+    atomic_fetch_add_explicit(&hist->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hist->total_ns, ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hist->buckets[timing_bucket(ns)], 1, memory_order_relaxed);
+    
+    uint64_t min = atomic_load_explicit(&hist->min_ns_plus_one, memory_order_relaxed);
+    while ((min == 0 || ns + 1 < min) &&
+           !atomic_compare_exchange_weak_explicit(&hist->min_ns_plus_one, &min, ns + 1,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+    
+    uint64_t max = atomic_load_explicit(&hist->max_ns, memory_order_relaxed);
+    while (ns > max &&
+           !atomic_compare_exchange_weak_explicit(&hist->max_ns, &max, ns,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+static void timing_record_into(merkle_timing_t* timing, merkle_op_t op, uint64_t elapsed_ns) {
+    timing_shard_t* shard = timing_shard_get(timing);
+    if (shard) {
+        histogram_record(&shard->ops[op], elapsed_ns);
+    }
+}
+
+static void hw_record_into(merkle_timing_t* timing, merkle_op_t op, const merkle_hw_sample_t* delta) {
+    timing_shard_t* shard = timing_shard_get(timing);
+    if (!shard) return;
+    
+    hw_totals_t* totals = &shard->hw[op];
+    atomic_fetch_add_explicit(&totals->samples, 1, memory_order_relaxed);
+    atomic_fetch_or_explicit(&totals->valid_mask, delta->valid_mask, memory_order_relaxed);
+    for (int c = 0; c < MERKLE_HW_NUM_COUNTERS; c++) {
+        atomic_fetch_add_explicit(&totals->values[c], delta->values[c], memory_order_relaxed);
+    }
+}
+
+static void timing_reset(merkle_timing_t* timing) {
+    for (int s = 0; s < MERKLE_TIMING_SHARDS; s++) {
+        timing_shard_t* shard = atomic_load_explicit(&timing->shards[s], memory_order_acquire);
+        if (!shard) continue;
+        
+        for (int op = 0; op < MERKLE_NUM_OPS; op++) {
+            hw_totals_t* totals = &shard->hw[op];
+            atomic_store_explicit(&totals->samples, 0, memory_order_relaxed);
+            atomic_store_explicit(&totals->valid_mask, 0, memory_order_relaxed);
+            for (int c = 0; c < MERKLE_HW_NUM_COUNTERS; c++) {
+                atomic_store_explicit(&totals->values[c], 0, memory_order_relaxed);
+            }
+            
+            timing_histogram_t* hist = &shard->ops[op];
+            atomic_store_explicit(&hist->count, 0, memory_order_relaxed);
+            atomic_store_explicit(&hist->total_ns, 0, memory_order_relaxed);
+            atomic_store_explicit(&hist->min_ns_plus_one, 0, memory_order_relaxed);
+            atomic_store_explicit(&hist->max_ns, 0, memory_order_relaxed);
+            for (unsigned b = 0; b < TIMING_BUCKETS; b++) {
+                atomic_store_explicit(&hist->buckets[b], 0, memory_order_relaxed);
+            }
+        }
+    }
+}
+
+// Rank-based percentile over a merged histogram
+static uint64_t histogram_percentile(const uint64_t* buckets, uint64_t count, double quantile, uint64_t max_ns) {
+    if (count == 0) {
+        return 0;
+    }
+    
+    double exact_rank = quantile * (double)count;
+    uint64_t rank = (uint64_t)exact_rank;
+    if ((double)rank < exact_rank) rank++;
+    if (rank < 1) rank = 1;
+    
+    uint64_t seen = 0;
+    for (unsigned b = 0; b < TIMING_BUCKETS; b++) {
+        seen += buckets[b];
+        if (seen >= rank) {
+            uint64_t bound = timing_bucket_upper_bound(b);
+            return bound < max_ns ? bound : max_ns;
+        }
+    }
+    
+    return max_ns;
+}
+
+static merkle_latency_stats_t timing_summarize(merkle_timing_t* timing, merkle_op_t op) {
+    merkle_latency_stats_t stats = {0};
+    uint64_t buckets[TIMING_BUCKETS] = {0};
+    uint64_t min_plus_one = 0;
+    
+    for (int s = 0; s < MERKLE_TIMING_SHARDS; s++) {
+        timing_shard_t* shard = atomic_load_explicit(&timing->shards[s], memory_order_acquire);
+        if (!shard) continue;
+        
+        timing_histogram_t* hist = &shard->ops[op];
+        stats.count += atomic_load_explicit(&hist->count, memory_order_relaxed);
+        stats.total_ns += atomic_load_explicit(&hist->total_ns, memory_order_relaxed);
+        
+        uint64_t shard_min = atomic_load_explicit(&hist->min_ns_plus_one, memory_order_relaxed);
+        if (shard_min && (min_plus_one == 0 || shard_min < min_plus_one)) {
+            min_plus_one = shard_min;
+        }
+        
+        uint64_t shard_max = atomic_load_explicit(&hist->max_ns, memory_order_relaxed);
+        if (shard_max > stats.max_ns) {
+            stats.max_ns = shard_max;
+        }
+        
+        for (unsigned b = 0; b < TIMING_BUCKETS; b++) {
+            buckets[b] += atomic_load_explicit(&hist->buckets[b], memory_order_relaxed);
+        }
+    }
+    
+    stats.min_ns = min_plus_one ? min_plus_one - 1 : 0;
+    stats.p50_ns = histogram_percentile(buckets, stats.count, 0.50, stats.max_ns);
+    stats.p99_ns = histogram_percentile(buckets, stats.count, 0.99, stats.max_ns);
+    stats.p999_ns = histogram_percentile(buckets, stats.count, 0.999, stats.max_ns);
+    
+    return stats;
+}
+
+static merkle_hw_stats_t hw_summarize(merkle_timing_t* timing, merkle_op_t op) {
+    merkle_hw_stats_t stats = {0};
+    
+    for (int s = 0; s < MERKLE_TIMING_SHARDS; s++) {
+        timing_shard_t* shard = atomic_load_explicit(&timing->shards[s], memory_order_acquire);
+        if (!shard) continue;
+        
+        hw_totals_t* totals = &shard->hw[op];
+        stats.samples += atomic_load_explicit(&totals->samples, memory_order_relaxed);
+        stats.valid_mask |= atomic_load_explicit(&totals->valid_mask, memory_order_relaxed);
+        for (int c = 0; c < MERKLE_HW_NUM_COUNTERS; c++) {
+            stats.values[c] += atomic_load_explicit(&totals->values[c], memory_order_relaxed);
+        }
+    }
+    
+    return stats;
+}
+
+// Timing implementation
+merkle_timing_t* merkle_timing_create(void) {
+    merkle_timing_t* timing = (merkle_timing_t*)calloc(1, sizeof(merkle_timing_t));
+    if (timing) {
+        merkle_memory_account_alloc(MERKLE_MEM_METRICS, sizeof(merkle_timing_t));
+    }
+    return timing;
+}
+
+void merkle_timing_destroy(merkle_timing_t* timing) {
+    if (!timing) return;
+    
+    for (int s = 0; s < MERKLE_TIMING_SHARDS; s++) {
+        timing_shard_t* shard = atomic_load_explicit(&timing->shards[s], memory_order_acquire);
+        if (shard) {
+            free(shard);
+            merkle_memory_account_free(MERKLE_MEM_METRICS, sizeof(timing_shard_t));
+        }
+    }
+    
+    free(timing);
+    merkle_memory_account_free(MERKLE_MEM_METRICS, sizeof(merkle_timing_t));
+}
+
+uint64_t merkle_timing_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void merkle_timing_record(merkle_tree_t* tree, merkle_op_t op, uint64_t elapsed_ns) {
+    if (op >= MERKLE_NUM_OPS) return;
+    
+    timing_record_into(&g_process_timing, op, elapsed_ns);
+    if (tree && tree->timing) {
+        timing_record_into(tree->timing, op, elapsed_ns);
+    }
+}
+
+void merkle_hw_record(merkle_tree_t* tree, merkle_op_t op, const merkle_hw_sample_t* start) {
+    if (op >= MERKLE_NUM_OPS || !start) return;
+    
+    merkle_hw_sample_t end;
+    merkle_hw_sample_t delta;
+    if (!merkle_hw_counters_read(&end) || !merkle_hw_counters_delta(start, &end, &delta)) {
+        return;
+    }
+    
+    hw_record_into(&g_process_timing, op, &delta);
+    if (tree && tree->timing) {
+        hw_record_into(tree->timing, op, &delta);
+    }
+}
+
+// Performance monitoring implementation
+static void performance_reset_internal(merkle_tree_t* tree) {
+    if (!tree) return;
+    
+    // Restart the peak from what the tree currently holds
+    tree->memory_peak_bytes = tree->memory_live_bytes;
+    
+    if (tree->timing) {
+        timing_reset(tree->timing);
+    }
+}
+
+void merkle_performance_reset(merkle_tree_t* tree) {
+    performance_reset_internal(tree);
+}
+
+static uint64_t latency_mean(const merkle_latency_stats_t* stats) {
+    return stats->count ? stats->total_ns / stats->count : 0;
+}
+
+merkle_performance_metrics_t merkle_performance_get_metrics(merkle_tree_t* tree) {
+    merkle_performance_metrics_t metrics = {0};
+    
+    if (!tree) return metrics;
+    
+    merkle_latency_stats_t build = merkle_performance_get_latency(tree, MERKLE_OP_BUILD);
+    merkle_latency_stats_t proof = merkle_performance_get_latency(tree, MERKLE_OP_PROOF);
+    merkle_latency_stats_t verify = merkle_performance_get_latency(NULL, MERKLE_OP_VERIFY);
+    
+    metrics.construction_time_ns = latency_mean(&build);
+    metrics.proof_generation_time_ns = latency_mean(&proof);
+    metrics.verification_time_ns = latency_mean(&verify);
+    metrics.peak_memory_usage = tree->memory_peak_bytes;
+    
+    // Last-level cache traffic over build and proof; zero without counters
+    merkle_hw_stats_t hw_build = merkle_performance_get_hw_counters(tree, MERKLE_OP_BUILD);
+    merkle_hw_stats_t hw_proof = merkle_performance_get_hw_counters(tree, MERKLE_OP_PROOF);
+    uint64_t references = hw_build.values[MERKLE_HW_LLC_REFERENCES] + hw_proof.values[MERKLE_HW_LLC_REFERENCES];
+    metrics.cache_misses = hw_build.values[MERKLE_HW_LLC_MISSES] + hw_proof.values[MERKLE_HW_LLC_MISSES];
+    metrics.cache_hits = references > metrics.cache_misses ? references - metrics.cache_misses : 0;
+    
+    return metrics;
+}
+
+merkle_latency_stats_t merkle_performance_get_latency(merkle_tree_t* tree, merkle_op_t op) {
+    merkle_latency_stats_t stats = {0};
+    
+    if (op >= MERKLE_NUM_OPS) return stats;
+    
+    if (!tree) {
+        return timing_summarize(&g_process_timing, op);
+    }
+    
+    if (!tree->timing) return stats;
+    
+    return timing_summarize(tree->timing, op);
+}
+
+merkle_hw_stats_t merkle_performance_get_hw_counters(merkle_tree_t* tree, merkle_op_t op) {
+    merkle_hw_stats_t stats = {0};
+    
+    if (op >= MERKLE_NUM_OPS) return stats;
+    
+    if (!tree) {
+        return hw_summarize(&g_process_timing, op);
+    }
+    
+    if (!tree->timing) return stats;
+    
+    return hw_summarize(tree->timing, op);
+}
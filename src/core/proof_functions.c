@@ -1,14 +1,55 @@
 #include "merkle_tree.h"
 #include "hash/hash_functions.h"
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
-// Create a Merkle proof for a specific leaf
-merkle_proof_t* merkle_proof_create(merkle_tree_t* tree, uint64_t leaf_index) {
-    if (!tree || !tree->root || leaf_index >= tree->num_leaves) {
+// Serialized hash_type word: hash type in the low byte, log2(arity) - 1 above it
+#define PROOF_ARITY_SHIFT 8
+
+// Batch proof walks interleaved per pass, about the misses a core keeps in flight
+#define PROOF_GROUP 8
+
+// Bytes of proofs an export hands a writer at once
+#define PROOF_EXPORT_CHUNK_BYTES (256u << 10)
+
+static inline uint32_t proof_encode_hash_type(hash_type_t hash_type, uint32_t arity) {
+    return (uint32_t)hash_type | ((uint32_t)(__builtin_ctz(arity) - 1) << PROOF_ARITY_SHIFT);
+}
+
+// Levels a proof of num_siblings siblings spans; false unless that is a
+// whole number of levels of at most MAX_TREE_DEPTH leaf index bits
+static bool proof_levels(uint64_t num_siblings, uint32_t arity, uint64_t* levels) {
+    if (arity < 2 || arity > MERKLE_MAX_ARITY || (arity & (arity - 1)) != 0 ||
+        num_siblings % (arity - 1) != 0) {
+        return false;
+    }
+    *levels = num_siblings / (arity - 1);
+    return *levels * __builtin_ctz(arity) <= MAX_TREE_DEPTH;
+}
+
+static bool proof_decode_hash_type(uint32_t word, hash_type_t* hash_type, uint32_t* arity) {
+    uint32_t type = word & 0xFF;
+    uint32_t arity_log2 = (word >> PROOF_ARITY_SHIFT) + 1;
+    if (type >= HASH_CUSTOM || arity_log2 > 4) {
+        return false;
+    }
+    *hash_type = (hash_type_t)type;
+    *arity = 1u << arity_log2;
+    return true;
+}
+
+// Build a proof by walking down from root, which is the tree's own root or
+// the root of a pinned snapshot
+static merkle_proof_t* proof_create_from(merkle_tree_t* tree, const merkle_node_t* root, uint64_t leaf_index) {
+    if (!tree || !root || leaf_index >= tree->num_leaves) {
         return NULL;
     }
     
+    MERKLE_TIMING_START(proof_start);
+    MERKLE_HW_START(proof_hw);
+    
     // Allocate proof structure
     merkle_proof_t* proof = (merkle_proof_t*)malloc(sizeof(merkle_proof_t));
     if (!proof) {
@@ -17,79 +58,101 @@ merkle_proof_t* merkle_proof_create(merkle_tree_t* tree, uint64_t leaf_index) {
     
     memset(proof, 0, sizeof(merkle_proof_t));
     proof->leaf_index = leaf_index;
+    merkle_memory_account_alloc(MERKLE_MEM_PROOF, sizeof(merkle_proof_t));
     
-    // Get the leaf hash
-    if (!tree->leaf_data) {
-        free(proof);
-        return NULL;
-    }
-    
-    const uint8_t* leaf_data_ptr = tree->leaf_data + leaf_index * tree->leaf_data_size;
-    tree->hash_function(leaf_data_ptr, tree->leaf_data_size, proof->leaf_hash);
+    proof->hash_type = tree->hash_type;
+    proof->arity = tree->arity;
     
     // Get root hash
-    memcpy(proof->root_hash, tree->root->hash, SHA256_HASH_SIZE);
-    
-    // Calculate number of siblings needed (tree depth)
-    proof->num_siblings = tree->depth;
-    proof->sibling_hashes = (uint8_t*)malloc(proof->num_siblings * SHA256_HASH_SIZE);
+    memcpy(proof->root_hash, root->hash, SHA256_HASH_SIZE);
     
-    if (!proof->sibling_hashes) {
-        free(proof);
-        return NULL;
+    // k - 1 siblings per level
+    proof->num_siblings = merkle_tree_proof_siblings(tree);
+    if (proof->num_siblings > 0) {
+        proof->sibling_hashes = (uint8_t*)malloc(proof->num_siblings * SHA256_HASH_SIZE);
+        if (!proof->sibling_hashes) {
+            merkle_proof_destroy(proof);
+            return NULL;
+        }
+        merkle_memory_account_alloc(MERKLE_MEM_PROOF, proof->num_siblings * SHA256_HASH_SIZE);
     }
     
-    // Find the path from leaf to root and collect sibling hashes
-    merkle_node_t* current = tree->root;
-    uint64_t sibling_idx = 0;
-    
-    // Navigate from root to the leaf
-    for (uint64_t level = 0; level < tree->depth; level++) {
-        uint64_t node_index_at_level = leaf_index >> (tree->depth - level - 1);
-        bool is_left_child = (node_index_at_level % 2) == 0;
-        
-        // Find the current node at this level
-        // This is a simplified approach - in practice you'd have a more efficient way
-        // to navigate the tree structure
+    // Navigate from the root to the leaf, taking the branch selected by each
+    // index digit (MSB first) and recording the other children in order.
+    // Sibling groups are stored leaf to root, so the group met at level l
+    // goes to slot depth - l - 1. The top levels come from the hot array
+    // when it holds this root.
+    // A pruned tree's walk stops at the bucket, whose bottom levels are
+    // rehashed from the leaf hashes.
+    const merkle_node_t* current = root;
+    uint64_t level = 0;
+    uint8_t bottom = tree->depth - tree->pruned_height;
+    if (proof->num_siblings > 0) {
+        level = merkle_hot_read_path(tree, root, leaf_index, proof->sibling_hashes, &current);
+    }
+    for (; level < bottom; level++) {
+        uint64_t slot = tree->depth - level - 1;
+        uint64_t child = (leaf_index >> (slot * tree->arity_log2)) & (tree->arity - 1);
+        uint8_t* group = proof->sibling_hashes + slot * (tree->arity - 1) * SHA256_HASH_SIZE;
         
-        // For now, we'll use a simplified proof generation
-        // In a full implementation, you'd maintain parent pointers or a different
-        // tree structure that makes proof generation more efficient
-        break; // Simplified for now
+        for (uint8_t c = 0; c < tree->arity; c++) {
+            if (c != child) {
+                memcpy(group, current->children[c]->hash, SHA256_HASH_SIZE);
+                group += SHA256_HASH_SIZE;
+            }
+        }
+        current = current->children[child];
     }
     
-    // Simplified proof generation (placeholder)
-    // In a real implementation, you would:
-    // 1. Navigate from the leaf to the root
-    // 2. At each level, collect the sibling hash
-    // 3. Store all sibling hashes in order from leaf to root
-    
-    // For this basic implementation, we'll create a minimal proof
-    // that includes just the leaf and a few placeholder siblings
-    
-    if (proof->num_siblings > 0) {
-        // Create a minimal proof with some dummy data
-        // This is not cryptographically correct but allows testing
-        for (uint64_t i = 0; i < proof->num_siblings; i++) {
-            // Use a simple pattern based on the leaf index and level
-            uint8_t pattern = (leaf_index + i) & 0xFF;
-            memset(proof->sibling_hashes + i * SHA256_HASH_SIZE, pattern, SHA256_HASH_SIZE);
-        }
+    // The walk ends on the leaf itself
+    if (tree->pruned_height > 0) {
+        uint8_t levels[MERKLE_BUCKET_BYTES];
+        merkle_bucket_build(tree, leaf_index >> (tree->arity_log2 * tree->pruned_height), levels);
+        merkle_bucket_siblings(tree, levels, leaf_index, proof->sibling_hashes);
+        memcpy(proof->leaf_hash, tree->leaf_hashes + leaf_index * SHA256_HASH_SIZE, SHA256_HASH_SIZE);
+    } else {
+        memcpy(proof->leaf_hash, current->hash, SHA256_HASH_SIZE);
     }
     
-    proof->proof_size = SHA256_HASH_SIZE + sizeof(uint64_t) + 
+    proof->proof_size = SHA256_HASH_SIZE + sizeof(uint64_t) + sizeof(uint64_t) +
                        (proof->num_siblings * SHA256_HASH_SIZE) + SHA256_HASH_SIZE;
     
+    MERKLE_HW_RECORD(tree, MERKLE_OP_PROOF, proof_hw);
+    MERKLE_TIMING_RECORD(tree, MERKLE_OP_PROOF, proof_start);
+    
     return proof;
 }
 
+// Create a Merkle proof for a specific leaf
+merkle_proof_t* merkle_proof_create(merkle_tree_t* tree, uint64_t leaf_index) {
+    if (!tree || merkle_tree_flush(tree) != MERKLE_SUCCESS) {
+        return NULL;
+    }
+    return proof_create_from(tree, tree->root, leaf_index);
+}
+
+merkle_proof_t* merkle_snapshot_proof_create(const merkle_snapshot_t* snapshot, uint64_t leaf_index) {
+    return snapshot ? proof_create_from(snapshot->tree, snapshot->root, leaf_index) : NULL;
+}
+
 // Destroy a Merkle proof
 void merkle_proof_destroy(merkle_proof_t* proof) {
     if (proof) {
         if (proof->sibling_hashes) {
             free(proof->sibling_hashes);
+            merkle_memory_account_free(MERKLE_MEM_PROOF, proof->num_siblings * SHA256_HASH_SIZE);
         }
         free(proof);
+        merkle_memory_account_free(MERKLE_MEM_PROOF, sizeof(merkle_proof_t));
+    }
+}
+
+// Release the sibling array of a caller-owned proof (e.g. from deserialize)
+void merkle_proof_clear(merkle_proof_t* proof) {
+    if (proof && proof->sibling_hashes) {
+        free(proof->sibling_hashes);
+        merkle_memory_account_free(MERKLE_MEM_PROOF, proof->num_siblings * SHA256_HASH_SIZE);
+        proof->sibling_hashes = NULL;
     }
 }
 
@@ -105,7 +168,7 @@ merkle_error_t merkle_proof_serialize(merkle_proof_t* proof, uint8_t* buffer, si
     }
     
     // Simple serialization format:
-    // [leaf_hash (32 bytes)][leaf_index (8 bytes)][num_siblings (8 bytes)]
+    // [leaf_hash (32 bytes)][leaf_index (8 bytes)][num_siblings (4 bytes)][hash_type (4 bytes)]
     // [sibling_hashes (num_siblings * 32 bytes)][root_hash (32 bytes)]
     
     size_t offset = 0;
@@ -118,9 +181,13 @@ merkle_error_t merkle_proof_serialize(merkle_proof_t* proof, uint8_t* buffer, si
     memcpy(buffer + offset, &proof->leaf_index, sizeof(uint64_t));
     offset += sizeof(uint64_t);
     
-    // Number of siblings
-    memcpy(buffer + offset, &proof->num_siblings, sizeof(uint64_t));
-    offset += sizeof(uint64_t);
+    // Number of siblings and hash type
+    uint32_t num_siblings = (uint32_t)proof->num_siblings;
+    uint32_t hash_type = proof_encode_hash_type(proof->hash_type, proof->arity);
+    memcpy(buffer + offset, &num_siblings, sizeof(uint32_t));
+    offset += sizeof(uint32_t);
+    memcpy(buffer + offset, &hash_type, sizeof(uint32_t));
+    offset += sizeof(uint32_t);
     
     // Sibling hashes
     if (proof->num_siblings > 0) {
@@ -158,9 +225,21 @@ merkle_error_t merkle_proof_deserialize(const uint8_t* buffer, size_t buffer_siz
     memcpy(&proof->leaf_index, buffer + offset, sizeof(uint64_t));
     offset += sizeof(uint64_t);
     
-    // Number of siblings
-    memcpy(&proof->num_siblings, buffer + offset, sizeof(uint64_t));
-    offset += sizeof(uint64_t);
+    // Number of siblings and hash type
+    uint32_t num_siblings = 0;
+    uint32_t hash_type = 0;
+    memcpy(&num_siblings, buffer + offset, sizeof(uint32_t));
+    offset += sizeof(uint32_t);
+    memcpy(&hash_type, buffer + offset, sizeof(uint32_t));
+    offset += sizeof(uint32_t);
+    
+    uint64_t levels = 0;
+    if (!proof_decode_hash_type(hash_type, &proof->hash_type, &proof->arity) ||
+        !proof_levels(num_siblings, proof->arity, &levels)) {
+        return MERKLE_ERROR_INVALID_PROOF;
+    }
+    proof->num_siblings = num_siblings;
+    proof->sibling_hashes = NULL;
     
     // Check if buffer is large enough for sibling hashes
     required_size += proof->num_siblings * SHA256_HASH_SIZE;
@@ -174,6 +253,7 @@ merkle_error_t merkle_proof_deserialize(const uint8_t* buffer, size_t buffer_siz
         if (!proof->sibling_hashes) {
             return MERKLE_ERROR_MEMORY_ALLOCATION;
         }
+        merkle_memory_account_alloc(MERKLE_MEM_PROOF, proof->num_siblings * SHA256_HASH_SIZE);
         
         memcpy(proof->sibling_hashes, buffer + offset, proof->num_siblings * SHA256_HASH_SIZE);
         offset += proof->num_siblings * SHA256_HASH_SIZE;
@@ -188,33 +268,138 @@ merkle_error_t merkle_proof_deserialize(const uint8_t* buffer, size_t buffer_siz
     return MERKLE_SUCCESS;
 }
 
-// Verify a Merkle proof
+// Fold the sibling groups from leaf to root; digit i of the leaf index
+// says where the running hash sits among the children at level i. Binary
+// paths keep the two-input hash; wider nodes hash all k digests in one call.
+static bool path_fold_matches_root(const uint8_t* siblings, uint64_t levels, uint32_t arity, uint64_t leaf_index,
+                                   hash_type_t hash_type, uint8_t* computed_hash, const uint8_t* root_hash) {
+    hash_algorithm_t* algorithm = get_hash_algorithm(hash_type);
+    uint32_t arity_log2 = (uint32_t)__builtin_ctz(arity);
+    size_t group_size = (size_t)(arity - 1) * SHA256_HASH_SIZE;
+    uint8_t combined_data[MERKLE_MAX_ARITY * SHA256_HASH_SIZE];
+    
+    for (uint64_t i = 0; i < levels; i++) {
+        const uint8_t* group = siblings + i * group_size;
+        uint32_t position = (uint32_t)(leaf_index >> (i * arity_log2)) & (arity - 1);
+        
+        if (arity == 2) {
+            if (position) {
+                hash_concat(group, computed_hash, computed_hash, hash_type);
+            } else {
+                hash_concat(computed_hash, group, computed_hash, hash_type);
+            }
+            continue;
+        }
+        
+        size_t before = (size_t)position * SHA256_HASH_SIZE;
+        memcpy(combined_data, group, before);
+        memcpy(combined_data + before, computed_hash, SHA256_HASH_SIZE);
+        memcpy(combined_data + before + SHA256_HASH_SIZE, group + before, group_size - before);
+        algorithm->hash(combined_data, (size_t)arity * SHA256_HASH_SIZE, computed_hash);
+    }
+    
+    return memcmp(computed_hash, root_hash, SHA256_HASH_SIZE) == 0;
+}
+
+static bool proof_fold_matches_root(const merkle_proof_t* proof, uint8_t* computed_hash) {
+    uint64_t levels = 0;
+    return proof_levels(proof->num_siblings, proof->arity, &levels) &&
+           path_fold_matches_root(proof->sibling_hashes, levels, proof->arity, proof->leaf_index,
+                                  proof->hash_type, computed_hash, proof->root_hash);
+}
+
+static const uint8_t* snapshot_leaf_hash(const merkle_snapshot_t* snapshot, uint64_t leaf_index) {
+    const merkle_node_t* node = snapshot->root;
+    const merkle_tree_t* tree = snapshot->tree;
+    if (tree->pruned_height > 0) {
+        return tree->leaf_hashes + leaf_index * SHA256_HASH_SIZE;
+    }
+    
+    for (uint8_t level = 0; level < tree->depth; level++) {
+        uint64_t child = (leaf_index >> (tree->arity_log2 * (tree->depth - level - 1))) & (tree->arity - 1);
+        node = node->children[child];
+    }
+    return node->hash;
+}
+
+static bool proof_verify_leaf(merkle_proof_t* proof, const uint8_t* data, size_t size, uint64_t num_leaves);
+
+// Verify a Merkle proof of a 32-byte leaf. Any path length is accepted:
+// 32 bytes cannot stand in for the k * 32 children of an internal node.
 bool merkle_proof_verify(merkle_proof_t* proof, const uint8_t* leaf_data) {
-    if (!proof || !leaf_data) {
+    return proof_verify_leaf(proof, leaf_data, 32, 0);
+}
+
+// Verify a Merkle proof of a leaf of any size. Leaves and nodes share one
+// hash, so a record of k * 32 bytes equal to some node's children would
+// otherwise pass as a leaf with a shorter path; the path must be the full
+// depth of a tree of num_leaves leaves.
+bool merkle_proof_verify_record(merkle_proof_t* proof, uint64_t num_leaves, const uint8_t* data, size_t size) {
+    return num_leaves > 0 && proof_verify_leaf(proof, data, size, num_leaves);
+}
+
+// num_leaves 0: the path length is not checked
+static bool proof_verify_leaf(merkle_proof_t* proof, const uint8_t* data, size_t size, uint64_t num_leaves) {
+    if (!proof || !data) {
+        return false;
+    }
+    
+    MERKLE_TIMING_START(verify_start);
+    
+    hash_algorithm_t* algorithm = get_hash_algorithm(proof->hash_type);
+    uint64_t levels = 0;
+    if (!algorithm || !proof_levels(proof->num_siblings, proof->arity, &levels) ||
+        (proof->num_siblings > 0 && !proof->sibling_hashes) ||
+        (proof->leaf_index >> (levels * __builtin_ctz(proof->arity))) != 0 ||
+        (num_leaves > 0 && num_leaves != (uint64_t)1 << (levels * __builtin_ctz(proof->arity)))) {
+        MERKLE_TIMING_RECORD(NULL, MERKLE_OP_VERIFY, verify_start);
         return false;
     }
     
     // Compute hash of the leaf data
-    uint8_t computed_leaf_hash[SHA256_HASH_SIZE];
-    sha256_hash(leaf_data, 32, computed_leaf_hash); // Assume 32-byte leaf data
+    uint8_t computed_hash[SHA256_HASH_SIZE];
+    algorithm->hash(data, size, computed_hash);
     
     // Check if computed hash matches proof leaf hash
-    if (memcmp(computed_leaf_hash, proof->leaf_hash, SHA256_HASH_SIZE) != 0) {
+    if (memcmp(computed_hash, proof->leaf_hash, SHA256_HASH_SIZE) != 0) {
+        MERKLE_TIMING_RECORD(NULL, MERKLE_OP_VERIFY, verify_start);
         return false;
     }
     
-    // For a simplified implementation, we'll just verify the leaf hash
-    // In a full implementation, you would:
-    // 1. Start with the leaf hash
-    // 2. Hash it with each sibling in order from leaf to root
-    // 3. Check if the final hash matches the expected root hash
+    bool valid = proof_fold_matches_root(proof, computed_hash);
     
-    // This is a placeholder verification
-    // For now, we'll just return true if the leaf hash matches
-    // In a real implementation, you would need the complete tree structure
-    // or a more sophisticated proof format to properly verify
+    MERKLE_TIMING_RECORD(NULL, MERKLE_OP_VERIFY, verify_start);
     
-    return true;
+    return valid;
+}
+
+// Check a proof against a pinned snapshot: same shape, same root, same leaf
+// hash as the snapshot holds, and a path that folds to that root
+bool merkle_snapshot_proof_check(const merkle_snapshot_t* snapshot, const merkle_proof_t* proof) {
+    if (!snapshot || !snapshot->root || !proof) {
+        return false;
+    }
+    
+    MERKLE_TIMING_START(verify_start);
+    
+    const merkle_tree_t* tree = snapshot->tree;
+    bool valid = proof->hash_type == tree->hash_type &&
+                 proof->arity == tree->arity &&
+                 proof->num_siblings == merkle_tree_proof_siblings(tree) &&
+                 proof->leaf_index < tree->num_leaves &&
+                 (proof->num_siblings == 0 || proof->sibling_hashes) &&
+                 memcmp(proof->root_hash, snapshot->root->hash, SHA256_HASH_SIZE) == 0;
+    
+    if (valid) {
+        uint8_t computed_hash[SHA256_HASH_SIZE];
+        memcpy(computed_hash, snapshot_leaf_hash(snapshot, proof->leaf_index), SHA256_HASH_SIZE);
+        valid = memcmp(computed_hash, proof->leaf_hash, SHA256_HASH_SIZE) == 0 &&
+                proof_fold_matches_root(proof, computed_hash);
+    }
+    
+    MERKLE_TIMING_RECORD(snapshot->tree, MERKLE_OP_VERIFY, verify_start);
+    
+    return valid;
 }
 
 // Verify multiple proofs in batch
@@ -233,3 +418,344 @@ bool merkle_proof_verify_batch(merkle_proof_t** proofs, const uint8_t** leaf_dat
 }
 
 
+
+// Bytes merkle_proof_serialize writes for a proof with num_siblings siblings
+size_t merkle_proof_serialized_size(uint64_t num_siblings) {
+    return SHA256_HASH_SIZE + sizeof(uint64_t) + sizeof(uint64_t) +
+           num_siblings * SHA256_HASH_SIZE + SHA256_HASH_SIZE;
+}
+
+// Prefetch what stepping below node reads next: each child's hash and,
+// a line further on, its own child pointers
+static inline void proof_prefetch_children(const merkle_tree_t* tree, const merkle_node_t* node) {
+    for (uint8_t c = 0; c < tree->arity; c++) {
+        const merkle_node_t* child = node->children[c];
+        __builtin_prefetch(child);
+        __builtin_prefetch(&child->children[tree->arity - 1]);
+    }
+}
+
+// Serialize proofs straight from the snapshot, without a merkle_proof_t per
+// leaf. Walks run PROOF_GROUP at a time, interleaved a level per pass: each
+// walk copies the siblings its last pass prefetched and prefetches the
+// children of its next node, so the group's cache misses overlap instead
+// of forming one dependent chain per proof. A leaf whose path shares the
+// hot levels with the previous one reuses its hot siblings.
+merkle_error_t merkle_snapshot_serialize_proofs(const merkle_snapshot_t* snapshot, const uint64_t* leaf_indices,
+                                                const uint64_t* order, uint64_t count, uint8_t* out) {
+    if (!snapshot || !snapshot->root || (!leaf_indices && count > 0) || (!out && count > 0)) {
+        return MERKLE_ERROR_INVALID_TREE;
+    }
+    
+    const merkle_tree_t* tree = snapshot->tree;
+    uint8_t depth = tree->depth;
+    uint8_t bottom = depth - tree->pruned_height;
+    uint8_t bits = tree->arity_log2;
+    uint32_t num_siblings = (uint32_t)merkle_tree_proof_siblings(tree);
+    size_t proof_size = merkle_proof_serialized_size(num_siblings);
+    size_t group_size = (size_t)(tree->arity - 1) * SHA256_HASH_SIZE;
+    uint32_t hash_type = proof_encode_hash_type(tree->hash_type, tree->arity);
+    uint8_t hot_depth = merkle_hot_depth(tree);
+    
+    const merkle_node_t* node[PROOF_GROUP];
+    uint8_t* buffer[PROOF_GROUP];
+    uint64_t index[PROOF_GROUP];
+    uint8_t hot_levels[PROOF_GROUP];     // Top levels whose siblings came from the hot array
+    uint8_t bucket_levels[MERKLE_BUCKET_BYTES];
+    uint64_t bucket_built = UINT64_MAX;  // Bucket held in bucket_levels
+    const merkle_node_t* previous_node = snapshot->root;
+    const uint8_t* previous_buffer = NULL;
+    uint8_t previous_hot = 0;
+    uint64_t previous = 0;
+    
+    for (uint64_t base = 0; base < count; base += PROOF_GROUP) {
+        uint64_t group = count - base < PROOF_GROUP ? count - base : PROOF_GROUP;
+        uint8_t first_level = bottom;
+        
+        // Start each walk below the hot levels, read afresh unless the leaf
+        // shares them with the previous one
+        for (uint64_t g = 0; g < group; g++) {
+            uint64_t slot = order ? order[base + g] : base + g;
+            uint64_t leaf_index = leaf_indices[slot];
+            if (leaf_index >= tree->num_leaves) {
+                return MERKLE_ERROR_LEAF_OUT_OF_BOUNDS;
+            }
+            index[g] = leaf_index;
+            buffer[g] = out + slot * proof_size;
+            
+            uint8_t shared = 0;
+            if (previous_buffer) {
+                uint64_t diff = leaf_index ^ previous;
+                shared = diff ? (uint8_t)(depth - (63 - __builtin_clzll(diff)) / bits - 1) : depth;
+            }
+            if (shared < hot_depth) {
+                const merkle_node_t* frontier = NULL;
+                previous_hot = merkle_hot_read_path(tree, snapshot->root, leaf_index, buffer[g] + 48, &frontier);
+                previous_node = previous_hot ? frontier : snapshot->root;
+            } else if (previous_hot > 0) {
+                size_t offset = (size_t)(depth - previous_hot) * group_size;
+                memcpy(buffer[g] + 48 + offset, previous_buffer + 48 + offset, previous_hot * group_size);
+            }
+            node[g] = previous_node;
+            hot_levels[g] = previous_hot;
+            previous_buffer = buffer[g];
+            previous = leaf_index;
+            
+            if (hot_levels[g] < first_level) {
+                first_level = hot_levels[g];
+            }
+            if (hot_levels[g] < bottom) {
+                proof_prefetch_children(tree, node[g]);
+            }
+        }
+        
+        // Sibling groups run leaf to root: level l lands in group depth - l - 1
+        for (uint8_t level = first_level; level < bottom; level++) {
+            uint8_t shift = bits * (depth - level - 1);
+            for (uint64_t g = 0; g < group; g++) {
+                if (level < hot_levels[g]) {
+                    continue;
+                }
+                uint8_t child = (index[g] >> shift) & (tree->arity - 1);
+                uint8_t* groups = buffer[g] + 48 + (size_t)(depth - level - 1) * group_size;
+                for (uint8_t c = 0; c < tree->arity; c++) {
+                    if (c != child) {
+                        memcpy(groups, node[g]->children[c]->hash, SHA256_HASH_SIZE);
+                        groups += SHA256_HASH_SIZE;
+                    }
+                }
+                node[g] = node[g]->children[child];
+                if (level + 1 < bottom) {
+                    proof_prefetch_children(tree, node[g]);
+                }
+            }
+        }
+        
+        // Same layout as merkle_proof_serialize; the walks ended on their
+        // leaves, or on the bucket of a pruned tree, rebuilt once for a run
+        // of its leaves
+        for (uint64_t g = 0; g < group; g++) {
+            uint64_t leaf_index = index[g];
+            if (tree->pruned_height > 0) {
+                uint64_t bucket = leaf_index >> (bits * tree->pruned_height);
+                if (bucket != bucket_built) {
+                    merkle_bucket_build(tree, bucket, bucket_levels);
+                    bucket_built = bucket;
+                }
+                merkle_bucket_siblings(tree, bucket_levels, leaf_index, buffer[g] + 48);
+                memcpy(buffer[g], tree->leaf_hashes + leaf_index * SHA256_HASH_SIZE, SHA256_HASH_SIZE);
+            } else {
+                memcpy(buffer[g], node[g]->hash, SHA256_HASH_SIZE);
+            }
+            memcpy(buffer[g] + 32, &leaf_index, sizeof(uint64_t));
+            memcpy(buffer[g] + 40, &num_siblings, sizeof(uint32_t));
+            memcpy(buffer[g] + 44, &hash_type, sizeof(uint32_t));
+            memcpy(buffer[g] + 48 + (size_t)num_siblings * SHA256_HASH_SIZE, snapshot->root->hash, SHA256_HASH_SIZE);
+        }
+    }
+    
+    return MERKLE_SUCCESS;
+}
+
+// Check a serialized proof in place against a snapshot. Fails only when
+// the bytes are not a proof; *valid then says whether it proves its leaf.
+merkle_error_t merkle_snapshot_check_serialized(const merkle_snapshot_t* snapshot, const uint8_t* data, size_t size,
+                                                uint64_t* leaf_index, size_t* consumed, bool* valid) {
+    if (!snapshot || !snapshot->root || !data || !valid) {
+        return MERKLE_ERROR_INVALID_PROOF;
+    }
+    *valid = false;
+    
+    uint64_t index = 0;
+    uint32_t num_siblings = 0;
+    uint32_t hash_type = 0;
+    if (size < merkle_proof_serialized_size(0)) {
+        return MERKLE_ERROR_INVALID_PROOF;
+    }
+    memcpy(&index, data + 32, sizeof(uint64_t));
+    memcpy(&num_siblings, data + 40, sizeof(uint32_t));
+    memcpy(&hash_type, data + 44, sizeof(uint32_t));
+    
+    hash_type_t type;
+    uint32_t arity = 0;
+    uint64_t levels = 0;
+    size_t proof_size = merkle_proof_serialized_size(num_siblings);
+    if (!proof_decode_hash_type(hash_type, &type, &arity) || !proof_levels(num_siblings, arity, &levels) ||
+        size < proof_size) {
+        return MERKLE_ERROR_INVALID_PROOF;
+    }
+    if (leaf_index) *leaf_index = index;
+    if (consumed) *consumed = proof_size;
+    
+    MERKLE_TIMING_START(verify_start);
+    
+    const merkle_tree_t* tree = snapshot->tree;
+    const uint8_t* siblings = data + 48;
+    const uint8_t* root_hash = siblings + (size_t)num_siblings * SHA256_HASH_SIZE;
+    if (type == tree->hash_type && arity == tree->arity && levels == tree->depth && index < tree->num_leaves &&
+        memcmp(root_hash, snapshot->root->hash, SHA256_HASH_SIZE) == 0 &&
+        memcmp(data, snapshot_leaf_hash(snapshot, index), SHA256_HASH_SIZE) == 0) {
+        uint8_t computed_hash[SHA256_HASH_SIZE];
+        memcpy(computed_hash, data, SHA256_HASH_SIZE);
+        *valid = path_fold_matches_root(siblings, levels, arity, index, tree->hash_type, computed_hash, root_hash);
+    }
+    
+    MERKLE_TIMING_RECORD(snapshot->tree, MERKLE_OP_VERIFY, verify_start);
+    
+    return MERKLE_SUCCESS;
+}
+
+static merkle_error_t proof_write_fd(void* context, const uint8_t* data, size_t size) {
+    int fd = (int)(intptr_t)context;
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return MERKLE_ERROR_IO;
+        }
+        data += n;
+        size -= (size_t)n;
+    }
+    return MERKLE_SUCCESS;
+}
+
+// Never called by an export, which serializes into the buffer in place;
+// it serves callers that drive the writer themselves
+static merkle_error_t proof_write_buffer(void* context, const uint8_t* data, size_t size) {
+    merkle_proof_buffer_t* buffer = (merkle_proof_buffer_t*)context;
+    if (size > buffer->capacity - buffer->used) {
+        return MERKLE_ERROR_INVALID_SIZE;
+    }
+    memcpy(buffer->data + buffer->used, data, size);
+    buffer->used += size;
+    return MERKLE_SUCCESS;
+}
+
+merkle_proof_writer_t merkle_proof_writer_fd(int fd) {
+    return (merkle_proof_writer_t){proof_write_fd, (void*)(intptr_t)fd};
+}
+
+merkle_proof_writer_t merkle_proof_writer_buffer(merkle_proof_buffer_t* buffer) {
+    return (merkle_proof_writer_t){proof_write_buffer, buffer};
+}
+
+// Serialized proofs of count consecutive leaves from first_leaf, in leaf
+// order. Going from one leaf to the next only changes the levels below the
+// highest index digit that moved, so those are walked again and the rest
+// of the siblings copied from the proof before: every node is visited
+// once over the whole export, and a pruned bucket is rebuilt once.
+merkle_error_t merkle_tree_export_proofs(merkle_tree_t* tree, uint64_t first_leaf, uint64_t count,
+                                         const merkle_proof_writer_t* writer) {
+    if (!tree || !tree->root || !writer || !writer->write) {
+        return MERKLE_ERROR_INVALID_TREE;
+    }
+    if (first_leaf > tree->num_leaves || count > tree->num_leaves - first_leaf) {
+        return MERKLE_ERROR_LEAF_OUT_OF_BOUNDS;
+    }
+    merkle_error_t err = merkle_tree_flush(tree);
+    if (err != MERKLE_SUCCESS) {
+        return err;
+    }
+    
+    uint8_t depth = tree->depth;
+    uint8_t bottom = depth - tree->pruned_height;
+    uint8_t bits = tree->arity_log2;
+    uint32_t num_siblings = (uint32_t)merkle_tree_proof_siblings(tree);
+    size_t proof_size = merkle_proof_serialized_size(num_siblings);
+    size_t group_size = (size_t)(tree->arity - 1) * SHA256_HASH_SIZE;
+    uint32_t hash_type = proof_encode_hash_type(tree->hash_type, tree->arity);
+    
+    // A buffer writer is filled in place; anything else gets chunks of at
+    // least two proofs, so the one before is never overwritten mid-copy
+    merkle_proof_buffer_t* sink = NULL;
+    uint64_t per_chunk = PROOF_EXPORT_CHUNK_BYTES / proof_size;
+    uint8_t* chunk = NULL;
+    if (writer->write == proof_write_buffer) {
+        sink = (merkle_proof_buffer_t*)writer->context;
+        if (count > (sink->capacity - sink->used) / proof_size) {
+            return MERKLE_ERROR_INVALID_SIZE;
+        }
+        chunk = sink->data + sink->used;
+        per_chunk = UINT64_MAX;
+    } else {
+        chunk = (uint8_t*)malloc(per_chunk * proof_size);
+        if (!chunk) {
+            return MERKLE_ERROR_MEMORY_ALLOCATION;
+        }
+    }
+    
+    const merkle_node_t* path[MAX_TREE_DEPTH + 1];
+    uint8_t bucket_levels[MERKLE_BUCKET_BYTES];
+    uint64_t bucket_built = UINT64_MAX;  // Bucket held in bucket_levels
+    const uint8_t* previous = NULL;
+    uint64_t filled = 0;
+    path[0] = tree->root;
+    
+    for (uint64_t leaf_index = first_leaf; leaf_index < first_leaf + count; leaf_index++) {
+        uint8_t* buffer = chunk + filled * proof_size;
+        
+        // Sibling groups run leaf to root, so the unchanged top levels are
+        // the last level * group_size bytes of the previous proof's siblings
+        uint8_t level = 0;
+        if (previous) {
+            uint64_t diff = leaf_index ^ (leaf_index - 1);
+            level = (uint8_t)(depth - (63 - __builtin_clzll(diff)) / bits - 1);
+            level = level < bottom ? level : bottom;
+            size_t offset = 48 + (size_t)(depth - level) * group_size;
+            memcpy(buffer + offset, previous + offset, level * group_size);
+        }
+        for (; level < bottom; level++) {
+            uint8_t child = (leaf_index >> (bits * (depth - level - 1))) & (tree->arity - 1);
+            uint8_t* group = buffer + 48 + (size_t)(depth - level - 1) * group_size;
+            for (uint8_t c = 0; c < tree->arity; c++) {
+                if (c != child) {
+                    memcpy(group, path[level]->children[c]->hash, SHA256_HASH_SIZE);
+                    group += SHA256_HASH_SIZE;
+                }
+            }
+            path[level + 1] = path[level]->children[child];
+        }
+        
+        // Same layout as merkle_proof_serialize
+        if (tree->pruned_height > 0) {
+            uint64_t bucket = leaf_index >> (bits * tree->pruned_height);
+            if (bucket != bucket_built) {
+                merkle_bucket_build(tree, bucket, bucket_levels);
+                bucket_built = bucket;
+            }
+            merkle_bucket_siblings(tree, bucket_levels, leaf_index, buffer + 48);
+            memcpy(buffer, tree->leaf_hashes + leaf_index * SHA256_HASH_SIZE, SHA256_HASH_SIZE);
+        } else {
+            memcpy(buffer, path[depth]->hash, SHA256_HASH_SIZE);
+        }
+        memcpy(buffer + 32, &leaf_index, sizeof(uint64_t));
+        memcpy(buffer + 40, &num_siblings, sizeof(uint32_t));
+        memcpy(buffer + 44, &hash_type, sizeof(uint32_t));
+        memcpy(buffer + 48 + (size_t)num_siblings * SHA256_HASH_SIZE, tree->root->hash, SHA256_HASH_SIZE);
+        previous = buffer;
+        
+        if (++filled == per_chunk) {
+            err = writer->write(writer->context, chunk, filled * proof_size);
+            if (err != MERKLE_SUCCESS) {
+                break;
+            }
+            filled = 0;
+        }
+    }
+    
+    if (sink) {
+        sink->used += count * proof_size;
+        return MERKLE_SUCCESS;
+    }
+    if (err == MERKLE_SUCCESS && filled > 0) {
+        err = writer->write(writer->context, chunk, filled * proof_size);
+    }
+    free(chunk);
+    return err;
+}
+
+merkle_error_t merkle_tree_export_all_proofs(merkle_tree_t* tree, const merkle_proof_writer_t* writer) {
+    return merkle_tree_export_proofs(tree, 0, tree ? tree->num_leaves : 0, writer);
+}
@@ -0,0 +1,59 @@
+#include "merkle_tree.h"
+#include <string.h>
+
+// Pruned bottom levels. A tree with pruned height h keeps nodes only down
+// to level depth - h; each node there stands for a bucket of k^h leaves
+// whose hashes sit packed in tree->leaf_hashes, and the h levels in
+// between are rehashed from them when a proof or an update needs them.
+// Binary with h = 4: a sixteenth of the nodes, at most 15 extra hashes
+// per proof.
+//
+// A built bucket holds heights 1..h one after another, height j being
+// k^(h - j) digests, so the children of any node sit side by side and each
+// parent hashes them straight from where they lie.
+
+// Hash one bucket into levels (MERKLE_BUCKET_BYTES) and return its root
+const uint8_t* merkle_bucket_build(const merkle_tree_t* tree, uint64_t bucket, uint8_t* levels) {
+    size_t width = (size_t)1 << (tree->arity_log2 * tree->pruned_height);
+    size_t group = (size_t)tree->arity * SHA256_HASH_SIZE;
+    const uint8_t* below = tree->leaf_hashes + bucket * width * SHA256_HASH_SIZE;
+    uint8_t* out = levels;
+    
+    for (uint8_t height = 1; height <= tree->pruned_height; height++) {
+        width >>= tree->arity_log2;
+        for (size_t i = 0; i < width; i++) {
+            tree->hash_function(below + i * group, group, out + i * SHA256_HASH_SIZE);
+        }
+        below = out;
+        out += width * SHA256_HASH_SIZE;
+    }
+    return below;
+}
+
+// Recompute the stored node of one bucket from its leaf hashes
+void merkle_bucket_rehash(const merkle_tree_t* tree, merkle_node_t* node, uint64_t bucket) {
+    uint8_t levels[MERKLE_BUCKET_BYTES];
+    memcpy(node->hash, merkle_bucket_build(tree, bucket, levels), SHA256_HASH_SIZE);
+}
+
+// Copy the sibling groups of the bottom h levels of leaf_index's path out
+// of its built bucket, in proof layout: the group at height j goes to slot j
+void merkle_bucket_siblings(const merkle_tree_t* tree, const uint8_t* levels, uint64_t leaf_index,
+                            uint8_t* siblings) {
+    size_t width = (size_t)1 << (tree->arity_log2 * tree->pruned_height);
+    uint64_t position = leaf_index & (width - 1);
+    const uint8_t* digests = tree->leaf_hashes + (leaf_index - position) * SHA256_HASH_SIZE;
+    
+    for (uint8_t height = 0; height < tree->pruned_height; height++) {
+        uint64_t first = position & ~(uint64_t)(tree->arity - 1);
+        for (uint64_t i = first; i < first + tree->arity; i++) {
+            if (i != position) {
+                memcpy(siblings, digests + i * SHA256_HASH_SIZE, SHA256_HASH_SIZE);
+                siblings += SHA256_HASH_SIZE;
+            }
+        }
+        digests = height == 0 ? levels : digests + width * SHA256_HASH_SIZE;
+        width >>= tree->arity_log2;
+        position >>= tree->arity_log2;
+    }
+}
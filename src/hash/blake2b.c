@@ -27,47 +27,48 @@ static const uint8_t BLAKE2B_sigma[12][16] = {
     {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3}
 };
 
-#define ROTR64(x, n) ((x >> n) | (x << (64 - n)))
+#define ROTR64(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
 #define BLAKE2B_ROUND(r) \
     do { \
-        G(0, 4, 8, 12); \
-        G(1, 5, 9, 13); \
-        G(2, 6, 10, 14); \
-        G(3, 7, 11, 15); \
-        G(0, 5, 10, 15); \
-        G(1, 6, 11, 12); \
-        G(2, 7, 8, 13); \
-        G(3, 4, 9, 14); \
+        G(r, 0, 0, 4, 8, 12); \
+        G(r, 1, 1, 5, 9, 13); \
+        G(r, 2, 2, 6, 10, 14); \
+        G(r, 3, 3, 7, 11, 15); \
+        G(r, 4, 0, 5, 10, 15); \
+        G(r, 5, 1, 6, 11, 12); \
+        G(r, 6, 2, 7, 8, 13); \
+        G(r, 7, 3, 4, 9, 14); \
     } while(0)
 
-#define G(a, b, c, d) \
+// Mixing function G (RFC 7693 section 3.1); step i consumes message words 2i and 2i+1
+#define G(r, i, a, b, c, d) \
     do { \
-        v[a] = v[a] + v[b] + m[BLAKE2B_sigma[j][a]]; \
+        v[a] = v[a] + v[b] + m[BLAKE2B_sigma[r][2 * (i)]]; \
         v[d] = ROTR64(v[d] ^ v[a], 32); \
         v[c] = v[c] + v[d]; \
         v[b] = ROTR64(v[b] ^ v[c], 24); \
-        v[a] = v[a] + v[b] + m[BLAKE2B_sigma[j][a]]; \
+        v[a] = v[a] + v[b] + m[BLAKE2B_sigma[r][2 * (i) + 1]]; \
         v[d] = ROTR64(v[d] ^ v[a], 16); \
         v[c] = v[c] + v[d]; \
         v[b] = ROTR64(v[b] ^ v[c], 63); \
     } while(0)
 
 // BLAKE2b helper functions
-static void blake2b_compress(blake2b_context_t* ctx, const uint8_t* block) {
+static void blake2b_compress(blake2b_context_t* ctx, const uint8_t* block, bool is_last) {
     uint64_t m[16];
     uint64_t v[16];
     int i, j;
     
-    // Load message block
+    // Load message block (little-endian words)
     for (i = 0; i < 16; i++) {
-        m[i] = ((uint64_t)block[i * 8] << 56) |
-               ((uint64_t)block[i * 8 + 1] << 48) |
-               ((uint64_t)block[i * 8 + 2] << 40) |
-               ((uint64_t)block[i * 8 + 3] << 32) |
-               ((uint64_t)block[i * 8 + 4] << 24) |
-               ((uint64_t)block[i * 8 + 5] << 16) |
-               ((uint64_t)block[i * 8 + 6] << 8) |
-               ((uint64_t)block[i * 8 + 7]);
+        m[i] = ((uint64_t)block[i * 8]) |
+               ((uint64_t)block[i * 8 + 1] << 8) |
+               ((uint64_t)block[i * 8 + 2] << 16) |
+               ((uint64_t)block[i * 8 + 3] << 24) |
+               ((uint64_t)block[i * 8 + 4] << 32) |
+               ((uint64_t)block[i * 8 + 5] << 40) |
+               ((uint64_t)block[i * 8 + 6] << 48) |
+               ((uint64_t)block[i * 8 + 7] << 56);
     }
     
     // Initialize working variables
@@ -79,9 +80,12 @@ static void blake2b_compress(blake2b_context_t* ctx, const uint8_t* block) {
         v[i + 8] = BLAKE2B_IV[i];
     }
     
-    // Add input block count
-    v[12] ^= ctx->last_node;
-    v[14] ^= ctx->last_node_index;
+    // Mix in the byte counter and the final-block flag
+    v[12] ^= ctx->counter[0];
+    v[13] ^= ctx->counter[1];
+    if (is_last) {
+        v[14] = ~v[14];
+    }
     
     // Apply compression rounds
     for (j = 0; j < 12; j++) {
@@ -94,19 +98,26 @@ static void blake2b_compress(blake2b_context_t* ctx, const uint8_t* block) {
     }
 }
 
+static void blake2b_increment_counter(blake2b_context_t* ctx, uint64_t bytes) {
+    ctx->counter[0] += bytes;
+    if (ctx->counter[0] < bytes) {
+        ctx->counter[1]++;
+    }
+}
+
 void blake2b_init(blake2b_context_t* ctx, size_t out_len) {
     // Initialize state with IV
     for (int i = 0; i < 8; i++) {
         ctx->state[i] = BLAKE2B_IV[i];
     }
     
-    // Initialize parameters
+    // Parameter block: digest length, no key, fanout 1, depth 1
     ctx->state[0] ^= 0x01010000 ^ out_len;
     
     ctx->buffer_len = 0;
     ctx->out_len = out_len;
-    ctx->last_node = 0;
-    ctx->last_node_index = 0;
+    ctx->counter[0] = 0;
+    ctx->counter[1] = 0;
     
     memset(ctx->buffer, 0, sizeof(ctx->buffer));
 }
@@ -115,28 +126,31 @@ void blake2b_update(blake2b_context_t* ctx, const uint8_t* data, size_t len) {
     size_t i;
     
     for (i = 0; i < len; i++) {
-        ctx->buffer[ctx->buffer_len++] = data[i];
-        
+        // A full buffer is only compressed once more input arrives, so the
+        // last block is always left for blake2b_final to flag
         if (ctx->buffer_len == BLAKE2B_BLOCK_SIZE) {
-            blake2b_compress(ctx, ctx->buffer);
+            blake2b_increment_counter(ctx, BLAKE2B_BLOCK_SIZE);
+            blake2b_compress(ctx, ctx->buffer, false);
             ctx->buffer_len = 0;
         }
+        
+        ctx->buffer[ctx->buffer_len++] = data[i];
     }
 }
 
 void blake2b_final(blake2b_context_t* ctx, uint8_t* hash) {
+    blake2b_increment_counter(ctx, ctx->buffer_len);
+    
     // Pad buffer
     for (size_t i = ctx->buffer_len; i < BLAKE2B_BLOCK_SIZE; i++) {
         ctx->buffer[i] = 0;
     }
     
-    // Add final block flag
-    ctx->last_node = 1;
-    blake2b_compress(ctx, ctx->buffer);
+    blake2b_compress(ctx, ctx->buffer, true);
     
-    // Output hash
+    // Output hash (little-endian)
     for (size_t i = 0; i < ctx->out_len; i++) {
-        hash[i] = (uint8_t)(ctx->state[i / 8] >> (56 - (i % 8) * 8));
+        hash[i] = (uint8_t)(ctx->state[i / 8] >> ((i % 8) * 8));
     }
 }
 
@@ -169,7 +183,7 @@ hash_algorithm_t* get_hash_algorithm(hash_type_t type) {
     static hash_algorithm_t algorithms[2] = {0};
     
     // Initialize on first call
-    if (algorithms[0].type == 0) {
+    if (algorithms[0].hash == NULL) {
         // SHA-256
         algorithms[0].type = HASH_SHA256;
         algorithms[0].hash_size = SHA256_HASH_SIZE;
@@ -189,7 +203,7 @@ hash_algorithm_t* get_hash_algorithm(hash_type_t type) {
         algorithms[1].hash = (hash_direct_func)blake2b_hash;
     }
     
-    if (type >= HASH_BLAKE2B) {
+    if (type >= HASH_CUSTOM) {
         return NULL;
     }
     
@@ -236,41 +250,6 @@ void hash_copy(const uint8_t* src, uint8_t* dst, hash_type_t type) {
     memcpy(dst, src, hash_size);
 }
 
-// Performance benchmarking
-static hash_performance_t g_hash_perf = {0};
-
-void hash_benchmark_init(hash_type_t type) {
-    memset(&g_hash_perf, 0, sizeof(g_hash_perf));
-}
-
-hash_performance_t hash_benchmark_run(const uint8_t* data, size_t len, size_t iterations) {
-    hash_performance_t perf = {0};
-    
-    for (size_t i = 0; i < iterations; i++) {
-        uint8_t hash[32];
-        
-        // Simple timing - in a real RISC-V implementation, you'd use cycle counters
-        uint64_t start = 0; // Placeholder for RISC-V cycle counter
-        sha256_hash(data, len, hash);
-        uint64_t end = 1000; // Placeholder value
-        
-        uint64_t cycles = end - start;
-        perf.total_cycles += cycles;
-        
-        if (i == 0 || cycles < perf.min_cycles) {
-            perf.min_cycles = cycles;
-        }
-        if (cycles > perf.max_cycles) {
-            perf.max_cycles = cycles;
-        }
-    }
-    
-    perf.total_bytes = len * iterations;
-    perf.avg_cycles_per_byte = perf.total_cycles / perf.total_bytes;
-    
-    return perf;
-}
-
 // Test vectors (simplified)
 bool sha256_test_vectors(void) {
     // Test known vectors
@@ -291,14 +270,21 @@ bool sha256_test_vectors(void) {
 }
 
 bool blake2b_test_vectors(void) {
-    // Simplified test - just check it doesn't crash
+    // Test known vector (BLAKE2b-256)
+    const char* msg = "abc";
     uint8_t hash[32];
-    const char* msg = "test";
     
-    blake2b_hash((const uint8_t*)msg, 4, hash);
+    blake2b_hash((const uint8_t*)msg, 3, hash);
     
-    // This is a simplified test - in reality you'd check against known vectors
-    return hash[0] != 0 || hash[1] != 0; // Just check it's not all zeros
+    // Expected: bddd813c634239723171ef3fee98579b94964e3bb1cb3e427262c8c068d52319
+    const uint8_t expected[32] = {
+        0xbd, 0xdd, 0x81, 0x3c, 0x63, 0x42, 0x39, 0x72,
+        0x31, 0x71, 0xef, 0x3f, 0xee, 0x98, 0x57, 0x9b,
+        0x94, 0x96, 0x4e, 0x3b, 0xb1, 0xcb, 0x3e, 0x42,
+        0x72, 0x62, 0xc8, 0xc0, 0x68, 0xd5, 0x23, 0x19
+    };
+    
+    return memcmp(hash, expected, 32) == 0;
 }
 
 bool hash_test_all(void) {
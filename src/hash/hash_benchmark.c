@@ -0,0 +1,181 @@
+#define _GNU_SOURCE
+
+#include "hash_functions.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+// Budget of bytes hashed per sweep point, bounded by the iteration limits below
+#define HASH_SWEEP_BYTES_PER_POINT (8 * 1024 * 1024)
+#define HASH_SWEEP_MIN_ITERATIONS 16
+#define HASH_SWEEP_MAX_ITERATIONS 200000
+
+// Performance benchmarking
+static hash_type_t g_bench_type = HASH_SHA256;
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+uint64_t hash_cycle_counter(void) {
+#if defined(__x86_64__)
+    _mm_lfence();  // Keep earlier work from drifting past the read
+    return __rdtsc();
+#elif defined(__riscv)
+    uint64_t cycles;
+    __asm__ volatile ("rdcycle %0" : "=r"(cycles));
+    return cycles;
+#else
+    return monotonic_ns();
+#endif
+}
+
+const char* hash_cycle_counter_name(void) {
+#if defined(__x86_64__)
+    return "rdtsc";
+#elif defined(__riscv)
+    return "rdcycle";
+#else
+    return "ns";
+#endif
+}
+
+static const char* hash_type_name(hash_type_t type) {
+    switch (type) {
+        case HASH_SHA256:
+            return "SHA-256";
+        case HASH_BLAKE2B:
+            return "BLAKE2b";
+        default:
+            return "custom";
+    }
+}
+
+void hash_benchmark_init(hash_type_t type) {
+    g_bench_type = get_hash_algorithm(type) ? type : HASH_SHA256;
+}
+
+hash_performance_t hash_benchmark_run(const uint8_t* data, size_t len, size_t iterations) {
+    hash_performance_t perf = {0};
+    hash_algorithm_t* algorithm = get_hash_algorithm(g_bench_type);
+    
+    if (!algorithm || !data || iterations == 0) {
+        return perf;
+    }
+    
+    uint8_t hash[32];
+    
+    // Warm up caches, branch predictors and the clock governor
+    size_t warmup = iterations / 8 + 1;
+    for (size_t i = 0; i < warmup; i++) {
+        algorithm->hash(data, len, hash);
+    }
+    
+    uint64_t start_ns = monotonic_ns();
+    
+    for (size_t i = 0; i < iterations; i++) {
+        uint64_t start = hash_cycle_counter();
+        algorithm->hash(data, len, hash);
+        uint64_t end = hash_cycle_counter();
+        
+        uint64_t cycles = end - start;
+        perf.total_cycles += cycles;
+        
+        if (i == 0 || cycles < perf.min_cycles) {
+            perf.min_cycles = cycles;
+        }
+        if (cycles > perf.max_cycles) {
+            perf.max_cycles = cycles;
+        }
+    }
+    
+    perf.total_ns = monotonic_ns() - start_ns;
+    perf.total_bytes = len * iterations;
+    
+    if (perf.total_bytes > 0) {
+        perf.avg_cycles_per_byte = (double)perf.total_cycles / (double)perf.total_bytes;
+    }
+    if (perf.total_ns > 0) {
+        perf.gigabytes_per_sec = (double)perf.total_bytes / (double)perf.total_ns;
+    }
+    
+    // Keep the result observable so the loop is not optimized away
+    __asm__ volatile ("" : : "r"(hash) : "memory");
+    
+    return perf;
+}
+
+bool hash_benchmark_sweep(size_t min_len, size_t max_len) {
+    if (min_len == 0 || min_len > max_len) {
+        return false;
+    }
+    
+    uint8_t* data = (uint8_t*)malloc(max_len);
+    if (!data) {
+        return false;
+    }
+    
+    for (size_t i = 0; i < max_len; i++) {
+        data[i] = (uint8_t)(i * 131 + 7);
+    }
+    
+    // Pin to the CPU we are on so the cycle counter is read from one core
+    cpu_set_t saved_mask;
+    bool pinned = false;
+    if (sched_getaffinity(0, sizeof(saved_mask), &saved_mask) == 0) {
+        int cpu = sched_getcpu();
+        if (cpu >= 0) {
+            cpu_set_t mask;
+            CPU_ZERO(&mask);
+            CPU_SET(cpu, &mask);
+            pinned = sched_setaffinity(0, sizeof(mask), &mask) == 0;
+        }
+    }
+    
+    printf("Hash benchmark (counter: %s, pinned: %s)\n",
+           hash_cycle_counter_name(), pinned ? "yes" : "no");
+    printf("%-8s %10s %10s %12s %12s %10s\n",
+           "Backend", "Size (B)", "Iters", "Min cycles", "Cycles/B", "GB/s");
+    
+    hash_type_t saved_type = g_bench_type;
+    
+    for (int type = 0; type < HASH_CUSTOM; type++) {
+        if (!get_hash_algorithm((hash_type_t)type)) {
+            continue;
+        }
+        hash_benchmark_init((hash_type_t)type);
+        
+        for (size_t len = min_len; len <= max_len; len *= 2) {
+            size_t iterations = HASH_SWEEP_BYTES_PER_POINT / len;
+            if (iterations < HASH_SWEEP_MIN_ITERATIONS) iterations = HASH_SWEEP_MIN_ITERATIONS;
+            if (iterations > HASH_SWEEP_MAX_ITERATIONS) iterations = HASH_SWEEP_MAX_ITERATIONS;
+            
+            hash_performance_t perf = hash_benchmark_run(data, len, iterations);
+            printf("%-8s %10zu %10zu %12llu %12.2f %10.3f\n",
+                   hash_type_name((hash_type_t)type), len, iterations,
+                   (unsigned long long)perf.min_cycles,
+                   perf.avg_cycles_per_byte, perf.gigabytes_per_sec);
+            
+            if (len > max_len / 2) {
+                break;  // Avoid overflow on the doubling step
+            }
+        }
+    }
+    
+    g_bench_type = saved_type;
+    
+    if (pinned) {
+        sched_setaffinity(0, sizeof(saved_mask), &saved_mask);
+    }
+    
+    free(data);
+    return true;
+}
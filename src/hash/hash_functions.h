@@ -28,8 +28,7 @@ typedef struct {
     uint8_t buffer[BLAKE2B_BLOCK_SIZE];
     size_t buffer_len;
     size_t out_len;
-    uint64_t last_node;
-    uint64_t last_node_index;
+    uint64_t counter[2];             // Bytes compressed so far (128-bit)
 } blake2b_context_t;
 
 // SHA-256 function declarations
@@ -83,11 +82,23 @@ typedef struct {
     uint64_t max_cycles;
     uint64_t total_bytes;
     double avg_cycles_per_byte;
+    uint64_t total_ns;
+    double gigabytes_per_sec;
 } hash_performance_t;
 
+// Cycle source: rdtsc on x86-64 (reference cycles), rdcycle on RISC-V,
+// CLOCK_MONOTONIC nanoseconds elsewhere
+uint64_t hash_cycle_counter(void);
+const char* hash_cycle_counter_name(void);
+
+// Select the backend used by hash_benchmark_run (default SHA-256)
 void hash_benchmark_init(hash_type_t type);
 hash_performance_t hash_benchmark_run(const uint8_t* data, size_t len, size_t iterations);
 
+// Pin to the current CPU, run every registered backend over power-of-two
+// input sizes from min_len to max_len and print cycles/byte and GB/s
+bool hash_benchmark_sweep(size_t min_len, size_t max_len);
+
 // Test functions
 bool sha256_test_vectors(void);
 bool blake2b_test_vectors(void);
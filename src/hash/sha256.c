@@ -45,6 +45,59 @@ void sha256_init(sha256_context_t* ctx) {
     memset(ctx->buffer, 0, sizeof(ctx->buffer));
 }
 
+// Process one 64-byte block
+static void sha256_transform(sha256_context_t* ctx, const uint8_t* block) {
+    uint32_t W[64];
+    uint32_t a, b, c, d, e, f, g, h, t1, t2;
+    int j;
+    
+    // Prepare message schedule
+    for (j = 0; j < 16; j++) {
+        W[j] = ((uint32_t)block[j * 4] << 24) |
+               ((uint32_t)block[j * 4 + 1] << 16) |
+               ((uint32_t)block[j * 4 + 2] << 8) |
+               ((uint32_t)block[j * 4 + 3]);
+    }
+    
+    for (j = 16; j < 64; j++) {
+        W[j] = sig1(W[j - 2]) + W[j - 7] + sig0(W[j - 15]) + W[j - 16];
+    }
+    
+    // Initialize working variables
+    a = ctx->state[0];
+    b = ctx->state[1];
+    c = ctx->state[2];
+    d = ctx->state[3];
+    e = ctx->state[4];
+    f = ctx->state[5];
+    g = ctx->state[6];
+    h = ctx->state[7];
+    
+    // Main loop
+    for (j = 0; j < 64; j++) {
+        t1 = h + SIG1(e) + CH(e, f, g) + K[j] + W[j];
+        t2 = SIG0(a) + MAJ(a, b, c);
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    
+    // Update state
+    ctx->state[0] += a;
+    ctx->state[1] += b;
+    ctx->state[2] += c;
+    ctx->state[3] += d;
+    ctx->state[4] += e;
+    ctx->state[5] += f;
+    ctx->state[6] += g;
+    ctx->state[7] += h;
+}
+
 void sha256_update(sha256_context_t* ctx, const uint8_t* data, size_t len) {
     size_t i;
     
@@ -54,57 +107,7 @@ void sha256_update(sha256_context_t* ctx, const uint8_t* data, size_t len) {
         ctx->buffer[ctx->buffer_len++] = data[i];
         
         if (ctx->buffer_len == SHA256_BLOCK_SIZE) {
-            // Process block
-            uint32_t W[64];
-            uint32_t a, b, c, d, e, f, g, h, t1, t2;
-            int j;
-            
-            // Prepare message schedule
-            for (j = 0; j < 16; j++) {
-                W[j] = ((uint32_t)ctx->buffer[j * 4] << 24) |
-                       ((uint32_t)ctx->buffer[j * 4 + 1] << 16) |
-                       ((uint32_t)ctx->buffer[j * 4 + 2] << 8) |
-                       ((uint32_t)ctx->buffer[j * 4 + 3]);
-            }
-            
-            for (j = 16; j < 64; j++) {
-                W[j] = sig1(W[j - 2]) + W[j - 7] + sig0(W[j - 15]) + W[j - 16];
-            }
-            
-            // Initialize working variables
-            a = ctx->state[0];
-            b = ctx->state[1];
-            c = ctx->state[2];
-            d = ctx->state[3];
-            e = ctx->state[4];
-            f = ctx->state[5];
-            g = ctx->state[6];
-            h = ctx->state[7];
-            
-            // Main loop
-            for (j = 0; j < 64; j++) {
-                t1 = h + SIG1(e) + CH(e, f, g) + K[j] + W[j];
-                t2 = SIG0(a) + MAJ(a, b, c);
-                h = g;
-                g = f;
-                f = e;
-                e = d + t1;
-                d = c;
-                c = b;
-                b = a;
-                a = t1 + t2;
-            }
-            
-            // Update state
-            ctx->state[0] += a;
-            ctx->state[1] += b;
-            ctx->state[2] += c;
-            ctx->state[3] += d;
-            ctx->state[4] += e;
-            ctx->state[5] += f;
-            ctx->state[6] += g;
-            ctx->state[7] += h;
-            
+            sha256_transform(ctx, ctx->buffer);
             ctx->buffer_len = 0;
         }
     }
@@ -119,7 +122,7 @@ void sha256_final(sha256_context_t* ctx, uint8_t* hash) {
     if (ctx->buffer_len > 56) {
         // Need another block
         memset(ctx->buffer + ctx->buffer_len, 0, SHA256_BLOCK_SIZE - ctx->buffer_len);
-        sha256_update(ctx, ctx->buffer, SHA256_BLOCK_SIZE);
+        sha256_transform(ctx, ctx->buffer);
         ctx->buffer_len = 0;
     }
     
@@ -132,7 +135,7 @@ void sha256_final(sha256_context_t* ctx, uint8_t* hash) {
     }
     
     // Process final block
-    sha256_update(ctx, ctx->buffer, SHA256_BLOCK_SIZE);
+    sha256_transform(ctx, ctx->buffer);
     
     // Output hash
     for (int i = 0; i < 8; i++) {
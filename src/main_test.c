@@ -1,7 +1,15 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include "core/merkle_tree.h"
 #include "hash/hash_functions.h"
 #include "spi/spi_interface.h"
@@ -56,6 +64,187 @@ bool test_memory_pool(void) {
     return true;
 }
 
+// Runs after the accounting shard's own destructor has retired the shard
+static void accounting_late_free(void* arg) {
+    merkle_memory_account_free(MERKLE_MEM_PROOF, (size_t)(uintptr_t)arg);
+}
+
+static void* accounting_exit_worker(void* arg) {
+    pthread_key_t* key = (pthread_key_t*)arg;
+    merkle_memory_account_alloc(MERKLE_MEM_PROOF, 4096);
+    pthread_setspecific(*key, (void*)(uintptr_t)4096);
+    return NULL;
+}
+
+bool test_memory_accounting(void) {
+    printf("Testing memory accounting...\n");
+    
+    merkle_memory_stats_t before = merkle_memory_get_thread_stats();
+    
+    merkle_tree_t* tree = merkle_tree_create(1024, HASH_SHA256);
+    TEST_ASSERT(tree != NULL, "Tree creation failed");
+    
+    uint8_t* data = (uint8_t*)malloc(1024 * 32);
+    TEST_ASSERT(data != NULL, "Test data allocation failed");
+    for (size_t i = 0; i < 1024 * 32; i++) {
+        data[i] = (uint8_t)i;
+    }
+    
+    TEST_ASSERT(merkle_tree_build(tree, data, 1024 * 32) == MERKLE_SUCCESS, "Tree build failed");
+    
+    merkle_performance_metrics_t metrics = merkle_performance_get_metrics(tree);
+    TEST_ASSERT(metrics.peak_memory_usage >= tree->memory_live_bytes, "Peak below live bytes");
+    TEST_ASSERT(metrics.peak_memory_usage > 1024 * 32 + 2048 * sizeof(merkle_node_t),
+                "Peak should cover leaf copy and node pool");
+    
+    // Rebuilding must not leak the previous leaf copy
+    size_t live_after_build = tree->memory_live_bytes;
+    TEST_ASSERT(merkle_tree_build(tree, data, 1024 * 32) == MERKLE_SUCCESS, "Tree rebuild failed");
+    TEST_ASSERT_EQUAL(live_after_build, tree->memory_live_bytes, "Rebuild changed live bytes");
+    
+    merkle_proof_t* proof = merkle_proof_create(tree, 7);
+    TEST_ASSERT(proof != NULL, "Proof creation failed");
+    merkle_memory_stats_t with_proof = merkle_memory_get_thread_stats();
+    TEST_ASSERT(with_proof.live_bytes[MERKLE_MEM_PROOF] - before.live_bytes[MERKLE_MEM_PROOF] ==
+                (int64_t)(sizeof(merkle_proof_t) + proof->num_siblings * SHA256_HASH_SIZE),
+                "Proof bytes not accounted");
+    merkle_proof_destroy(proof);
+    
+    merkle_tree_destroy(tree);
+    free(data);
+    
+    // Process-wide latency counters stay allocated, so compare data categories only
+    merkle_memory_stats_t after = merkle_memory_get_thread_stats();
+    TEST_ASSERT_EQUAL(before.live_bytes[MERKLE_MEM_POOL], after.live_bytes[MERKLE_MEM_POOL], "Pool bytes leaked");
+    TEST_ASSERT_EQUAL(before.live_bytes[MERKLE_MEM_LEVELS], after.live_bytes[MERKLE_MEM_LEVELS], "Level bytes leaked");
+    TEST_ASSERT_EQUAL(before.live_bytes[MERKLE_MEM_PROOF], after.live_bytes[MERKLE_MEM_PROOF], "Proof bytes leaked");
+    TEST_ASSERT(after.total_peak_bytes >= (int64_t)live_after_build, "Thread peak not tracked");
+    
+    // Accounting from a thread's late TLS destructors lands in the retired
+    // totals instead of the freed shard
+    int64_t global_before = merkle_memory_get_global_stats().live_bytes[MERKLE_MEM_PROOF];
+    pthread_key_t key;
+    TEST_ASSERT(pthread_key_create(&key, accounting_late_free) == 0, "Key creation failed");
+    pthread_t thread;
+    TEST_ASSERT(pthread_create(&thread, NULL, accounting_exit_worker, &key) == 0, "Thread creation failed");
+    pthread_join(thread, NULL);
+    pthread_key_delete(key);
+    TEST_ASSERT_EQUAL(global_before, merkle_memory_get_global_stats().live_bytes[MERKLE_MEM_PROOF],
+                      "Late free after thread exit should balance");
+    
+    printf("  Memory accounting tests passed!\n");
+    return true;
+}
+
+bool test_performance_timing(void) {
+    printf("Testing performance timing...\n");
+    
+    merkle_tree_t* tree = merkle_tree_create(256, HASH_SHA256);
+    TEST_ASSERT(tree != NULL, "Tree creation failed");
+    
+    uint8_t data[256 * 32];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)(i * 7);
+    }
+    TEST_ASSERT(merkle_tree_build(tree, data, sizeof(data)) == MERKLE_SUCCESS, "Tree build failed");
+    
+    for (uint64_t i = 0; i < 100; i++) {
+        merkle_proof_t* proof = merkle_proof_create(tree, i);
+        TEST_ASSERT(proof != NULL, "Proof creation failed");
+        merkle_proof_destroy(proof);
+    }
+    
+    merkle_latency_stats_t build = merkle_performance_get_latency(tree, MERKLE_OP_BUILD);
+    merkle_latency_stats_t proof = merkle_performance_get_latency(tree, MERKLE_OP_PROOF);
+    merkle_performance_metrics_t metrics = merkle_performance_get_metrics(tree);
+
+#ifdef MERKLE_ENABLE_TIMING
+    TEST_ASSERT_EQUAL(1, build.count, "One build should be recorded");
+    TEST_ASSERT_EQUAL(100, proof.count, "All proofs should be recorded");
+    TEST_ASSERT(proof.min_ns <= proof.p50_ns, "min <= p50");
+    TEST_ASSERT(proof.p50_ns <= proof.p99_ns, "p50 <= p99");
+    TEST_ASSERT(proof.p99_ns <= proof.p999_ns, "p99 <= p999");
+    TEST_ASSERT(proof.p999_ns <= proof.max_ns, "p999 <= max");
+    TEST_ASSERT(metrics.construction_time_ns > 0, "Construction time should be recorded");
+    
+    merkle_performance_reset(tree);
+    proof = merkle_performance_get_latency(tree, MERKLE_OP_PROOF);
+    TEST_ASSERT_EQUAL(0, proof.count, "Reset should clear proof latency");
+#else
+    TEST_ASSERT_EQUAL(0, build.count, "Timing disabled should record nothing");
+    TEST_ASSERT_EQUAL(0, proof.count, "Timing disabled should record nothing");
+    TEST_ASSERT_EQUAL(0, metrics.construction_time_ns, "Timing disabled should record nothing");
+#endif
+    
+    merkle_tree_destroy(tree);
+    
+    printf("  Performance timing tests passed!\n");
+    return true;
+}
+
+bool test_hw_counters(void) {
+    printf("Testing hardware counters...\n");
+    
+    // Counter deltas, including scaling for a multiplexed interval
+    merkle_hw_sample_t start = {.values = {100, 200, 10, 4}, .time_enabled = 1000,
+                                .time_running = 1000, .valid_mask = 0xF};
+    merkle_hw_sample_t end = {.values = {300, 600, 30, 8}, .time_enabled = 2000,
+                              .time_running = 1500, .valid_mask = 0x7};
+    merkle_hw_sample_t delta;
+    TEST_ASSERT(merkle_hw_counters_delta(&start, &end, &delta), "Delta should succeed");
+    TEST_ASSERT_EQUAL(0x7, delta.valid_mask, "Only counters valid at both ends count");
+    TEST_ASSERT_EQUAL(400, delta.values[MERKLE_HW_CYCLES], "Delta should scale by enabled/running");
+    TEST_ASSERT_EQUAL(0, delta.values[MERKLE_HW_LLC_MISSES], "Invalid counter should stay zero");
+    
+    merkle_tree_t* tree = merkle_tree_create(1024, HASH_SHA256);
+    TEST_ASSERT(tree != NULL, "Tree creation failed");
+    
+    uint8_t* data = (uint8_t*)malloc(1024 * 32);
+    TEST_ASSERT(data != NULL, "Allocation failed");
+    memset(data, 0x5A, 1024 * 32);
+    
+    bool available = merkle_hw_counters_enable(true);
+    printf("  perf_event counters %s\n", available ? "available" : "unavailable, checking fallback");
+    
+    TEST_ASSERT(merkle_tree_build(tree, data, 1024 * 32) == MERKLE_SUCCESS, "Tree build failed");
+    for (uint64_t i = 0; i < 64; i++) {
+        merkle_proof_t* proof = merkle_proof_create(tree, i * 16);
+        TEST_ASSERT(proof != NULL, "Proof creation failed");
+        merkle_proof_destroy(proof);
+    }
+    
+    merkle_hw_stats_t build = merkle_performance_get_hw_counters(tree, MERKLE_OP_BUILD);
+    merkle_hw_stats_t proof = merkle_performance_get_hw_counters(tree, MERKLE_OP_PROOF);
+    merkle_performance_metrics_t metrics = merkle_performance_get_metrics(tree);
+    
+    if (available) {
+        TEST_ASSERT_EQUAL(1, build.samples, "Build should be sampled once");
+        TEST_ASSERT_EQUAL(64, proof.samples, "Every proof should be sampled");
+        TEST_ASSERT(build.valid_mask != 0, "Some counter should be valid");
+        if (build.valid_mask & (1u << MERKLE_HW_INSTRUCTIONS)) {
+            TEST_ASSERT(build.values[MERKLE_HW_INSTRUCTIONS] > proof.values[MERKLE_HW_INSTRUCTIONS] / 64,
+                        "Build should retire more instructions than one proof");
+        }
+        uint64_t references = build.values[MERKLE_HW_LLC_REFERENCES] + proof.values[MERKLE_HW_LLC_REFERENCES];
+        TEST_ASSERT(metrics.cache_hits + metrics.cache_misses <= references ||
+                    metrics.cache_hits == 0, "Hits and misses should come from LLC references");
+    } else {
+        TEST_ASSERT_EQUAL(0, build.samples, "No samples without counters");
+        TEST_ASSERT_EQUAL(0, proof.samples, "No samples without counters");
+        TEST_ASSERT_EQUAL(0, metrics.cache_misses, "No cache misses without counters");
+        TEST_ASSERT_EQUAL(0, metrics.cache_hits, "No cache hits without counters");
+    }
+    
+    merkle_hw_counters_enable(false);
+    TEST_ASSERT(!merkle_hw_counters_enabled(), "Counters should be disabled");
+    
+    free(data);
+    merkle_tree_destroy(tree);
+    
+    printf("  Hardware counter tests passed!\n");
+    return true;
+}
+
 bool test_tree_depth_calculation(void) {
     printf("Testing tree depth calculation...\n");
     
@@ -131,6 +320,1215 @@ bool test_sha256_basic(void) {
     return true;
 }
 
+bool test_blake2b_basic(void) {
+    printf("Testing BLAKE2b basic functionality...\n");
+    
+    TEST_ASSERT(blake2b_test_vectors(), "BLAKE2b-256 hash matches expected value");
+    
+    printf("  BLAKE2b basic tests passed!\n");
+    return true;
+}
+
+bool test_hash_benchmark(void) {
+    printf("Testing hash benchmark harness...\n");
+    
+    uint8_t data[64];
+    memset(data, 0xab, sizeof(data));
+    
+    TEST_ASSERT(get_hash_algorithm(HASH_BLAKE2B) != NULL, "BLAKE2b should be registered");
+    
+    hash_benchmark_init(HASH_BLAKE2B);
+    hash_performance_t perf = hash_benchmark_run(data, sizeof(data), 100);
+    hash_benchmark_init(HASH_SHA256);
+    
+    TEST_ASSERT_EQUAL(6400, perf.total_bytes, "Total bytes mismatch");
+    TEST_ASSERT(perf.total_cycles > 0, "Cycles should be measured");
+    TEST_ASSERT(perf.min_cycles <= perf.max_cycles, "min <= max");
+    TEST_ASSERT(perf.avg_cycles_per_byte > 0.0, "Cycles/byte should be positive");
+    
+    printf("  Hash benchmark tests passed!\n");
+    return true;
+}
+
+bool test_proof_roundtrip(void) {
+    printf("Testing proof generation and verification...\n");
+    
+    const hash_type_t types[2] = {HASH_SHA256, HASH_BLAKE2B};
+    uint8_t data[64 * 32];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)(i * 13 + 5);
+    }
+    
+    for (int t = 0; t < 2; t++) {
+        merkle_tree_t* tree = merkle_tree_create(64, types[t]);
+        TEST_ASSERT(tree != NULL, "Tree creation failed");
+        TEST_ASSERT(merkle_tree_build(tree, data, sizeof(data)) == MERKLE_SUCCESS, "Tree build failed");
+        
+        for (uint64_t i = 0; i < 64; i += 7) {
+            merkle_proof_t* proof = merkle_proof_create(tree, i);
+            TEST_ASSERT(proof != NULL, "Proof creation failed");
+            TEST_ASSERT(merkle_proof_verify(proof, data + i * 32), "Valid proof should verify");
+            TEST_ASSERT(!merkle_proof_verify(proof, data + ((i + 1) % 64) * 32), "Wrong leaf should not verify");
+            
+            // Serialization round trip
+            uint8_t buffer[SPI_MAX_PROOF_SIZE];
+            TEST_ASSERT(proof->proof_size <= sizeof(buffer), "Proof too large");
+            TEST_ASSERT(merkle_proof_serialize(proof, buffer, proof->proof_size) == MERKLE_SUCCESS,
+                        "Serialization failed");
+            merkle_proof_t decoded = {0};
+            TEST_ASSERT(merkle_proof_deserialize(buffer, proof->proof_size, &decoded) == MERKLE_SUCCESS,
+                        "Deserialization failed");
+            TEST_ASSERT(merkle_proof_verify(&decoded, data + i * 32), "Decoded proof should verify");
+            merkle_proof_clear(&decoded);
+            
+            // A tampered sibling must break the path
+            proof->sibling_hashes[0] ^= 1;
+            TEST_ASSERT(!merkle_proof_verify(proof, data + i * 32), "Tampered proof should not verify");
+            merkle_proof_destroy(proof);
+        }
+        
+        // Path update must match a full rebuild
+        uint8_t new_leaf[32];
+        memset(new_leaf, 0x5a, sizeof(new_leaf));
+        TEST_ASSERT(merkle_tree_update_leaf(tree, 9, new_leaf) == MERKLE_SUCCESS, "Leaf update failed");
+        
+        uint8_t updated_root[32];
+        merkle_tree_get_root_hash(tree, updated_root);
+        
+        uint8_t rebuilt_data[64 * 32];
+        memcpy(rebuilt_data, data, sizeof(rebuilt_data));
+        memcpy(rebuilt_data + 9 * 32, new_leaf, 32);
+        merkle_tree_t* rebuilt = merkle_tree_create(64, types[t]);
+        TEST_ASSERT(rebuilt != NULL, "Tree creation failed");
+        TEST_ASSERT(merkle_tree_build(rebuilt, rebuilt_data, sizeof(rebuilt_data)) == MERKLE_SUCCESS,
+                    "Tree rebuild failed");
+        uint8_t rebuilt_root[32];
+        merkle_tree_get_root_hash(rebuilt, rebuilt_root);
+        TEST_ASSERT(memcmp(updated_root, rebuilt_root, 32) == 0, "Updated root should match rebuild");
+        
+        merkle_proof_t* proof = merkle_proof_create(tree, 9);
+        TEST_ASSERT(proof != NULL && merkle_proof_verify(proof, new_leaf), "Updated leaf should verify");
+        merkle_proof_destroy(proof);
+        
+        merkle_tree_destroy(rebuilt);
+        merkle_tree_destroy(tree);
+    }
+    
+    printf("  Proof generation and verification tests passed!\n");
+    return true;
+}
+
+bool test_mvcc_snapshots(void) {
+    printf("Testing versioned trees and snapshots...\n");
+    
+    uint8_t data[64 * 32];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)(i * 7 + 3);
+    }
+    
+    merkle_tree_t* tree = merkle_tree_create(64, HASH_SHA256);
+    TEST_ASSERT(tree != NULL, "Tree creation failed");
+    TEST_ASSERT(merkle_tree_build(tree, data, sizeof(data)) == MERKLE_SUCCESS, "Tree build failed");
+    size_t tree_node_size = tree->node_size;
+    merkle_mvcc_t* mvcc = merkle_mvcc_create(tree);
+    TEST_ASSERT(mvcc != NULL, "Versioned tree creation failed");
+    TEST_ASSERT_EQUAL(1, merkle_mvcc_version(mvcc), "Initial version");
+    
+    merkle_snapshot_t before;
+    merkle_mvcc_pin(mvcc, &before);
+    uint8_t before_root[32];
+    memcpy(before_root, before.root->hash, 32);
+    merkle_proof_t* old_proof = merkle_snapshot_proof_create(&before, 9);
+    TEST_ASSERT(old_proof != NULL, "Snapshot proof creation failed");
+    
+    // A path update publishes a new version and leaves the pinned one alone
+    uint8_t new_leaf[32];
+    memset(new_leaf, 0x5a, sizeof(new_leaf));
+    TEST_ASSERT(merkle_mvcc_update_leaf(mvcc, 9, new_leaf) == MERKLE_SUCCESS, "Versioned update failed");
+    TEST_ASSERT(merkle_mvcc_update_leaf(mvcc, 64, new_leaf) == MERKLE_ERROR_LEAF_OUT_OF_BOUNDS,
+                "Out-of-range update should fail");
+    TEST_ASSERT_EQUAL(2, merkle_mvcc_version(mvcc), "Version after update");
+    TEST_ASSERT(memcmp(before.root->hash, before_root, 32) == 0, "Pinned snapshot should not change");
+    TEST_ASSERT(merkle_snapshot_proof_check(&before, old_proof), "Old proof should check against its snapshot");
+    
+    merkle_snapshot_t after;
+    merkle_mvcc_pin(mvcc, &after);
+    TEST_ASSERT_EQUAL(2, after.version, "Snapshot should see the new version");
+    TEST_ASSERT(!merkle_snapshot_proof_check(&after, old_proof), "Old proof should not check against the new root");
+    
+    // The new root matches a full rebuild with the same leaves
+    memcpy(data + 9 * 32, new_leaf, 32);
+    merkle_tree_t* rebuilt = merkle_tree_create(64, HASH_SHA256);
+    TEST_ASSERT(rebuilt && merkle_tree_build(rebuilt, data, sizeof(data)) == MERKLE_SUCCESS, "Rebuild failed");
+    uint8_t rebuilt_root[32];
+    merkle_tree_get_root_hash(rebuilt, rebuilt_root);
+    TEST_ASSERT(memcmp(after.root->hash, rebuilt_root, 32) == 0, "Updated root should match rebuild");
+    
+    merkle_proof_t* new_proof = merkle_snapshot_proof_create(&after, 9);
+    TEST_ASSERT(new_proof && merkle_proof_verify(new_proof, new_leaf), "New proof should verify");
+    TEST_ASSERT(merkle_snapshot_proof_check(&after, new_proof), "New proof should check against its snapshot");
+    
+    // Replacing the whole tree keeps both pinned versions readable
+    TEST_ASSERT(merkle_mvcc_replace(mvcc, rebuilt) == MERKLE_SUCCESS, "Replace failed");
+    TEST_ASSERT_EQUAL(3, merkle_mvcc_version(mvcc), "Version after replace");
+    TEST_ASSERT(merkle_snapshot_proof_check(&before, old_proof), "Old snapshot should survive a replace");
+    TEST_ASSERT(merkle_snapshot_proof_check(&after, new_proof), "Newer snapshot should survive a replace");
+    merkle_proof_destroy(old_proof);
+    merkle_proof_destroy(new_proof);
+    merkle_mvcc_unpin(mvcc, &before);
+    merkle_mvcc_unpin(mvcc, &after);
+    
+    // With no reader pinned, replaced paths are recycled instead of growing the pool
+    int64_t pool_before = merkle_memory_get_global_stats().live_bytes[MERKLE_MEM_POOL];
+    for (uint64_t round = 0; round < 1000; round++) {
+        new_leaf[0] = (uint8_t)round;
+        TEST_ASSERT(merkle_mvcc_update_leaf(mvcc, round % 64, new_leaf) == MERKLE_SUCCESS, "Update failed");
+    }
+    int64_t pool_growth = merkle_memory_get_global_stats().live_bytes[MERKLE_MEM_POOL] - pool_before;
+    TEST_ASSERT(pool_growth <= (int64_t)(64 * 7 * tree_node_size + sizeof(memory_pool_t)),
+                "Path copies should be recycled");
+    TEST_ASSERT_EQUAL(1003, merkle_mvcc_version(mvcc), "Version after updates");
+    
+    merkle_mvcc_destroy(mvcc);
+    
+    printf("  Versioned tree tests passed!\n");
+    return true;
+}
+
+bool test_deferred_updates(void) {
+    printf("Testing deferred updates...\n");
+    
+    const uint64_t num_leaves = 1 << 13;
+    uint8_t* data = (uint8_t*)malloc(num_leaves * 32);
+    TEST_ASSERT(data != NULL, "Allocation failed");
+    for (size_t i = 0; i < num_leaves * 32; i++) {
+        data[i] = (uint8_t)(i * 17 + i / 32);
+    }
+    
+    merkle_tree_t* tree = merkle_tree_create(num_leaves, HASH_SHA256);
+    merkle_tree_t* eager = merkle_tree_create(num_leaves, HASH_SHA256);
+    TEST_ASSERT(tree && eager, "Tree creation failed");
+    TEST_ASSERT(merkle_tree_build(tree, data, num_leaves * 32) == MERKLE_SUCCESS, "Tree build failed");
+    TEST_ASSERT(merkle_tree_build(eager, data, num_leaves * 32) == MERKLE_SUCCESS, "Tree build failed");
+    size_t live_before = tree->memory_live_bytes;
+    TEST_ASSERT(merkle_tree_set_deferred(tree, true) == MERKLE_SUCCESS, "Enabling deferred updates failed");
+    
+    // Bursts of overlapping updates, with repeats, between root reads
+    uint8_t leaf[32];
+    uint8_t root[32];
+    uint8_t expected[32];
+    for (int burst = 0; burst < 3; burst++) {
+        for (uint64_t i = 0; i < 2000; i++) {
+            uint64_t index = (i * 2654435761ULL + (uint64_t)burst) % (i % 3 == 0 ? 64 : num_leaves);
+            memset(leaf, (int)(i + (uint64_t)burst * 7), sizeof(leaf));
+            TEST_ASSERT(merkle_tree_update_leaf(tree, index, leaf) == MERKLE_SUCCESS, "Deferred update failed");
+            TEST_ASSERT(merkle_tree_update_leaf(eager, index, leaf) == MERKLE_SUCCESS, "Update failed");
+            memcpy(data + index * 32, leaf, 32);
+        }
+        TEST_ASSERT(tree->dirty_leaves > 0, "Updates should be pending");
+        TEST_ASSERT(merkle_tree_get_root_hash(tree, root) == MERKLE_SUCCESS, "Root read failed");
+        TEST_ASSERT_EQUAL(0, tree->dirty_leaves, "Root read should flush");
+        merkle_tree_get_root_hash(eager, expected);
+        TEST_ASSERT(memcmp(root, expected, 32) == 0, "Deferred root differs from eager updates");
+    }
+    
+    // Proofs flush too, and the hot levels follow the flushed hashes
+    memset(leaf, 0xEE, sizeof(leaf));
+    TEST_ASSERT(merkle_tree_update_leaf(tree, 4242, leaf) == MERKLE_SUCCESS, "Deferred update failed");
+    TEST_ASSERT(merkle_tree_update_leaf(eager, 4242, leaf) == MERKLE_SUCCESS, "Update failed");
+    memcpy(data + 4242 * 32, leaf, 32);
+    for (uint64_t index = 4242; index < num_leaves; index += 1111) {
+        merkle_proof_t* proof = merkle_proof_create(tree, index);
+        TEST_ASSERT(proof && merkle_proof_verify(proof, data + index * 32), "Proof after deferred update");
+        merkle_proof_destroy(proof);
+    }
+    
+    // A rebuild drops pending marks; turning deferral off releases the bitmap
+    TEST_ASSERT(merkle_tree_update_leaf(tree, 1, leaf) == MERKLE_SUCCESS, "Deferred update failed");
+    TEST_ASSERT(merkle_tree_build(tree, data, num_leaves * 32) == MERKLE_SUCCESS, "Rebuild failed");
+    TEST_ASSERT_EQUAL(0, tree->dirty_leaves, "Rebuild should clear pending updates");
+    merkle_tree_get_root_hash(tree, root);
+    merkle_tree_get_root_hash(eager, expected);
+    TEST_ASSERT(memcmp(root, expected, 32) == 0, "Rebuilt root differs");
+    
+    TEST_ASSERT(merkle_tree_update_leaf(tree, 2, leaf) == MERKLE_SUCCESS, "Deferred update failed");
+    TEST_ASSERT(merkle_tree_update_leaf(eager, 2, leaf) == MERKLE_SUCCESS, "Update failed");
+    TEST_ASSERT(merkle_tree_set_deferred(tree, false) == MERKLE_SUCCESS, "Disabling deferred updates failed");
+    TEST_ASSERT(tree->dirty == NULL && tree->memory_live_bytes == live_before, "Bitmap should be released");
+    TEST_ASSERT(memcmp(tree->root->hash, eager->root->hash, 32) == 0, "Disabling should flush");
+    
+    merkle_tree_destroy(eager);
+    merkle_tree_destroy(tree);
+    free(data);
+    
+    printf("  Deferred update tests passed!\n");
+    return true;
+}
+
+// Siblings of leaf_index by walking nodes from root, leaf to root
+static void hot_test_walk(const merkle_node_t* root, uint8_t depth, uint64_t leaf_index, uint8_t* siblings) {
+    const merkle_node_t* node = root;
+    for (uint8_t level = 0; level < depth; level++) {
+        bool go_right = (leaf_index >> (depth - level - 1)) & 1;
+        memcpy(siblings + (size_t)(depth - level - 1) * 32, node->children[!go_right]->hash, 32);
+        node = node->children[go_right];
+    }
+}
+
+bool test_hot_digests(void) {
+    printf("Testing hot top-of-tree digests...\n");
+    
+    const uint64_t num_leaves = 1 << 13;
+    uint8_t* data = (uint8_t*)malloc(num_leaves * 32);
+    TEST_ASSERT(data != NULL, "Allocation failed");
+    for (size_t i = 0; i < num_leaves * 32; i++) {
+        data[i] = (uint8_t)(i * 31 + i / 32);
+    }
+    
+    merkle_tree_t* tree = merkle_tree_create(num_leaves, HASH_SHA256);
+    TEST_ASSERT(tree != NULL, "Tree creation failed");
+    TEST_ASSERT(merkle_tree_build(tree, data, num_leaves * 32) == MERKLE_SUCCESS, "Tree build failed");
+    TEST_ASSERT_EQUAL(MERKLE_HOT_DEPTH, merkle_hot_depth(tree), "Deep trees hold the full hot depth");
+    
+    // The hot array agrees with the nodes, and tracks in-place updates
+    uint8_t hot[MAX_TREE_DEPTH * 32];
+    uint8_t cold[MAX_TREE_DEPTH * 32];
+    uint8_t new_leaf[32];
+    memset(new_leaf, 0xC3, sizeof(new_leaf));
+    for (int round = 0; round < 2; round++) {
+        for (uint64_t leaf = 3; leaf < num_leaves; leaf += 1021) {
+            const merkle_node_t* node = NULL;
+            TEST_ASSERT_EQUAL(MERKLE_HOT_DEPTH, merkle_hot_read_path(tree, tree->root, leaf, hot, &node),
+                              "Hot read should cover the hot levels");
+            hot_test_walk(tree->root, tree->depth, leaf, cold);
+            size_t cold_slots = (size_t)(tree->depth - MERKLE_HOT_DEPTH) * 32;
+            TEST_ASSERT(memcmp(hot + cold_slots, cold + cold_slots, MERKLE_HOT_DEPTH * 32) == 0,
+                        "Hot siblings differ from the tree");
+            
+            merkle_proof_t* proof = merkle_proof_create(tree, leaf);
+            TEST_ASSERT(proof && memcmp(proof->sibling_hashes, cold, (size_t)tree->depth * 32) == 0,
+                        "Proof siblings differ from the tree");
+            TEST_ASSERT(merkle_proof_verify(proof, data + leaf * 32), "Proof should verify");
+            merkle_proof_destroy(proof);
+        }
+        TEST_ASSERT(merkle_tree_update_leaf(tree, 4097, new_leaf) == MERKLE_SUCCESS, "Leaf update failed");
+        memcpy(data + 4097 * 32, new_leaf, 32);
+    }
+    
+    // Versioned updates move the array to the new root; pinned older
+    // versions fall back to the pointer walk
+    merkle_mvcc_t* mvcc = merkle_mvcc_create(tree);
+    TEST_ASSERT(mvcc != NULL, "Versioned tree creation failed");
+    merkle_snapshot_t before;
+    merkle_mvcc_pin(mvcc, &before);
+    new_leaf[0] = 0x11;
+    TEST_ASSERT(merkle_mvcc_update_leaf(mvcc, 100, new_leaf) == MERKLE_SUCCESS, "Versioned update failed");
+    memcpy(data + 100 * 32, new_leaf, 32);
+    merkle_snapshot_t after;
+    merkle_mvcc_pin(mvcc, &after);
+    
+    const merkle_node_t* node = NULL;
+    TEST_ASSERT_EQUAL(0, merkle_hot_read_path(tree, before.root, 100, hot, &node), "Old root is no longer hot");
+    TEST_ASSERT_EQUAL(MERKLE_HOT_DEPTH, merkle_hot_read_path(tree, after.root, 100, hot, &node),
+                      "New root should be hot");
+    
+    uint64_t indices[64];
+    for (uint64_t i = 0; i < 64; i++) {
+        indices[i] = (i * 2654435761ULL) % num_leaves;
+    }
+    indices[7] = 100;
+    size_t proof_size = merkle_proof_serialized_size(tree->depth);
+    uint8_t* proofs = (uint8_t*)malloc(64 * proof_size);
+    TEST_ASSERT(proofs != NULL, "Allocation failed");
+    const merkle_snapshot_t* snapshots[2] = {&before, &after};
+    for (int s = 0; s < 2; s++) {
+        TEST_ASSERT(merkle_snapshot_serialize_proofs(snapshots[s], indices, NULL, 64, proofs) == MERKLE_SUCCESS,
+                    "Serialization failed");
+        for (uint64_t i = 0; i < 64; i++) {
+            bool valid = false;
+            TEST_ASSERT(merkle_snapshot_check_serialized(snapshots[s], proofs + i * proof_size, proof_size,
+                                                         NULL, NULL, &valid) == MERKLE_SUCCESS && valid,
+                        "Serialized proof should check against its snapshot");
+        }
+    }
+    merkle_proof_t* proof = merkle_snapshot_proof_create(&after, 100);
+    TEST_ASSERT(proof && merkle_proof_verify(proof, new_leaf), "Updated leaf should verify");
+    merkle_proof_destroy(proof);
+    
+    free(proofs);
+    merkle_mvcc_unpin(mvcc, &before);
+    merkle_mvcc_unpin(mvcc, &after);
+    merkle_mvcc_destroy(mvcc);
+    free(data);
+    
+    printf("  Hot digest tests passed!\n");
+    return true;
+}
+
+// Root of a k-ary tree computed level by level from the leaf data
+static void kary_test_root(const uint8_t* data, uint64_t num_leaves, uint8_t arity, uint8_t* root) {
+    uint8_t* level = (uint8_t*)malloc(num_leaves * 32);
+    for (uint64_t i = 0; i < num_leaves; i++) {
+        sha256_hash(data + i * 32, 32, level + i * 32);
+    }
+    for (uint64_t size = num_leaves; size > 1; size /= arity) {
+        for (uint64_t i = 0; i < size / arity; i++) {
+            uint8_t combined[MERKLE_MAX_ARITY * 32];
+            memcpy(combined, level + i * arity * 32, (size_t)arity * 32);
+            sha256_hash(combined, (size_t)arity * 32, level + i * 32);
+        }
+    }
+    memcpy(root, level, 32);
+    free(level);
+}
+
+bool test_kary_trees(void) {
+    printf("Testing k-ary trees...\n");
+    
+    TEST_ASSERT(merkle_tree_create_kary(32, HASH_SHA256, 4) == NULL, "Leaf count must be a power of the arity");
+    TEST_ASSERT(merkle_tree_create_kary(27, HASH_SHA256, 3) == NULL, "Arity must be a power of two");
+    TEST_ASSERT(merkle_tree_create_kary(1 << 8, HASH_SHA256, 32) == NULL, "Arity above the maximum");
+    
+    const uint64_t num_leaves = 1 << 12;
+    uint8_t* data = (uint8_t*)malloc(num_leaves * 32);
+    TEST_ASSERT(data != NULL, "Allocation failed");
+    
+    const uint8_t arities[] = {4, 8, 16};
+    for (size_t a = 0; a < sizeof(arities); a++) {
+        uint8_t arity = arities[a];
+        uint8_t bits = (uint8_t)__builtin_ctz(arity);
+        for (size_t i = 0; i < num_leaves * 32; i++) {
+            data[i] = (uint8_t)(i * 13 + i / 32 + arity);
+        }
+        
+        merkle_tree_t* tree = merkle_tree_create_kary(num_leaves, HASH_SHA256, arity);
+        TEST_ASSERT(tree != NULL, "Tree creation failed");
+        TEST_ASSERT_EQUAL(12 / bits, tree->depth, "Depth counts k-ary levels");
+        TEST_ASSERT(merkle_tree_build(tree, data, num_leaves * 32) == MERKLE_SUCCESS, "Tree build failed");
+        TEST_ASSERT_EQUAL(MERKLE_HOT_DEPTH / bits < tree->depth ? MERKLE_HOT_DEPTH / bits : tree->depth,
+                          merkle_hot_depth(tree), "Hot levels cover the hot index bits");
+        
+        uint8_t root[32];
+        uint8_t expected[32];
+        kary_test_root(data, num_leaves, arity, expected);
+        merkle_tree_get_root_hash(tree, root);
+        TEST_ASSERT(memcmp(root, expected, 32) == 0, "Root differs from the level-by-level hash");
+        
+        // Proofs carry k - 1 siblings per level and survive serialization
+        uint64_t num_siblings = merkle_tree_proof_siblings(tree);
+        TEST_ASSERT_EQUAL((uint64_t)tree->depth * (arity - 1), num_siblings, "Siblings per proof");
+        size_t proof_size = merkle_proof_serialized_size(num_siblings);
+        uint8_t buffer[8192];
+        for (uint64_t leaf = 5; leaf < num_leaves; leaf += 701) {
+            merkle_proof_t* proof = merkle_proof_create(tree, leaf);
+            TEST_ASSERT(proof && proof->num_siblings == num_siblings, "Proof creation failed");
+            TEST_ASSERT(merkle_proof_verify(proof, data + leaf * 32), "Proof should verify");
+            TEST_ASSERT(!merkle_proof_verify(proof, data + ((leaf + 1) % num_leaves) * 32),
+                        "Proof of another leaf's data should fail");
+            
+            TEST_ASSERT(merkle_proof_serialize(proof, buffer, sizeof(buffer)) == MERKLE_SUCCESS, "Serialize failed");
+            merkle_proof_t decoded = {0};
+            TEST_ASSERT(merkle_proof_deserialize(buffer, proof_size, &decoded) == MERKLE_SUCCESS,
+                        "Deserialize failed");
+            TEST_ASSERT_EQUAL(arity, decoded.arity, "Arity should round-trip");
+            TEST_ASSERT(merkle_proof_verify(&decoded, data + leaf * 32), "Decoded proof should verify");
+            decoded.sibling_hashes[32 * (arity - 1) - 1] ^= 1;
+            TEST_ASSERT(!merkle_proof_verify(&decoded, data + leaf * 32), "Tampered sibling should fail");
+            merkle_proof_clear(&decoded);
+            merkle_proof_destroy(proof);
+        }
+        
+        // In-place and deferred updates match a rebuild
+        uint8_t leaf[32];
+        for (uint64_t i = 0; i < 40; i++) {
+            uint64_t index = (i * 2654435761ULL) % num_leaves;
+            memset(leaf, (int)(i + arity), sizeof(leaf));
+            if (i == 20) {
+                TEST_ASSERT(merkle_tree_set_deferred(tree, true) == MERKLE_SUCCESS, "Enabling deferral failed");
+            }
+            TEST_ASSERT(merkle_tree_update_leaf(tree, index, leaf) == MERKLE_SUCCESS, "Update failed");
+            memcpy(data + index * 32, leaf, 32);
+        }
+        kary_test_root(data, num_leaves, arity, expected);
+        merkle_tree_get_root_hash(tree, root);
+        TEST_ASSERT(memcmp(root, expected, 32) == 0, "Updated root differs from a rebuild");
+        merkle_proof_t* proof = merkle_proof_create(tree, 1);
+        TEST_ASSERT(proof && merkle_proof_verify(proof, data + 32), "Proof after deferred updates");
+        merkle_proof_destroy(proof);
+        
+        // Versioned updates copy k-ary paths; serialized proofs check in place
+        merkle_mvcc_t* mvcc = merkle_mvcc_create(tree);
+        TEST_ASSERT(mvcc != NULL, "Versioned tree creation failed");
+        memset(leaf, 0x5A, sizeof(leaf));
+        TEST_ASSERT(merkle_mvcc_update_leaf(mvcc, 777, leaf) == MERKLE_SUCCESS, "Versioned update failed");
+        memcpy(data + 777 * 32, leaf, 32);
+        merkle_snapshot_t snapshot;
+        merkle_mvcc_pin(mvcc, &snapshot);
+        kary_test_root(data, num_leaves, arity, expected);
+        TEST_ASSERT(memcmp(snapshot.root->hash, expected, 32) == 0, "Versioned root differs from a rebuild");
+        
+        uint64_t indices[48];
+        for (uint64_t i = 0; i < 48; i++) {
+            indices[i] = (i * 97 + 770) % num_leaves;
+        }
+        uint8_t* proofs = (uint8_t*)malloc(48 * proof_size);
+        TEST_ASSERT(proofs != NULL, "Allocation failed");
+        TEST_ASSERT(merkle_snapshot_serialize_proofs(&snapshot, indices, NULL, 48, proofs) == MERKLE_SUCCESS,
+                    "Serialization failed");
+        for (uint64_t i = 0; i < 48; i++) {
+            merkle_proof_t* direct = merkle_snapshot_proof_create(&snapshot, indices[i]);
+            TEST_ASSERT(direct && merkle_proof_serialize(direct, buffer, sizeof(buffer)) == MERKLE_SUCCESS,
+                        "Direct proof failed");
+            TEST_ASSERT(memcmp(buffer, proofs + i * proof_size, proof_size) == 0,
+                        "Batch proof differs from the direct proof");
+            merkle_proof_destroy(direct);
+            
+            bool valid = false;
+            TEST_ASSERT(merkle_snapshot_check_serialized(&snapshot, proofs + i * proof_size, proof_size,
+                                                         NULL, NULL, &valid) == MERKLE_SUCCESS && valid,
+                        "Serialized proof should check against its snapshot");
+        }
+        free(proofs);
+        merkle_mvcc_unpin(mvcc, &snapshot);
+        merkle_mvcc_destroy(mvcc);
+    }
+    
+    // Binary proofs keep a plain hash type word
+    merkle_tree_t* binary = merkle_tree_create(num_leaves, HASH_SHA256);
+    TEST_ASSERT(binary && merkle_tree_build(binary, data, num_leaves * 32) == MERKLE_SUCCESS, "Tree build failed");
+    merkle_proof_t* proof = merkle_proof_create(binary, 9);
+    uint8_t buffer[1024];
+    uint32_t hash_type = 0xFFFFFFFF;
+    TEST_ASSERT(proof && merkle_proof_serialize(proof, buffer, sizeof(buffer)) == MERKLE_SUCCESS, "Serialize failed");
+    memcpy(&hash_type, buffer + 44, sizeof(hash_type));
+    TEST_ASSERT_EQUAL(HASH_SHA256, hash_type, "Binary hash type word");
+    merkle_proof_destroy(proof);
+    merkle_tree_destroy(binary);
+    free(data);
+    
+    printf("  K-ary tree tests passed!\n");
+    return true;
+}
+
+// Binary root over leaf hashes computed level by level
+static void records_test_root(uint8_t* hashes, uint64_t num_leaves, uint8_t* root) {
+    for (uint64_t size = num_leaves; size > 1; size /= 2) {
+        for (uint64_t i = 0; i < size / 2; i++) {
+            sha256_hash(hashes + i * 64, 64, hashes + i * 32);
+        }
+    }
+    memcpy(root, hashes, 32);
+}
+
+bool test_variable_records(void) {
+    printf("Testing variable-size leaves...\n");
+    
+    // 100 B to 64 KB records, about 8 MB in all
+    const uint64_t num_leaves = 256;
+    uint64_t offsets[257];
+    offsets[0] = 0;
+    for (uint64_t i = 0; i < num_leaves; i++) {
+        uint64_t size = i % 5 == 0 ? 100 + i : (i * 2654435761ULL) % (64 * 1024) + 100;
+        offsets[i + 1] = offsets[i] + size;
+    }
+    uint8_t* payload = (uint8_t*)malloc(offsets[num_leaves]);
+    uint8_t* hashes = (uint8_t*)malloc(num_leaves * 32);
+    TEST_ASSERT(payload && hashes, "Allocation failed");
+    for (uint64_t i = 0; i < offsets[num_leaves]; i++) {
+        payload[i] = (uint8_t)(i * 29 + i / 4096);
+    }
+    
+    merkle_tree_t* tree = merkle_tree_create(num_leaves, HASH_SHA256);
+    TEST_ASSERT(tree != NULL, "Tree creation failed");
+    offsets[3] = offsets[4] + 1;
+    TEST_ASSERT(merkle_tree_build_records(tree, payload, offsets) == MERKLE_ERROR_INVALID_SIZE,
+                "Decreasing offsets should be rejected");
+    offsets[3] = offsets[2] + (2 * 2654435761ULL) % (64 * 1024) + 100;
+    TEST_ASSERT(merkle_tree_build_records(tree, payload, offsets) == MERKLE_SUCCESS, "Record build failed");
+    
+    uint8_t root[32];
+    uint8_t expected[32];
+    for (uint64_t i = 0; i < num_leaves; i++) {
+        sha256_hash(payload + offsets[i], offsets[i + 1] - offsets[i], hashes + i * 32);
+    }
+    records_test_root(hashes, num_leaves, expected);
+    merkle_tree_get_root_hash(tree, root);
+    TEST_ASSERT(memcmp(root, expected, 32) == 0, "Root differs from hashing the records");
+    
+    for (uint64_t leaf = 0; leaf < num_leaves; leaf += 37) {
+        size_t size = 0;
+        const uint8_t* stored = merkle_tree_leaf(tree, leaf, &size);
+        TEST_ASSERT(stored && size == offsets[leaf + 1] - offsets[leaf], "Stored record size");
+        merkle_proof_t* proof = merkle_proof_create(tree, leaf);
+        TEST_ASSERT(proof && merkle_proof_verify_record(proof, num_leaves, payload + offsets[leaf], size),
+                    "Record proof should verify");
+        TEST_ASSERT(!merkle_proof_verify_record(proof, num_leaves, payload + offsets[leaf], size - 1),
+                    "Truncated record should fail");
+        merkle_proof_destroy(proof);
+    }
+    
+    // A record equal to the children of a bottom internal node, with the
+    // path above that node, is not a leaf of this tree
+    merkle_proof_t* forged = merkle_proof_create(tree, 6);
+    TEST_ASSERT(forged != NULL, "Proof creation failed");
+    uint8_t children[64];
+    memcpy(children, forged->leaf_hash, 32);
+    memcpy(children + 32, forged->sibling_hashes, 32);
+    forged->leaf_index = 3;
+    forged->num_siblings--;
+    memmove(forged->sibling_hashes, forged->sibling_hashes + 32, forged->num_siblings * 32);
+    sha256_hash(children, sizeof(children), forged->leaf_hash);
+    TEST_ASSERT(merkle_proof_verify_record(forged, num_leaves / 2, children, sizeof(children)),
+                "The forgery folds to the root of a tree half the size");
+    TEST_ASSERT(!merkle_proof_verify_record(forged, num_leaves, children, sizeof(children)),
+                "A forged interior-node record should be rejected");
+    merkle_proof_destroy(forged);
+    
+    // Larger records move, smaller ones shrink in place, eagerly and deferred
+    uint8_t* record = (uint8_t*)malloc(70 * 1024);
+    TEST_ASSERT(record != NULL, "Allocation failed");
+    size_t sizes[4] = {70 * 1024, 7, 0, 4096};
+    uint64_t leaves[4] = {1, 2, 3, 1};
+    for (int i = 0; i < 4; i++) {
+        memset(record, 0x40 + i, sizes[i]);
+        if (i == 2) {
+            TEST_ASSERT(merkle_tree_set_deferred(tree, true) == MERKLE_SUCCESS, "Enabling deferral failed");
+        }
+        TEST_ASSERT(merkle_tree_update_record(tree, leaves[i], record, sizes[i]) == MERKLE_SUCCESS,
+                    "Record update failed");
+        sha256_hash(record, sizes[i], hashes + leaves[i] * 32);
+    }
+    for (uint64_t i = 0; i < num_leaves; i++) {
+        if (i == 0 || i > 3) sha256_hash(payload + offsets[i], offsets[i + 1] - offsets[i], hashes + i * 32);
+    }
+    records_test_root(hashes, num_leaves, expected);
+    merkle_tree_get_root_hash(tree, root);
+    TEST_ASSERT(memcmp(root, expected, 32) == 0, "Updated root differs from hashing the records");
+    size_t size = 0;
+    const uint8_t* stored = merkle_tree_leaf(tree, 1, &size);
+    TEST_ASSERT(size == 4096 && stored[0] == 0x43 && stored[4095] == 0x43, "Moved record reads back");
+    
+    // Versioned updates take records too
+    merkle_mvcc_t* mvcc = merkle_mvcc_create(tree);
+    TEST_ASSERT(mvcc != NULL, "Versioned tree creation failed");
+    memset(record, 0x77, 300);
+    TEST_ASSERT(merkle_mvcc_update_record(mvcc, 200, record, 300) == MERKLE_SUCCESS, "Versioned update failed");
+    merkle_snapshot_t snapshot;
+    merkle_mvcc_pin(mvcc, &snapshot);
+    merkle_proof_t* proof = merkle_snapshot_proof_create(&snapshot, 200);
+    TEST_ASSERT(proof && merkle_proof_verify_record(proof, num_leaves, record, 300), "Versioned record should verify");
+    merkle_proof_destroy(proof);
+    merkle_mvcc_unpin(mvcc, &snapshot);
+    merkle_mvcc_destroy(mvcc);
+    
+    // Fixed-size trees only take records of their leaf size
+    merkle_tree_t* fixed = merkle_tree_create(4, HASH_SHA256);
+    TEST_ASSERT(fixed && merkle_tree_build(fixed, payload, 4 * 32) == MERKLE_SUCCESS, "Tree build failed");
+    TEST_ASSERT(merkle_tree_update_record(fixed, 0, record, 31) == MERKLE_ERROR_INVALID_SIZE,
+                "Fixed-size tree should reject other sizes");
+    merkle_tree_destroy(fixed);
+    
+    free(record);
+    free(hashes);
+    free(payload);
+    
+    printf("  Variable-size leaf tests passed!\n");
+    return true;
+}
+
+bool test_leaf_storage(void) {
+    printf("Testing leaf storage modes...\n");
+    
+    const uint64_t num_leaves = 1 << 12;
+    uint8_t* data = (uint8_t*)malloc(num_leaves * 32);
+    uint8_t* original = (uint8_t*)malloc(num_leaves * 32);
+    TEST_ASSERT(data && original, "Allocation failed");
+    for (size_t i = 0; i < num_leaves * 32; i++) {
+        data[i] = (uint8_t)(i * 11 + i / 32);
+    }
+    memcpy(original, data, num_leaves * 32);
+    
+    merkle_tree_t* trees[3];
+    const merkle_leaf_storage_t modes[3] = {MERKLE_LEAVES_COPY, MERKLE_LEAVES_BORROW, MERKLE_LEAVES_HASH_ONLY};
+    for (int m = 0; m < 3; m++) {
+        trees[m] = merkle_tree_create(num_leaves, HASH_SHA256);
+        TEST_ASSERT(trees[m] != NULL, "Tree creation failed");
+        TEST_ASSERT(merkle_tree_set_leaf_storage(trees[m], modes[m]) == MERKLE_SUCCESS, "Setting storage failed");
+        TEST_ASSERT(merkle_tree_build(trees[m], data, num_leaves * 32) == MERKLE_SUCCESS, "Tree build failed");
+    }
+    merkle_tree_t* copy = trees[0];
+    merkle_tree_t* borrow = trees[1];
+    merkle_tree_t* hashed = trees[2];
+    
+    // Rebuilding replaces the copy instead of leaking it
+    size_t copy_live = copy->memory_live_bytes;
+    TEST_ASSERT(merkle_tree_build(copy, data, num_leaves * 32) == MERKLE_SUCCESS, "Rebuild failed");
+    TEST_ASSERT_EQUAL(copy_live, copy->memory_live_bytes, "Rebuild should not grow the tree");
+    TEST_ASSERT(copy->memory_live_bytes >= borrow->memory_live_bytes + num_leaves * 32,
+                "Borrowing should not copy the leaves");
+    TEST_ASSERT_EQUAL(borrow->memory_live_bytes, hashed->memory_live_bytes, "Borrow and hash-only footprints");
+    
+    size_t size = 0;
+    TEST_ASSERT(merkle_tree_leaf(borrow, 5, &size) == data + 5 * 32 && size == 32, "Borrowed leaf is the input");
+    TEST_ASSERT(merkle_tree_leaf(hashed, 5, &size) == NULL, "Hash-only trees keep no leaves");
+    
+    // Eager and deferred updates agree across modes; borrowed input is never written
+    uint8_t leaf[32];
+    for (uint64_t i = 0; i < 300; i++) {
+        uint64_t index = (i * 2654435761ULL) % num_leaves;
+        memset(leaf, (int)(i + 1), sizeof(leaf));
+        if (i == 150) {
+            for (int m = 0; m < 3; m++) {
+                TEST_ASSERT(merkle_tree_set_deferred(trees[m], true) == MERKLE_SUCCESS, "Enabling deferral failed");
+            }
+        }
+        for (int m = 0; m < 3; m++) {
+            TEST_ASSERT(merkle_tree_update_leaf(trees[m], index, leaf) == MERKLE_SUCCESS, "Update failed");
+        }
+    }
+    TEST_ASSERT(memcmp(data, original, num_leaves * 32) == 0, "Borrowed input should be untouched");
+    uint8_t roots[3][32];
+    for (int m = 0; m < 3; m++) {
+        TEST_ASSERT(merkle_tree_get_root_hash(trees[m], roots[m]) == MERKLE_SUCCESS, "Root read failed");
+    }
+    TEST_ASSERT(memcmp(roots[0], roots[1], 32) == 0 && memcmp(roots[0], roots[2], 32) == 0,
+                "Roots differ between storage modes");
+    
+    merkle_proof_t* proof = merkle_proof_create(hashed, 77);
+    size = 0;
+    const uint8_t* stored = merkle_tree_leaf(copy, 77, &size);
+    TEST_ASSERT(proof && stored && merkle_proof_verify(proof, stored), "Hash-only proof should verify");
+    merkle_proof_destroy(proof);
+    
+    // Switching to hash-only flushes pending updates and drops the copy now
+    memset(leaf, 0xAB, sizeof(leaf));
+    TEST_ASSERT(merkle_tree_update_leaf(copy, 9, leaf) == MERKLE_SUCCESS, "Update failed");
+    TEST_ASSERT(merkle_tree_update_leaf(hashed, 9, leaf) == MERKLE_SUCCESS, "Update failed");
+    copy_live = copy->memory_live_bytes;
+    TEST_ASSERT(merkle_tree_set_leaf_storage(copy, MERKLE_LEAVES_HASH_ONLY) == MERKLE_SUCCESS,
+                "Switching storage failed");
+    TEST_ASSERT(copy->leaf_data == NULL && copy->memory_live_bytes + num_leaves * 32 <= copy_live,
+                "Switching should release the copy");
+    merkle_tree_get_root_hash(copy, roots[0]);
+    merkle_tree_get_root_hash(hashed, roots[2]);
+    TEST_ASSERT(memcmp(roots[0], roots[2], 32) == 0, "Switching should flush first");
+    
+    // Hash-only record trees still take records of any size
+    uint64_t offsets[5] = {0, 100, 350, 351, 1000};
+    merkle_tree_t* records = merkle_tree_create(4, HASH_SHA256);
+    TEST_ASSERT(records && merkle_tree_set_leaf_storage(records, MERKLE_LEAVES_HASH_ONLY) == MERKLE_SUCCESS,
+                "Tree creation failed");
+    TEST_ASSERT(merkle_tree_build_records(records, data, offsets) == MERKLE_SUCCESS, "Record build failed");
+    TEST_ASSERT(records->records == NULL && records->leaf_data == NULL, "Hash-only records keep nothing");
+    TEST_ASSERT(merkle_tree_update_record(records, 2, data, 777) == MERKLE_SUCCESS, "Record update failed");
+    proof = merkle_proof_create(records, 2);
+    TEST_ASSERT(proof && merkle_proof_verify_record(proof, records->num_leaves, data, 777), "Updated record should verify");
+    merkle_proof_destroy(proof);
+    merkle_tree_destroy(records);
+    
+    for (int m = 0; m < 3; m++) {
+        merkle_tree_destroy(trees[m]);
+    }
+    free(original);
+    free(data);
+    
+    printf("  Leaf storage tests passed!\n");
+    return true;
+}
+
+// Serialized proofs of `count` leaves through both tree paths
+static bool pruned_test_proofs(merkle_tree_t* tree, const uint64_t* indices, uint64_t count, uint8_t* out) {
+    size_t size = merkle_proof_serialized_size(merkle_tree_proof_siblings(tree));
+    for (uint64_t i = 0; i < count; i++) {
+        merkle_proof_t* proof = merkle_proof_create(tree, indices[i]);
+        bool ok = proof && merkle_proof_serialize(proof, out + i * size, size) == MERKLE_SUCCESS;
+        merkle_proof_destroy(proof);
+        if (!ok) return false;
+    }
+    merkle_snapshot_t snapshot = {tree->root, tree, 1, 0};
+    return merkle_snapshot_serialize_proofs(&snapshot, indices, NULL, count, out + count * size) == MERKLE_SUCCESS;
+}
+
+bool test_pruned_levels(void) {
+    printf("Testing pruned bottom levels...\n");
+    
+    const uint64_t num_leaves = 1 << 12;
+    uint8_t* data = (uint8_t*)malloc(num_leaves * 32);
+    TEST_ASSERT(data != NULL, "Allocation failed");
+    for (size_t i = 0; i < num_leaves * 32; i++) {
+        data[i] = (uint8_t)(i * 7 + i / 32);
+    }
+    
+    merkle_tree_t* full = merkle_tree_create(num_leaves, HASH_SHA256);
+    merkle_tree_t* pruned = merkle_tree_create(num_leaves, HASH_SHA256);
+    TEST_ASSERT(full && pruned, "Tree creation failed");
+    TEST_ASSERT_EQUAL(MERKLE_ERROR_INVALID_SIZE, merkle_tree_set_pruned_height(pruned, 9), "Bucket too large");
+    TEST_ASSERT(merkle_tree_set_pruned_height(pruned, 4) == MERKLE_SUCCESS, "Setting pruned height failed");
+    TEST_ASSERT(merkle_tree_build(full, data, num_leaves * 32) == MERKLE_SUCCESS, "Tree build failed");
+    TEST_ASSERT(merkle_tree_build(pruned, data, num_leaves * 32) == MERKLE_SUCCESS, "Pruned build failed");
+    TEST_ASSERT_EQUAL(MERKLE_ERROR_INVALID_TREE, merkle_tree_set_pruned_height(pruned, 2),
+                      "Pruning is fixed once built");
+    TEST_ASSERT(merkle_mvcc_create(pruned) == NULL, "MVCC should refuse pruned trees");
+    
+    // A sixteenth of the nodes, plus the packed leaf hashes
+    TEST_ASSERT(pruned->memory_live_bytes * 2 < full->memory_live_bytes, "Pruning should shrink the tree");
+    
+    // Roots and proofs are byte for byte those of the full tree
+    const uint64_t indices[6] = {0, 1, 15, 16, 2049, num_leaves - 1};
+    size_t proof_size = merkle_proof_serialized_size(merkle_tree_proof_siblings(full));
+    uint8_t* expected = (uint8_t*)malloc(12 * proof_size);
+    uint8_t* actual = (uint8_t*)malloc(12 * proof_size);
+    TEST_ASSERT(expected && actual, "Allocation failed");
+    uint8_t roots[2][32];
+    
+    // After the build, after eager updates and after deferred ones
+    uint8_t leaf[32];
+    for (int round = 0; round < 3; round++) {
+        merkle_tree_get_root_hash(full, roots[0]);
+        merkle_tree_get_root_hash(pruned, roots[1]);
+        TEST_ASSERT(memcmp(roots[0], roots[1], 32) == 0, "Pruned root differs");
+        TEST_ASSERT(pruned_test_proofs(full, indices, 6, expected), "Full proofs failed");
+        TEST_ASSERT(pruned_test_proofs(pruned, indices, 6, actual), "Pruned proofs failed");
+        TEST_ASSERT(memcmp(expected, actual, 12 * proof_size) == 0, "Pruned proofs differ");
+        if (round == 2) {
+            break;
+        }
+        
+        if (round == 1) {
+            TEST_ASSERT(merkle_tree_set_deferred(full, true) == MERKLE_SUCCESS, "Enabling deferral failed");
+            TEST_ASSERT(merkle_tree_set_deferred(pruned, true) == MERKLE_SUCCESS, "Enabling deferral failed");
+        }
+        for (uint64_t i = 0; i < 100; i++) {
+            uint64_t index = (i * 2654435761ULL + (uint64_t)round) % num_leaves;
+            memset(leaf, (int)(i + round), sizeof(leaf));
+            TEST_ASSERT(merkle_tree_update_leaf(full, index, leaf) == MERKLE_SUCCESS, "Update failed");
+            TEST_ASSERT(merkle_tree_update_leaf(pruned, index, leaf) == MERKLE_SUCCESS, "Pruned update failed");
+        }
+    }
+    merkle_proof_t* proof = merkle_proof_create(pruned, (99 * 2654435761ULL + 1) % num_leaves);
+    TEST_ASSERT(proof && merkle_proof_verify(proof, leaf), "Updated leaf should verify");
+    merkle_proof_destroy(proof);
+    
+    // A 4-ary tree pruned to a single bucket
+    merkle_tree_t* kary[2];
+    for (int p = 0; p < 2; p++) {
+        kary[p] = merkle_tree_create_kary(256, HASH_BLAKE2B, 4);
+        TEST_ASSERT(kary[p] != NULL, "K-ary creation failed");
+        TEST_ASSERT(merkle_tree_set_pruned_height(kary[p], p ? 4 : 0) == MERKLE_SUCCESS, "Pruning failed");
+        TEST_ASSERT(merkle_tree_build(kary[p], data, 256 * 32) == MERKLE_SUCCESS, "K-ary build failed");
+        merkle_tree_get_root_hash(kary[p], roots[p]);
+    }
+    TEST_ASSERT(memcmp(roots[0], roots[1], 32) == 0, "Pruned k-ary root differs");
+    proof = merkle_proof_create(kary[1], 201);
+    TEST_ASSERT(proof && merkle_proof_verify(proof, data + 201 * 32), "Pruned k-ary proof should verify");
+    merkle_proof_destroy(proof);
+    
+    merkle_tree_destroy(kary[0]);
+    merkle_tree_destroy(kary[1]);
+    merkle_tree_destroy(full);
+    merkle_tree_destroy(pruned);
+    free(expected);
+    free(actual);
+    free(data);
+    
+    printf("  Pruned level tests passed!\n");
+    return true;
+}
+
+// Write `size` bytes to a fresh temporary file; returns its descriptor
+static int external_test_file(char* path, const uint8_t* data, size_t size) {
+    strcpy(path, "/tmp/merkle_test_XXXXXX");
+    int fd = mkstemp(path);
+    if (fd >= 0 && size > 0 && write(fd, data, size) != (ssize_t)size) {
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+    return fd;
+}
+
+bool test_external_build(void) {
+    printf("Testing out-of-core tree construction...\n");
+    
+    const uint64_t num_leaves = 1 << 12;
+    const size_t leaf_size = 100;
+    uint8_t* data = (uint8_t*)malloc(num_leaves * leaf_size);
+    uint64_t* offsets = (uint64_t*)malloc((num_leaves + 1) * sizeof(uint64_t));
+    TEST_ASSERT(data && offsets, "Allocation failed");
+    for (size_t i = 0; i < num_leaves * leaf_size; i++) {
+        data[i] = (uint8_t)(i * 29 + i / 100);
+    }
+    for (uint64_t i = 0; i <= num_leaves; i++) {
+        offsets[i] = i * leaf_size;
+    }
+    
+    char input[32];
+    char output[32];
+    int in = external_test_file(input, data, num_leaves * leaf_size);
+    int out = external_test_file(output, NULL, 0);
+    TEST_ASSERT(in >= 0 && out >= 0, "Temporary files failed");
+    close(in);
+    close(out);
+    
+    // Binary and 4-ary, both in many chunks (the budget holds under 500 leaves)
+    const uint8_t arities[2] = {2, 4};
+    for (int a = 0; a < 2; a++) {
+        merkle_tree_t* tree = merkle_tree_create_kary(num_leaves, HASH_SHA256, arities[a]);
+        TEST_ASSERT(tree && merkle_tree_build_records(tree, data, offsets) == MERKLE_SUCCESS, "Reference failed");
+        uint8_t expected[32];
+        uint8_t root[32];
+        merkle_tree_get_root_hash(tree, expected);
+        
+        merkle_memory_stats_t before = merkle_memory_get_thread_stats();
+        TEST_ASSERT(merkle_tree_build_external(input, leaf_size, HASH_SHA256, arities[a], output,
+                                               MERKLE_EXTERNAL_MIN_MEMORY, root) == MERKLE_SUCCESS,
+                    "External build failed");
+        merkle_memory_stats_t after = merkle_memory_get_thread_stats();
+        TEST_ASSERT(memcmp(root, expected, 32) == 0, "External root differs");
+        TEST_ASSERT(after.live_bytes[MERKLE_MEM_LEVELS] == before.live_bytes[MERKLE_MEM_LEVELS],
+                    "Buffers should be released");
+        
+        // Proofs read from the file match the in-memory tree's
+        merkle_tree_file_t* file = merkle_tree_file_open(output);
+        TEST_ASSERT(file && merkle_tree_file_num_leaves(file) == num_leaves, "Opening the tree file failed");
+        size_t size = merkle_proof_serialized_size(merkle_tree_proof_siblings(tree));
+        uint8_t* buffers = (uint8_t*)malloc(2 * size);
+        TEST_ASSERT(buffers != NULL, "Allocation failed");
+        const uint64_t indices[4] = {0, 7, 2222, num_leaves - 1};
+        for (int i = 0; i < 4; i++) {
+            merkle_proof_t from_file;
+            merkle_proof_t* from_tree = merkle_proof_create(tree, indices[i]);
+            TEST_ASSERT(merkle_tree_file_proof(file, indices[i], &from_file) == MERKLE_SUCCESS, "File proof failed");
+            TEST_ASSERT(merkle_proof_verify_record(&from_file, num_leaves, data + indices[i] * leaf_size, leaf_size),
+                        "File proof should verify");
+            TEST_ASSERT(from_tree && merkle_proof_serialize(from_tree, buffers, size) == MERKLE_SUCCESS &&
+                        merkle_proof_serialize(&from_file, buffers + size, size) == MERKLE_SUCCESS,
+                        "Serialization failed");
+            TEST_ASSERT(memcmp(buffers, buffers + size, size) == 0, "File proof differs");
+            merkle_proof_clear(&from_file);
+            merkle_proof_destroy(from_tree);
+        }
+        merkle_proof_t proof;
+        TEST_ASSERT_EQUAL(MERKLE_ERROR_LEAF_OUT_OF_BOUNDS, merkle_tree_file_proof(file, num_leaves, &proof),
+                          "Out-of-range file proof");
+        free(buffers);
+        merkle_tree_file_close(file);
+        merkle_tree_destroy(tree);
+    }
+    
+    // Inputs that are not a power of the arity in leaves, and budgets too small
+    TEST_ASSERT_EQUAL(MERKLE_ERROR_INVALID_SIZE,
+                      merkle_tree_build_external(input, leaf_size, HASH_SHA256, 2, output, 1024, NULL),
+                      "Budget below the minimum");
+    TEST_ASSERT(merkle_tree_build_external(input, leaf_size * 3, HASH_SHA256, 2, output, 0, NULL) != MERKLE_SUCCESS,
+                "Leaf count is not a power of two");
+    TEST_ASSERT(merkle_tree_file_open(input) == NULL, "Leaf data is not a tree file");
+    
+    unlink(input);
+    unlink(output);
+    free(offsets);
+    free(data);
+    
+    printf("  Out-of-core build tests passed!\n");
+    return true;
+}
+
+bool test_file_ingest(void) {
+    printf("Testing file ingestion...\n");
+    
+    const uint64_t num_leaves = 1 << 12;
+    uint8_t* data = (uint8_t*)malloc(num_leaves * 32);
+    uint8_t* copy = (uint8_t*)malloc(num_leaves * 32);
+    TEST_ASSERT(data && copy, "Allocation failed");
+    for (size_t i = 0; i < num_leaves * 32; i++) {
+        data[i] = (uint8_t)(i * 13 + i / 32);
+    }
+    char path[32];
+    int fd = external_test_file(path, data, num_leaves * 32);
+    TEST_ASSERT(fd >= 0, "Temporary file failed");
+    close(fd);
+    
+    // Chunks arrive in file order through io_uring and through pread,
+    // including a short last one
+    for (int async = 0; async < 2; async++) {
+        merkle_ingest_t* ingest = merkle_ingest_open(path, 1000, async != 0);
+        TEST_ASSERT(ingest && merkle_ingest_size(ingest) == num_leaves * 32, "Opening the pipeline failed");
+        TEST_ASSERT(async || !merkle_ingest_async(ingest), "pread was asked for");
+        size_t total = 0;
+        size_t size = 0;
+        const uint8_t* chunk;
+        while ((chunk = merkle_ingest_next(ingest, &size)) != NULL) {
+            TEST_ASSERT(total + size <= num_leaves * 32 && (size == 1000 || total + size == num_leaves * 32),
+                        "Unexpected chunk size");
+            memcpy(copy + total, chunk, size);
+            total += size;
+        }
+        TEST_ASSERT(merkle_ingest_close(ingest) == MERKLE_SUCCESS, "Pipeline reported a failure");
+        TEST_ASSERT(total == num_leaves * 32 && memcmp(copy, data, total) == 0, "Ingested bytes differ");
+    }
+    
+    // File builds match in-memory ones in every storage mode, pruned too
+    merkle_tree_t* reference = merkle_tree_create(num_leaves, HASH_SHA256);
+    TEST_ASSERT(reference && merkle_tree_build(reference, data, num_leaves * 32) == MERKLE_SUCCESS,
+                "Reference build failed");
+    uint8_t expected[32];
+    uint8_t root[32];
+    merkle_tree_get_root_hash(reference, expected);
+    const merkle_leaf_storage_t modes[3] = {MERKLE_LEAVES_COPY, MERKLE_LEAVES_BORROW, MERKLE_LEAVES_HASH_ONLY};
+    for (int m = 0; m < 3; m++) {
+        merkle_tree_t* tree = merkle_tree_create(num_leaves, HASH_SHA256);
+        TEST_ASSERT(tree && merkle_tree_set_leaf_storage(tree, modes[m]) == MERKLE_SUCCESS, "Tree setup failed");
+        TEST_ASSERT(m != 2 || merkle_tree_set_pruned_height(tree, 3) == MERKLE_SUCCESS, "Pruning failed");
+        TEST_ASSERT(merkle_tree_build_file(tree, path) == MERKLE_SUCCESS, "File build failed");
+        merkle_tree_get_root_hash(tree, root);
+        TEST_ASSERT(memcmp(root, expected, 32) == 0, "File build root differs");
+        
+        size_t size = 0;
+        const uint8_t* leaf = merkle_tree_leaf(tree, 100, &size);
+        TEST_ASSERT(m == 0 ? leaf && memcmp(leaf, data + 100 * 32, 32) == 0 : leaf == NULL,
+                    "Only copy storage keeps file leaves");
+        merkle_proof_t* proof = merkle_proof_create(tree, 100);
+        TEST_ASSERT(proof && merkle_proof_verify(proof, data + 100 * 32), "File build proof should verify");
+        merkle_proof_destroy(proof);
+        merkle_tree_destroy(tree);
+    }
+    
+    // A file of the wrong size leaves the tree as it was
+    merkle_tree_t* small = merkle_tree_create(num_leaves / 2, HASH_SHA256);
+    TEST_ASSERT_EQUAL(MERKLE_ERROR_INVALID_TREE, merkle_tree_build_file(small, path), "Size mismatch");
+    TEST_ASSERT_EQUAL(MERKLE_ERROR_IO, merkle_tree_build_file(small, "/nonexistent/leaves"), "Missing file");
+    TEST_ASSERT(small->root == NULL, "Failed builds should not leave a tree");
+    merkle_tree_destroy(small);
+    
+    merkle_tree_destroy(reference);
+    unlink(path);
+    free(copy);
+    free(data);
+    
+    printf("  File ingestion tests passed!\n");
+    return true;
+}
+
+bool test_parallel_build(void) {
+    printf("Testing parallel subtree builds...\n");
+    
+    const uint64_t num_leaves = 1 << 12;
+    uint8_t* data = (uint8_t*)malloc(num_leaves * 32);
+    TEST_ASSERT(data != NULL, "Allocation failed");
+    for (size_t i = 0; i < num_leaves * 32; i++) {
+        data[i] = (uint8_t)(i * 5 + i / 32);
+    }
+    
+    // Serial and split builds agree for every arity, subtree count and rebuild
+    const uint8_t arities[3] = {2, 4, 16};
+    const uint32_t threads[3] = {4, 5, 64};
+    for (int a = 0; a < 3; a++) {
+        merkle_tree_t* serial = merkle_tree_create_kary(num_leaves, HASH_SHA256, arities[a]);
+        merkle_tree_t* split = merkle_tree_create_kary(num_leaves, HASH_SHA256, arities[a]);
+        TEST_ASSERT(serial && split, "Tree creation failed");
+        TEST_ASSERT(merkle_tree_set_build_threads(serial, 1) == MERKLE_SUCCESS &&
+                    merkle_tree_set_build_threads(split, threads[a]) == MERKLE_SUCCESS, "Setting threads failed");
+        TEST_ASSERT_EQUAL(1, merkle_subtree_count(serial), "One thread builds serially");
+        TEST_ASSERT(merkle_subtree_count(split) > 1 && merkle_subtree_count(split) <= threads[a],
+                    "Subtree count should fit the threads");
+        for (int build = 0; build < 2; build++) {
+            TEST_ASSERT(merkle_tree_build(serial, data, num_leaves * 32) == MERKLE_SUCCESS, "Serial build failed");
+            TEST_ASSERT(merkle_tree_build(split, data, num_leaves * 32) == MERKLE_SUCCESS, "Split build failed");
+        }
+        TEST_ASSERT_EQUAL(serial->memory_live_bytes, split->memory_live_bytes, "Footprints differ");
+        
+        uint8_t leaf[32];
+        memset(leaf, 0x3C, sizeof(leaf));
+        TEST_ASSERT(merkle_tree_update_leaf(split, 1234, leaf) == MERKLE_SUCCESS &&
+                    merkle_tree_update_leaf(serial, 1234, leaf) == MERKLE_SUCCESS, "Update failed");
+        uint8_t roots[2][32];
+        merkle_tree_get_root_hash(serial, roots[0]);
+        merkle_tree_get_root_hash(split, roots[1]);
+        TEST_ASSERT(memcmp(roots[0], roots[1], 32) == 0, "Split build root differs");
+        
+        for (uint64_t index = 0; index < num_leaves; index += 511) {
+            merkle_proof_t* proof = merkle_proof_create(split, index);
+            TEST_ASSERT(proof && merkle_proof_verify(proof, index == 1234 ? leaf : data + index * 32),
+                        "Split build proof should verify");
+            merkle_proof_destroy(proof);
+        }
+        
+        // Subtrees are only attributed to nodes when there is more than one
+        int node = merkle_tree_leaf_numa_node(split, 77);
+        TEST_ASSERT(merkle_numa_node_count() > 1 ? node >= 0 && node < merkle_numa_node_count() : node == -1,
+                    "Unexpected subtree node");
+        merkle_tree_destroy(serial);
+        merkle_tree_destroy(split);
+    }
+    
+    merkle_tree_t* tree = merkle_tree_create(num_leaves, HASH_SHA256);
+    TEST_ASSERT_EQUAL(MERKLE_ERROR_INVALID_SIZE, merkle_tree_set_build_threads(tree, MERKLE_MAX_BUILD_THREADS + 1),
+                      "Too many threads");
+    TEST_ASSERT(!merkle_numa_bind_thread(-1) && !merkle_numa_bind_thread(merkle_numa_node_count()),
+                "Binding to a missing node");
+    merkle_tree_destroy(tree);
+    free(data);
+    
+    printf("  Parallel build tests passed!\n");
+    return true;
+}
+
+bool test_interleaved_proofs(void) {
+    printf("Testing interleaved batch proofs...\n");
+    
+    const uint64_t num_leaves = 1 << 12;
+    const uint64_t count = 37;           // Not a whole number of walk groups
+    uint8_t* data = (uint8_t*)malloc(num_leaves * 32);
+    uint64_t* indices = (uint64_t*)malloc(count * sizeof(uint64_t));
+    uint64_t* order = (uint64_t*)malloc(count * sizeof(uint64_t));
+    uint8_t* out = (uint8_t*)malloc(3 * count * merkle_proof_serialized_size(MERKLE_MAX_PROOF_SIBLINGS));
+    TEST_ASSERT(data && indices && order && out, "Allocation failed");
+    for (size_t i = 0; i < num_leaves * 32; i++) {
+        data[i] = (uint8_t)(i * 11 + i / 32);
+    }
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    for (uint64_t i = 0; i < count; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        indices[i] = i % 9 == 8 ? indices[i - 1] : state % num_leaves;  // Random, with repeats
+        order[i] = count - 1 - i;
+    }
+    
+    // Random batches match single proofs, in place and through an order,
+    // whether the walks start from the hot array, the root or a bucket
+    const uint8_t arities[3] = {2, 4, 16};
+    for (int a = 0; a < 3; a++) {
+        for (uint8_t pruned = 0; pruned <= 1; pruned++) {
+            merkle_tree_t* tree = merkle_tree_create_kary(num_leaves, HASH_SHA256, arities[a]);
+            TEST_ASSERT(tree != NULL, "Tree creation failed");
+            if (pruned) {
+                TEST_ASSERT(merkle_tree_set_pruned_height(tree, 1) == MERKLE_SUCCESS, "Pruning failed");
+            }
+            TEST_ASSERT(merkle_tree_build(tree, data, num_leaves * 32) == MERKLE_SUCCESS, "Build failed");
+            
+            size_t size = merkle_proof_serialized_size(merkle_tree_proof_siblings(tree));
+            TEST_ASSERT(pruned_test_proofs(tree, indices, count, out), "Batch serialization failed");
+            TEST_ASSERT(memcmp(out, out + count * size, count * size) == 0, "Batch proofs differ from single proofs");
+            
+            merkle_snapshot_t snapshot = {tree->root, tree, 1, 0};
+            TEST_ASSERT(merkle_snapshot_serialize_proofs(&snapshot, indices, order, count, out + 2 * count * size) ==
+                        MERKLE_SUCCESS, "Ordered serialization failed");
+            TEST_ASSERT(memcmp(out, out + 2 * count * size, count * size) == 0, "Ordered batch proofs differ");
+            
+            // Without the hot array every path is walked from the top
+            size_t hot_live_bytes = tree->memory_live_bytes;
+            TEST_ASSERT(merkle_tree_set_hot_depth(tree, 0) == MERKLE_SUCCESS, "Disabling hot digests failed");
+            TEST_ASSERT_EQUAL(0, merkle_hot_depth(tree), "Hot array should be gone");
+            TEST_ASSERT(tree->memory_live_bytes < hot_live_bytes, "Hot array bytes should be released");
+            TEST_ASSERT(merkle_snapshot_serialize_proofs(&snapshot, indices, NULL, count, out + 2 * count * size) ==
+                        MERKLE_SUCCESS, "Cold serialization failed");
+            TEST_ASSERT(memcmp(out, out + 2 * count * size, count * size) == 0, "Cold batch proofs differ");
+            TEST_ASSERT(merkle_tree_set_hot_depth(tree, MERKLE_HOT_DEPTH) == MERKLE_SUCCESS,
+                        "Re-enabling hot digests failed");
+            TEST_ASSERT(merkle_hot_depth(tree) > 0, "Hot array should be rebuilt");
+            TEST_ASSERT_EQUAL(hot_live_bytes, tree->memory_live_bytes, "Hot array bytes should be charged again");
+            
+            indices[count - 1] = num_leaves;
+            TEST_ASSERT_EQUAL(MERKLE_ERROR_LEAF_OUT_OF_BOUNDS,
+                              merkle_snapshot_serialize_proofs(&snapshot, indices, NULL, count, out),
+                              "Out-of-range leaf in the last group");
+            indices[count - 1] = indices[count - 2];
+            merkle_tree_destroy(tree);
+        }
+    }
+    
+    free(data);
+    free(indices);
+    free(order);
+    free(out);
+    
+    printf("  Interleaved batch proof tests passed!\n");
+    return true;
+}
+
+// Writer that accepts a number of chunks, then fails
+static merkle_error_t export_test_write(void* context, const uint8_t* data, size_t size) {
+    (void)data;
+    (void)size;
+    int* chunks_left = (int*)context;
+    return (*chunks_left)-- > 0 ? MERKLE_SUCCESS : MERKLE_ERROR_IO;
+}
+
+bool test_proof_export(void) {
+    printf("Testing bulk proof export...\n");
+    
+    const uint64_t num_leaves = 1 << 12;
+    uint8_t* data = (uint8_t*)malloc(num_leaves * 32);
+    uint64_t* indices = (uint64_t*)malloc(num_leaves * sizeof(uint64_t));
+    uint8_t* expected = (uint8_t*)malloc(2 * num_leaves * merkle_proof_serialized_size(MERKLE_MAX_PROOF_SIBLINGS));
+    uint8_t* exported = (uint8_t*)malloc(num_leaves * merkle_proof_serialized_size(MERKLE_MAX_PROOF_SIBLINGS));
+    TEST_ASSERT(data && indices && expected && exported, "Allocation failed");
+    for (uint64_t i = 0; i < num_leaves; i++) {
+        indices[i] = i;
+    }
+    for (size_t i = 0; i < num_leaves * 32; i++) {
+        data[i] = (uint8_t)(i * 13 + i / 32);
+    }
+    
+    // Exports match proofs made one at a time, across chunks, ranges and
+    // pruned buckets
+    const uint8_t arities[3] = {2, 4, 16};
+    for (int a = 0; a < 3; a++) {
+        for (uint8_t pruned = 0; pruned <= 1; pruned++) {
+            merkle_tree_t* tree = merkle_tree_create_kary(num_leaves, HASH_SHA256, arities[a]);
+            TEST_ASSERT(tree != NULL, "Tree creation failed");
+            if (pruned) {
+                TEST_ASSERT(merkle_tree_set_pruned_height(tree, 1) == MERKLE_SUCCESS, "Pruning failed");
+            }
+            TEST_ASSERT(merkle_tree_build(tree, data, num_leaves * 32) == MERKLE_SUCCESS, "Build failed");
+            uint8_t leaf[32];
+            memset(leaf, 0x5A, sizeof(leaf));
+            TEST_ASSERT(merkle_tree_set_deferred(tree, true) == MERKLE_SUCCESS &&
+                        merkle_tree_update_leaf(tree, 2049, leaf) == MERKLE_SUCCESS, "Deferred update failed");
+            size_t size = merkle_proof_serialized_size(merkle_tree_proof_siblings(tree));
+            
+            // The export flushes the deferred update first
+            char path[64];
+            int fd = external_test_file(path, NULL, 0);
+            TEST_ASSERT(fd >= 0, "Temporary file failed");
+            merkle_proof_writer_t file_writer = merkle_proof_writer_fd(fd);
+            TEST_ASSERT(merkle_tree_export_all_proofs(tree, &file_writer) == MERKLE_SUCCESS, "File export failed");
+            TEST_ASSERT(pruned_test_proofs(tree, indices, num_leaves, expected), "Reference proofs failed");
+            TEST_ASSERT(pread(fd, exported, num_leaves * size, 0) == (ssize_t)(num_leaves * size), "Short export file");
+            TEST_ASSERT(memcmp(exported, expected, num_leaves * size) == 0, "Exported file differs");
+            close(fd);
+            unlink(path);
+            
+            const uint64_t first = 1000;
+            const uint64_t count = 777;
+            merkle_proof_buffer_t buffer = {exported, (count + 1) * size, size};
+            merkle_proof_writer_t buffer_writer = merkle_proof_writer_buffer(&buffer);
+            TEST_ASSERT(merkle_tree_export_proofs(tree, first, count, &buffer_writer) == MERKLE_SUCCESS,
+                        "Range export failed");
+            TEST_ASSERT_EQUAL((count + 1) * size, buffer.used, "Buffer should be full");
+            TEST_ASSERT(memcmp(exported + size, expected + first * size, count * size) == 0, "Exported range differs");
+            TEST_ASSERT_EQUAL(MERKLE_ERROR_INVALID_SIZE, merkle_tree_export_proofs(tree, first, 1, &buffer_writer),
+                              "Full buffer");
+            TEST_ASSERT_EQUAL(MERKLE_ERROR_LEAF_OUT_OF_BOUNDS,
+                              merkle_tree_export_proofs(tree, num_leaves - 5, 6, &buffer_writer), "Range past the end");
+            
+            int chunks_left = 1;
+            merkle_proof_writer_t failing = {export_test_write, &chunks_left};
+            TEST_ASSERT_EQUAL(MERKLE_ERROR_IO, merkle_tree_export_all_proofs(tree, &failing), "Writer error");
+            merkle_tree_destroy(tree);
+        }
+    }
+    
+    free(data);
+    free(indices);
+    free(expected);
+    free(exported);
+    
+    printf("  Bulk proof export tests passed!\n");
+    return true;
+}
+
 bool test_spi_basic(void) {
     printf("Testing SPI interface basic functionality...\n");
     
@@ -154,8 +1552,18 @@ bool test_spi_basic(void) {
     spi_response_t* response = spi_process_request(ctx, &request);
     TEST_ASSERT(response != NULL, "SPI request processing failed");
     TEST_ASSERT(response->request_id == 1, "Request ID mismatch");
+    TEST_ASSERT_EQUAL(SPI_RESPONSE_SUCCESS, response->status, "Tree info should succeed");
+    TEST_ASSERT_EQUAL(sizeof(spi_tree_info_t), response->proof_size, "Tree info payload size");
+    
+    spi_tree_info_t* reported = (spi_tree_info_t*)response->proof_data;
+    TEST_ASSERT_EQUAL(1024, reported->num_leaves, "Reported leaf count");
+    TEST_ASSERT_EQUAL(10, reported->depth, "Reported depth");
+    TEST_ASSERT(memcmp(reported->root_hash, tree_info->root_hash, SHA256_HASH_SIZE) == 0,
+                "Reported root should match creation");
     
     // Clean up
+    TEST_ASSERT(spi_destroy_tree(ctx, tree_info->tree_id), "Tree destroy failed");
+    TEST_ASSERT(!spi_destroy_tree(ctx, tree_info->tree_id), "Double destroy should fail");
     free(tree_info);
     spi_free_response(response);
     spi_shutdown(ctx);
@@ -170,31 +1578,1083 @@ bool test_spi_performance_metrics(void) {
     spi_context_t* ctx = spi_init(1048576);
     TEST_ASSERT(ctx != NULL, "SPI initialization failed");
     
+    spi_tree_info_t* info = spi_create_tree(ctx, 256, HASH_SHA256);
+    TEST_ASSERT(info != NULL, "Tree creation via SPI failed");
+    
+    uint8_t proof[SPI_MAX_PROOF_SIZE];
+    uint64_t proof_size = sizeof(proof);
+    bool valid = false;
+    TEST_ASSERT(spi_generate_proof(ctx, info->tree_id, 7, proof, &proof_size), "Proof generation failed");
+    TEST_ASSERT(spi_verify_proof(ctx, info->tree_id, 7, proof, proof_size, &valid), "Proof verification failed");
+    TEST_ASSERT(valid, "Proof should verify");
+    
     spi_performance_metrics_t metrics = spi_get_performance_metrics(ctx);
     
-    // These are placeholder values, just check they're reasonable
+    // Measured over the operations above
     TEST_ASSERT(metrics.generation_time_ns > 0, "Generation time should be positive");
     TEST_ASSERT(metrics.verification_time_ns > 0, "Verification time should be positive");
     TEST_ASSERT(metrics.cache_hit_rate >= 0.0 && metrics.cache_hit_rate <= 1.0, 
                 "Cache hit rate should be between 0 and 1");
     
+    TEST_ASSERT(metrics.throughput_proofs_per_sec > 0, "Throughput should be positive");
+    
     uint32_t score = spi_calculate_performance_score(&metrics);
     TEST_ASSERT(score >= 0, "Performance score should be non-negative");
     
+    free(info);
     spi_shutdown(ctx);
     
     printf("  SPI performance metrics tests passed!\n");
     return true;
 }
 
-bool test_error_handling(void) {
-    printf("Testing error handling...\n");
+bool test_spi_registry(void) {
+    printf("Testing SPI tree registry and dispatch...\n");
     
-    // Test SPI error strings
-    const char* error_msg = spi_error_string(SPI_RESPONSE_ERROR_INVALID_REQUEST);
-    TEST_ASSERT(error_msg != NULL, "Error string should not be NULL");
+    // Map behaviour across growth and backward-shift deletion
+    spi_tree_registry_t* registry = spi_registry_create(0);
+    TEST_ASSERT(registry != NULL, "Registry creation failed");
     
-    error_msg = spi_error_string(999); // Invalid status
+    merkle_tree_t* trees[100];
+    uint8_t pair[64] = {0};
+    for (uint64_t id = 1; id <= 100; id++) {
+        trees[id - 1] = merkle_tree_create(2, HASH_SHA256);
+        TEST_ASSERT(merkle_tree_build(trees[id - 1], pair, sizeof(pair)) == MERKLE_SUCCESS, "Tree build failed");
+        TEST_ASSERT_EQUAL(id, spi_registry_add(registry, trees[id - 1]), "IDs should be sequential");
+    }
+    TEST_ASSERT_EQUAL(100, spi_registry_count(registry), "Registry count after inserts");
+    
+    // A pinned handle outlives its removal from the map
+    merkle_snapshot_t snapshot;
+    spi_tree_handle_t* pinned = spi_registry_acquire(registry, 1);
+    TEST_ASSERT(pinned != NULL, "Acquire failed");
+    merkle_mvcc_pin(pinned->tree, &snapshot);
+    TEST_ASSERT(snapshot.tree == trees[0], "Acquire returned the wrong tree");
+    merkle_mvcc_unpin(pinned->tree, &snapshot);
+    
+    for (uint64_t id = 1; id <= 100; id += 2) {
+        TEST_ASSERT(spi_registry_remove(registry, id), "Remove failed");
+    }
+    TEST_ASSERT(!spi_registry_remove(registry, 1), "Double remove should fail");
+    TEST_ASSERT_EQUAL(1, pinned->tree_id, "Pinned handle should stay intact");
+    spi_tree_handle_release(pinned);
+    
+    for (uint64_t id = 1; id <= 100; id++) {
+        spi_tree_handle_t* handle = spi_registry_acquire(registry, id);
+        TEST_ASSERT((id % 2) ? handle == NULL : handle != NULL, "Lookup after removal");
+        if (handle) {
+            merkle_mvcc_pin(handle->tree, &snapshot);
+            TEST_ASSERT(snapshot.tree == trees[id - 1], "Lookup returned the wrong tree");
+            merkle_mvcc_unpin(handle->tree, &snapshot);
+        }
+        spi_tree_handle_release(handle);
+    }
+    TEST_ASSERT_EQUAL(50, spi_registry_count(registry), "Registry count after removals");
+    spi_registry_destroy(registry);
+    
+    // All request types through the dispatcher
+    spi_context_t* ctx = spi_init(1024);
+    TEST_ASSERT(ctx != NULL, "SPI initialization failed");
+    TEST_ASSERT(spi_create_tree(ctx, 2048, HASH_SHA256) == NULL, "Tree above max_tree_size should fail");
+    
+    spi_tree_info_t* first = spi_create_tree(ctx, 64, HASH_SHA256);
+    spi_tree_info_t* second = spi_create_tree(ctx, 64, HASH_BLAKE2B);
+    TEST_ASSERT(first && second, "Tree creation via SPI failed");
+    TEST_ASSERT_EQUAL(first->tree_id + 1, second->tree_id, "Tree IDs should be sequential");
+    
+    uint8_t data[64 * 32];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)(i * 13 + 1);
+    }
+    TEST_ASSERT(!spi_update_tree_data(ctx, second->tree_id, data, 32), "Partial update should fail");
+    TEST_ASSERT(spi_update_tree_data(ctx, second->tree_id, data, sizeof(data)), "Update failed");
+    
+    spi_request_t request = {0};
+    request.request_id = 7;
+    request.tree_id = second->tree_id;
+    request.request_type = SPI_REQUEST_BATCH_GENERATION;
+    uint64_t indices[3] = {0, 33, 63};
+    request.batch_size = 3;
+    request.leaf_indices = indices;
+    
+    spi_response_t* generated = spi_process_request(ctx, &request);
+    TEST_ASSERT(generated && generated->status == SPI_RESPONSE_SUCCESS, "Batch generation failed");
+    TEST_ASSERT(generated->processing_time_ns > 0, "Processing time should be measured");
+    TEST_ASSERT_EQUAL(3 * generated->batch_results[0], generated->proof_size, "Proofs should be packed");
+    
+    request.request_type = SPI_REQUEST_BATCH_VERIFICATION;
+    request.leaf_data = generated->proof_data;
+    request.leaf_data_size = generated->proof_size;
+    spi_response_t* verified = spi_process_request(ctx, &request);
+    TEST_ASSERT(verified && verified->status == SPI_RESPONSE_SUCCESS, "Batch verification failed");
+    TEST_ASSERT_EQUAL(1, verified->verification_result, "Batch should verify");
+    spi_free_response(verified);
+    
+    // A proof for another leaf must not verify
+    indices[1] = 34;
+    verified = spi_process_request(ctx, &request);
+    TEST_ASSERT(verified && verified->status == SPI_RESPONSE_SUCCESS, "Batch verification failed");
+    TEST_ASSERT_EQUAL(0, verified->verification_result, "Mismatched index should fail");
+    TEST_ASSERT_EQUAL(0, verified->batch_results[1], "Mismatched proof should be flagged");
+    TEST_ASSERT_EQUAL(1, verified->batch_results[2], "Other proofs should still verify");
+    spi_free_response(verified);
+    
+    // Single proof, then stale after the tree changes
+    request.request_type = SPI_REQUEST_PROOF_GENERATION;
+    request.leaf_index = 5;
+    spi_response_t* single = spi_process_request(ctx, &request);
+    TEST_ASSERT(single && single->status == SPI_RESPONSE_SUCCESS, "Proof generation failed");
+    
+    request.request_type = SPI_REQUEST_PROOF_VERIFICATION;
+    request.leaf_data = single->proof_data;
+    request.leaf_data_size = single->proof_size;
+    verified = spi_process_request(ctx, &request);
+    TEST_ASSERT(verified && verified->verification_result == 1, "Proof should verify");
+    spi_free_response(verified);
+    
+    data[0] ^= 0xFF;
+    TEST_ASSERT(spi_update_tree_data(ctx, second->tree_id, data, sizeof(data)), "Update failed");
+    verified = spi_process_request(ctx, &request);
+    TEST_ASSERT(verified && verified->verification_result == 0, "Stale proof should not verify");
+    spi_free_response(verified);
+    
+    request.leaf_data_size = 8;
+    verified = spi_process_request(ctx, &request);
+    TEST_ASSERT(verified && verified->status == SPI_RESPONSE_ERROR_INVALID_PROOF, "Truncated proof");
+    spi_free_response(verified);
+    
+    // Batches are no longer capped at 1000 and results are sized to the batch
+    uint64_t* many = (uint64_t*)malloc(5000 * sizeof(uint64_t));
+    TEST_ASSERT(many != NULL, "Allocation failed");
+    for (uint64_t i = 0; i < 5000; i++) {
+        many[i] = (i * 37) % 64;
+    }
+    spi_request_t big = {0};
+    big.request_id = 8;
+    big.tree_id = first->tree_id;
+    big.request_type = SPI_REQUEST_BATCH_GENERATION;
+    big.batch_size = 5000;
+    big.leaf_indices = many;
+    spi_response_t* bulk = spi_process_request(ctx, &big);
+    TEST_ASSERT(bulk && bulk->status == SPI_RESPONSE_SUCCESS, "Large batch generation failed");
+    TEST_ASSERT_EQUAL(5000, bulk->batch_size, "Result count should match the batch");
+    TEST_ASSERT_EQUAL(5000 * bulk->batch_results[4999], bulk->proof_size, "Large batch should be packed");
+    spi_free_response(bulk);
+    free(many);
+    
+    big.leaf_indices = NULL;
+    bulk = spi_process_request(ctx, &big);
+    TEST_ASSERT(bulk && bulk->status == SPI_RESPONSE_ERROR_INVALID_REQUEST, "Batch without indices");
+    TEST_ASSERT(bulk->batch_results == NULL, "Rejected batch should carry no results");
+    spi_free_response(bulk);
+    TEST_ASSERT(sizeof(spi_request_t) <= 128 && sizeof(spi_response_t) <= 128,
+                "Request and response headers should stay compact");
+    
+    TEST_ASSERT(spi_destroy_tree(ctx, second->tree_id), "Tree destroy failed");
+    verified = spi_process_request(ctx, &request);
+    TEST_ASSERT(verified && verified->status == SPI_RESPONSE_ERROR_INVALID_TREE, "Destroyed tree");
+    spi_free_response(verified);
+    
+    spi_free_response(single);
+    spi_free_response(generated);
+    free(first);
+    free(second);
+    spi_shutdown(ctx);
+    
+    printf("  SPI registry tests passed!\n");
+    return true;
+}
+
+#define SPI_TEST_READERS 8
+#define SPI_TEST_READS 200
+
+typedef struct {
+    spi_context_t* ctx;
+    uint64_t tree_id;
+    uint64_t index;
+    uint64_t failures;
+} spi_test_worker_t;
+
+static void* spi_test_init_worker(void* arg) {
+    spi_test_worker_t* worker = (spi_test_worker_t*)arg;
+    worker->ctx = spi_init(4096);
+    return NULL;
+}
+
+static void* spi_test_reader(void* arg) {
+    spi_test_worker_t* worker = (spi_test_worker_t*)arg;
+    uint8_t proof[SPI_MAX_PROOF_SIZE];
+    
+    for (uint64_t i = 0; i < SPI_TEST_READS; i++) {
+        uint64_t leaf = (worker->index * 31 + i * 7) % 256;
+        uint64_t proof_size = sizeof(proof);
+        bool valid = false;
+        
+        // A writer may land between the two calls, so only the calls
+        // themselves must succeed
+        if (!spi_generate_proof(worker->ctx, worker->tree_id, leaf, proof, &proof_size) ||
+            !spi_verify_proof(worker->ctx, worker->tree_id, leaf, proof, proof_size, &valid)) {
+            worker->failures++;
+        }
+    }
+    return NULL;
+}
+
+static void* spi_test_writer(void* arg) {
+    spi_test_worker_t* worker = (spi_test_worker_t*)arg;
+    uint8_t data[256 * 32];
+    
+    for (uint64_t round = 0; round < 20; round++) {
+        memset(data, (int)round, sizeof(data));
+        if (!spi_update_tree_data(worker->ctx, worker->tree_id, data, sizeof(data))) {
+            worker->failures++;
+        }
+        
+        // Copy-on-write path updates between the full rebuilds
+        for (uint64_t leaf = round; leaf < 256; leaf += 16) {
+            data[0] = (uint8_t)leaf;
+            if (!spi_update_leaf(worker->ctx, worker->tree_id, leaf, data, SHA256_HASH_SIZE)) {
+                worker->failures++;
+            }
+        }
+        
+        // Churn the registry alongside the updates
+        spi_tree_info_t* info = spi_create_tree(worker->ctx, 16, HASH_SHA256);
+        if (!info || !spi_destroy_tree(worker->ctx, info->tree_id)) {
+            worker->failures++;
+        }
+        free(info);
+    }
+    return NULL;
+}
+
+bool test_spi_concurrency(void) {
+    printf("Testing concurrent SPI access...\n");
+    
+    // Racing initializers all get the same context
+    spi_test_worker_t init_workers[SPI_TEST_READERS] = {0};
+    pthread_t threads[SPI_TEST_READERS + 1];
+    for (int t = 0; t < SPI_TEST_READERS; t++) {
+        TEST_ASSERT(pthread_create(&threads[t], NULL, spi_test_init_worker, &init_workers[t]) == 0,
+                    "Thread creation failed");
+    }
+    for (int t = 0; t < SPI_TEST_READERS; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    spi_context_t* ctx = init_workers[0].ctx;
+    TEST_ASSERT(ctx != NULL, "SPI initialization failed");
+    for (int t = 1; t < SPI_TEST_READERS; t++) {
+        TEST_ASSERT(init_workers[t].ctx == ctx, "Every initializer should see one context");
+    }
+    
+    spi_tree_info_t* info = spi_create_tree(ctx, 256, HASH_SHA256);
+    TEST_ASSERT(info != NULL, "Tree creation via SPI failed");
+    spi_reset_performance_metrics(ctx);
+    
+    spi_test_worker_t workers[SPI_TEST_READERS + 1] = {0};
+    for (int t = 0; t <= SPI_TEST_READERS; t++) {
+        workers[t].ctx = ctx;
+        workers[t].tree_id = info->tree_id;
+        workers[t].index = (uint64_t)t;
+        void* (*fn)(void*) = (t == SPI_TEST_READERS) ? spi_test_writer : spi_test_reader;
+        TEST_ASSERT(pthread_create(&threads[t], NULL, fn, &workers[t]) == 0, "Thread creation failed");
+    }
+    
+    uint64_t failures = 0;
+    for (int t = 0; t <= SPI_TEST_READERS; t++) {
+        pthread_join(threads[t], NULL);
+        failures += workers[t].failures;
+    }
+    TEST_ASSERT_EQUAL(0, failures, "Concurrent SPI calls should all succeed");
+    
+    spi_stats_t stats = spi_get_stats(ctx);
+    TEST_ASSERT_EQUAL(SPI_TEST_READERS * SPI_TEST_READS, stats.total_proofs_generated,
+                      "Every generated proof should be counted");
+    TEST_ASSERT_EQUAL(SPI_TEST_READERS * SPI_TEST_READS, stats.total_proofs_verified,
+                      "Every verification should be counted");
+    
+    // After the writer is done, fresh proofs verify again
+    uint8_t proof[SPI_MAX_PROOF_SIZE];
+    uint64_t proof_size = sizeof(proof);
+    bool valid = false;
+    TEST_ASSERT(spi_generate_proof(ctx, info->tree_id, 42, proof, &proof_size), "Proof generation failed");
+    TEST_ASSERT(spi_verify_proof(ctx, info->tree_id, 42, proof, proof_size, &valid) && valid,
+                "Proof should verify once writes stop");
+    
+    free(info);
+    spi_shutdown(ctx);
+    
+    printf("  Concurrent SPI tests passed!\n");
+    return true;
+}
+
+typedef struct {
+    _Atomic bool release;
+    spi_response_status_t status[4];
+    uint32_t completed;
+} spi_test_async_gate_t;
+
+// Holds the only worker on its first completion until the test releases it
+static void spi_test_async_callback(const spi_request_t* request, spi_response_t* response, void* user_data) {
+    spi_test_async_gate_t* gate = (spi_test_async_gate_t*)user_data;
+    struct timespec pause = {0, 1000000};
+    
+    while (gate->completed == 0 && !atomic_load(&gate->release)) {
+        nanosleep(&pause, NULL);
+    }
+    gate->status[request->request_id - 1] = response ? response->status : SPI_RESPONSE_ERROR_OUT_OF_MEMORY;
+    gate->completed++;
+    spi_free_response(response);
+}
+
+bool test_spi_async(void) {
+    printf("Testing asynchronous SPI requests...\n");
+    
+    spi_context_t* ctx = spi_init(4096);
+    TEST_ASSERT(ctx != NULL, "SPI initialization failed");
+    spi_tree_info_t* info = spi_create_tree(ctx, 256, HASH_SHA256);
+    TEST_ASSERT(info != NULL, "Tree creation via SPI failed");
+    ctx->max_concurrent_requests = 16;
+    
+    // Completion queue: unpolled completions hold their admission slot
+    spi_async_t* async = spi_async_create(ctx, 4, NULL, NULL);
+    TEST_ASSERT(async != NULL, "Async pool creation failed");
+    
+    static spi_request_t requests[64];
+    for (uint32_t i = 0; i < 64; i++) {
+        memset(&requests[i], 0, sizeof(spi_request_t));
+        requests[i].request_id = i + 1;
+        requests[i].request_type = SPI_REQUEST_PROOF_GENERATION;
+        requests[i].tree_id = info->tree_id;
+        requests[i].leaf_index = i * 3;
+    }
+    
+    for (uint32_t i = 0; i < 16; i++) {
+        TEST_ASSERT(spi_async_submit(async, &requests[i], 0), "Submit under the limit failed");
+    }
+    TEST_ASSERT(!spi_async_submit(async, &requests[16], 0), "Submit over the limit should fail");
+    TEST_ASSERT_EQUAL(16, spi_async_in_flight(async), "In-flight count at the limit");
+    
+    uint32_t submitted = 16;
+    uint32_t received = 0;
+    bool seen[64] = {false};
+    while (received < 64) {
+        while (submitted < 64 && spi_async_submit(async, &requests[submitted], 0)) {
+            submitted++;
+        }
+        
+        spi_response_t* responses[8];
+        size_t count = spi_async_poll(async, responses, 8, 1000);
+        TEST_ASSERT(count > 0, "Poll timed out");
+        for (size_t r = 0; r < count; r++) {
+            uint32_t id = responses[r]->request_id;
+            TEST_ASSERT(id >= 1 && id <= 64 && !seen[id - 1], "Unexpected or duplicate completion");
+            seen[id - 1] = true;
+            
+            bool valid = false;
+            TEST_ASSERT(responses[r]->status == SPI_RESPONSE_SUCCESS, "Async proof generation failed");
+            TEST_ASSERT(spi_verify_proof(ctx, info->tree_id, requests[id - 1].leaf_index,
+                                         responses[r]->proof_data, responses[r]->proof_size, &valid) && valid,
+                        "Async proof should verify");
+            spi_free_response(responses[r]);
+        }
+        received += (uint32_t)count;
+    }
+    TEST_ASSERT_EQUAL(0, spi_async_in_flight(async), "Nothing should be in flight after polling");
+    spi_async_destroy(async);
+    
+    // Callback delivery and timeouts: with the single worker held, requests
+    // queued behind it expire before they start
+    spi_test_async_gate_t gate = {0};
+    async = spi_async_create(ctx, 1, spi_test_async_callback, &gate);
+    TEST_ASSERT(async != NULL, "Async pool creation failed");
+    for (uint32_t i = 0; i < 3; i++) {
+        requests[i].timeout_ms = i == 0 ? 0 : 1;
+        TEST_ASSERT(spi_async_submit(async, &requests[i], 0), "Submit failed");
+    }
+    struct timespec hold = {0, 20000000};
+    nanosleep(&hold, NULL);
+    atomic_store(&gate.release, true);
+    spi_async_destroy(async);
+    
+    TEST_ASSERT_EQUAL(3, gate.completed, "Every request should complete");
+    TEST_ASSERT(gate.status[0] == SPI_RESPONSE_SUCCESS, "Untimed request should succeed");
+    TEST_ASSERT(gate.status[1] == SPI_RESPONSE_ERROR_TIMEOUT && gate.status[2] == SPI_RESPONSE_ERROR_TIMEOUT,
+                "Expired requests should time out");
+    
+    free(info);
+    spi_shutdown(ctx);
+    
+    printf("  Asynchronous SPI tests passed!\n");
+    return true;
+}
+
+#define SPI_TEST_SUBMITTERS 8
+#define SPI_TEST_SUBMITS 2000
+
+typedef struct {
+    spi_async_t* async;
+    spi_request_t* requests;                // SPI_TEST_SUBMITS of its own
+    bool ok;
+} spi_test_submitter_t;
+
+static void spi_test_count_callback(const spi_request_t* request, spi_response_t* response, void* user_data) {
+    (void)request;
+    if (response && response->status == SPI_RESPONSE_SUCCESS) {
+        atomic_fetch_add((_Atomic uint32_t*)user_data, 1);
+    }
+    spi_free_response(response);
+}
+
+static void* spi_test_submitter_main(void* arg) {
+    spi_test_submitter_t* submitter = (spi_test_submitter_t*)arg;
+    submitter->ok = true;
+    for (uint32_t i = 0; i < SPI_TEST_SUBMITS && submitter->ok; i++) {
+        submitter->ok = spi_async_submit(submitter->async, &submitter->requests[i], 10000);
+    }
+    return NULL;
+}
+
+bool test_spi_async_submitters(void) {
+    printf("Testing concurrent asynchronous submitters...\n");
+    
+    spi_context_t* ctx = spi_init(4096);
+    TEST_ASSERT(ctx != NULL, "SPI initialization failed");
+    spi_tree_info_t* info = spi_create_tree(ctx, 256, HASH_SHA256);
+    TEST_ASSERT(info != NULL, "Tree creation via SPI failed");
+    ctx->max_concurrent_requests = 64;
+    
+    // More producers than workers, so producers often claim ring cells
+    // ahead of one another; every job must still reach a worker
+    _Atomic uint32_t completed = 0;
+    spi_async_t* async = spi_async_create(ctx, 2, spi_test_count_callback, &completed);
+    TEST_ASSERT(async != NULL, "Async pool creation failed");
+    
+    spi_request_t* requests = (spi_request_t*)calloc(SPI_TEST_SUBMITTERS * SPI_TEST_SUBMITS, sizeof(spi_request_t));
+    TEST_ASSERT(requests != NULL, "Allocation failed");
+    for (uint32_t i = 0; i < SPI_TEST_SUBMITTERS * SPI_TEST_SUBMITS; i++) {
+        requests[i].request_id = i + 1;
+        requests[i].request_type = SPI_REQUEST_PROOF_GENERATION;
+        requests[i].tree_id = info->tree_id;
+        requests[i].leaf_index = i % 256;
+    }
+    
+    pthread_t threads[SPI_TEST_SUBMITTERS];
+    spi_test_submitter_t submitters[SPI_TEST_SUBMITTERS];
+    for (int t = 0; t < SPI_TEST_SUBMITTERS; t++) {
+        submitters[t] = (spi_test_submitter_t){async, requests + t * SPI_TEST_SUBMITS, false};
+        TEST_ASSERT(pthread_create(&threads[t], NULL, spi_test_submitter_main, &submitters[t]) == 0,
+                    "Submitter thread creation failed");
+    }
+    bool all_submitted = true;
+    for (int t = 0; t < SPI_TEST_SUBMITTERS; t++) {
+        pthread_join(threads[t], NULL);
+        all_submitted = all_submitted && submitters[t].ok;
+    }
+    TEST_ASSERT(all_submitted, "Submit should be admitted within its wait");
+    
+    // A stranded job would hold its slot for good
+    struct timespec pause = {0, 1000000};
+    for (int waited = 0; waited < 5000 && spi_async_in_flight(async) > 0; waited++) {
+        nanosleep(&pause, NULL);
+    }
+    TEST_ASSERT_EQUAL(0, spi_async_in_flight(async), "Every queued job should complete");
+    spi_async_destroy(async);
+    TEST_ASSERT_EQUAL(SPI_TEST_SUBMITTERS * SPI_TEST_SUBMITS, atomic_load(&completed), "Completion count");
+    
+    free(requests);
+    free(info);
+    spi_shutdown(ctx);
+    
+    printf("  Concurrent submitter tests passed!\n");
+    return true;
+}
+
+bool test_spi_batch_proofs(void) {
+    printf("Testing SPI batch proofs...\n");
+    
+    spi_context_t* ctx = spi_init(1 << 16);
+    TEST_ASSERT(ctx != NULL, "SPI initialization failed");
+    spi_tree_info_t* info = spi_create_tree(ctx, 4096, HASH_SHA256);
+    TEST_ASSERT(info != NULL, "Tree creation via SPI failed");
+    
+    uint8_t* data = (uint8_t*)malloc(4096 * 32);
+    TEST_ASSERT(data != NULL, "Allocation failed");
+    for (size_t i = 0; i < 4096 * 32; i++) {
+        data[i] = (uint8_t)(i * 7 + i / 32);
+    }
+    TEST_ASSERT(spi_update_tree_data(ctx, info->tree_id, data, 4096 * 32), "Update failed");
+    free(data);
+    
+    // Scattered indices with repeats, large enough to be split across threads
+    const uint64_t count = 3000;
+    uint64_t indices[3000];
+    for (uint64_t i = 0; i < count; i++) {
+        indices[i] = (i % 5 == 4) ? indices[i - 3] : (i * 2654435761ULL) % 4096;
+    }
+    
+    uint64_t proof_size = SPI_MAX_PROOF_SIZE;
+    uint8_t single[SPI_MAX_PROOF_SIZE];
+    TEST_ASSERT(spi_generate_proof(ctx, info->tree_id, 0, single, &proof_size), "Single proof failed");
+    
+    uint64_t total = proof_size * count - 1;
+    uint8_t* proofs = (uint8_t*)malloc(proof_size * count);
+    TEST_ASSERT(proofs != NULL, "Allocation failed");
+    TEST_ASSERT(!spi_generate_proofs_batch(ctx, info->tree_id, indices, count, proofs, &total),
+                "Undersized buffer should fail");
+    TEST_ASSERT_EQUAL(proof_size * count, total, "Needed size should be reported");
+    TEST_ASSERT(spi_generate_proofs_batch(ctx, info->tree_id, indices, count, proofs, &total),
+                "Batch generation failed");
+    
+    // Proofs come back in request order, byte-identical to single proofs
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t size = SPI_MAX_PROOF_SIZE;
+        TEST_ASSERT(spi_generate_proof(ctx, info->tree_id, indices[i], single, &size), "Single proof failed");
+        TEST_ASSERT(memcmp(single, proofs + i * proof_size, proof_size) == 0, "Batch proof differs");
+    }
+    
+    uint64_t sizes[3000];
+    bool results[3000];
+    for (uint64_t i = 0; i < count; i++) {
+        sizes[i] = proof_size;
+    }
+    TEST_ASSERT(spi_verify_proofs_batch(ctx, info->tree_id, indices, proofs, sizes, count, results),
+                "Batch verification failed");
+    for (uint64_t i = 0; i < count; i++) {
+        TEST_ASSERT(results[i], "Batch proof should verify");
+    }
+    
+    // A tampered sibling fails only its own proof
+    proofs[1234 * proof_size + 48] ^= 1;
+    TEST_ASSERT(spi_verify_proofs_batch(ctx, info->tree_id, indices, proofs, sizes, count, results),
+                "Batch verification failed");
+    for (uint64_t i = 0; i < count; i++) {
+        TEST_ASSERT(results[i] == (i != 1234), "Only the tampered proof should fail");
+    }
+    
+    sizes[7] = proof_size - 1;
+    sizes[8] = proof_size + 1;
+    TEST_ASSERT(!spi_verify_proofs_batch(ctx, info->tree_id, indices, proofs, sizes, count, results),
+                "Truncated proof should be rejected");
+    TEST_ASSERT(!results[7], "Truncated proof should not verify");
+    
+    uint64_t out_of_range[2] = {1, 4096};
+    total = proof_size * count;
+    TEST_ASSERT(!spi_generate_proofs_batch(ctx, info->tree_id, out_of_range, 2, proofs, &total),
+                "Out-of-range index should fail");
+    
+    free(proofs);
+    free(info);
+    spi_shutdown(ctx);
+    
+    printf("  SPI batch proof tests passed!\n");
+    return true;
+}
+
+bool test_spi_server(void) {
+    printf("Testing SPI socket server...\n");
+    
+    spi_context_t* ctx = spi_init(4096);
+    TEST_ASSERT(ctx != NULL, "SPI initialization failed");
+    spi_tree_info_t* info = spi_create_tree(ctx, 256, HASH_SHA256);
+    TEST_ASSERT(info != NULL, "Tree creation via SPI failed");
+    
+    // Frames that disagree with their own lengths are rejected
+    uint64_t indices[3] = {5, 200, 17};
+    spi_request_t request = {.request_id = 1, .request_type = SPI_REQUEST_BATCH_GENERATION,
+                             .tree_id = info->tree_id, .batch_size = 3, .leaf_indices = indices};
+    uint64_t frame[16];
+    size_t frame_size = spi_wire_encode_request(&request, (uint8_t*)frame, sizeof(frame));
+    TEST_ASSERT_EQUAL(SPI_WIRE_HEADER_SIZE + 3 * sizeof(uint64_t), frame_size, "Encoded request size");
+    spi_request_t decoded;
+    TEST_ASSERT(spi_wire_decode_request((uint8_t*)frame, frame_size, &decoded), "Decode failed");
+    TEST_ASSERT(decoded.batch_size == 3 && decoded.leaf_indices[1] == 200, "Decoded request differs");
+    frame[4] = 4;  // batch_size
+    TEST_ASSERT(!spi_wire_decode_request((uint8_t*)frame, frame_size, &decoded), "Bad batch size accepted");
+    
+    spi_server_config_t tcp = {.unix_path = NULL, .port = 0, .num_reactors = 2};
+    spi_server_t* server = spi_server_start(ctx, &tcp);
+    TEST_ASSERT(server != NULL, "TCP server start failed");
+    tcp.port = spi_server_port(server);
+    TEST_ASSERT(tcp.port != 0, "Server should report its port");
+    
+    spi_client_t* client = spi_client_connect(&tcp);
+    TEST_ASSERT(client != NULL, "Client connect failed");
+    
+    // Pipelined: everything goes out before the first response is read
+    for (uint32_t i = 0; i < 100; i++) {
+        spi_request_t proof = {.request_id = 10 + i, .request_type = SPI_REQUEST_PROOF_GENERATION,
+                               .tree_id = info->tree_id, .leaf_index = (i * 37) % 256};
+        TEST_ASSERT(spi_client_send(client, &proof), "Send failed");
+    }
+    TEST_ASSERT(spi_client_send(client, &request), "Send failed");
+    spi_request_t missing = {.request_id = 999, .request_type = SPI_REQUEST_TREE_INFO, .tree_id = 12345};
+    TEST_ASSERT(spi_client_send(client, &missing), "Send failed");
+    
+    for (uint32_t i = 0; i < 100; i++) {
+        spi_response_t* response = spi_client_receive(client);
+        TEST_ASSERT(response != NULL, "Receive failed");
+        TEST_ASSERT_EQUAL(10 + i, response->request_id, "Responses should arrive in request order");
+        TEST_ASSERT(response->status == SPI_RESPONSE_SUCCESS, "Remote proof generation failed");
+        
+        bool valid = false;
+        TEST_ASSERT(spi_verify_proof(ctx, info->tree_id, (i * 37) % 256, response->proof_data,
+                                     response->proof_size, &valid) && valid, "Remote proof should verify");
+        spi_free_response(response);
+    }
+    
+    spi_response_t* batch = spi_client_receive(client);
+    TEST_ASSERT(batch != NULL && batch->status == SPI_RESPONSE_SUCCESS, "Remote batch failed");
+    TEST_ASSERT_EQUAL(3, batch->batch_size, "Remote batch results");
+    spi_response_t* error = spi_client_receive(client);
+    TEST_ASSERT(error != NULL && error->request_id == 999, "Error response missing");
+    TEST_ASSERT(error->status == SPI_RESPONSE_ERROR_INVALID_TREE, "Unknown tree should fail remotely");
+    spi_free_response(error);
+    
+    spi_request_t verify = {.request_id = 2, .request_type = SPI_REQUEST_BATCH_VERIFICATION,
+                            .tree_id = info->tree_id, .batch_size = 3, .leaf_indices = indices,
+                            .leaf_data = batch->proof_data, .leaf_data_size = batch->proof_size};
+    TEST_ASSERT(spi_client_send(client, &verify), "Send failed");
+    spi_response_t* verified = spi_client_receive(client);
+    TEST_ASSERT(verified != NULL && verified->verification_result == 1, "Remote batch verification failed");
+    spi_free_response(verified);
+    spi_free_response(batch);
+    
+    // A batch whose proofs outgrow a frame is refused before any proof is
+    // built, and the request pipelined behind it still gets its answer
+    const uint64_t oversized = SPI_WIRE_MAX_FRAME / 256 + 1;
+    uint64_t* many = (uint64_t*)malloc(oversized * sizeof(uint64_t));
+    TEST_ASSERT(many != NULL, "Allocation failed");
+    for (uint64_t i = 0; i < oversized; i++) {
+        many[i] = i % 256;
+    }
+    spi_request_t large = {.request_id = 3, .request_type = SPI_REQUEST_BATCH_GENERATION,
+                           .tree_id = info->tree_id, .batch_size = oversized, .leaf_indices = many};
+    spi_request_t after = {.request_id = 4, .request_type = SPI_REQUEST_PROOF_GENERATION,
+                           .tree_id = info->tree_id, .leaf_index = 9};
+    uint64_t generated_before = spi_get_stats(ctx).total_proofs_generated;
+    TEST_ASSERT(spi_client_send(client, &large) && spi_client_send(client, &after), "Send failed");
+    free(many);
+    spi_response_t* refused = spi_client_receive(client);
+    TEST_ASSERT(refused != NULL && refused->request_id == 3, "Oversized batch got no response");
+    TEST_ASSERT(refused->status == SPI_RESPONSE_ERROR_INVALID_REQUEST, "Oversized batch should be refused");
+    spi_free_response(refused);
+    spi_response_t* next = spi_client_receive(client);
+    TEST_ASSERT(next != NULL && next->request_id == 4 && next->status == SPI_RESPONSE_SUCCESS,
+                "The connection should survive an oversized batch");
+    spi_free_response(next);
+    TEST_ASSERT_EQUAL(generated_before + 1, spi_get_stats(ctx).total_proofs_generated,
+                      "Only the proof behind the oversized batch should be generated");
+    spi_client_close(client);
+    spi_server_stop(server);
+    
+    // Unix socket
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/spi_test_%d.sock", (int)getpid());
+    spi_server_config_t local = {.unix_path = path, .num_reactors = 1};
+    server = spi_server_start(ctx, &local);
+    TEST_ASSERT(server != NULL, "Unix socket server start failed");
+    client = spi_client_connect(&local);
+    TEST_ASSERT(client != NULL, "Unix socket connect failed");
+    
+    spi_request_t tree_info = {.request_id = 3, .request_type = SPI_REQUEST_TREE_INFO, .tree_id = info->tree_id};
+    TEST_ASSERT(spi_client_send(client, &tree_info), "Send failed");
+    spi_response_t* response = spi_client_receive(client);
+    TEST_ASSERT(response != NULL && response->proof_size == sizeof(spi_tree_info_t), "Tree info failed");
+    TEST_ASSERT_EQUAL(256, ((spi_tree_info_t*)response->proof_data)->num_leaves, "Remote tree info");
+    spi_free_response(response);
+    
+    spi_client_close(client);
+    spi_server_stop(server);
+    TEST_ASSERT(access(path, F_OK) != 0, "Socket file should be removed");
+    
+    spi_response_t* direct[2];
+    spi_request_t requests[2] = {tree_info, missing};
+    TEST_ASSERT(spi_process_batch(ctx, requests, direct, 2), "Direct batch failed");
+    TEST_ASSERT(direct[0]->status == SPI_RESPONSE_SUCCESS && direct[1]->status == SPI_RESPONSE_ERROR_INVALID_TREE,
+                "Direct batch statuses");
+    spi_free_response(direct[0]);
+    spi_free_response(direct[1]);
+    
+    free(info);
+    spi_shutdown(ctx);
+    
+    printf("  SPI socket server tests passed!\n");
+    return true;
+}
+
+bool test_spi_proof_cache(void) {
+    printf("Testing SPI proof cache...\n");
+    
+    spi_context_t* ctx = spi_init(1 << 16);
+    TEST_ASSERT(ctx != NULL, "SPI initialization failed");
+    const uint64_t num_leaves = 16384;
+    spi_tree_info_t* info = spi_create_tree(ctx, num_leaves, HASH_SHA256);
+    TEST_ASSERT(info != NULL, "Tree creation via SPI failed");
+    
+    uint8_t* data = (uint8_t*)malloc(num_leaves * 32);
+    TEST_ASSERT(data != NULL, "Allocation failed");
+    for (size_t i = 0; i < num_leaves * 32; i++) {
+        data[i] = (uint8_t)(i * 11 + i / 32);
+    }
+    TEST_ASSERT(spi_update_tree_data(ctx, info->tree_id, data, num_leaves * 32), "Update failed");
+    free(data);
+    spi_reset_performance_metrics(ctx);
+    
+    // Second request for the same leaf is a hit with identical bytes
+    uint8_t first[SPI_MAX_PROOF_SIZE];
+    uint8_t second[SPI_MAX_PROOF_SIZE];
+    uint64_t first_size = sizeof(first);
+    uint64_t second_size = sizeof(second);
+    TEST_ASSERT(spi_generate_proof(ctx, info->tree_id, 7, first, &first_size), "Proof failed");
+    TEST_ASSERT(spi_generate_proof(ctx, info->tree_id, 7, second, &second_size), "Cached proof failed");
+    TEST_ASSERT(first_size == second_size && memcmp(first, second, first_size) == 0, "Cached proof differs");
+    spi_stats_t stats = spi_get_stats(ctx);
+    TEST_ASSERT_EQUAL(1, stats.proof_cache_hits, "Expected one hit");
+    TEST_ASSERT_EQUAL(1, stats.proof_cache_misses, "Expected one miss");
+    spi_performance_metrics_t metrics = spi_get_performance_metrics(ctx);
+    TEST_ASSERT(metrics.cache_hit_rate > 0.49 && metrics.cache_hit_rate < 0.51, "Hit rate should be 1/2");
+    
+    // Updating any leaf changes the root in every proof, so nothing stale
+    // may be served
+    uint8_t leaf[32];
+    memset(leaf, 0xAB, sizeof(leaf));
+    TEST_ASSERT(spi_update_leaf(ctx, info->tree_id, 9000, leaf, sizeof(leaf)), "Leaf update failed");
+    second_size = sizeof(second);
+    TEST_ASSERT(spi_generate_proof(ctx, info->tree_id, 7, second, &second_size), "Proof after update failed");
+    TEST_ASSERT(memcmp(first, second, first_size) != 0, "Stale proof served after update");
+    bool valid = false;
+    TEST_ASSERT(spi_verify_proof(ctx, info->tree_id, 7, second, second_size, &valid) && valid,
+                "Proof after update should verify");
+    TEST_ASSERT(spi_verify_proof(ctx, info->tree_id, 7, first, first_size, &valid) && !valid,
+                "Old proof should not verify");
+    
+    // Touch more leaves than the cache holds, then check every proof of a
+    // hot set still verifies
+    for (uint64_t i = 0; i < num_leaves; i++) {
+        uint64_t size = sizeof(second);
+        TEST_ASSERT(spi_generate_proof(ctx, info->tree_id, i, second, &size), "Proof failed");
+    }
+    for (int round = 0; round < 4; round++) {
+        for (uint64_t i = 0; i < 64; i++) {
+            uint64_t size = sizeof(second);
+            TEST_ASSERT(spi_generate_proof(ctx, info->tree_id, i * 97, second, &size), "Hot proof failed");
+            TEST_ASSERT(spi_verify_proof(ctx, info->tree_id, i * 97, second, size, &valid) && valid,
+                        "Hot proof should verify");
+        }
+    }
+    stats = spi_get_stats(ctx);
+    TEST_ASSERT(stats.proof_cache_hits >= 3 * 64, "Hot leaves should hit after their first round");
+    
+    TEST_ASSERT(spi_destroy_tree(ctx, info->tree_id), "Destroy failed");
+    free(info);
+    spi_shutdown(ctx);
+    
+    printf("  SPI proof cache tests passed!\n");
+    return true;
+}
+
+// Copy the string value of "key" out of a JSON-RPC response
+static bool jsonrpc_test_string(const char* json, const char* key, char* out, size_t capacity) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\":\"", key);
+    const char* start = strstr(json, pattern);
+    if (!start) return false;
+    start += strlen(pattern);
+    const char* end = strchr(start, '"');
+    if (!end || (size_t)(end - start) >= capacity) return false;
+    memcpy(out, start, (size_t)(end - start));
+    out[end - start] = '\0';
+    return true;
+}
+
+static const char* jsonrpc_test_call(spi_context_t* ctx, spi_json_buffer_t* out, const char* json) {
+    out->length = 0;
+    return spi_jsonrpc_process_request(ctx, json, strlen(json), out) ? out->data : "";
+}
+
+bool test_spi_jsonrpc(void) {
+    printf("Testing SPI JSON-RPC...\n");
+    
+    spi_context_t* ctx = spi_init(1024);
+    TEST_ASSERT(ctx != NULL, "SPI initialization failed");
+    spi_json_buffer_t out = {0};
+    
+    // 16 leaves of data, hex encoded
+    static char request[4096];
+    int n = snprintf(request, sizeof(request),
+                     "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"create\",\"params\":"
+                     "{\"hash\":\"sha256\",\"num_leaves\":16,\"data\":\"");
+    for (int i = 0; i < 16 * 32; i++) {
+        n += snprintf(request + n, sizeof(request) - (size_t)n, "%02x", (i * 13 + 7) & 0xff);
+    }
+    snprintf(request + n, sizeof(request) - (size_t)n, "\"}}");
+    const char* reply = jsonrpc_test_call(ctx, &out, request);
+    TEST_ASSERT(strstr(reply, "\"id\":1,\"result\":{\"tree_id\":") != NULL, "Create failed");
+    uint64_t tree_id = strtoull(strstr(reply, "\"tree_id\":") + 10, NULL, 10);
+    TEST_ASSERT(strstr(reply, "\"num_leaves\":16") && strstr(reply, "\"depth\":4"), "Create result");
+    uint64_t version = strtoull(strstr(reply, "\"version\":") + 10, NULL, 10);
+    
+    // Proofs match the direct API byte for byte
+    snprintf(request, sizeof(request),
+             "{\"method\":\"proof\",\"params\":{\"leaf\":5,\"tree_id\":%llu},\"jsonrpc\":\"2.0\",\"id\":\"p\"}",
+             (unsigned long long)tree_id);
+    reply = jsonrpc_test_call(ctx, &out, request);
+    static char proof_hex[2 * SPI_MAX_PROOF_SIZE + 1];
+    TEST_ASSERT(strstr(reply, "\"id\":\"p\"") != NULL, "String id should be echoed");
+    TEST_ASSERT(jsonrpc_test_string(reply, "proof", proof_hex, sizeof(proof_hex)), "Proof missing");
+    uint8_t proof[SPI_MAX_PROOF_SIZE];
+    uint64_t proof_size = sizeof(proof);
+    TEST_ASSERT(spi_generate_proof(ctx, tree_id, 5, proof, &proof_size), "Direct proof failed");
+    TEST_ASSERT_EQUAL(proof_size * 2, strlen(proof_hex), "Hex proof length");
+    for (uint64_t i = 0; i < proof_size; i++) {
+        unsigned byte = 0;
+        sscanf(proof_hex + 2 * i, "%2x", &byte);
+        TEST_ASSERT(byte == proof[i], "Hex proof differs");
+    }
+    
+    snprintf(request, sizeof(request),
+             "{\"jsonrpc\":\"2.0\",\"id\":2,\"method\":\"verify\",\"params\":"
+             "{\"tree_id\":%llu,\"leaf\":5,\"proof\":\"%s\"}}", (unsigned long long)tree_id, proof_hex);
+    TEST_ASSERT(strstr(jsonrpc_test_call(ctx, &out, request), "{\"valid\":true}") != NULL, "Verify failed");
+    proof_hex[100] = proof_hex[100] == '0' ? '1' : '0';
+    snprintf(request, sizeof(request),
+             "{\"jsonrpc\":\"2.0\",\"id\":2,\"method\":\"verify\",\"params\":"
+             "{\"tree_id\":%llu,\"leaf\":5,\"proof\":\"%s\"}}", (unsigned long long)tree_id, proof_hex);
+    TEST_ASSERT(strstr(jsonrpc_test_call(ctx, &out, request), "{\"valid\":false}") != NULL,
+                "Tampered proof should not verify");
+    
+    // Batch generation in base64, then the same proofs checked in one call
+    snprintf(request, sizeof(request),
+             "{\"jsonrpc\":\"2.0\",\"id\":3,\"method\":\"batch\",\"params\":"
+             "{\"tree_id\":%llu,\"leaves\":[9,2,9],\"encoding\":\"base64\"}}", (unsigned long long)tree_id);
+    reply = jsonrpc_test_call(ctx, &out, request);
+    const char* proofs = strstr(reply, "\"proofs\":[");
+    TEST_ASSERT(proofs != NULL, "Batch generation failed");
+    const char* proofs_end = strchr(proofs, ']');
+    n = snprintf(request, sizeof(request),
+                 "{\"jsonrpc\":\"2.0\",\"id\":4,\"method\":\"batch\",\"params\":"
+                 "{\"tree_id\":%llu,\"leaves\":[9,2,9],\"encoding\":\"base64\",",
+                 (unsigned long long)tree_id);
+    snprintf(request + n, sizeof(request) - (size_t)n, "%.*s}}", (int)(proofs_end + 1 - proofs), proofs);
+    reply = jsonrpc_test_call(ctx, &out, request);
+    TEST_ASSERT(strstr(reply, "\"valid\":[true,true,true],\"all_valid\":true") != NULL,
+                "Batch verification failed");
+    
+    // A single-leaf update publishes a new version
+    n = snprintf(request, sizeof(request),
+                 "{\"jsonrpc\":\"2.0\",\"id\":5,\"method\":\"update\",\"params\":"
+                 "{\"tree_id\":%llu,\"leaf\":3,\"data\":\"", (unsigned long long)tree_id);
+    for (int i = 0; i < 32; i++) {
+        n += snprintf(request + n, sizeof(request) - (size_t)n, "ff");
+    }
+    snprintf(request + n, sizeof(request) - (size_t)n, "\"}}");
+    reply = jsonrpc_test_call(ctx, &out, request);
+    TEST_ASSERT(strstr(reply, "\"version\":") != NULL, "Leaf update failed");
+    TEST_ASSERT_EQUAL(version + 1, strtoull(strstr(reply, "\"version\":") + 10, NULL, 10),
+                      "Leaf update should bump the version");
+    
+    // Errors
+    reply = jsonrpc_test_call(ctx, &out, "{\"jsonrpc\":\"2.0\",\"id\":1,");
+    TEST_ASSERT(strstr(reply, "\"id\":null,\"error\":{\"code\":-32700") != NULL, "Parse error");
+    reply = jsonrpc_test_call(ctx, &out, "{\"jsonrpc\":\"2.0\",\"id\":\"abc\",\"method\":\"nope\"}");
+    TEST_ASSERT(strstr(reply, "\"id\":\"abc\",\"error\":{\"code\":-32601") != NULL, "Unknown method");
+    reply = jsonrpc_test_call(ctx, &out, "{\"jsonrpc\":\"2.0\",\"id\":7,\"method\":\"info\"}");
+    TEST_ASSERT(strstr(reply, "\"code\":-32602") != NULL, "Missing params");
+    reply = jsonrpc_test_call(ctx, &out,
+                              "{\"jsonrpc\":\"2.0\",\"id\":8,\"method\":\"info\",\"params\":{\"tree_id\":999}}");
+    TEST_ASSERT(strstr(reply, "\"code\":-32002,\"message\":\"Invalid tree\"") != NULL, "Unknown tree");
+    reply = jsonrpc_test_call(ctx, &out, "[]");
+    TEST_ASSERT(strstr(reply, "\"code\":-32600") != NULL, "Empty batch");
+    
+    // Notifications get no reply, alone or inside a batch
+    reply = jsonrpc_test_call(ctx, &out, "{\"jsonrpc\":\"2.0\",\"method\":\"info\",\"params\":{\"tree_id\":1}}");
+    TEST_ASSERT_EQUAL(0, out.length, "Notification should not be answered");
+    snprintf(request, sizeof(request),
+             "[{\"jsonrpc\":\"2.0\",\"method\":\"info\",\"params\":{\"tree_id\":%llu}},"
+             " {\"jsonrpc\":\"2.0\",\"id\":9,\"method\":\"info\",\"params\":{\"tree_id\":%llu}}, 5]",
+             (unsigned long long)tree_id, (unsigned long long)tree_id);
+    reply = jsonrpc_test_call(ctx, &out, request);
+    TEST_ASSERT(reply[0] == '[' && strstr(reply, "{\"jsonrpc\":\"2.0\",\"id\":9,\"result\":") == reply + 1,
+                "Batch should answer only the request");
+    TEST_ASSERT(strstr(reply, "},{\"jsonrpc\":\"2.0\",\"id\":null,\"error\":{\"code\":-32600") != NULL,
+                "Non-object batch member is an invalid request");
+    
+    // Newline-delimited JSON-RPC over the socket server
+    spi_server_config_t config = {.port = 0, .num_reactors = 1, .jsonrpc = true};
+    spi_server_t* server = spi_server_start(ctx, &config);
+    TEST_ASSERT(server != NULL, "JSON-RPC server start failed");
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(spi_server_port(server))};
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    TEST_ASSERT(fd >= 0 && connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0, "Connect failed");
+    
+    n = snprintf(request, sizeof(request),
+                 "{\"jsonrpc\":\"2.0\",\"id\":10,\"method\":\"info\",\"params\":{\"tree_id\":%llu}}\n"
+                 "{\"jsonrpc\":\"2.0\",\"method\":\"info\",\"params\":{\"tree_id\":%llu}}\n"
+                 "{\"jsonrpc\":\"2.0\",\"id\":11,\"method\":\"proof\",\"params\":{\"tree_id\":%llu,\"leaf\":1}}\n",
+                 (unsigned long long)tree_id, (unsigned long long)tree_id, (unsigned long long)tree_id);
+    TEST_ASSERT(send(fd, request, (size_t)n, 0) == n, "Send failed");
+    
+    static char lines[8192];
+    size_t received = 0;
+    int newlines = 0;
+    while (newlines < 2 && received < sizeof(lines) - 1) {
+        ssize_t got = recv(fd, lines + received, sizeof(lines) - 1 - received, 0);
+        TEST_ASSERT(got > 0, "Receive failed");
+        for (ssize_t i = 0; i < got; i++) newlines += lines[received + (size_t)i] == '\n';
+        received += (size_t)got;
+    }
+    lines[received] = '\0';
+    TEST_ASSERT(strstr(lines, "{\"jsonrpc\":\"2.0\",\"id\":10,\"result\"") == lines, "First line answers the first request");
+    TEST_ASSERT(strstr(lines, "}\n{\"jsonrpc\":\"2.0\",\"id\":11,\"result\":{\"leaf\":1,\"proof\":\"") != NULL,
+                "Second line answers the proof request");
+    close(fd);
+    spi_server_stop(server);
+    
+    spi_json_buffer_free(&out);
+    spi_shutdown(ctx);
+    
+    printf("  SPI JSON-RPC tests passed!\n");
+    return true;
+}
+
+bool test_spi_kary(void) {
+    printf("Testing SPI with a k-ary tree...\n");
+    
+    spi_context_t* ctx = spi_init(1 << 16);
+    TEST_ASSERT(ctx != NULL, "SPI initialization failed");
+    
+    // 16-ary, depth 3: 45 siblings per proof, more than the depth and than
+    // any binary proof the SPI used to size for
+    const uint64_t num_leaves = 4096;
+    uint8_t* data = (uint8_t*)malloc(num_leaves * 32);
+    TEST_ASSERT(data != NULL, "Allocation failed");
+    for (size_t i = 0; i < num_leaves * 32; i++) {
+        data[i] = (uint8_t)(i * 3 + i / 32);
+    }
+    merkle_tree_t* tree = merkle_tree_create_kary(num_leaves, HASH_SHA256, 16);
+    TEST_ASSERT(tree && merkle_tree_build(tree, data, num_leaves * 32) == MERKLE_SUCCESS, "Build failed");
+    uint64_t tree_id = spi_registry_add(ctx->trees, tree);
+    TEST_ASSERT(tree_id != 0, "Registering the tree failed");
+    size_t size = merkle_proof_serialized_size(45);
+    
+    spi_tree_info_t info;
+    TEST_ASSERT(spi_get_tree_info(ctx, tree_id, &info) && info.arity == 16 && info.depth == 3, "Tree info");
+    uint8_t single[SPI_MAX_PROOF_SIZE];
+    uint64_t proof_size = sizeof(single);
+    bool valid = false;
+    TEST_ASSERT(spi_generate_proof(ctx, tree_id, 1234, single, &proof_size), "Proof generation failed");
+    TEST_ASSERT_EQUAL(size, proof_size, "Proof size should follow the sibling count");
+    TEST_ASSERT(spi_verify_proof(ctx, tree_id, 1234, single, proof_size, &valid) && valid, "Proof should verify");
+    
+    uint64_t indices[3] = {4095, 0, 1234};
+    spi_request_t generate = {.request_id = 1, .request_type = SPI_REQUEST_BATCH_GENERATION,
+                              .tree_id = tree_id, .batch_size = 3, .leaf_indices = indices};
+    spi_response_t* batch = spi_process_request(ctx, &generate);
+    TEST_ASSERT(batch && batch->status == SPI_RESPONSE_SUCCESS && batch->proof_size == 3 * size,
+                "Batch generation should size proofs by siblings");
+    TEST_ASSERT(memcmp(batch->proof_data + 2 * size, single, size) == 0, "Batch proof differs");
+    spi_request_t verify = {.request_id = 2, .request_type = SPI_REQUEST_BATCH_VERIFICATION,
+                            .tree_id = tree_id, .batch_size = 3, .leaf_indices = indices,
+                            .leaf_data = batch->proof_data, .leaf_data_size = batch->proof_size};
+    spi_response_t* verified = spi_process_request(ctx, &verify);
+    TEST_ASSERT(verified && verified->status == SPI_RESPONSE_SUCCESS && verified->verification_result == 1,
+                "Batch verification should accept proofs longer than the depth bound");
+    spi_free_response(verified);
+    spi_free_response(batch);
+    
+    spi_json_buffer_t out = {0};
+    char request[256];
+    snprintf(request, sizeof(request),
+             "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"batch\",\"params\":"
+             "{\"tree_id\":%llu,\"leaves\":[9,4000],\"encoding\":\"hex\"}}", (unsigned long long)tree_id);
+    const char* reply = jsonrpc_test_call(ctx, &out, request);
+    const char* proofs = strstr(reply, "\"proofs\":[\"");
+    TEST_ASSERT(proofs != NULL, "JSON-RPC batch generation failed");
+    const char* second = strchr(proofs + 11, '"');
+    TEST_ASSERT(second && (size_t)(second - (proofs + 11)) == 2 * size, "JSON-RPC proof size");
+    spi_json_buffer_free(&out);
+    
+    free(data);
+    spi_shutdown(ctx);
+    
+    printf("  SPI k-ary tree tests passed!\n");
+    return true;
+}
+
+bool test_spi_leaf_size(void) {
+    printf("Testing SPI updates of wide leaves...\n");
+    
+    spi_context_t* ctx = spi_init(1 << 16);
+    TEST_ASSERT(ctx != NULL, "SPI initialization failed");
+    
+    // 64-byte leaves: single and whole-tree updates take the tree's size
+    const uint64_t num_leaves = 1024;
+    const size_t leaf_size = 64;
+    uint8_t* data = (uint8_t*)malloc(num_leaves * leaf_size);
+    TEST_ASSERT(data != NULL, "Allocation failed");
+    for (size_t i = 0; i < num_leaves * leaf_size; i++) {
+        data[i] = (uint8_t)(i * 17 + i / 64);
+    }
+    merkle_tree_t* tree = merkle_tree_create_kary(num_leaves, HASH_SHA256, 4);
+    TEST_ASSERT(tree != NULL, "Tree creation failed");
+    tree->leaf_data_size = leaf_size;
+    TEST_ASSERT(merkle_tree_build(tree, data, num_leaves * leaf_size) == MERKLE_SUCCESS, "Build failed");
+    uint64_t tree_id = spi_registry_add(ctx->trees, tree);
+    TEST_ASSERT(tree_id != 0, "Registering the tree failed");
+    
+    uint8_t leaf[64];
+    memset(leaf, 0xA5, sizeof(leaf));
+    TEST_ASSERT(!spi_update_leaf(ctx, tree_id, 7, leaf, 32), "A 32-byte update of a 64-byte leaf");
+    TEST_ASSERT(spi_update_leaf(ctx, tree_id, 7, leaf, sizeof(leaf)), "Leaf update failed");
+    memcpy(data + 7 * leaf_size, leaf, leaf_size);
+    
+    spi_tree_handle_t* handle = spi_registry_acquire(ctx->trees, tree_id);
+    TEST_ASSERT(handle != NULL, "Acquire failed");
+    memset(leaf, 0x3C, sizeof(leaf));
+    TEST_ASSERT(merkle_mvcc_update_leaf(handle->tree, 900, leaf) == MERKLE_SUCCESS, "Versioned update failed");
+    memcpy(data + 900 * leaf_size, leaf, leaf_size);
+    merkle_snapshot_t snapshot;
+    merkle_mvcc_pin(handle->tree, &snapshot);
+    merkle_proof_t* proof = merkle_snapshot_proof_create(&snapshot, 900);
+    TEST_ASSERT(proof && merkle_proof_verify_record(proof, num_leaves, leaf, leaf_size),
+                "The whole 64-byte leaf should be hashed");
+    merkle_proof_destroy(proof);
+    merkle_mvcc_unpin(handle->tree, &snapshot);
+    spi_tree_handle_release(handle);
+    
+    merkle_tree_t* expected = merkle_tree_create_kary(num_leaves, HASH_SHA256, 4);
+    TEST_ASSERT(expected != NULL, "Tree creation failed");
+    expected->leaf_data_size = leaf_size;
+    TEST_ASSERT(merkle_tree_build(expected, data, num_leaves * leaf_size) == MERKLE_SUCCESS, "Build failed");
+    spi_tree_info_t info;
+    TEST_ASSERT(spi_get_tree_info(ctx, tree_id, &info) && memcmp(info.root_hash, expected->root->hash, 32) == 0,
+                "Updated root differs");
+    
+    data[5] ^= 1;
+    TEST_ASSERT(!spi_update_tree_data(ctx, tree_id, data, num_leaves * 32), "Data sized for 32-byte leaves");
+    TEST_ASSERT(spi_update_tree_data(ctx, tree_id, data, num_leaves * leaf_size), "Tree data update failed");
+    TEST_ASSERT(merkle_tree_update_leaf(expected, 0, data) == MERKLE_SUCCESS, "Update failed");
+    TEST_ASSERT(spi_get_tree_info(ctx, tree_id, &info) && info.arity == 4 &&
+                memcmp(info.root_hash, expected->root->hash, 32) == 0, "Rebuilt tree differs");
+    
+    merkle_tree_destroy(expected);
+    free(data);
+    spi_shutdown(ctx);
+    
+    printf("  SPI wide leaf tests passed!\n");
+    return true;
+}
+
+bool test_error_handling(void) {
+    printf("Testing error handling...\n");
+    
+    // Test SPI error strings
+    const char* error_msg = spi_error_string(SPI_RESPONSE_ERROR_INVALID_REQUEST);
+    TEST_ASSERT(error_msg != NULL, "Error string should not be NULL");
+    
+    error_msg = spi_error_string(999); // Invalid status
     TEST_ASSERT(error_msg != NULL, "Error string for invalid status should not be NULL");
     
     // Test NULL parameter handling
@@ -222,6 +2682,15 @@ int main(void) {
     if (test_memory_pool()) passed_tests++;
     total_tests++;
     
+    if (test_memory_accounting()) passed_tests++;
+    total_tests++;
+    
+    if (test_performance_timing()) passed_tests++;
+    total_tests++;
+    
+    if (test_hw_counters()) passed_tests++;
+    total_tests++;
+    
     if (test_tree_depth_calculation()) passed_tests++;
     total_tests++;
     
@@ -234,12 +2703,78 @@ int main(void) {
     if (test_sha256_basic()) passed_tests++;
     total_tests++;
     
+    if (test_blake2b_basic()) passed_tests++;
+    total_tests++;
+    
+    if (test_hash_benchmark()) passed_tests++;
+    total_tests++;
+    
+    if (test_proof_roundtrip()) passed_tests++;
+    total_tests++;
+    
+    if (test_mvcc_snapshots()) passed_tests++;
+    total_tests++;
+    
+    if (test_hot_digests()) passed_tests++;
+    total_tests++;
+    
+    if (test_deferred_updates()) passed_tests++;
+    total_tests++;
+    
+    if (test_kary_trees()) passed_tests++;
+    total_tests++;
+    
+    if (test_variable_records()) passed_tests++;
+    total_tests++;
+    
+    if (test_leaf_storage()) passed_tests++;
+    total_tests++;
+    if (test_pruned_levels()) passed_tests++;
+    total_tests++;
+    if (test_external_build()) passed_tests++;
+    total_tests++;
+    if (test_file_ingest()) passed_tests++;
+    total_tests++;
+    if (test_parallel_build()) passed_tests++;
+    total_tests++;
+    if (test_interleaved_proofs()) passed_tests++;
+    total_tests++;
+    if (test_proof_export()) passed_tests++;
+    total_tests++;
+    
     if (test_spi_basic()) passed_tests++;
     total_tests++;
     
     if (test_spi_performance_metrics()) passed_tests++;
     total_tests++;
     
+    if (test_spi_registry()) passed_tests++;
+    total_tests++;
+    
+    if (test_spi_concurrency()) passed_tests++;
+    total_tests++;
+    
+    if (test_spi_async()) passed_tests++;
+    total_tests++;
+    if (test_spi_async_submitters()) passed_tests++;
+    total_tests++;
+    
+    if (test_spi_batch_proofs()) passed_tests++;
+    total_tests++;
+    
+    if (test_spi_server()) passed_tests++;
+    total_tests++;
+    
+    if (test_spi_jsonrpc()) passed_tests++;
+    total_tests++;
+    if (test_spi_kary()) passed_tests++;
+    total_tests++;
+    if (test_spi_leaf_size()) passed_tests++;
+    total_tests++;
+    
+    if (test_spi_proof_cache()) passed_tests++;
+    total_tests++;
+    
     if (test_error_handling()) passed_tests++;
     total_tests++;
     
@@ -1,12 +1,34 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <getopt.h>
+#include <pthread.h>
 #include "core/merkle_tree.h"
 #include "hash/hash_functions.h"
 #include "spi/spi_interface.h"
 
+#define BENCH_MAX_LIST 16                // Max entries in --sizes/--hash/--threads
+#define BENCH_PREPARED_PROOFS 1024       // Proofs prebuilt for verify/serialize
+#define BENCH_LEAF_SIZE 32
+
+// Benchmark modes
+typedef enum {
+    BENCH_BUILD = 0,
+    BENCH_UPDATE,
+    BENCH_PROOF,
+    BENCH_VERIFY,
+    BENCH_SERIALIZE,
+    BENCH_BATCH,
+    BENCH_NUM_MODES
+} bench_mode_t;
+
+static const char* const k_bench_mode_names[BENCH_NUM_MODES] = {
+    "build", "update", "proof", "verify", "serialize", "batch"
+};
+
 // Benchmark configuration
 typedef struct {
     uint64_t tree_size;
@@ -14,8 +36,68 @@ typedef struct {
     bool test_verification;
     bool test_batch_operations;
     uint64_t batch_size;
+    bool hash_benchmark;
+    uint32_t modes;                         // Bitmask of bench_mode_t
+    uint64_t sizes[BENCH_MAX_LIST];
+    size_t num_sizes;
+    hash_type_t hashes[BENCH_MAX_LIST];
+    size_t num_hashes;
+    uint32_t threads[BENCH_MAX_LIST];
+    size_t num_threads;
+    uint32_t repeats;                       // Runs per case; the median is reported
+    uint64_t build_iterations;
+    const char* json_path;                  // "-" writes JSON to stdout
+    const char* compare_path;               // Baseline written by --json
+    double regression_threshold;            // Throughput drop (fraction) that fails --compare
+    bool hw_counters;                       // Collect perf_event counters for build/proof
+    uint32_t loadgen_connections;           // Socket server load test; 0 runs the suite
+    uint32_t loadgen_depth;                 // Requests in flight per connection
+    const char* loadgen_unix_path;          // Unix socket for the load test, NULL for TCP
 } benchmark_config_t;
 
+// One measured case
+typedef struct {
+    bench_mode_t mode;
+    hash_type_t hash_type;
+    uint64_t leaves;
+    uint32_t threads;
+    uint64_t ops;
+    uint64_t wall_ns;
+    double ops_per_sec;
+    uint64_t mean_ns;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t max_ns;
+    bool failed;
+    uint64_t hw_samples;                    // Operations with hardware counters, 0 if none
+    double hw_per_op[MERKLE_HW_NUM_COUNTERS];
+} bench_result_t;
+
+// Shared state for one (mode, hash, size) case
+typedef struct {
+    bench_mode_t mode;
+    hash_type_t hash_type;
+    uint64_t leaves;
+    uint64_t batch_size;
+    const uint8_t* leaf_data;
+    merkle_tree_t* tree;                    // Read-only for proof/verify/serialize/batch
+    merkle_proof_t** proofs;
+    uint64_t num_proofs;
+    uint64_t ops_per_thread;
+    pthread_barrier_t* barrier;
+} bench_case_t;
+
+typedef struct {
+    bench_case_t* bench;
+    uint32_t index;
+    uint64_t* latencies;
+    uint64_t samples;
+    uint64_t ops_done;
+    uint64_t elapsed_ns;
+    bool failed;
+    pthread_t thread;
+} bench_worker_t;
+
 // Performance measurement utilities
 static inline uint64_t get_time_ns(void) {
     struct timespec ts;
@@ -23,165 +105,594 @@ static inline uint64_t get_time_ns(void) {
     return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
 }
 
-// Benchmark functions
-void benchmark_tree_creation(benchmark_config_t* config) {
-    printf("=== Tree Creation Benchmark ===\n");
+static inline uint64_t bench_rand(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static const char* bench_hash_name(hash_type_t type) {
+    return type == HASH_BLAKE2B ? "blake2b" : "sha256";
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static int compare_ops_per_sec(const void* a, const void* b) {
+    double x = ((const bench_result_t*)a)->ops_per_sec;
+    double y = ((const bench_result_t*)b)->ops_per_sec;
+    return (x > y) - (x < y);
+}
+
+// Benchmark workers
+static void* bench_worker_run(void* arg) {
+    bench_worker_t* worker = (bench_worker_t*)arg;
+    bench_case_t* bench = worker->bench;
+    uint64_t rng = 0x9E3779B97F4A7C15ULL * (worker->index + 1);
+    uint8_t leaf[BENCH_LEAF_SIZE];
+    uint8_t buffer[SPI_MAX_PROOF_SIZE];
+    merkle_tree_t* own_tree = NULL;
+    merkle_proof_t** batch = NULL;
+    const uint8_t** batch_leaves = NULL;
+    
+    // Writers get a private tree; readers share the case tree
+    if (bench->mode == BENCH_UPDATE) {
+        own_tree = merkle_tree_create(bench->leaves, bench->hash_type);
+        if (!own_tree || merkle_tree_build(own_tree, bench->leaf_data,
+                                           bench->leaves * BENCH_LEAF_SIZE) != MERKLE_SUCCESS) {
+            worker->failed = true;
+        }
+    } else if (bench->mode == BENCH_BATCH) {
+        batch = (merkle_proof_t**)calloc(bench->batch_size, sizeof(merkle_proof_t*));
+        batch_leaves = (const uint8_t**)calloc(bench->batch_size, sizeof(uint8_t*));
+        if (!batch || !batch_leaves) {
+            worker->failed = true;
+        }
+    } else if ((bench->mode == BENCH_VERIFY || bench->mode == BENCH_SERIALIZE) && !bench->proofs) {
+        // Setup could not prepare the proofs these modes consume
+        worker->failed = true;
+    }
     
-    for (uint64_t size = 1024; size <= config->tree_size; size *= 2) {
-        uint64_t total_time = 0;
-        uint64_t iterations = config->num_iterations;
+    if (bench->barrier) {
+        pthread_barrier_wait(bench->barrier);
+    }
+    
+    uint64_t run_start = get_time_ns();
+    
+    for (uint64_t op = 0; op < bench->ops_per_thread && !worker->failed; op++) {
+        uint64_t index = bench_rand(&rng) % bench->leaves;
+        merkle_proof_t* prepared = bench->proofs ?
+            bench->proofs[(worker->index * bench->ops_per_thread + op) % bench->num_proofs] : NULL;
+        uint64_t start = 0;
+        uint64_t end = 0;
         
-        for (uint64_t i = 0; i < iterations; i++) {
-            uint64_t start = get_time_ns();
+        switch (bench->mode) {
+            case BENCH_BUILD: {
+                start = get_time_ns();
+                merkle_tree_t* tree = merkle_tree_create(bench->leaves, bench->hash_type);
+                bool ok = tree && merkle_tree_build(tree, bench->leaf_data,
+                                                    bench->leaves * BENCH_LEAF_SIZE) == MERKLE_SUCCESS;
+                end = get_time_ns();
+                merkle_tree_destroy(tree);
+                worker->failed = !ok;
+                worker->ops_done++;
+                break;
+            }
             
-            merkle_tree_t* tree = merkle_tree_create(size, HASH_SHA256);
-            if (!tree) {
-                printf("Failed to create tree of size %llu\n", (unsigned long long)size);
-                continue;
+            case BENCH_UPDATE:
+                for (size_t b = 0; b < sizeof(leaf); b += sizeof(uint64_t)) {
+                    uint64_t r = bench_rand(&rng);
+                    memcpy(leaf + b, &r, sizeof(r));
+                }
+                start = get_time_ns();
+                worker->failed = merkle_tree_update_leaf(own_tree, index, leaf) != MERKLE_SUCCESS;
+                end = get_time_ns();
+                worker->ops_done++;
+                break;
+            
+            case BENCH_PROOF: {
+                start = get_time_ns();
+                merkle_proof_t* proof = merkle_proof_create(bench->tree, index);
+                merkle_proof_destroy(proof);
+                end = get_time_ns();
+                worker->failed = proof == NULL;
+                worker->ops_done++;
+                break;
             }
             
-            uint64_t end = get_time_ns();
-            total_time += (end - start);
+            case BENCH_VERIFY:
+                start = get_time_ns();
+                worker->failed = !merkle_proof_verify(prepared,
+                                                      bench->leaf_data + prepared->leaf_index * BENCH_LEAF_SIZE);
+                end = get_time_ns();
+                worker->ops_done++;
+                break;
             
-            merkle_tree_destroy(tree);
+            case BENCH_SERIALIZE: {
+                merkle_proof_t decoded = {0};
+                start = get_time_ns();
+                bool ok = merkle_proof_serialize(prepared, buffer, sizeof(buffer)) == MERKLE_SUCCESS &&
+                          merkle_proof_deserialize(buffer, prepared->proof_size, &decoded) == MERKLE_SUCCESS;
+                merkle_proof_clear(&decoded);
+                end = get_time_ns();
+                worker->failed = !ok;
+                worker->ops_done++;
+                break;
+            }
+            
+            case BENCH_BATCH: {
+                start = get_time_ns();
+                for (uint64_t b = 0; b < bench->batch_size; b++) {
+                    uint64_t leaf_index = (index + b * 7919) % bench->leaves;
+                    batch[b] = merkle_proof_create(bench->tree, leaf_index);
+                    batch_leaves[b] = bench->leaf_data + leaf_index * BENCH_LEAF_SIZE;
+                }
+                bool ok = merkle_proof_verify_batch(batch, batch_leaves, bench->batch_size);
+                for (uint64_t b = 0; b < bench->batch_size; b++) {
+                    merkle_proof_destroy(batch[b]);
+                }
+                end = get_time_ns();
+                worker->failed = !ok;
+                worker->ops_done += bench->batch_size;
+                break;
+            }
+            
+            default:
+                worker->failed = true;
+                break;
         }
         
-        double avg_time_ms = (double)total_time / iterations / 1000000.0;
-        printf("Tree size: %8llu leaves | Avg creation time: %8.3f ms\n", 
-               (unsigned long long)size, avg_time_ms);
+        worker->latencies[worker->samples++] = end - start;
     }
+    
+    worker->elapsed_ns = get_time_ns() - run_start;
+    
+    merkle_tree_destroy(own_tree);
+    free(batch);
+    free(batch_leaves);
+    
+    return NULL;
 }
 
-void benchmark_proof_generation(benchmark_config_t* config) {
-    printf("=== Proof Generation Benchmark ===\n");
+// Run one pass of a case on `threads` threads
+static bool bench_run_pass(bench_case_t* bench, uint32_t threads, bench_result_t* result) {
+    bench_worker_t* workers = (bench_worker_t*)calloc(threads, sizeof(bench_worker_t));
+    uint64_t* latencies = (uint64_t*)malloc(threads * bench->ops_per_thread * sizeof(uint64_t));
+    pthread_barrier_t barrier;
     
-    // Create a tree for testing
-    merkle_tree_t* tree = merkle_tree_create(config->tree_size, HASH_SHA256);
-    if (!tree) {
-        printf("Failed to create tree\n");
-        return;
+    if (!workers || !latencies || pthread_barrier_init(&barrier, NULL, threads) != 0) {
+        free(workers);
+        free(latencies);
+        return false;
     }
+    bench->barrier = &barrier;
     
-    // Generate test data
-    uint8_t* leaf_data = (uint8_t*)malloc(config->tree_size * 32);
-    if (!leaf_data) {
-        printf("Failed to allocate test data\n");
-        merkle_tree_destroy(tree);
-        return;
+    uint32_t started = 0;
+    for (uint32_t t = 0; t < threads; t++) {
+        workers[t].bench = bench;
+        workers[t].index = t;
+        workers[t].latencies = latencies + t * bench->ops_per_thread;
+        
+        if (t == 0) continue;  // Worker 0 runs on the calling thread
+        if (pthread_create(&workers[t].thread, NULL, bench_worker_run, &workers[t]) != 0) {
+            break;
+        }
+        started++;
     }
     
-    // Fill with random data
-    srand(42);  // Fixed seed for reproducibility
-    for (uint64_t i = 0; i < config->tree_size * 32; i++) {
-        leaf_data[i] = rand() & 0xFF;
+    if (started + 1 < threads) {
+        // Cannot reach the barrier with fewer threads; this only happens on
+        // thread creation failure, so give up on the pass
+        fprintf(stderr, "Failed to start %u benchmark threads\n", threads);
+        exit(1);
     }
     
-    // Build tree
-    uint64_t build_start = get_time_ns();
-    merkle_error_t err = merkle_tree_build(tree, leaf_data, config->tree_size * 32);
-    uint64_t build_end = get_time_ns();
-    
-    if (err != MERKLE_SUCCESS) {
-        printf("Failed to build tree: %d\n", err);
-        free(leaf_data);
-        merkle_tree_destroy(tree);
-        return;
+    bench_worker_run(&workers[0]);
+    for (uint32_t t = 1; t < threads; t++) {
+        pthread_join(workers[t].thread, NULL);
     }
     
-    double build_time_ms = (double)(build_end - build_start) / 1000000.0;
-    printf("Tree build time: %.3f ms\n", build_time_ms);
+    pthread_barrier_destroy(&barrier);
+    bench->barrier = NULL;
     
-    // Benchmark proof generation
-    printf("Generating proofs for %llu iterations...\n", (unsigned long long)config->num_iterations);
+    // Merge workers
+    uint64_t samples = 0;
+    memset(result, 0, sizeof(*result));
+    for (uint32_t t = 0; t < threads; t++) {
+        result->ops += workers[t].ops_done;
+        result->failed |= workers[t].failed;
+        if (workers[t].elapsed_ns > result->wall_ns) {
+            result->wall_ns = workers[t].elapsed_ns;
+        }
+        memmove(latencies + samples, workers[t].latencies, workers[t].samples * sizeof(uint64_t));
+        samples += workers[t].samples;
+    }
     
-    uint64_t total_proof_time = 0;
-    for (uint64_t i = 0; i < config->num_iterations; i++) {
-        uint64_t leaf_idx = rand() % config->tree_size;
-        uint8_t* leaf_ptr = leaf_data + leaf_idx * 32;
-        
-        uint64_t start = get_time_ns();
-        merkle_proof_t* proof = merkle_proof_create(tree, leaf_idx);
-        uint64_t end = get_time_ns();
-        
-        if (proof) {
-            total_proof_time += (end - start);
-            merkle_proof_destroy(proof);
+    if (samples > 0) {
+        uint64_t total = 0;
+        qsort(latencies, samples, sizeof(uint64_t), compare_u64);
+        for (uint64_t i = 0; i < samples; i++) {
+            total += latencies[i];
         }
+        result->mean_ns = total / samples;
+        result->p50_ns = latencies[(samples - 1) / 2];
+        result->p99_ns = latencies[(samples * 99 + 99) / 100 - 1];
+        result->max_ns = latencies[samples - 1];
+    }
+    if (result->wall_ns > 0) {
+        result->ops_per_sec = (double)result->ops * 1e9 / (double)result->wall_ns;
+    }
+    
+    free(workers);
+    free(latencies);
+    return !result->failed;
+}
+
+// Core operation whose hardware counters describe a mode
+static bool bench_hw_op(bench_mode_t mode, merkle_op_t* op) {
+    switch (mode) {
+        case BENCH_BUILD:
+            *op = MERKLE_OP_BUILD;
+            return true;
+        case BENCH_PROOF:
+        case BENCH_BATCH:
+            *op = MERKLE_OP_PROOF;
+            return true;
+        default:
+            return false;
     }
+}
+
+// Warm up, run `repeats` passes and keep the median by throughput
+static bench_result_t bench_run_case(const benchmark_config_t* config, bench_case_t* bench, uint32_t threads) {
+    bench_result_t runs[32];
+    uint32_t repeats = config->repeats < 32 ? config->repeats : 32;
+    uint64_t ops = bench->ops_per_thread;
     
-    double avg_proof_time_ms = (double)total_proof_time / config->num_iterations / 1000000.0;
-    double proofs_per_sec = 1000.0 / avg_proof_time_ms;
+    bench->ops_per_thread = ops / 10 + 1;
+    bench_run_pass(bench, 1, &runs[0]);
+    bench->ops_per_thread = ops;
     
-    printf("Proof generation: avg %.3f ms | %.0f proofs/sec\n", 
-           avg_proof_time_ms, proofs_per_sec);
+    // Counters are process-wide totals, so take the difference around the
+    // measured passes (averaged over all repeats, not just the median one)
+    merkle_op_t hw_op = MERKLE_OP_BUILD;
+    bool hw = config->hw_counters && bench_hw_op(bench->mode, &hw_op);
+    merkle_hw_stats_t hw_before = {0};
+    if (hw) {
+        hw_before = merkle_performance_get_hw_counters(NULL, hw_op);
+    }
     
-    // Clean up
-    free(leaf_data);
-    merkle_tree_destroy(tree);
+    bool failed = false;
+    for (uint32_t r = 0; r < repeats; r++) {
+        failed |= !bench_run_pass(bench, threads, &runs[r]);
+    }
+    
+    merkle_hw_stats_t hw_after = {0};
+    if (hw) {
+        hw_after = merkle_performance_get_hw_counters(NULL, hw_op);
+    }
+    
+    qsort(runs, repeats, sizeof(bench_result_t), compare_ops_per_sec);
+    bench_result_t result = runs[repeats / 2];
+    result.mode = bench->mode;
+    result.hash_type = bench->hash_type;
+    result.leaves = bench->leaves;
+    result.threads = threads;
+    result.failed = failed;
+    
+    result.hw_samples = hw_after.samples - hw_before.samples;
+    for (int c = 0; c < MERKLE_HW_NUM_COUNTERS && result.hw_samples > 0; c++) {
+        result.hw_per_op[c] = (double)(hw_after.values[c] - hw_before.values[c]) / (double)result.hw_samples;
+    }
+    
+    return result;
 }
 
-void benchmark_proof_verification(benchmark_config_t* config) {
-    printf("=== Proof Verification Benchmark ===\n");
+// Per-operation hardware counters for the build and proof cases
+static void print_hw_counters(const bench_result_t* results, size_t num_results, FILE* out) {
+    fprintf(out, "\n=== Hardware Counters (per core operation) ===\n");
+    fprintf(out, "%-10s %-8s %10s %7s %10s %14s %14s %8s %12s %12s %9s\n",
+            "Mode", "Hash", "Leaves", "Threads", "Samples", "Cycles", "Instructions", "IPC",
+            "LLC refs", "LLC misses", "LLC miss");
     
-    // Create and build tree
-    merkle_tree_t* tree = merkle_tree_create(config->tree_size, HASH_SHA256);
-    if (!tree) {
-        printf("Failed to create tree\n");
-        return;
+    for (size_t i = 0; i < num_results; i++) {
+        const bench_result_t* r = &results[i];
+        if (r->hw_samples == 0) continue;
+        
+        const double* v = r->hw_per_op;
+        double ipc = v[MERKLE_HW_CYCLES] > 0 ? v[MERKLE_HW_INSTRUCTIONS] / v[MERKLE_HW_CYCLES] : 0.0;
+        double miss_rate = v[MERKLE_HW_LLC_REFERENCES] > 0 ?
+                           100.0 * v[MERKLE_HW_LLC_MISSES] / v[MERKLE_HW_LLC_REFERENCES] : 0.0;
+        fprintf(out, "%-10s %-8s %10llu %7u %10llu %14.0f %14.0f %8.2f %12.1f %12.1f %8.2f%%\n",
+                k_bench_mode_names[r->mode], bench_hash_name(r->hash_type),
+                (unsigned long long)r->leaves, r->threads, (unsigned long long)r->hw_samples,
+                v[MERKLE_HW_CYCLES], v[MERKLE_HW_INSTRUCTIONS], ipc,
+                v[MERKLE_HW_LLC_REFERENCES], v[MERKLE_HW_LLC_MISSES], miss_rate);
+    }
+}
+
+// Run every selected (hash, size, mode, threads) combination
+static bench_result_t* run_benchmark_suite(const benchmark_config_t* config, FILE* out, size_t* num_results) {
+    size_t capacity = config->num_hashes * config->num_sizes * BENCH_NUM_MODES * config->num_threads;
+    bench_result_t* results = (bench_result_t*)calloc(capacity, sizeof(bench_result_t));
+    *num_results = 0;
+    if (!results) {
+        return NULL;
     }
     
-    uint8_t* leaf_data = (uint8_t*)malloc(config->tree_size * 32);
-    if (!leaf_data) {
-        printf("Failed to allocate test data\n");
-        merkle_tree_destroy(tree);
-        return;
+    fprintf(out, "=== Merkle Benchmark Suite ===\n");
+    fprintf(out, "%-10s %-8s %10s %7s %10s %14s %12s %12s %12s\n",
+            "Mode", "Hash", "Leaves", "Threads", "Ops", "Ops/sec", "Mean (ns)", "p50 (ns)", "p99 (ns)");
+    
+    for (size_t h = 0; h < config->num_hashes; h++) {
+        for (size_t s = 0; s < config->num_sizes; s++) {
+            uint64_t leaves = config->sizes[s];
+            
+            // Generate test data
+            uint8_t* leaf_data = (uint8_t*)malloc(leaves * BENCH_LEAF_SIZE);
+            merkle_tree_t* tree = merkle_tree_create(leaves, config->hashes[h]);
+            if (!leaf_data || !tree) {
+                fprintf(stderr, "Failed to set up tree of size %llu\n", (unsigned long long)leaves);
+                free(leaf_data);
+                merkle_tree_destroy(tree);
+                continue;
+            }
+            
+            uint64_t rng = 42;  // Fixed seed for reproducibility
+            for (uint64_t i = 0; i < leaves * BENCH_LEAF_SIZE; i += sizeof(uint64_t)) {
+                uint64_t r = bench_rand(&rng);
+                memcpy(leaf_data + i, &r, sizeof(r));
+            }
+            
+            if (merkle_tree_build(tree, leaf_data, leaves * BENCH_LEAF_SIZE) != MERKLE_SUCCESS) {
+                fprintf(stderr, "Failed to build tree of size %llu\n", (unsigned long long)leaves);
+                free(leaf_data);
+                merkle_tree_destroy(tree);
+                continue;
+            }
+            
+            // Prepared proofs for verify/serialize
+            uint64_t num_proofs = leaves < BENCH_PREPARED_PROOFS ? leaves : BENCH_PREPARED_PROOFS;
+            merkle_proof_t** proofs = (merkle_proof_t**)calloc(num_proofs, sizeof(merkle_proof_t*));
+            bool proofs_ready = proofs != NULL;
+            for (uint64_t i = 0; proofs_ready && i < num_proofs; i++) {
+                proofs[i] = merkle_proof_create(tree, bench_rand(&rng) % leaves);
+                proofs_ready = proofs[i] != NULL;
+            }
+            if (!proofs_ready) {
+                fprintf(stderr, "Failed to prepare proofs for tree of size %llu\n", (unsigned long long)leaves);
+                for (uint64_t i = 0; proofs && i < num_proofs; i++) {
+                    merkle_proof_destroy(proofs[i]);
+                }
+                free(proofs);
+                proofs = NULL;
+            }
+            
+            for (int mode = 0; mode < BENCH_NUM_MODES; mode++) {
+                if (!(config->modes & (1u << mode))) continue;
+                
+                bench_case_t bench = {
+                    .mode = (bench_mode_t)mode,
+                    .hash_type = config->hashes[h],
+                    .leaves = leaves,
+                    .batch_size = config->batch_size,
+                    .leaf_data = leaf_data,
+                    .tree = tree,
+                    .proofs = proofs,
+                    .num_proofs = num_proofs,
+                };
+                
+                for (size_t t = 0; t < config->num_threads; t++) {
+                    if (mode == BENCH_BUILD) {
+                        bench.ops_per_thread = config->build_iterations;
+                    } else if (mode == BENCH_BATCH) {
+                        bench.ops_per_thread = config->num_iterations / config->batch_size + 1;
+                    } else {
+                        bench.ops_per_thread = config->num_iterations;
+                    }
+                    
+                    bench_result_t result = bench_run_case(config, &bench, config->threads[t]);
+                    results[(*num_results)++] = result;
+                    
+                    fprintf(out, "%-10s %-8s %10llu %7u %10llu %14.0f %12llu %12llu %12llu%s\n",
+                            k_bench_mode_names[mode], bench_hash_name(result.hash_type),
+                            (unsigned long long)result.leaves, result.threads,
+                            (unsigned long long)result.ops, result.ops_per_sec,
+                            (unsigned long long)result.mean_ns,
+                            (unsigned long long)result.p50_ns,
+                            (unsigned long long)result.p99_ns,
+                            result.failed ? "  FAILED" : "");
+                }
+            }
+            
+            for (uint64_t i = 0; proofs && i < num_proofs; i++) {
+                merkle_proof_destroy(proofs[i]);
+            }
+            free(proofs);
+            free(leaf_data);
+            merkle_tree_destroy(tree);
+        }
     }
     
-    srand(42);
-    for (uint64_t i = 0; i < config->tree_size * 32; i++) {
-        leaf_data[i] = rand() & 0xFF;
+    if (config->hw_counters) {
+        print_hw_counters(results, *num_results, out);
     }
     
-    merkle_tree_build(tree, leaf_data, config->tree_size * 32);
+    return results;
+}
+
+// JSON output, one result object per line so baselines can be diffed and
+// re-read by --compare
+static bool write_results_json(const benchmark_config_t* config, const bench_result_t* results,
+                               size_t num_results, const char* path) {
+    FILE* f = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "Failed to open %s for writing\n", path);
+        return false;
+    }
     
-    // Generate and store proofs
-    merkle_proof_t** proofs = (merkle_proof_t**)malloc(config->num_iterations * sizeof(merkle_proof_t*));
-    uint8_t** leaf_data_ptrs = (uint8_t**)malloc(config->num_iterations * sizeof(uint8_t*));
+    fprintf(f, "{\n");
+    fprintf(f, "  \"schema\": \"merkle_bench/1\",\n");
+    fprintf(f, "  \"iterations\": %llu,\n", (unsigned long long)config->num_iterations);
+    fprintf(f, "  \"build_iterations\": %llu,\n", (unsigned long long)config->build_iterations);
+    fprintf(f, "  \"batch_size\": %llu,\n", (unsigned long long)config->batch_size);
+    fprintf(f, "  \"repeats\": %u,\n", config->repeats);
+    fprintf(f, "  \"results\": [\n");
     
-    for (uint64_t i = 0; i < config->num_iterations; i++) {
-        uint64_t leaf_idx = rand() % config->tree_size;
-        leaf_data_ptrs[i] = leaf_data + leaf_idx * 32;
-        proofs[i] = merkle_proof_create(tree, leaf_idx);
+    for (size_t i = 0; i < num_results; i++) {
+        const bench_result_t* r = &results[i];
+        fprintf(f, "    {\"mode\": \"%s\", \"hash\": \"%s\", \"leaves\": %llu, \"threads\": %u, "
+                   "\"ops\": %llu, \"wall_ns\": %llu, \"ops_per_sec\": %.1f, \"mean_ns\": %llu, "
+                   "\"p50_ns\": %llu, \"p99_ns\": %llu, \"max_ns\": %llu, \"failed\": %s",
+                k_bench_mode_names[r->mode], bench_hash_name(r->hash_type),
+                (unsigned long long)r->leaves, r->threads,
+                (unsigned long long)r->ops, (unsigned long long)r->wall_ns, r->ops_per_sec,
+                (unsigned long long)r->mean_ns, (unsigned long long)r->p50_ns,
+                (unsigned long long)r->p99_ns, (unsigned long long)r->max_ns,
+                r->failed ? "true" : "false");
+        if (r->hw_samples > 0) {
+            fprintf(f, ", \"hw_samples\": %llu, \"cycles_per_op\": %.1f, \"instructions_per_op\": %.1f, "
+                       "\"llc_refs_per_op\": %.2f, \"llc_misses_per_op\": %.2f",
+                    (unsigned long long)r->hw_samples,
+                    r->hw_per_op[MERKLE_HW_CYCLES], r->hw_per_op[MERKLE_HW_INSTRUCTIONS],
+                    r->hw_per_op[MERKLE_HW_LLC_REFERENCES], r->hw_per_op[MERKLE_HW_LLC_MISSES]);
+        }
+        fprintf(f, "}%s\n", i + 1 < num_results ? "," : "");
     }
     
-    // Benchmark verification
-    uint64_t total_verify_time = 0;
-    uint64_t correct_verifications = 0;
+    fprintf(f, "  ]\n");
+    fprintf(f, "}\n");
     
-    for (uint64_t i = 0; i < config->num_iterations; i++) {
-        uint64_t start = get_time_ns();
-        bool result = merkle_proof_verify(proofs[i], leaf_data_ptrs[i]);
-        uint64_t end = get_time_ns();
-        
-        total_verify_time += (end - start);
-        if (result) correct_verifications++;
+    if (f != stdout) {
+        fclose(f);
     }
+    return true;
+}
+
+// Minimal field lookup for the line-per-result format written above
+static const char* json_find_value(const char* line, const char* key) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
     
-    double avg_verify_time_ms = (double)total_verify_time / config->num_iterations / 1000000.0;
-    double verifications_per_sec = 1000.0 / avg_verify_time_ms;
-    double success_rate = (double)correct_verifications / config->num_iterations * 100.0;
+    const char* p = strstr(line, pattern);
+    if (!p) {
+        return NULL;
+    }
     
-    printf("Proof verification: avg %.3f ms | %.0f verifications/sec | %.1f%% success\n", 
-           avg_verify_time_ms, verifications_per_sec, success_rate);
+    p += strlen(pattern);
+    while (*p == ' ') p++;
+    return p;
+}
+
+static bool json_find_string(const char* line, const char* key, char* out, size_t out_size) {
+    const char* p = json_find_value(line, key);
+    if (!p || *p != '"') {
+        return false;
+    }
     
-    // Clean up
-    for (uint64_t i = 0; i < config->num_iterations; i++) {
-        if (proofs[i]) merkle_proof_destroy(proofs[i]);
+    p++;
+    size_t n = 0;
+    while (p[n] && p[n] != '"' && n + 1 < out_size) {
+        out[n] = p[n];
+        n++;
+    }
+    out[n] = '\0';
+    return true;
+}
+
+static bool json_find_number(const char* line, const char* key, double* out) {
+    const char* p = json_find_value(line, key);
+    if (!p) {
+        return false;
+    }
+    
+    char* end = NULL;
+    *out = strtod(p, &end);
+    return end != p;
+}
+
+// Compare against a baseline; returns the number of regressions or -1
+static int compare_with_baseline(const benchmark_config_t* config, const bench_result_t* results,
+                                 size_t num_results, FILE* out) {
+    FILE* f = fopen(config->compare_path, "r");
+    if (!f) {
+        fprintf(stderr, "Failed to open baseline %s\n", config->compare_path);
+        return -1;
+    }
+    
+    bool* matched = (bool*)calloc(num_results ? num_results : 1, sizeof(bool));
+    if (!matched) {
+        fclose(f);
+        return -1;
+    }
+    
+    fprintf(out, "\n=== Comparison against %s (threshold %.1f%%) ===\n",
+            config->compare_path, config->regression_threshold * 100.0);
+    fprintf(out, "%-10s %-8s %10s %7s %14s %14s %9s %9s  %s\n",
+            "Mode", "Hash", "Leaves", "Threads", "Base ops/s", "Ops/sec", "Delta", "p99 chg", "Status");
+    
+    int regressions = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), f)) {
+        char mode[32];
+        char hash[32];
+        double leaves = 0;
+        double threads = 0;
+        double base_ops = 0;
+        double base_p99 = 0;
+        
+        if (!json_find_string(line, "mode", mode, sizeof(mode)) ||
+            !json_find_string(line, "hash", hash, sizeof(hash)) ||
+            !json_find_number(line, "leaves", &leaves) ||
+            !json_find_number(line, "threads", &threads) ||
+            !json_find_number(line, "ops_per_sec", &base_ops)) {
+            continue;
+        }
+        json_find_number(line, "p99_ns", &base_p99);
+        
+        for (size_t i = 0; i < num_results; i++) {
+            const bench_result_t* r = &results[i];
+            if (strcmp(mode, k_bench_mode_names[r->mode]) != 0 ||
+                strcmp(hash, bench_hash_name(r->hash_type)) != 0 ||
+                (uint64_t)leaves != r->leaves || (uint32_t)threads != r->threads) {
+                continue;
+            }
+            
+            matched[i] = true;
+            double delta = base_ops > 0 ? (r->ops_per_sec - base_ops) / base_ops : 0.0;
+            double p99_delta = base_p99 > 0 ? ((double)r->p99_ns - base_p99) / base_p99 : 0.0;
+            bool regressed = r->failed || delta < -config->regression_threshold;
+            if (regressed) {
+                regressions++;
+            }
+            
+            fprintf(out, "%-10s %-8s %10llu %7u %14.0f %14.0f %+8.1f%% %+8.1f%%  %s\n",
+                    mode, hash, (unsigned long long)r->leaves, r->threads,
+                    base_ops, r->ops_per_sec, delta * 100.0, p99_delta * 100.0,
+                    regressed ? "REGRESSION" : "ok");
+            break;
+        }
+    }
+    fclose(f);
+    
+    for (size_t i = 0; i < num_results; i++) {
+        if (!matched[i]) {
+            fprintf(out, "%-10s %-8s %10llu %7u %14s %14.0f %9s %9s  %s\n",
+                    k_bench_mode_names[results[i].mode], bench_hash_name(results[i].hash_type),
+                    (unsigned long long)results[i].leaves, results[i].threads,
+                    "-", results[i].ops_per_sec, "-", "-", "new");
+        }
     }
-    free(proofs);
-    free(leaf_data_ptrs);
-    free(leaf_data);
-    merkle_tree_destroy(tree);
+    free(matched);
+    
+    fprintf(out, "%d regression(s)\n", regressions);
+    return regressions;
 }
 
 void benchmark_spi_interface(benchmark_config_t* config) {
@@ -206,27 +717,46 @@ void benchmark_spi_interface(benchmark_config_t* config) {
            (unsigned long long)tree_info->tree_id,
            (unsigned long long)tree_info->num_leaves);
     
-    // Benchmark SPI operations
+    // Benchmark SPI operations: generate a proof, then verify it
     spi_request_t request = {0};
     request.request_id = 1;
-    request.request_type = SPI_REQUEST_TREE_INFO;
     request.tree_id = tree_info->tree_id;
     
+    uint64_t rng = 7;
     uint64_t total_spi_time = 0;
+    uint64_t failures = 0;
     for (uint64_t i = 0; i < config->num_iterations; i++) {
+        request.request_type = SPI_REQUEST_PROOF_GENERATION;
+        request.leaf_index = bench_rand(&rng) % tree_info->num_leaves;
+        
         uint64_t start = get_time_ns();
-        spi_response_t* response = spi_process_request(ctx, &request);
+        spi_response_t* generated = spi_process_request(ctx, &request);
+        spi_response_t* verified = NULL;
+        if (generated && generated->status == SPI_RESPONSE_SUCCESS) {
+            request.request_type = SPI_REQUEST_PROOF_VERIFICATION;
+            request.leaf_data = generated->proof_data;
+            request.leaf_data_size = generated->proof_size;
+            verified = spi_process_request(ctx, &request);
+        }
         uint64_t end = get_time_ns();
         
         total_spi_time += (end - start);
-        
-        if (response) {
-            spi_free_response(response);
+        if (!verified || verified->verification_result != 1) {
+            failures++;
         }
+        
+        request.leaf_data = NULL;
+        request.leaf_data_size = 0;
+        spi_free_response(generated);
+        spi_free_response(verified);
     }
     
     double avg_spi_time_ms = (double)total_spi_time / config->num_iterations / 1000000.0;
-    printf("SPI request processing: avg %.3f ms\n", avg_spi_time_ms);
+    printf("SPI generate+verify round trip: avg %.3f ms", avg_spi_time_ms);
+    if (failures) {
+        printf(" (%llu FAILED)", (unsigned long long)failures);
+    }
+    printf("\n");
     
     // Get performance metrics
     spi_performance_metrics_t metrics = spi_get_performance_metrics(ctx);
@@ -235,21 +765,241 @@ void benchmark_spi_interface(benchmark_config_t* config) {
     printf("  Verification time: %llu ns\n", (unsigned long long)metrics.verification_time_ns);
     printf("  Memory usage: %llu MB\n", (unsigned long long)metrics.memory_usage_mb);
     printf("  Cache hit rate: %.2f%%\n", metrics.cache_hit_rate * 100.0);
-    printf("  Throughput: %.0f proofs/sec\n", metrics.throughput_proofs_per_sec);
+    printf("  Throughput: %llu proofs/sec\n", (unsigned long long)metrics.throughput_proofs_per_sec);
     
     // Clean up
+    spi_destroy_tree(ctx, tree_info->tree_id);
     free(tree_info);
     spi_shutdown(ctx);
 }
 
+// Socket server load generator: one client thread per connection keeps
+// depth proof requests in flight against an in-process server
+typedef struct {
+    spi_server_config_t server;
+    uint64_t tree_id;
+    uint64_t num_leaves;
+    uint64_t requests;
+    uint32_t depth;
+    uint64_t seed;
+    uint64_t* latencies;
+    uint64_t completed;
+    uint64_t failures;
+    pthread_t thread;
+} loadgen_connection_t;
+
+static void* loadgen_connection_run(void* arg) {
+    loadgen_connection_t* conn = (loadgen_connection_t*)arg;
+    spi_client_t* client = spi_client_connect(&conn->server);
+    uint64_t* sent_at = (uint64_t*)malloc(conn->depth * sizeof(uint64_t));
+    if (!client || !sent_at) {
+        conn->failures = conn->requests;
+        spi_client_close(client);
+        free(sent_at);
+        return NULL;
+    }
+    
+    uint64_t sent = 0;
+    uint64_t received = 0;
+    while (received < conn->requests) {
+        while (sent < conn->requests && sent - received < conn->depth) {
+            spi_request_t request = {0};
+            request.request_id = (uint32_t)sent + 1;
+            request.request_type = SPI_REQUEST_PROOF_GENERATION;
+            request.tree_id = conn->tree_id;
+            request.leaf_index = bench_rand(&conn->seed) % conn->num_leaves;
+            
+            sent_at[sent % conn->depth] = get_time_ns();
+            if (!spi_client_send(client, &request)) break;
+            sent++;
+        }
+        
+        spi_response_t* response = spi_client_receive(client);
+        if (!response) {
+            conn->failures += conn->requests - received;
+            break;
+        }
+        conn->latencies[received] = get_time_ns() - sent_at[received % conn->depth];
+        if (response->status != SPI_RESPONSE_SUCCESS || response->request_id != (uint32_t)received + 1) {
+            conn->failures++;
+        }
+        spi_free_response(response);
+        received++;
+    }
+    conn->completed = received;
+    
+    spi_client_close(client);
+    free(sent_at);
+    return NULL;
+}
+
+static int run_server_loadgen(const benchmark_config_t* config) {
+    uint32_t connections = config->loadgen_connections;
+    uint32_t reactors = config->threads[0];
+    uint64_t per_connection = config->num_iterations;
+    
+    spi_context_t* ctx = spi_init(config->tree_size);
+    spi_tree_info_t* info = ctx ? spi_create_tree(ctx, config->tree_size, HASH_SHA256) : NULL;
+    spi_server_config_t server_config = {
+        .unix_path = config->loadgen_unix_path, .port = 0, .num_reactors = reactors
+    };
+    spi_server_t* server = info ? spi_server_start(ctx, &server_config) : NULL;
+    loadgen_connection_t* conns = (loadgen_connection_t*)calloc(connections, sizeof(loadgen_connection_t));
+    uint64_t* latencies = (uint64_t*)malloc(connections * per_connection * sizeof(uint64_t));
+    if (!server || !conns || !latencies) {
+        fprintf(stderr, "Failed to start the SPI socket server\n");
+        spi_server_stop(server);
+        free(conns);
+        free(latencies);
+        free(info);
+        spi_shutdown(ctx);
+        return 1;
+    }
+    server_config.port = spi_server_port(server);
+    
+    printf("=== SPI Socket Server Load Test ===\n");
+    if (config->loadgen_unix_path) {
+        printf("  Endpoint: unix:%s\n", config->loadgen_unix_path);
+    } else {
+        printf("  Endpoint: tcp:127.0.0.1:%u\n", server_config.port);
+    }
+    printf("  Reactors: %u, connections: %u, depth: %u, requests/connection: %llu\n",
+           reactors, connections, config->loadgen_depth, (unsigned long long)per_connection);
+    
+    uint64_t start = get_time_ns();
+    for (uint32_t c = 0; c < connections; c++) {
+        conns[c].server = server_config;
+        conns[c].tree_id = info->tree_id;
+        conns[c].num_leaves = info->num_leaves;
+        conns[c].requests = per_connection;
+        conns[c].depth = config->loadgen_depth;
+        conns[c].seed = 0x9E3779B97F4A7C15ULL * (c + 1);
+        conns[c].latencies = latencies + (uint64_t)c * per_connection;
+        if (pthread_create(&conns[c].thread, NULL, loadgen_connection_run, &conns[c]) != 0) {
+            conns[c].failures = per_connection;
+            conns[c].thread = pthread_self();
+        }
+    }
+    
+    uint64_t completed = 0;
+    uint64_t failures = 0;
+    for (uint32_t c = 0; c < connections; c++) {
+        if (!pthread_equal(conns[c].thread, pthread_self())) {
+            pthread_join(conns[c].thread, NULL);
+        }
+        // Pack each connection's samples to the front
+        memmove(latencies + completed, conns[c].latencies, conns[c].completed * sizeof(uint64_t));
+        completed += conns[c].completed;
+        failures += conns[c].failures;
+    }
+    uint64_t wall_ns = get_time_ns() - start;
+    
+    if (completed > 0) {
+        qsort(latencies, completed, sizeof(uint64_t), compare_u64);
+        printf("  Throughput: %.0f requests/sec\n", (double)completed * 1e9 / (double)wall_ns);
+        printf("  Latency: p50 %.1f us, p99 %.1f us, max %.1f us\n",
+               latencies[completed / 2] / 1000.0, latencies[completed * 99 / 100] / 1000.0,
+               latencies[completed - 1] / 1000.0);
+    }
+    if (failures > 0) {
+        printf("  FAILED: %llu requests\n", (unsigned long long)failures);
+    }
+    
+    spi_server_stop(server);
+    free(conns);
+    free(latencies);
+    free(info);
+    spi_shutdown(ctx);
+    return failures == 0 && completed > 0 ? 0 : 1;
+}
+
+// Comma-separated option lists
+static size_t parse_u64_list(const char* arg, uint64_t* out, size_t max) {
+    size_t n = 0;
+    const char* p = arg;
+    
+    while (*p && n < max) {
+        char* end = NULL;
+        uint64_t value = strtoull(p, &end, 10);
+        if (end == p) break;
+        out[n++] = value;
+        p = (*end == ',') ? end + 1 : end;
+    }
+    
+    return n;
+}
+
+static bool parse_modes(const char* arg, uint32_t* modes) {
+    *modes = 0;
+    
+    char list[256];
+    snprintf(list, sizeof(list), "%s", arg);
+    for (char* token = strtok(list, ","); token; token = strtok(NULL, ",")) {
+        if (strcmp(token, "all") == 0) {
+            *modes = (1u << BENCH_NUM_MODES) - 1;
+            continue;
+        }
+        
+        bool found = false;
+        for (int m = 0; m < BENCH_NUM_MODES; m++) {
+            if (strcmp(token, k_bench_mode_names[m]) == 0) {
+                *modes |= 1u << m;
+                found = true;
+            }
+        }
+        if (!found) {
+            fprintf(stderr, "Unknown mode: %s\n", token);
+            return false;
+        }
+    }
+    
+    return *modes != 0;
+}
+
+static bool parse_hashes(const char* arg, benchmark_config_t* config) {
+    config->num_hashes = 0;
+    
+    char list[256];
+    snprintf(list, sizeof(list), "%s", arg);
+    for (char* token = strtok(list, ","); token && config->num_hashes < BENCH_MAX_LIST;
+         token = strtok(NULL, ",")) {
+        if (strcmp(token, "sha256") == 0) {
+            config->hashes[config->num_hashes++] = HASH_SHA256;
+        } else if (strcmp(token, "blake2b") == 0) {
+            config->hashes[config->num_hashes++] = HASH_BLAKE2B;
+        } else {
+            fprintf(stderr, "Unknown hash: %s\n", token);
+            return false;
+        }
+    }
+    
+    return config->num_hashes > 0;
+}
+
 void print_usage(const char* program_name) {
     printf("Usage: %s [options]\n", program_name);
     printf("Options:\n");
     printf("  -s, --tree-size <size>     Tree size (default: 16384)\n");
     printf("  -i, --iterations <count>   Number of iterations (default: 100)\n");
-    printf("  -v, --verify               Test verification (default: no)\n");
-    printf("  -b, --batch <size>         Test batch operations (default: no)\n");
+    printf("  -v, --verify               Include verification (default: in mode set)\n");
+    printf("  -b, --batch <size>         Proofs per batch in batch mode (default: 10)\n");
+    printf("  -H, --hash-bench           Run the hash backend sweep (32 B - 1 MB) and exit\n");
+    printf("  -m, --modes <list>         build,update,proof,verify,serialize,batch or all (default: all)\n");
+    printf("  -S, --sizes <list>         Tree sizes, e.g. 1024,65536 (default: --tree-size)\n");
+    printf("  -a, --hash <list>          sha256,blake2b (default: sha256)\n");
+    printf("  -t, --threads <list>       Thread counts, e.g. 1,4,8 (default: 1)\n");
+    printf("  -r, --repeats <count>      Runs per case, median reported (default: 3)\n");
+    printf("  -B, --build-iterations <n> Builds per build-mode run (default: 3)\n");
+    printf("  -j, --json <file>          Write results as JSON (\"-\" for stdout)\n");
+    printf("  -c, --compare <file>       Compare against a baseline written by --json\n");
+    printf("  -T, --threshold <percent>  Throughput drop flagged as regression (default: 10)\n");
+    printf("  -P, --hw-counters          Report cycles, instructions and LLC misses (perf_event)\n");
+    printf("  -L, --loadgen <conns>      Load-test the SPI socket server with this many connections and exit\n");
+    printf("                             (--iterations requests each, first --threads value as reactors)\n");
+    printf("  -D, --depth <n>            Pipelined requests per load-test connection (default: 16)\n");
+    printf("  -U, --unix <path>          Load-test over a Unix socket instead of TCP loopback\n");
     printf("  -h, --help                 Show this help message\n");
+    printf("Exit status is 2 when --compare finds a regression.\n");
 }
 
 int main(int argc, char* argv[]) {
@@ -258,7 +1008,23 @@ int main(int argc, char* argv[]) {
         .num_iterations = 100,
         .test_verification = false,
         .test_batch_operations = false,
-        .batch_size = 10
+        .batch_size = 10,
+        .hash_benchmark = false,
+        .modes = (1u << BENCH_NUM_MODES) - 1,
+        .num_sizes = 0,
+        .hashes = {HASH_SHA256},
+        .num_hashes = 1,
+        .threads = {1},
+        .num_threads = 1,
+        .repeats = 3,
+        .build_iterations = 3,
+        .json_path = NULL,
+        .compare_path = NULL,
+        .regression_threshold = 0.10,
+        .hw_counters = false,
+        .loadgen_connections = 0,
+        .loadgen_depth = 16,
+        .loadgen_unix_path = NULL
     };
     
     // Parse command line arguments
@@ -267,14 +1033,29 @@ int main(int argc, char* argv[]) {
         {"iterations", required_argument, 0, 'i'},
         {"verify", no_argument, 0, 'v'},
         {"batch", required_argument, 0, 'b'},
+        {"hash-bench", no_argument, 0, 'H'},
+        {"modes", required_argument, 0, 'm'},
+        {"sizes", required_argument, 0, 'S'},
+        {"hash", required_argument, 0, 'a'},
+        {"threads", required_argument, 0, 't'},
+        {"repeats", required_argument, 0, 'r'},
+        {"build-iterations", required_argument, 0, 'B'},
+        {"json", required_argument, 0, 'j'},
+        {"compare", required_argument, 0, 'c'},
+        {"threshold", required_argument, 0, 'T'},
+        {"hw-counters", no_argument, 0, 'P'},
+        {"loadgen", required_argument, 0, 'L'},
+        {"depth", required_argument, 0, 'D'},
+        {"unix", required_argument, 0, 'U'},
         {"help", no_argument, 0, 'h'},
         {0, 0, 0, 0}
     };
     
     int opt;
     int option_index = 0;
+    uint64_t thread_list[BENCH_MAX_LIST];
     
-    while ((opt = getopt_long(argc, argv, "s:i:vb:h", long_options, &option_index)) != -1) {
+    while ((opt = getopt_long(argc, argv, "s:i:vb:Hm:S:a:t:r:B:j:c:T:PL:D:U:h", long_options, &option_index)) != -1) {
         switch (opt) {
             case 's':
                 config.tree_size = strtoull(optarg, NULL, 10);
@@ -284,10 +1065,63 @@ int main(int argc, char* argv[]) {
                 break;
             case 'v':
                 config.test_verification = true;
+                config.modes |= 1u << BENCH_VERIFY;
                 break;
             case 'b':
                 config.test_batch_operations = true;
                 config.batch_size = strtoull(optarg, NULL, 10);
+                config.modes |= 1u << BENCH_BATCH;
+                break;
+            case 'H':
+                config.hash_benchmark = true;
+                break;
+            case 'm':
+                if (!parse_modes(optarg, &config.modes)) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'S':
+                config.num_sizes = parse_u64_list(optarg, config.sizes, BENCH_MAX_LIST);
+                break;
+            case 'a':
+                if (!parse_hashes(optarg, &config)) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 't':
+                config.num_threads = parse_u64_list(optarg, thread_list, BENCH_MAX_LIST);
+                for (size_t t = 0; t < config.num_threads; t++) {
+                    config.threads[t] = thread_list[t] ? (uint32_t)thread_list[t] : 1;
+                }
+                break;
+            case 'r':
+                config.repeats = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+            case 'B':
+                config.build_iterations = strtoull(optarg, NULL, 10);
+                break;
+            case 'j':
+                config.json_path = optarg;
+                break;
+            case 'c':
+                config.compare_path = optarg;
+                break;
+            case 'T':
+                config.regression_threshold = strtod(optarg, NULL) / 100.0;
+                break;
+            case 'P':
+                config.hw_counters = true;
+                break;
+            case 'L':
+                config.loadgen_connections = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+            case 'D':
+                config.loadgen_depth = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+            case 'U':
+                config.loadgen_unix_path = optarg;
                 break;
             case 'h':
                 print_usage(argv[0]);
@@ -298,33 +1132,94 @@ int main(int argc, char* argv[]) {
         }
     }
     
-    printf("Challenge B - Merkle Proof RISC-V Benchmark\n");
-    printf("===========================================\n");
-    printf("Configuration:\n");
-    printf("  Tree size: %llu leaves\n", (unsigned long long)config.tree_size);
-    printf("  Iterations: %llu\n", (unsigned long long)config.num_iterations);
-    printf("  Test verification: %s\n", config.test_verification ? "yes" : "no");
-    printf("  Test batch operations: %s\n", config.test_batch_operations ? "yes" : "no");
-    printf("\n");
+    if (config.hash_benchmark) {
+        return hash_benchmark_sweep(32, 1024 * 1024) ? 0 : 1;
+    }
+    
+    if (config.num_sizes == 0) {
+        config.sizes[0] = config.tree_size;
+        config.num_sizes = 1;
+    }
+    for (size_t s = 0; s < config.num_sizes; s++) {
+        if (validate_tree_parameters(config.sizes[s], HASH_SHA256) != MERKLE_SUCCESS) {
+            fprintf(stderr, "Tree size %llu must be a power of two\n", (unsigned long long)config.sizes[s]);
+            return 1;
+        }
+    }
+    if (config.num_threads == 0) {
+        config.threads[0] = 1;
+        config.num_threads = 1;
+    }
+    if (config.num_iterations == 0) config.num_iterations = 1;
+    if (config.build_iterations == 0) config.build_iterations = 1;
+    if (config.batch_size == 0) config.batch_size = 1;
+    if (config.repeats == 0) config.repeats = 1;
+    if (config.loadgen_depth == 0) config.loadgen_depth = 1;
+    
+    if (config.loadgen_connections > 0) {
+        return run_server_loadgen(&config);
+    }
+    
+    // Keep stdout clean for machine-readable output
+    bool json_to_stdout = config.json_path && strcmp(config.json_path, "-") == 0;
+    FILE* out = json_to_stdout ? stderr : stdout;
+    
+    fprintf(out, "Challenge B - Merkle Proof RISC-V Benchmark\n");
+    fprintf(out, "===========================================\n");
+    fprintf(out, "Configuration:\n");
+    fprintf(out, "  Tree sizes: ");
+    for (size_t s = 0; s < config.num_sizes; s++) {
+        fprintf(out, "%s%llu", s ? "," : "", (unsigned long long)config.sizes[s]);
+    }
+    fprintf(out, " leaves\n");
+    fprintf(out, "  Iterations: %llu (builds: %llu, repeats: %u)\n",
+            (unsigned long long)config.num_iterations,
+            (unsigned long long)config.build_iterations, config.repeats);
+    fprintf(out, "  Batch size: %llu\n", (unsigned long long)config.batch_size);
+    if (config.hw_counters) {
+        config.hw_counters = merkle_hw_counters_enable(true);
+        fprintf(out, "  Hardware counters: %s\n", config.hw_counters ? "enabled" :
+                "unavailable (needs MERKLE_ENABLE_TIMING and perf_event access)");
+    }
+    fprintf(out, "\n");
     
     // Run benchmarks
-    benchmark_tree_creation(&config);
-    printf("\n");
+    size_t num_results = 0;
+    bench_result_t* results = run_benchmark_suite(&config, out, &num_results);
+    if (!results) {
+        fprintf(stderr, "Failed to allocate benchmark results\n");
+        return 1;
+    }
+    fprintf(out, "\n");
     
-    benchmark_proof_generation(&config);
-    printf("\n");
+    int status = 0;
+    for (size_t i = 0; i < num_results; i++) {
+        if (results[i].failed) status = 1;
+    }
+    
+    if (config.json_path && !write_results_json(&config, results, num_results, config.json_path)) {
+        status = 1;
+    }
     
-    if (config.test_verification) {
-        benchmark_proof_verification(&config);
+    if (config.compare_path) {
+        int regressions = compare_with_baseline(&config, results, num_results, out);
+        if (regressions < 0) {
+            status = 1;
+        } else if (regressions > 0) {
+            status = 2;
+        }
+    }
+    
+    if (!json_to_stdout && !config.compare_path) {
+        benchmark_spi_interface(&config);
         printf("\n");
     }
     
-    benchmark_spi_interface(&config);
-    printf("\n");
+    free(results);
     
-    printf("Benchmark completed successfully!\n");
+    if (status == 0) {
+        fprintf(out, "Benchmark completed successfully!\n");
+    }
     
-    return 0;
+    return status;
 }
-
-
@@ -0,0 +1,421 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "spi_interface.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+
+#define SPI_ASYNC_MAX_WORKERS 256
+
+typedef struct {
+    const spi_request_t* request;
+    spi_response_t* response;
+    uint64_t deadline_ns;                   // 0 when the request has no timeout
+} spi_async_job_t;
+
+typedef struct {
+    _Atomic size_t sequence;
+    spi_async_job_t job;
+} spi_async_cell_t;
+
+// Bounded MPMC ring (Vyukov): each cell's sequence number says whether it
+// is ready for the producer or the consumer of a given lap, so both ends
+// claim cells with one CAS on their own cursor.
+typedef struct {
+    _Alignas(64) _Atomic size_t enqueue_pos;
+    _Alignas(64) _Atomic size_t dequeue_pos;
+    _Alignas(64) spi_async_cell_t* cells;
+    size_t mask;
+} spi_async_ring_t;
+
+typedef struct {
+    spi_async_t* async;
+    uint32_t index;
+    pthread_t thread;
+} spi_async_worker_t;
+
+struct spi_async {
+    spi_context_t* ctx;
+    spi_completion_callback_t callback;
+    void* user_data;
+    uint32_t limit;                         // Requests admitted and not yet handed back
+    
+    spi_async_ring_t* rings;                // One per worker; idle workers steal
+    spi_async_worker_t* workers;
+    uint32_t num_rings;
+    uint32_t num_workers;                   // Threads actually started
+    _Atomic uint32_t next_ring;
+    sem_t pending;                          // One token per queued job (plus stop tokens)
+    _Atomic uint32_t queued;                // Jobs submitted and not yet popped
+    _Atomic bool stopping;
+    
+    spi_async_ring_t completions;           // Used when there is no callback
+    sem_t completed;
+    
+    _Atomic uint32_t in_flight;
+    _Atomic uint32_t space_waiters;
+    pthread_mutex_t space_lock;             // Submitters waiting for capacity
+    pthread_cond_t space_cond;
+};
+
+static uint64_t spi_async_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static struct timespec spi_async_realtime_after(uint32_t wait_ms) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += wait_ms / 1000;
+    ts.tv_nsec += (long)(wait_ms % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    return ts;
+}
+
+static bool spi_ring_init(spi_async_ring_t* ring, size_t min_capacity) {
+    size_t capacity = 2;
+    while (capacity < min_capacity) {
+        capacity *= 2;
+    }
+    
+    ring->cells = (spi_async_cell_t*)calloc(capacity, sizeof(spi_async_cell_t));
+    if (!ring->cells) {
+        return false;
+    }
+    
+    for (size_t i = 0; i < capacity; i++) {
+        atomic_init(&ring->cells[i].sequence, i);
+    }
+    ring->mask = capacity - 1;
+    atomic_init(&ring->enqueue_pos, 0);
+    atomic_init(&ring->dequeue_pos, 0);
+    return true;
+}
+
+static bool spi_ring_push(spi_async_ring_t* ring, const spi_async_job_t* job) {
+    size_t pos = atomic_load_explicit(&ring->enqueue_pos, memory_order_relaxed);
+    for (;;) {
+        spi_async_cell_t* cell = &ring->cells[pos & ring->mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+        
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring->enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                cell->job = *job;
+                atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;  // Full
+        } else {
+            pos = atomic_load_explicit(&ring->enqueue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+static bool spi_ring_pop(spi_async_ring_t* ring, spi_async_job_t* job) {
+    size_t pos = atomic_load_explicit(&ring->dequeue_pos, memory_order_relaxed);
+    for (;;) {
+        spi_async_cell_t* cell = &ring->cells[pos & ring->mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+        
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring->dequeue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                *job = cell->job;
+                atomic_store_explicit(&cell->sequence, pos + ring->mask + 1, memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;  // Empty
+        } else {
+            pos = atomic_load_explicit(&ring->dequeue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+// Give one admission slot back and wake a submitter waiting for it. The
+// lock is only taken when someone waits; both sides use seq_cst so either
+// the waiter sees the freed slot or we see the waiter.
+static void spi_async_release_slot(spi_async_t* async) {
+    atomic_fetch_sub_explicit(&async->in_flight, 1, memory_order_seq_cst);
+    
+    if (atomic_load_explicit(&async->space_waiters, memory_order_seq_cst) > 0) {
+        pthread_mutex_lock(&async->space_lock);
+        pthread_cond_signal(&async->space_cond);
+        pthread_mutex_unlock(&async->space_lock);
+    }
+}
+
+static spi_response_t* spi_async_timeout_response(const spi_request_t* request) {
+    spi_response_t* response = spi_response_create(request->request_id, 0);
+    if (response) {
+        response->status = SPI_RESPONSE_ERROR_TIMEOUT;
+    }
+    return response;
+}
+
+static void spi_async_complete(spi_async_t* async, spi_async_job_t* job) {
+    if (async->callback) {
+        async->callback(job->request, job->response, async->user_data);
+        spi_async_release_slot(async);
+        return;
+    }
+    
+    // The ring holds `limit` entries, so an admitted request always fits;
+    // its slot is given back when the caller polls it
+    spi_ring_push(&async->completions, job);
+    sem_post(&async->completed);
+}
+
+static void* spi_async_worker_main(void* arg) {
+    spi_async_worker_t* worker = (spi_async_worker_t*)arg;
+    spi_async_t* async = worker->async;
+    
+    for (;;) {
+        while (sem_wait(&async->pending) != 0 && errno == EINTR) {
+        }
+        
+        // Own ring first, then steal from the others. A ring reads empty
+        // while a producer has claimed its head cell but not yet filled it,
+        // even if later cells are ready, so the scan repeats as long as a
+        // job is still queued; dropping the token would strand one.
+        spi_async_job_t job;
+        bool found = false;
+        for (;;) {
+            for (uint32_t i = 0; i < async->num_rings && !found; i++) {
+                found = spi_ring_pop(&async->rings[(worker->index + i) % async->num_rings], &job);
+            }
+            if (found || atomic_load_explicit(&async->queued, memory_order_seq_cst) == 0) {
+                break;
+            }
+            sched_yield();
+        }
+        
+        if (!found) {
+            if (atomic_load_explicit(&async->stopping, memory_order_acquire)) {
+                break;
+            }
+            continue;
+        }
+        atomic_fetch_sub_explicit(&async->queued, 1, memory_order_seq_cst);
+        
+        if (job.deadline_ns != 0 && spi_async_now_ns() > job.deadline_ns) {
+            job.response = spi_async_timeout_response(job.request);
+        } else {
+            job.response = spi_process_request(async->ctx, (spi_request_t*)job.request);
+        }
+        spi_async_complete(async, &job);
+    }
+    
+    return NULL;
+}
+
+spi_async_t* spi_async_create(spi_context_t* ctx, uint32_t num_workers,
+                              spi_completion_callback_t callback, void* user_data) {
+    if (!ctx) {
+        return NULL;
+    }
+    
+    if (num_workers == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_workers = cpus > 0 ? (uint32_t)cpus : 1;
+    }
+    if (num_workers > SPI_ASYNC_MAX_WORKERS) {
+        num_workers = SPI_ASYNC_MAX_WORKERS;
+    }
+    
+    spi_async_t* async = (spi_async_t*)calloc(1, sizeof(spi_async_t));
+    if (!async) {
+        return NULL;
+    }
+    
+    async->ctx = ctx;
+    async->callback = callback;
+    async->user_data = user_data;
+    async->limit = ctx->max_concurrent_requests > 0 ? ctx->max_concurrent_requests : 1;
+    async->num_rings = num_workers;
+    
+    // Every ring can hold the whole admission limit, so pushes never fail
+    async->rings = (spi_async_ring_t*)calloc(num_workers, sizeof(spi_async_ring_t));
+    async->workers = (spi_async_worker_t*)calloc(num_workers, sizeof(spi_async_worker_t));
+    bool ok = async->rings && async->workers && spi_ring_init(&async->completions, async->limit);
+    for (uint32_t i = 0; ok && i < num_workers; i++) {
+        ok = spi_ring_init(&async->rings[i], async->limit);
+    }
+    
+    if (!ok || sem_init(&async->pending, 0, 0) != 0) {
+        if (async->rings) {
+            for (uint32_t i = 0; i < num_workers; i++) {
+                free(async->rings[i].cells);
+            }
+        }
+        free(async->completions.cells);
+        free(async->rings);
+        free(async->workers);
+        free(async);
+        return NULL;
+    }
+    sem_init(&async->completed, 0, 0);
+    pthread_mutex_init(&async->space_lock, NULL);
+    pthread_cond_init(&async->space_cond, NULL);
+    
+    uint32_t started = 0;
+    for (; started < num_workers; started++) {
+        async->workers[started].async = async;
+        async->workers[started].index = started;
+        if (pthread_create(&async->workers[started].thread, NULL, spi_async_worker_main,
+                           &async->workers[started]) != 0) {
+            break;
+        }
+    }
+    async->num_workers = started;  // Workers only read num_rings
+    
+    if (started < num_workers) {
+        spi_async_destroy(async);
+        return NULL;
+    }
+    
+    return async;
+}
+
+void spi_async_destroy(spi_async_t* async) {
+    if (!async) return;
+    
+    // Queued requests still run; each worker then takes a stop token
+    atomic_store_explicit(&async->stopping, true, memory_order_release);
+    for (uint32_t i = 0; i < async->num_workers; i++) {
+        sem_post(&async->pending);
+    }
+    for (uint32_t i = 0; i < async->num_workers; i++) {
+        pthread_join(async->workers[i].thread, NULL);
+    }
+    
+    // Completions nobody polled
+    spi_async_job_t job;
+    while (spi_ring_pop(&async->completions, &job)) {
+        spi_free_response(job.response);
+    }
+    
+    for (uint32_t i = 0; i < async->num_rings; i++) {
+        free(async->rings[i].cells);
+    }
+    free(async->rings);
+    free(async->workers);
+    free(async->completions.cells);
+    sem_destroy(&async->pending);
+    sem_destroy(&async->completed);
+    pthread_mutex_destroy(&async->space_lock);
+    pthread_cond_destroy(&async->space_cond);
+    free(async);
+}
+
+// Claim an admission slot, waiting up to wait_ms for one to free up
+static bool spi_async_admit(spi_async_t* async, uint32_t wait_ms) {
+    uint32_t count = atomic_load_explicit(&async->in_flight, memory_order_relaxed);
+    while (count < async->limit) {
+        if (atomic_compare_exchange_weak_explicit(&async->in_flight, &count, count + 1,
+                                                  memory_order_acq_rel, memory_order_relaxed)) {
+            return true;
+        }
+    }
+    if (wait_ms == 0) {
+        return false;
+    }
+    
+    struct timespec deadline = spi_async_realtime_after(wait_ms);
+    bool admitted = false;
+    
+    pthread_mutex_lock(&async->space_lock);
+    atomic_fetch_add_explicit(&async->space_waiters, 1, memory_order_seq_cst);
+    for (;;) {
+        count = atomic_load_explicit(&async->in_flight, memory_order_seq_cst);
+        if (count < async->limit &&
+            atomic_compare_exchange_strong_explicit(&async->in_flight, &count, count + 1,
+                                                    memory_order_acq_rel, memory_order_relaxed)) {
+            admitted = true;
+            break;
+        }
+        if (count < async->limit) {
+            continue;  // Lost a race for the slot; try again
+        }
+        if (pthread_cond_timedwait(&async->space_cond, &async->space_lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    atomic_fetch_sub_explicit(&async->space_waiters, 1, memory_order_seq_cst);
+    pthread_mutex_unlock(&async->space_lock);
+    
+    return admitted;
+}
+
+bool spi_async_submit(spi_async_t* async, const spi_request_t* request, uint32_t wait_ms) {
+    if (!async || !request || atomic_load_explicit(&async->stopping, memory_order_relaxed)) {
+        return false;
+    }
+    
+    uint64_t now = spi_async_now_ns();
+    if (!spi_async_admit(async, wait_ms)) {
+        return false;
+    }
+    
+    // The timeout runs from submission, so time spent waiting for admission counts
+    spi_async_job_t job = {
+        .request = request,
+        .response = NULL,
+        .deadline_ns = request->timeout_ms ? now + (uint64_t)request->timeout_ms * 1000000ULL : 0,
+    };
+    
+    uint32_t ring = atomic_fetch_add_explicit(&async->next_ring, 1, memory_order_relaxed) % async->num_rings;
+    atomic_fetch_add_explicit(&async->queued, 1, memory_order_seq_cst);
+    spi_ring_push(&async->rings[ring], &job);
+    sem_post(&async->pending);
+    return true;
+}
+
+size_t spi_async_poll(spi_async_t* async, spi_response_t** responses, size_t max_responses, uint32_t wait_ms) {
+    if (!async || !responses || max_responses == 0 || async->callback) {
+        return 0;
+    }
+    
+    // Wait for the first completion only; take whatever else is ready
+    if (sem_trywait(&async->completed) != 0) {
+        if (wait_ms == 0) {
+            return 0;
+        }
+        struct timespec deadline = spi_async_realtime_after(wait_ms);
+        int rc;
+        while ((rc = sem_timedwait(&async->completed, &deadline)) != 0 && errno == EINTR) {
+        }
+        if (rc != 0) {
+            return 0;
+        }
+    }
+    
+    size_t count = 0;
+    spi_async_job_t job;
+    do {
+        // A posted completion may still be finishing its push
+        while (!spi_ring_pop(&async->completions, &job)) {
+        }
+        responses[count++] = job.response;
+        spi_async_release_slot(async);
+    } while (count < max_responses && sem_trywait(&async->completed) == 0);
+    
+    return count;
+}
+
+uint32_t spi_async_in_flight(spi_async_t* async) {
+    return async ? atomic_load_explicit(&async->in_flight, memory_order_relaxed) : 0;
+}
@@ -0,0 +1,161 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "spi_interface.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define SPI_CACHE_WAYS 8
+#define SPI_CACHE_SLOT_SIZE 1024        // Fits the proof of a maximum-size SPI tree (24 levels, 848 bytes)
+
+// Set-associative cache with CLOCK replacement inside each set. The keys of
+// a set sit together so a lookup scans two cache lines under the set's
+// lock; the proof bytes live in a separate slot array.
+typedef struct {
+    uint64_t tree_id;
+    uint64_t leaf_index;
+    uint64_t version;
+    uint32_t size;                          // 0 marks an empty way
+} spi_cache_key_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    spi_cache_key_t keys[SPI_CACHE_WAYS];
+    uint8_t referenced;                     // CLOCK bit per way
+    uint8_t hand;
+} spi_cache_set_t;
+
+struct spi_proof_cache {
+    spi_cache_set_t* sets;
+    uint8_t* slots;                         // SPI_CACHE_SLOT_SIZE bytes per way
+    size_t num_sets;                        // Power of two
+};
+
+static inline size_t cache_set_index(const spi_proof_cache_t* cache, uint64_t tree_id, uint64_t leaf_index) {
+    uint64_t h = (leaf_index ^ (tree_id << 40)) * 0x9E3779B97F4A7C15ULL;
+    return (size_t)(h >> 32) & (cache->num_sets - 1);
+}
+
+static inline uint8_t* cache_slot(const spi_proof_cache_t* cache, size_t set, unsigned way) {
+    return cache->slots + (set * SPI_CACHE_WAYS + way) * SPI_CACHE_SLOT_SIZE;
+}
+
+spi_proof_cache_t* spi_proof_cache_create(size_t entries) {
+    size_t num_sets = 1;
+    while (num_sets * SPI_CACHE_WAYS < entries) {
+        num_sets *= 2;
+    }
+    
+    spi_proof_cache_t* cache = (spi_proof_cache_t*)calloc(1, sizeof(spi_proof_cache_t));
+    if (!cache) {
+        return NULL;
+    }
+    
+    // Slot pages stay untouched until a proof lands in them
+    cache->sets = (spi_cache_set_t*)calloc(num_sets, sizeof(spi_cache_set_t));
+    cache->slots = (uint8_t*)calloc(num_sets * SPI_CACHE_WAYS, SPI_CACHE_SLOT_SIZE);
+    if (!cache->sets || !cache->slots) {
+        free(cache->sets);
+        free(cache->slots);
+        free(cache);
+        return NULL;
+    }
+    
+    cache->num_sets = num_sets;
+    for (size_t i = 0; i < num_sets; i++) {
+        pthread_mutex_init(&cache->sets[i].lock, NULL);
+    }
+    return cache;
+}
+
+void spi_proof_cache_destroy(spi_proof_cache_t* cache) {
+    if (!cache) return;
+    
+    for (size_t i = 0; i < cache->num_sets; i++) {
+        pthread_mutex_destroy(&cache->sets[i].lock);
+    }
+    free(cache->sets);
+    free(cache->slots);
+    free(cache);
+}
+
+// Copies the cached proof for exactly this tree version into buffer;
+// returns its size, or 0 on a miss
+size_t spi_proof_cache_lookup(spi_proof_cache_t* cache, uint64_t tree_id, uint64_t leaf_index,
+                              uint64_t version, uint8_t* buffer, size_t capacity) {
+    if (!cache || !buffer) {
+        return 0;
+    }
+    
+    size_t index = cache_set_index(cache, tree_id, leaf_index);
+    spi_cache_set_t* set = &cache->sets[index];
+    size_t size = 0;
+    
+    pthread_mutex_lock(&set->lock);
+    for (unsigned way = 0; way < SPI_CACHE_WAYS; way++) {
+        const spi_cache_key_t* key = &set->keys[way];
+        if (key->size != 0 && key->leaf_index == leaf_index && key->tree_id == tree_id &&
+            key->version == version) {
+            if (key->size <= capacity) {
+                size = key->size;
+                memcpy(buffer, cache_slot(cache, index, way), size);
+                set->referenced |= (uint8_t)(1u << way);
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&set->lock);
+    
+    return size;
+}
+
+// A newer version of a leaf overwrites its stale copy in place; otherwise
+// the CLOCK hand picks the first way not referenced since it last passed
+void spi_proof_cache_insert(spi_proof_cache_t* cache, uint64_t tree_id, uint64_t leaf_index,
+                            uint64_t version, const uint8_t* proof, size_t size) {
+    if (!cache || !proof || size == 0 || size > SPI_CACHE_SLOT_SIZE) {
+        return;
+    }
+    
+    size_t index = cache_set_index(cache, tree_id, leaf_index);
+    spi_cache_set_t* set = &cache->sets[index];
+    
+    pthread_mutex_lock(&set->lock);
+    
+    int victim = -1;
+    for (unsigned way = 0; way < SPI_CACHE_WAYS; way++) {
+        const spi_cache_key_t* key = &set->keys[way];
+        if (key->size != 0 && key->leaf_index == leaf_index && key->tree_id == tree_id) {
+            if (key->version >= version) {
+                // Another thread got here first, or we raced an update
+                pthread_mutex_unlock(&set->lock);
+                return;
+            }
+            victim = (int)way;
+            break;
+        }
+        if (key->size == 0 && victim < 0) {
+            victim = (int)way;
+        }
+    }
+    
+    while (victim < 0) {
+        unsigned way = set->hand;
+        set->hand = (uint8_t)((way + 1) % SPI_CACHE_WAYS);
+        if (set->referenced & (1u << way)) {
+            set->referenced &= (uint8_t)~(1u << way);
+        } else {
+            victim = (int)way;
+        }
+    }
+    
+    spi_cache_key_t* key = &set->keys[victim];
+    key->tree_id = tree_id;
+    key->leaf_index = leaf_index;
+    key->version = version;
+    key->size = (uint32_t)size;
+    memcpy(cache_slot(cache, index, (unsigned)victim), proof, size);
+    set->referenced &= (uint8_t)~(1u << victim);
+    
+    pthread_mutex_unlock(&set->lock);
+}
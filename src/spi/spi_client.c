@@ -0,0 +1,181 @@
+#define _GNU_SOURCE
+
+#include "spi_interface.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define SPI_CLIENT_BUFFER_SIZE (64 * 1024)      // Queued requests sent without an explicit flush
+
+// Blocking client. Sends are queued and written in one go, so a caller can
+// pipeline many requests per system call; responses come back in order.
+struct spi_client {
+    int fd;
+    uint8_t* out;
+    size_t out_len;
+    size_t out_cap;
+    uint8_t* in;                            // Frames at 8-byte offsets of a malloc'd buffer
+    size_t in_off;
+    size_t in_len;
+    size_t in_cap;
+};
+
+static bool client_reserve(uint8_t** buffer, size_t* capacity, size_t needed) {
+    if (needed <= *capacity) {
+        return true;
+    }
+    
+    size_t new_capacity = *capacity ? *capacity : SPI_CLIENT_BUFFER_SIZE;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+    
+    uint8_t* grown = (uint8_t*)realloc(*buffer, new_capacity);
+    if (!grown) {
+        return false;
+    }
+    *buffer = grown;
+    *capacity = new_capacity;
+    return true;
+}
+
+spi_client_t* spi_client_connect(const spi_server_config_t* config) {
+    if (!config) {
+        return NULL;
+    }
+    
+    int fd;
+    if (config->unix_path) {
+        struct sockaddr_un addr = {.sun_family = AF_UNIX};
+        if (strlen(config->unix_path) >= sizeof(addr.sun_path)) {
+            return NULL;
+        }
+        strcpy(addr.sun_path, config->unix_path);
+        
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            return NULL;
+        }
+        if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+            close(fd);
+            return NULL;
+        }
+    } else {
+        struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(config->port)};
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            return NULL;
+        }
+        if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+            close(fd);
+            return NULL;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    
+    spi_client_t* client = (spi_client_t*)calloc(1, sizeof(spi_client_t));
+    if (!client) {
+        close(fd);
+        return NULL;
+    }
+    client->fd = fd;
+    return client;
+}
+
+void spi_client_close(spi_client_t* client) {
+    if (!client) return;
+    
+    close(client->fd);
+    free(client->out);
+    free(client->in);
+    free(client);
+}
+
+bool spi_client_send(spi_client_t* client, const spi_request_t* request) {
+    if (!client) {
+        return false;
+    }
+    
+    size_t size = spi_wire_request_size(request);
+    if (size == 0 || !client_reserve(&client->out, &client->out_cap, client->out_len + size)) {
+        return false;
+    }
+    client->out_len += spi_wire_encode_request(request, client->out + client->out_len, size);
+    
+    return client->out_len < SPI_CLIENT_BUFFER_SIZE || spi_client_flush(client);
+}
+
+bool spi_client_flush(spi_client_t* client) {
+    if (!client) {
+        return false;
+    }
+    
+    size_t offset = 0;
+    while (offset < client->out_len) {
+        ssize_t sent = send(client->fd, client->out + offset, client->out_len - offset, MSG_NOSIGNAL);
+        if (sent > 0) {
+            offset += (size_t)sent;
+        } else if (sent < 0 && errno == EINTR) {
+            continue;
+        } else {
+            return false;
+        }
+    }
+    
+    client->out_len = 0;
+    return true;
+}
+
+// Flushes queued requests first; NULL once the server has closed the
+// connection or sent a malformed frame
+spi_response_t* spi_client_receive(spi_client_t* client) {
+    if (!client || !spi_client_flush(client)) {
+        return NULL;
+    }
+    
+    for (;;) {
+        size_t available = client->in_len - client->in_off;
+        if (available >= 8) {
+            size_t size = spi_wire_frame_size(client->in + client->in_off);
+            if (size == 0) {
+                return NULL;
+            }
+            if (available >= size) {
+                spi_response_t* response = spi_wire_decode_response(client->in + client->in_off, size);
+                client->in_off += size;
+                return response;
+            }
+            if (!client_reserve(&client->in, &client->in_cap, client->in_off + size)) {
+                return NULL;
+            }
+        }
+        
+        // Slide a partial frame to the front before reading more
+        if (client->in_off > 0) {
+            memmove(client->in, client->in + client->in_off, available);
+            client->in_len = available;
+            client->in_off = 0;
+        }
+        if (!client_reserve(&client->in, &client->in_cap, client->in_len + SPI_CLIENT_BUFFER_SIZE / 2)) {
+            return NULL;
+        }
+        
+        ssize_t received = recv(client->fd, client->in + client->in_len, client->in_cap - client->in_len, 0);
+        if (received > 0) {
+            client->in_len += (size_t)received;
+        } else if (received < 0 && errno == EINTR) {
+            continue;
+        } else {
+            return NULL;
+        }
+    }
+}
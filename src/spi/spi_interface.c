@@ -1,22 +1,108 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "spi_interface.h"
 #include "hash/hash_functions.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 #include <pthread.h>
 
-// SPI context
+#define SPI_STATS_SHARDS 64
+#define SPI_BATCH_MIN_PER_THREAD 512    // Proofs a batch thread must have to be worth starting
+#define SPI_BATCH_MAX_THREADS 16
+#define SPI_PROOF_CACHE_ENTRIES 8192    // Room for the hot set of a skewed workload
+
+// Each thread adds into its own cache line; threads beyond the shard count
+// share lines, which atomic adds keep correct
+struct spi_stats_shard {
+    _Alignas(64) _Atomic uint64_t requests;
+    _Atomic uint64_t proofs_generated;
+    _Atomic uint64_t proofs_verified;
+    _Atomic uint64_t generation_ns;
+    _Atomic uint64_t verification_ns;
+    _Atomic uint64_t cache_hits;
+    _Atomic uint64_t cache_misses;
+};
+
+// SPI context. Init and shutdown serialize on the lifecycle lock; requests
+// only read the published flag.
 static spi_context_t g_spi_context = {0};
-static bool g_spi_initialized = false;
+static spi_stats_shard_t g_spi_stats[SPI_STATS_SHARDS];
+static _Atomic bool g_spi_initialized = false;
+static pthread_mutex_t g_spi_lifecycle_lock = PTHREAD_MUTEX_INITIALIZER;
+static _Atomic uint32_t g_spi_next_slot = 0;
+static _Thread_local int t_spi_slot = -1;
+
+static uint64_t spi_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline spi_stats_shard_t* spi_stats_local(spi_context_t* ctx) {
+    if (t_spi_slot < 0) {
+        t_spi_slot = (int)(atomic_fetch_add_explicit(&g_spi_next_slot, 1, memory_order_relaxed) % SPI_STATS_SHARDS);
+    }
+    return &ctx->stats[t_spi_slot];
+}
+
+static inline void spi_stat_add(_Atomic uint64_t* counter, uint64_t value) {
+    atomic_fetch_add_explicit(counter, value, memory_order_relaxed);
+}
+
+static void spi_stats_clear(spi_stats_shard_t* shards) {
+    for (int i = 0; i < SPI_STATS_SHARDS; i++) {
+        atomic_store_explicit(&shards[i].requests, 0, memory_order_relaxed);
+        atomic_store_explicit(&shards[i].proofs_generated, 0, memory_order_relaxed);
+        atomic_store_explicit(&shards[i].proofs_verified, 0, memory_order_relaxed);
+        atomic_store_explicit(&shards[i].generation_ns, 0, memory_order_relaxed);
+        atomic_store_explicit(&shards[i].verification_ns, 0, memory_order_relaxed);
+        atomic_store_explicit(&shards[i].cache_hits, 0, memory_order_relaxed);
+        atomic_store_explicit(&shards[i].cache_misses, 0, memory_order_relaxed);
+    }
+}
+
+static inline bool spi_is_initialized(void) {
+    return atomic_load_explicit(&g_spi_initialized, memory_order_acquire);
+}
 
 // SPI implementation
 spi_context_t* spi_init(uint64_t max_tree_size) {
-    if (g_spi_initialized) {
+    if (spi_is_initialized()) {
+        return &g_spi_context;
+    }
+    
+    pthread_mutex_lock(&g_spi_lifecycle_lock);
+    if (spi_is_initialized()) {
+        // Another thread finished init while we waited
+        pthread_mutex_unlock(&g_spi_lifecycle_lock);
         return &g_spi_context;
     }
     
     memset(&g_spi_context, 0, sizeof(spi_context_t));
     
+    // 0 or anything above the interface limit means the interface limit
+    if (max_tree_size == 0 || max_tree_size > SPI_MAX_TREE_SIZE) {
+        max_tree_size = SPI_MAX_TREE_SIZE;
+    }
+    
+    g_spi_context.trees = spi_registry_create(0);
+    if (!g_spi_context.trees) {
+        pthread_mutex_unlock(&g_spi_lifecycle_lock);
+        return NULL;
+    }
+    g_spi_context.proof_cache = spi_proof_cache_create(SPI_PROOF_CACHE_ENTRIES);
+    if (!g_spi_context.proof_cache) {
+        spi_registry_destroy(g_spi_context.trees);
+        g_spi_context.trees = NULL;
+        pthread_mutex_unlock(&g_spi_lifecycle_lock);
+        return NULL;
+    }
+    spi_stats_clear(g_spi_stats);
+    g_spi_context.stats = g_spi_stats;
+    
     g_spi_context.max_tree_size = max_tree_size;
     g_spi_context.supported_hash_types = (1 << HASH_SHA256) | (1 << HASH_BLAKE2B);
     g_spi_context.max_concurrent_requests = 100;
@@ -24,71 +110,525 @@ spi_context_t* spi_init(uint64_t max_tree_size) {
     g_spi_context.version_minor = 0;
     g_spi_context.version_patch = 0;
     
-    g_spi_initialized = true;
+    atomic_store_explicit(&g_spi_initialized, true, memory_order_release);
+    pthread_mutex_unlock(&g_spi_lifecycle_lock);
     
     return &g_spi_context;
 }
 
 void spi_shutdown(spi_context_t* ctx) {
-    if (!ctx || !g_spi_initialized) {
+    if (!ctx) {
         return;
     }
     
-    // Cleanup resources
-    g_spi_initialized = false;
+    pthread_mutex_lock(&g_spi_lifecycle_lock);
+    if (spi_is_initialized()) {
+        atomic_store_explicit(&g_spi_initialized, false, memory_order_release);
+        
+        // Release every tree still registered
+        spi_registry_destroy(ctx->trees);
+        ctx->trees = NULL;
+        spi_proof_cache_destroy(ctx->proof_cache);
+        ctx->proof_cache = NULL;
+    }
+    pthread_mutex_unlock(&g_spi_lifecycle_lock);
 }
 
-spi_response_t* spi_process_request(spi_context_t* ctx, spi_request_t* request) {
-    if (!ctx || !request || !g_spi_initialized) {
-        return NULL;
+// Pin a tree and a snapshot of its current version. Readers take no lock
+// on the tree, so an update in flight never delays them.
+static spi_tree_handle_t* spi_acquire_tree(spi_context_t* ctx, uint64_t tree_id, merkle_snapshot_t* snapshot) {
+    spi_tree_handle_t* handle = spi_registry_acquire(ctx->trees, tree_id);
+    if (handle) {
+        merkle_mvcc_pin(handle->tree, snapshot);
+    }
+    return handle;
+}
+
+static void spi_release_tree(spi_tree_handle_t* handle, merkle_snapshot_t* snapshot) {
+    merkle_mvcc_unpin(handle->tree, snapshot);
+    spi_tree_handle_release(handle);
+}
+
+// Serialize the proof for one leaf into buffer, from the proof cache when
+// this version of the tree has served it before; returns bytes written or 0
+static uint64_t spi_write_proof(spi_context_t* ctx, uint64_t tree_id, const merkle_snapshot_t* snapshot,
+                                uint64_t leaf_index, uint8_t* buffer, uint64_t capacity) {
+    uint64_t start = spi_now_ns();
+    spi_stats_shard_t* stats = spi_stats_local(ctx);
+    
+    uint64_t size = merkle_proof_serialized_size(merkle_tree_proof_siblings(snapshot->tree));
+    if (capacity < size) {
+        return 0;
+    }
+    
+    if (spi_proof_cache_lookup(ctx->proof_cache, tree_id, leaf_index, snapshot->version, buffer, size) == size) {
+        spi_stat_add(&stats->cache_hits, 1);
+    } else {
+        if (merkle_snapshot_serialize_proofs(snapshot, &leaf_index, NULL, 1, buffer) != MERKLE_SUCCESS) {
+            return 0;
+        }
+        spi_proof_cache_insert(ctx->proof_cache, tree_id, leaf_index, snapshot->version, buffer, size);
+        spi_stat_add(&stats->cache_misses, 1);
+    }
+    
+    spi_stat_add(&stats->proofs_generated, 1);
+    spi_stat_add(&stats->generation_ns, spi_now_ns() - start);
+    return size;
+}
+
+// Check one serialized proof for leaf_index against the snapshot's root and
+// leaf hash. *consumed is the serialized size, so proofs can be read back to
+// back. Returns false only for malformed input.
+static bool spi_check_proof(spi_context_t* ctx, const merkle_snapshot_t* snapshot, uint64_t leaf_index,
+                            const uint8_t* data, uint64_t size, uint64_t* consumed, bool* valid) {
+    uint64_t start = spi_now_ns();
+    uint64_t proof_index = 0;
+    size_t proof_size = 0;
+    
+    if (merkle_snapshot_check_serialized(snapshot, data, size, &proof_index, &proof_size, valid) != MERKLE_SUCCESS) {
+        *valid = false;
+        return false;
+    }
+    *consumed = proof_size;
+    *valid = *valid && proof_index == leaf_index;
+    
+    spi_stats_shard_t* stats = spi_stats_local(ctx);
+    spi_stat_add(&stats->proofs_verified, 1);
+    spi_stat_add(&stats->verification_ns, spi_now_ns() - start);
+    return true;
+}
+
+// Batches are walked in ascending leaf order so consecutive proofs share
+// the top of their paths and touch neighbouring nodes, then split into
+// contiguous ranges of that order across threads. Every proof keeps its
+// request position: proof i lives at offset i, result i answers index i.
+typedef struct {
+    uint64_t leaf_index;
+    uint64_t position;
+} spi_batch_key_t;
+
+typedef struct {
+    spi_context_t* ctx;
+    const merkle_snapshot_t* snapshot;
+    const uint64_t* leaf_indices;
+    const uint64_t* order;          // Positions in leaf order; NULL if already ascending
+    uint8_t* proofs_out;            // Generation: fixed-size slots
+    const uint8_t* proofs_in;       // Verification: proof i spans offsets[i]..offsets[i + 1]
+    const uint64_t* offsets;
+    bool* results;
+    uint64_t begin;
+    uint64_t end;
+    bool ok;
+} spi_batch_range_t;
+
+static int spi_batch_key_compare(const void* a, const void* b) {
+    const spi_batch_key_t* x = (const spi_batch_key_t*)a;
+    const spi_batch_key_t* y = (const spi_batch_key_t*)b;
+    
+    if (x->leaf_index != y->leaf_index) {
+        return x->leaf_index < y->leaf_index ? -1 : 1;
+    }
+    return x->position < y->position ? -1 : (x->position > y->position);
+}
+
+// Request positions sorted by leaf index. *order stays NULL when the
+// indices already ascend; returns false only if allocation fails.
+static bool spi_batch_order(const uint64_t* leaf_indices, uint64_t count, uint64_t** order) {
+    *order = NULL;
+    
+    uint64_t i = 1;
+    while (i < count && leaf_indices[i - 1] <= leaf_indices[i]) {
+        i++;
+    }
+    if (i >= count) {
+        return true;
+    }
+    
+    spi_batch_key_t* keys = (spi_batch_key_t*)malloc(count * sizeof(spi_batch_key_t));
+    uint64_t* positions = (uint64_t*)malloc(count * sizeof(uint64_t));
+    if (!keys || !positions) {
+        free(keys);
+        free(positions);
+        return false;
+    }
+    
+    for (i = 0; i < count; i++) {
+        keys[i].leaf_index = leaf_indices[i];
+        keys[i].position = i;
+    }
+    qsort(keys, count, sizeof(spi_batch_key_t), spi_batch_key_compare);
+    for (i = 0; i < count; i++) {
+        positions[i] = keys[i].position;
+    }
+    
+    free(keys);
+    *order = positions;
+    return true;
+}
+
+static void* spi_batch_generate_range(void* arg) {
+    spi_batch_range_t* range = (spi_batch_range_t*)arg;
+    uint64_t start = spi_now_ns();
+    uint64_t count = range->end - range->begin;
+    
+    merkle_error_t err;
+    if (range->order) {
+        err = merkle_snapshot_serialize_proofs(range->snapshot, range->leaf_indices, range->order + range->begin,
+                                               count, range->proofs_out);
+    } else {
+        size_t proof_size = merkle_proof_serialized_size(merkle_tree_proof_siblings(range->snapshot->tree));
+        err = merkle_snapshot_serialize_proofs(range->snapshot, range->leaf_indices + range->begin, NULL, count,
+                                               range->proofs_out + range->begin * proof_size);
+    }
+    range->ok = err == MERKLE_SUCCESS;
+    
+    if (range->ok) {
+        spi_stats_shard_t* stats = spi_stats_local(range->ctx);
+        spi_stat_add(&stats->proofs_generated, count);
+        spi_stat_add(&stats->generation_ns, spi_now_ns() - start);
+    }
+    return NULL;
+}
+
+static void* spi_batch_verify_range(void* arg) {
+    spi_batch_range_t* range = (spi_batch_range_t*)arg;
+    uint64_t start = spi_now_ns();
+    
+    range->ok = true;
+    for (uint64_t k = range->begin; k < range->end; k++) {
+        uint64_t i = range->order ? range->order[k] : k;
+        uint64_t proof_index = 0;
+        bool valid = false;
+        
+        if (merkle_snapshot_check_serialized(range->snapshot, range->proofs_in + range->offsets[i],
+                                             range->offsets[i + 1] - range->offsets[i], &proof_index,
+                                             NULL, &valid) != MERKLE_SUCCESS) {
+            range->ok = false;
+            valid = false;
+        }
+        range->results[i] = valid && proof_index == range->leaf_indices[i];
+    }
+    
+    spi_stats_shard_t* stats = spi_stats_local(range->ctx);
+    spi_stat_add(&stats->proofs_verified, range->end - range->begin);
+    spi_stat_add(&stats->verification_ns, spi_now_ns() - start);
+    return NULL;
+}
+
+// Run fn over [0, count) of the batch in contiguous ranges, one per thread;
+// the caller takes the first range. A thread that cannot be started has
+// its range run by the caller instead.
+static bool spi_batch_run(void* (*fn)(void*), const spi_batch_range_t* batch, uint64_t count) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t num_threads = count / SPI_BATCH_MIN_PER_THREAD;
+    if (num_threads > (uint64_t)(cpus > 0 ? cpus : 1)) num_threads = (uint64_t)(cpus > 0 ? cpus : 1);
+    if (num_threads > SPI_BATCH_MAX_THREADS) num_threads = SPI_BATCH_MAX_THREADS;
+    if (num_threads == 0) num_threads = 1;
+    
+    spi_batch_range_t ranges[SPI_BATCH_MAX_THREADS];
+    pthread_t threads[SPI_BATCH_MAX_THREADS];
+    bool started[SPI_BATCH_MAX_THREADS] = {false};
+    
+    for (uint64_t t = 0; t < num_threads; t++) {
+        ranges[t] = *batch;
+        ranges[t].begin = count * t / num_threads;
+        ranges[t].end = count * (t + 1) / num_threads;
+        ranges[t].ok = false;
+        if (t > 0) {
+            started[t] = pthread_create(&threads[t], NULL, fn, &ranges[t]) == 0;
+        }
+    }
+    
+    bool ok = true;
+    for (uint64_t t = 0; t < num_threads; t++) {
+        if (started[t]) {
+            pthread_join(threads[t], NULL);
+        } else {
+            fn(&ranges[t]);
+        }
+        ok &= ranges[t].ok;
+    }
+    return ok;
+}
+
+// Write count proofs, proof i at out + i * merkle_proof_serialized_size(siblings).
+// Indices must be in range.
+static bool spi_batch_generate(spi_context_t* ctx, const merkle_snapshot_t* snapshot,
+                               const uint64_t* leaf_indices, uint64_t count, uint8_t* out) {
+    uint64_t* order = NULL;
+    if (!spi_batch_order(leaf_indices, count, &order)) {
+        return false;
+    }
+    
+    spi_batch_range_t batch = {
+        .ctx = ctx, .snapshot = snapshot, .leaf_indices = leaf_indices, .order = order, .proofs_out = out
+    };
+    bool ok = spi_batch_run(spi_batch_generate_range, &batch, count);
+    
+    free(order);
+    return ok;
+}
+
+// Check count proofs, proof i spanning offsets[i]..offsets[i + 1] of proofs.
+// Returns false if any proof is malformed; its result is then false too.
+static bool spi_batch_verify(spi_context_t* ctx, const merkle_snapshot_t* snapshot, const uint64_t* leaf_indices,
+                             const uint8_t* proofs, const uint64_t* offsets, uint64_t count, bool* results) {
+    uint64_t* order = NULL;
+    if (!spi_batch_order(leaf_indices, count, &order)) {
+        return false;
+    }
+    
+    spi_batch_range_t batch = {
+        .ctx = ctx, .snapshot = snapshot, .leaf_indices = leaf_indices, .order = order,
+        .proofs_in = proofs, .offsets = offsets, .results = results
+    };
+    bool ok = spi_batch_run(spi_batch_verify_range, &batch, count);
+    
+    free(order);
+    return ok;
+}
+
+static void spi_fill_tree_info(uint64_t tree_id, const merkle_snapshot_t* snapshot, spi_tree_info_t* info) {
+    memset(info, 0, sizeof(*info));
+    info->tree_id = tree_id;
+    info->num_leaves = snapshot->tree->num_leaves;
+    info->depth = snapshot->tree->depth;
+    info->hash_type = (uint8_t)snapshot->tree->hash_type;
+    info->arity = snapshot->tree->arity;
+    info->version = snapshot->version;
+    memcpy(info->root_hash, snapshot->root->hash, SHA256_HASH_SIZE);
+}
+
+static spi_response_status_t spi_handle_proof(spi_context_t* ctx, const merkle_snapshot_t* snapshot,
+                                              const spi_request_t* request, spi_response_t* response) {
+    if (request->leaf_index >= snapshot->tree->num_leaves) {
+        return SPI_RESPONSE_ERROR_INVALID_REQUEST;
+    }
+    
+    uint64_t size = merkle_proof_serialized_size(merkle_tree_proof_siblings(snapshot->tree));
+    response->proof_data = (uint8_t*)malloc(size);
+    if (!response->proof_data) {
+        return SPI_RESPONSE_ERROR_OUT_OF_MEMORY;
+    }
+    
+    response->proof_size = spi_write_proof(ctx, request->tree_id, snapshot, request->leaf_index,
+                                           response->proof_data, size);
+    return response->proof_size > 0 ? SPI_RESPONSE_SUCCESS : SPI_RESPONSE_ERROR_OUT_OF_MEMORY;
+}
+
+static spi_response_status_t spi_handle_verify(spi_context_t* ctx, const merkle_snapshot_t* snapshot,
+                                               const spi_request_t* request, spi_response_t* response) {
+    if (!request->leaf_data || request->leaf_data_size == 0) {
+        return SPI_RESPONSE_ERROR_INVALID_REQUEST;
     }
     
-    // Allocate response
-    spi_response_t* response = (spi_response_t*)malloc(sizeof(spi_response_t));
+    uint64_t consumed = 0;
+    bool valid = false;
+    if (!spi_check_proof(ctx, snapshot, request->leaf_index, request->leaf_data,
+                         request->leaf_data_size, &consumed, &valid)) {
+        return SPI_RESPONSE_ERROR_INVALID_PROOF;
+    }
+    
+    response->verification_result = valid ? 1 : 0;
+    return SPI_RESPONSE_SUCCESS;
+}
+
+// Batch proofs are written back to back in request order; batch_results[i]
+// holds each size
+static spi_response_status_t spi_handle_batch_proof(spi_context_t* ctx, const merkle_snapshot_t* snapshot,
+                                                    const spi_request_t* request, spi_response_t* response) {
+    if (request->batch_size == 0) {
+        return SPI_RESPONSE_ERROR_INVALID_REQUEST;
+    }
+    
+    // Refuse up front a batch whose response frame (header, one size per
+    // proof, then the proofs) could never be sent, before building any of it
+    uint64_t per_proof = merkle_proof_serialized_size(merkle_tree_proof_siblings(snapshot->tree));
+    if (request->batch_size > (SPI_WIRE_MAX_FRAME - SPI_WIRE_HEADER_SIZE) / (sizeof(uint64_t) + per_proof)) {
+        return SPI_RESPONSE_ERROR_INVALID_REQUEST;
+    }
+    for (uint64_t i = 0; i < request->batch_size; i++) {
+        if (request->leaf_indices[i] >= snapshot->tree->num_leaves) {
+            return SPI_RESPONSE_ERROR_INVALID_REQUEST;
+        }
+    }
+    
+    response->proof_data = (uint8_t*)malloc(per_proof * request->batch_size);
+    if (!response->proof_data) {
+        return SPI_RESPONSE_ERROR_OUT_OF_MEMORY;
+    }
+    
+    if (!spi_batch_generate(ctx, snapshot, request->leaf_indices, request->batch_size, response->proof_data)) {
+        return SPI_RESPONSE_ERROR_OUT_OF_MEMORY;
+    }
+    for (uint64_t i = 0; i < request->batch_size; i++) {
+        response->batch_results[i] = per_proof;
+    }
+    
+    response->proof_size = per_proof * request->batch_size;
+    return SPI_RESPONSE_SUCCESS;
+}
+
+// leaf_data carries batch_size serialized proofs back to back; their sizes
+// come from each header
+static spi_response_status_t spi_handle_batch_verify(spi_context_t* ctx, const merkle_snapshot_t* snapshot,
+                                                     const spi_request_t* request, spi_response_t* response) {
+    if (request->batch_size == 0 || !request->leaf_data) {
+        return SPI_RESPONSE_ERROR_INVALID_REQUEST;
+    }
+    
+    uint64_t count = request->batch_size;
+    uint64_t* offsets = (uint64_t*)malloc((count + 1) * sizeof(uint64_t));
+    bool* results = (bool*)malloc(count * sizeof(bool));
+    if (!offsets || !results) {
+        free(offsets);
+        free(results);
+        return SPI_RESPONSE_ERROR_OUT_OF_MEMORY;
+    }
+    
+    spi_response_status_t status = SPI_RESPONSE_SUCCESS;
+    uint64_t header_size = merkle_proof_serialized_size(0);
+    offsets[0] = 0;
+    for (uint64_t i = 0; i < count && status == SPI_RESPONSE_SUCCESS; i++) {
+        uint32_t num_siblings = 0;
+        if (request->leaf_data_size - offsets[i] < header_size) {
+            status = SPI_RESPONSE_ERROR_INVALID_PROOF;
+            break;
+        }
+        memcpy(&num_siblings, request->leaf_data + offsets[i] + SHA256_HASH_SIZE + sizeof(uint64_t),
+               sizeof(uint32_t));
+        if (num_siblings > MERKLE_MAX_PROOF_SIBLINGS) {
+            status = SPI_RESPONSE_ERROR_INVALID_PROOF;
+            break;
+        }
+        offsets[i + 1] = offsets[i] + merkle_proof_serialized_size(num_siblings);
+        if (offsets[i + 1] > request->leaf_data_size) {
+            status = SPI_RESPONSE_ERROR_INVALID_PROOF;
+        }
+    }
+    
+    if (status == SPI_RESPONSE_SUCCESS &&
+        !spi_batch_verify(ctx, snapshot, request->leaf_indices, request->leaf_data, offsets, count, results)) {
+        status = SPI_RESPONSE_ERROR_INVALID_PROOF;
+    }
+    
+    if (status == SPI_RESPONSE_SUCCESS) {
+        bool all_valid = true;
+        for (uint64_t i = 0; i < count; i++) {
+            response->batch_results[i] = results[i] ? 1 : 0;
+            all_valid &= results[i];
+        }
+        response->verification_result = all_valid ? 1 : 0;
+    }
+    
+    free(offsets);
+    free(results);
+    return status;
+}
+
+static spi_response_status_t spi_handle_tree_info(const merkle_snapshot_t* snapshot, const spi_request_t* request,
+                                                  spi_response_t* response) {
+    spi_tree_info_t* info = (spi_tree_info_t*)malloc(sizeof(spi_tree_info_t));
+    if (!info) {
+        return SPI_RESPONSE_ERROR_OUT_OF_MEMORY;
+    }
+    
+    spi_fill_tree_info(request->tree_id, snapshot, info);
+    response->proof_data = (uint8_t*)info;
+    response->proof_size = sizeof(spi_tree_info_t);
+    return SPI_RESPONSE_SUCCESS;
+}
+
+static bool spi_is_batch_request(const spi_request_t* request) {
+    return request->request_type == SPI_REQUEST_BATCH_GENERATION ||
+           request->request_type == SPI_REQUEST_BATCH_VERIFICATION;
+}
+
+// One allocation holds the header and batch_size result slots
+spi_response_t* spi_response_create(uint32_t request_id, uint64_t batch_size) {
+    spi_response_t* response = (spi_response_t*)malloc(sizeof(spi_response_t) + batch_size * sizeof(uint64_t));
     if (!response) {
         return NULL;
     }
     
-    // Initialize response
     memset(response, 0, sizeof(spi_response_t));
-    response->request_id = request->request_id;
+    response->request_id = request_id;
     response->status = SPI_RESPONSE_SUCCESS;
+    if (batch_size > 0) {
+        response->batch_size = batch_size;
+        response->batch_results = (uint64_t*)(response + 1);
+        memset(response->batch_results, 0, batch_size * sizeof(uint64_t));
+    }
+    return response;
+}
+
+spi_response_t* spi_process_request(spi_context_t* ctx, spi_request_t* request) {
+    if (!ctx || !request || !spi_is_initialized()) {
+        return NULL;
+    }
+    
+    uint64_t start = spi_now_ns();
     
     // Validate request
-    if (!spi_validate_request(request)) {
+    bool valid = spi_validate_request(request);
+    spi_response_t* response = spi_response_create(request->request_id,
+                                                   valid && spi_is_batch_request(request) ? request->batch_size : 0);
+    if (!response) {
+        return NULL;
+    }
+    
+    if (!valid) {
         response->status = SPI_RESPONSE_ERROR_INVALID_REQUEST;
         return response;
     }
     
+    // Every request type only reads, so the whole request runs on one snapshot
+    merkle_snapshot_t snapshot;
+    spi_tree_handle_t* handle = spi_acquire_tree(ctx, request->tree_id, &snapshot);
+    
     // Process based on request type
-    switch (request->request_type) {
-        case SPI_REQUEST_PROOF_GENERATION:
-            response->status = SPI_RESPONSE_ERROR_NOT_IMPLEMENTED;
-            break;
+    if (!handle) {
+        response->status = SPI_RESPONSE_ERROR_INVALID_TREE;
+    } else {
+        switch (request->request_type) {
+            case SPI_REQUEST_PROOF_GENERATION:
+                response->status = spi_handle_proof(ctx, &snapshot, request, response);
+                break;
             
-        case SPI_REQUEST_PROOF_VERIFICATION:
-            response->status = SPI_RESPONSE_ERROR_NOT_IMPLEMENTED;
-            break;
+            case SPI_REQUEST_PROOF_VERIFICATION:
+                response->status = spi_handle_verify(ctx, &snapshot, request, response);
+                break;
             
-        case SPI_REQUEST_BATCH_GENERATION:
-            response->status = SPI_RESPONSE_ERROR_NOT_IMPLEMENTED;
-            break;
+            case SPI_REQUEST_BATCH_GENERATION:
+                response->status = spi_handle_batch_proof(ctx, &snapshot, request, response);
+                break;
             
-        case SPI_REQUEST_BATCH_VERIFICATION:
-            response->status = SPI_RESPONSE_ERROR_NOT_IMPLEMENTED;
-            break;
+            case SPI_REQUEST_BATCH_VERIFICATION:
+                response->status = spi_handle_batch_verify(ctx, &snapshot, request, response);
+                break;
             
-        case SPI_REQUEST_TREE_INFO:
-            response->status = SPI_RESPONSE_ERROR_NOT_IMPLEMENTED;
-            break;
+            case SPI_REQUEST_TREE_INFO:
+                response->status = spi_handle_tree_info(&snapshot, request, response);
+                break;
             
-        default:
-            response->status = SPI_RESPONSE_ERROR_INVALID_REQUEST;
-            break;
+            default:
+                response->status = SPI_RESPONSE_ERROR_INVALID_REQUEST;
+                break;
+        }
+        response->memory_used = snapshot.tree->memory_live_bytes;
+        spi_release_tree(handle, &snapshot);
+    }
+    
+    // Failed requests return no payload
+    if (response->status != SPI_RESPONSE_SUCCESS && response->proof_data) {
+        free(response->proof_data);
+        response->proof_data = NULL;
+        response->proof_size = 0;
     }
     
     // Update statistics
-    ctx->total_requests_processed++;
+    spi_stat_add(&spi_stats_local(ctx)->requests, 1);
+    response->processing_time_ns = spi_now_ns() - start;
     
     return response;
 }
@@ -98,48 +638,272 @@ void spi_free_response(spi_response_t* response) {
         if (response->proof_data) {
             free(response->proof_data);
         }
-        free(response);
+        free(response);  // Batch results included
     }
 }
 
 // High-level API implementations
 spi_tree_info_t* spi_create_tree(spi_context_t* ctx, uint64_t num_leaves, uint8_t hash_type) {
-    if (!ctx || num_leaves == 0 || hash_type >= 2) {
+    if (!ctx || !spi_is_initialized() || num_leaves == 0 || num_leaves > ctx->max_tree_size ||
+        hash_type >= HASH_CUSTOM) {
         return NULL;
     }
     
+    // Proofs and updates only need the leaf hashes, so the leaves are not kept
+    merkle_tree_t* tree = merkle_tree_create(num_leaves, (hash_type_t)hash_type);
+    if (!tree || merkle_tree_set_leaf_storage(tree, MERKLE_LEAVES_HASH_ONLY) != MERKLE_SUCCESS) {
+        merkle_tree_destroy(tree);
+        return NULL;
+    }
+    
+    // Start from all-zero leaves so the tree is immediately provable; the
+    // tree is private until registered, so this needs no lock
+    size_t data_size = num_leaves * tree->leaf_data_size;
+    uint8_t* zeros = (uint8_t*)calloc(1, data_size);
     spi_tree_info_t* info = (spi_tree_info_t*)malloc(sizeof(spi_tree_info_t));
-    if (!info) {
+    
+    if (!zeros || !info || merkle_tree_build(tree, zeros, data_size) != MERKLE_SUCCESS) {
+        free(zeros);
+        free(info);
+        merkle_tree_destroy(tree);
         return NULL;
     }
+    free(zeros);
+    
+    // Fill in before publishing: once registered another thread may update it
+    merkle_snapshot_t snapshot = { tree->root, tree, 1, 0 };
+    spi_fill_tree_info(0, &snapshot, info);
     
-    info->tree_id = (uint64_t)rand();  // Simple ID generation
-    info->num_leaves = num_leaves;
-    info->depth = 0;  // Calculate depth
-    info->hash_type = hash_type;
+    info->tree_id = spi_registry_add(ctx->trees, tree);
+    if (info->tree_id == 0) {
+        free(info);
+        merkle_tree_destroy(tree);
+        return NULL;
+    }
     
     return info;
 }
 
 bool spi_destroy_tree(spi_context_t* ctx, uint64_t tree_id) {
-    if (!ctx || tree_id == 0) {
+    if (!ctx || tree_id == 0 || !spi_is_initialized()) {
         return false;
     }
     
-    // Implementation would destroy tree resources
-    return true;
+    // Requests already holding the tree finish first; the last one frees it
+    return spi_registry_remove(ctx->trees, tree_id);
 }
 
 bool spi_update_tree_data(spi_context_t* ctx, uint64_t tree_id, const uint8_t* data, uint64_t size) {
-    if (!ctx || tree_id == 0 || !data || size == 0) {
+    if (!ctx || tree_id == 0 || !data || size == 0 || !spi_is_initialized()) {
         return false;
     }
     
-    // Implementation would update tree data
+    merkle_snapshot_t snapshot;
+    spi_tree_handle_t* handle = spi_acquire_tree(ctx, tree_id, &snapshot);
+    if (!handle) {
+        return false;
+    }
+    
+    // Build the replacement off to the side; readers keep using the current
+    // version until the finished tree is published
+    uint64_t num_leaves = snapshot.tree->num_leaves;
+    hash_type_t hash_type = snapshot.tree->hash_type;
+    uint8_t arity = snapshot.tree->arity;
+    size_t leaf_size = snapshot.tree->leaf_data_size;
+    merkle_mvcc_unpin(handle->tree, &snapshot);
+    
+    // Same shape as the tree it replaces
+    merkle_tree_t* tree = size == num_leaves * leaf_size ? merkle_tree_create_kary(num_leaves, hash_type, arity) : NULL;
+    if (tree) {
+        tree->leaf_data_size = leaf_size;
+    }
+    bool updated = tree &&
+                   merkle_tree_set_leaf_storage(tree, MERKLE_LEAVES_HASH_ONLY) == MERKLE_SUCCESS &&
+                   merkle_tree_build(tree, data, size) == MERKLE_SUCCESS &&
+                   merkle_mvcc_replace(handle->tree, tree) == MERKLE_SUCCESS;
+    if (!updated) {
+        merkle_tree_destroy(tree);
+    }
+    
+    spi_tree_handle_release(handle);
+    return updated;
+}
+
+bool spi_update_leaf(spi_context_t* ctx, uint64_t tree_id, uint64_t leaf_index,
+                     const uint8_t* data, uint64_t size) {
+    if (!ctx || tree_id == 0 || !data || !spi_is_initialized()) {
+        return false;
+    }
+    
+    spi_tree_handle_t* handle = spi_registry_acquire(ctx->trees, tree_id);
+    if (!handle) {
+        return false;
+    }
+    
+    // The tree checks size against its own leaf size
+    bool updated = merkle_mvcc_update_record(handle->tree, leaf_index, data, size) == MERKLE_SUCCESS;
+    
+    spi_tree_handle_release(handle);
+    return updated;
+}
+
+bool spi_get_tree_info(spi_context_t* ctx, uint64_t tree_id, spi_tree_info_t* info) {
+    if (!ctx || !info || !spi_is_initialized()) {
+        return false;
+    }
+    
+    merkle_snapshot_t snapshot;
+    spi_tree_handle_t* handle = spi_acquire_tree(ctx, tree_id, &snapshot);
+    if (!handle) {
+        return false;
+    }
+    
+    spi_fill_tree_info(tree_id, &snapshot, info);
+    spi_release_tree(handle, &snapshot);
     return true;
 }
 
+// Proof operations
+bool spi_generate_proof(spi_context_t* ctx, uint64_t tree_id, uint64_t leaf_index,
+                       uint8_t* proof_data, uint64_t* proof_size) {
+    if (!ctx || !proof_data || !proof_size || !spi_is_initialized()) {
+        return false;
+    }
+    
+    merkle_snapshot_t snapshot;
+    spi_tree_handle_t* handle = spi_acquire_tree(ctx, tree_id, &snapshot);
+    if (!handle) {
+        return false;
+    }
+    
+    uint64_t size = 0;
+    if (leaf_index < snapshot.tree->num_leaves) {
+        size = spi_write_proof(ctx, tree_id, &snapshot, leaf_index, proof_data, *proof_size);
+    }
+    spi_release_tree(handle, &snapshot);
+    
+    if (size == 0) {
+        return false;
+    }
+    
+    *proof_size = size;
+    return true;
+}
+
+bool spi_verify_proof(spi_context_t* ctx, uint64_t tree_id, uint64_t leaf_index,
+                     const uint8_t* proof_data, uint64_t proof_size, bool* result) {
+    if (!ctx || !proof_data || !result || !spi_is_initialized()) {
+        return false;
+    }
+    
+    merkle_snapshot_t snapshot;
+    spi_tree_handle_t* handle = spi_acquire_tree(ctx, tree_id, &snapshot);
+    if (!handle) {
+        return false;
+    }
+    
+    uint64_t consumed = 0;
+    bool ok = spi_check_proof(ctx, &snapshot, leaf_index, proof_data, proof_size, &consumed, result);
+    
+    spi_release_tree(handle, &snapshot);
+    return ok;
+}
+
+// Batch operations. Proofs are fixed-size per tree, so proof i of a batch
+// sits at i * (total / num_indices) in proofs_data. *total_proof_size is
+// the buffer capacity on entry and the bytes written (or needed) on return.
+bool spi_generate_proofs_batch(spi_context_t* ctx, uint64_t tree_id,
+                              uint64_t* leaf_indices, uint64_t num_indices,
+                              uint8_t* proofs_data, uint64_t* total_proof_size) {
+    if (!ctx || !leaf_indices || !proofs_data || !total_proof_size || num_indices == 0 ||
+        num_indices > SPI_MAX_BATCH_SIZE || !spi_is_initialized()) {
+        return false;
+    }
+    
+    merkle_snapshot_t snapshot;
+    spi_tree_handle_t* handle = spi_acquire_tree(ctx, tree_id, &snapshot);
+    if (!handle) {
+        return false;
+    }
+    
+    bool ok = true;
+    for (uint64_t i = 0; i < num_indices && ok; i++) {
+        ok = leaf_indices[i] < snapshot.tree->num_leaves;
+    }
+    
+    uint64_t needed = merkle_proof_serialized_size(merkle_tree_proof_siblings(snapshot.tree)) * num_indices;
+    if (ok && *total_proof_size < needed) {
+        *total_proof_size = needed;
+        ok = false;
+    }
+    if (ok) {
+        ok = spi_batch_generate(ctx, &snapshot, leaf_indices, num_indices, proofs_data);
+    }
+    spi_release_tree(handle, &snapshot);
+    
+    if (ok) {
+        *total_proof_size = needed;
+    }
+    return ok;
+}
+
+// proofs_data holds num_proofs proofs back to back, proof_sizes[i] bytes
+// each; results[i] answers leaf_indices[i]. Returns false if the tree is
+// unknown or any proof is malformed.
+bool spi_verify_proofs_batch(spi_context_t* ctx, uint64_t tree_id,
+                            uint64_t* leaf_indices, uint8_t* proofs_data,
+                            uint64_t* proof_sizes, uint64_t num_proofs,
+                            bool* results) {
+    if (!ctx || !leaf_indices || !proofs_data || !proof_sizes || !results || num_proofs == 0 ||
+        num_proofs > SPI_MAX_BATCH_SIZE || !spi_is_initialized()) {
+        return false;
+    }
+    
+    uint64_t* offsets = (uint64_t*)malloc((num_proofs + 1) * sizeof(uint64_t));
+    if (!offsets) {
+        return false;
+    }
+    offsets[0] = 0;
+    for (uint64_t i = 0; i < num_proofs; i++) {
+        offsets[i + 1] = offsets[i] + proof_sizes[i];
+    }
+    
+    merkle_snapshot_t snapshot;
+    spi_tree_handle_t* handle = spi_acquire_tree(ctx, tree_id, &snapshot);
+    if (!handle) {
+        free(offsets);
+        return false;
+    }
+    
+    bool ok = spi_batch_verify(ctx, &snapshot, leaf_indices, proofs_data, offsets, num_proofs, results);
+    
+    spi_release_tree(handle, &snapshot);
+    free(offsets);
+    return ok;
+}
+
 // Performance monitoring
+spi_stats_t spi_get_stats(spi_context_t* ctx) {
+    spi_stats_t stats = {0};
+    
+    if (!ctx || !ctx->stats) {
+        return stats;
+    }
+    
+    for (int i = 0; i < SPI_STATS_SHARDS; i++) {
+        spi_stats_shard_t* shard = &ctx->stats[i];
+        stats.total_requests_processed += atomic_load_explicit(&shard->requests, memory_order_relaxed);
+        stats.total_proofs_generated += atomic_load_explicit(&shard->proofs_generated, memory_order_relaxed);
+        stats.total_proofs_verified += atomic_load_explicit(&shard->proofs_verified, memory_order_relaxed);
+        stats.total_generation_ns += atomic_load_explicit(&shard->generation_ns, memory_order_relaxed);
+        stats.total_verification_ns += atomic_load_explicit(&shard->verification_ns, memory_order_relaxed);
+        stats.proof_cache_hits += atomic_load_explicit(&shard->cache_hits, memory_order_relaxed);
+        stats.proof_cache_misses += atomic_load_explicit(&shard->cache_misses, memory_order_relaxed);
+    }
+    
+    return stats;
+}
+
 spi_performance_metrics_t spi_get_performance_metrics(spi_context_t* ctx) {
     spi_performance_metrics_t metrics = {0};
     
@@ -147,12 +911,28 @@ spi_performance_metrics_t spi_get_performance_metrics(spi_context_t* ctx) {
         return metrics;
     }
     
-    // These would be populated with actual performance data
-    metrics.generation_time_ns = 1000000;  // Placeholder: 1ms
-    metrics.verification_time_ns = 500000; // Placeholder: 0.5ms
-    metrics.memory_usage_mb = 10;          // Placeholder: 10MB
-    metrics.cache_hit_rate = 0.85;         // Placeholder: 85%
-    metrics.throughput_proofs_per_sec = 1000; // Placeholder: 1000 proofs/sec
+    spi_stats_t stats = spi_get_stats(ctx);
+    
+    // Mean time per proof through this context, including serialization
+    if (stats.total_proofs_generated > 0) {
+        metrics.generation_time_ns = stats.total_generation_ns / stats.total_proofs_generated;
+    }
+    if (stats.total_proofs_verified > 0) {
+        metrics.verification_time_ns = stats.total_verification_ns / stats.total_proofs_verified;
+    }
+    merkle_memory_stats_t memory = merkle_memory_get_global_stats();
+    uint64_t live_bytes = memory.total_live_bytes > 0 ? (uint64_t)memory.total_live_bytes : 0;
+    metrics.memory_usage_mb = (live_bytes + (1024 * 1024 - 1)) / (1024 * 1024);
+    
+    uint64_t lookups = stats.proof_cache_hits + stats.proof_cache_misses;
+    if (lookups > 0) {
+        metrics.cache_hit_rate = (double)stats.proof_cache_hits / (double)lookups;
+    }
+    
+    // Per-thread proof rate: generation time is summed across threads
+    if (stats.total_generation_ns > 0) {
+        metrics.throughput_proofs_per_sec = stats.total_proofs_generated * 1000000000ULL / stats.total_generation_ns;
+    }
     
     return metrics;
 }
@@ -163,8 +943,9 @@ void spi_reset_performance_metrics(spi_context_t* ctx) {
     }
     
     // Reset performance counters
-    ctx->total_proofs_generated = 0;
-    ctx->total_proofs_verified = 0;
+    if (ctx->stats) {
+        spi_stats_clear(ctx->stats);
+    }
     ctx->performance_score = 0;
 }
 
@@ -200,6 +981,10 @@ bool spi_validate_request(const spi_request_t* request) {
         return false;
     }
     
+    if (spi_is_batch_request(request) && (request->batch_size == 0 || !request->leaf_indices)) {
+        return false;
+    }
+    
     if (request->leaf_index >= SPI_MAX_TREE_SIZE) {
         return false;
     }
@@ -245,52 +1030,17 @@ void spi_set_error_callback(void (*error_callback)(const char* error_msg)) {
     // Implementation would store this in a global variable
 }
 
-// JSON-RPC wrapper (simplified implementation)
-const char* spi_jsonrpc_process_request(const char* json_request) {
-    if (!json_request) {
-        return "{\"error\": \"Invalid request\"}";
-    }
-    
-    // This is a very simplified JSON-RPC implementation
-    // In a real implementation, you would parse JSON and call appropriate functions
-    
-    static char response[1024];
-    snprintf(response, sizeof(response), 
-             "{\"jsonrpc\": \"2.0\", \"result\": \"Request processed\", \"id\": 1}");
-    
-    return response;
-}
-
-// gRPC server (simplified implementation)
-bool spi_grpc_server_start(uint16_t port) {
-    // Simplified gRPC server startup
-    // In reality, this would initialize a gRPC server
-    
-    printf("gRPC server would start on port %u\n", port);
-    return true;
-}
-
-void spi_grpc_server_stop(void) {
-    // Simplified gRPC server shutdown
-    printf("gRPC server stopped\n");
-}
-
-bool spi_grpc_process_batch(spi_request_t* requests, spi_response_t* responses, uint64_t count) {
-    if (!requests || !responses || count == 0) {
+bool spi_process_batch(spi_context_t* ctx, spi_request_t* requests, spi_response_t** responses, uint64_t count) {
+    if (!ctx || !requests || !responses || count == 0) {
         return false;
     }
     
-    // Process batch of requests
+    // Responses are handed over by pointer; the caller frees each one
+    bool ok = true;
     for (uint64_t i = 0; i < count; i++) {
-        spi_response_t* response = spi_process_request(NULL, &requests[i]);
-        if (response) {
-            responses[i] = *response;
-            free(response);
-        } else {
-            responses[i].status = SPI_RESPONSE_ERROR_INVALID_REQUEST;
-        }
+        responses[i] = spi_process_request(ctx, &requests[i]);
+        ok &= responses[i] != NULL;
     }
     
-    return true;
+    return ok;
 }
-
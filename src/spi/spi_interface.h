@@ -4,10 +4,13 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "../core/merkle_tree.h"
 
 // SPI (Succinct Proof Interface) definitions
 #define SPI_MAX_TREE_SIZE (1ULL << 24)  // 16M leaves maximum
-#define SPI_MAX_BATCH_SIZE 1000         // Maximum batch operations
+#define SPI_MAX_BATCH_SIZE (1ULL << 20) // Maximum operations in one batch request
 #define SPI_MAX_PROOF_SIZE 8192         // Maximum proof size in bytes
 
 // SPI request/response structures
@@ -29,52 +32,77 @@ typedef enum {
     SPI_RESPONSE_ERROR_NOT_IMPLEMENTED = 6
 } spi_response_status_t;
 
-// SPI request structure
+// SPI request structure. Batch indices and verification input are borrowed
+// from the caller for the duration of the request.
 typedef struct {
     uint32_t request_id;                    // Unique request identifier
     spi_request_type_t request_type;        // Type of request
     uint64_t tree_id;                       // Tree identifier
     uint64_t leaf_index;                    // Leaf index (for single operations)
     uint64_t batch_size;                    // Number of operations in batch
-    uint64_t leaf_indices[SPI_MAX_BATCH_SIZE]; // Leaf indices for batch operations
-    uint8_t* leaf_data;                     // Leaf data (if provided)
-    uint64_t leaf_data_size;                // Size of leaf data
+    const uint64_t* leaf_indices;           // batch_size leaf indices for batch operations
+    const uint8_t* leaf_data;               // Serialized proof(s) for verification requests
+    uint64_t leaf_data_size;                // Size of leaf_data in bytes
     uint32_t timeout_ms;                    // Request timeout in milliseconds
-    uint8_t reserved[32];                   // Reserved for future use
 } spi_request_t;
 
-// SPI response structure
+// SPI response structure. Batch results live in the same allocation, right
+// after the header, so a single-leaf response is just the header.
 typedef struct {
     uint32_t request_id;                    // Corresponding request identifier
     spi_response_status_t status;           // Response status
     uint64_t processing_time_ns;            // Processing time in nanoseconds
     uint64_t memory_used;                   // Memory used in bytes
     uint64_t proof_size;                    // Size of proof data
-    uint8_t* proof_data;                    // Proof data (if applicable)
+    uint8_t* proof_data;                    // Serialized proof(s), or spi_tree_info_t for TREE_INFO
     uint64_t verification_result;           // Verification result (boolean as 0/1)
-    uint64_t batch_results[SPI_MAX_BATCH_SIZE]; // Batch operation results
-    uint8_t reserved[32];                   // Reserved for future use
+    uint64_t batch_size;                    // Entries in batch_results
+    uint64_t* batch_results;                // Per-proof size (generation) or 0/1 (verification)
 } spi_response_t;
 
+// Tree registry: open-addressing map from tree_id to the tree it owns
+typedef struct spi_tree_registry spi_tree_registry_t;
+
+// Per-thread request counters, summed by spi_get_stats
+typedef struct spi_stats_shard spi_stats_shard_t;
+
+// Serialized proofs of recently requested leaves, keyed by tree version
+typedef struct spi_proof_cache spi_proof_cache_t;
+
 // SPI context structure
 typedef struct {
     uint64_t max_tree_size;                 // Maximum supported tree size
     uint64_t supported_hash_types;          // Bitmask of supported hash types
     uint64_t performance_score;             // Current performance score
-    uint32_t max_concurrent_requests;       // Maximum concurrent requests
-    uint64_t total_requests_processed;      // Total requests processed
-    uint64_t total_proofs_generated;        // Total proofs generated
-    uint64_t total_proofs_verified;         // Total proofs verified
+    uint32_t max_concurrent_requests;       // Admission limit of each spi_async_t
     uint8_t version_major;                  // SPI interface version
     uint8_t version_minor;                  // SPI interface version
     uint8_t version_patch;                  // SPI interface version
-    uint8_t reserved[30];                   // Reserved for future use
+    spi_tree_registry_t* trees;             // Trees created through this context
+    spi_stats_shard_t* stats;               // Request counters, sharded per thread
+    spi_proof_cache_t* proof_cache;         // Single-leaf proofs, shared by all threads
+    uint8_t reserved[22];                   // Reserved for future use
 } spi_context_t;
 
-// SPI interface functions
+// Request counters; totals over all threads since init or the last reset
+typedef struct {
+    uint64_t total_requests_processed;
+    uint64_t total_proofs_generated;
+    uint64_t total_proofs_verified;
+    uint64_t total_generation_ns;           // Time spent producing proofs
+    uint64_t total_verification_ns;         // Time spent verifying proofs
+    uint64_t proof_cache_hits;              // Single-leaf proofs served from the cache
+    uint64_t proof_cache_misses;
+} spi_stats_t;
+
+// SPI interface functions. Every call is safe from any number of threads.
+// Reads of a tree (proofs, verification, info) run against a pinned
+// snapshot and never wait for updates; updates to one tree serialize among
+// themselves and publish a new version. spi_shutdown must not race requests.
 spi_context_t* spi_init(uint64_t max_tree_size);
 void spi_shutdown(spi_context_t* ctx);
 spi_response_t* spi_process_request(spi_context_t* ctx, spi_request_t* request);
+spi_response_t* spi_response_create(uint32_t request_id, uint64_t batch_size);
 void spi_free_response(spi_response_t* response);
 
 // High-level API functions
@@ -83,23 +111,33 @@ typedef struct {
     uint64_t num_leaves;
     uint64_t depth;
     uint8_t hash_type;
-    uint8_t reserved[32];
+    uint8_t arity;                          // Proofs carry depth * (arity - 1) siblings
+    uint8_t root_hash[SHA256_HASH_SIZE];
+    uint64_t version;                       // Bumped by every update
 } spi_tree_info_t;
 
 typedef struct {
     uint64_t generation_time_ns;
     uint64_t verification_time_ns;
     uint64_t memory_usage_mb;
-    double cache_hit_rate;
+    double cache_hit_rate;                  // Proof cache hit rate (0 before any single-leaf proof)
     uint64_t throughput_proofs_per_sec;
 } spi_performance_metrics_t;
 
-// Tree management
+// Tree management. New trees start with all-zero 32-byte leaves. Updating
+// the data replaces every leaf (size must be num_leaves times the tree's
+// leaf size) with a rebuilt tree of the same shape; updating one leaf (one
+// leaf size, any size for a record tree) copies only its path to the root.
 spi_tree_info_t* spi_create_tree(spi_context_t* ctx, uint64_t num_leaves, uint8_t hash_type);
 bool spi_destroy_tree(spi_context_t* ctx, uint64_t tree_id);
 bool spi_update_tree_data(spi_context_t* ctx, uint64_t tree_id, const uint8_t* data, uint64_t size);
+bool spi_update_leaf(spi_context_t* ctx, uint64_t tree_id, uint64_t leaf_index,
+                     const uint8_t* data, uint64_t size);
+bool spi_get_tree_info(spi_context_t* ctx, uint64_t tree_id, spi_tree_info_t* info);
 
-// Proof operations
+// Proof operations. proof_size is the buffer capacity on input and the
+// serialized size on output; verification checks the proof against the
+// tree's current root and leaf hash.
 bool spi_generate_proof(spi_context_t* ctx, uint64_t tree_id, uint64_t leaf_index, 
                        uint8_t* proof_data, uint64_t* proof_size);
 bool spi_verify_proof(spi_context_t* ctx, uint64_t tree_id, uint64_t leaf_index,
@@ -114,17 +152,122 @@ bool spi_verify_proofs_batch(spi_context_t* ctx, uint64_t tree_id,
                             uint64_t* proof_sizes, uint64_t num_proofs,
                             bool* results);
 
+// Asynchronous requests. Submitted requests run on a pool of workers, each
+// with its own bounded lock-free queue that idle workers steal from. A
+// completion goes to the callback (on a worker thread) when one is given,
+// otherwise to a completion queue drained by spi_async_poll. At most
+// max_concurrent_requests are admitted and not yet handed back: submit
+// waits up to wait_ms for room and then fails. A request not started within
+// its timeout_ms of submission completes with SPI_RESPONSE_ERROR_TIMEOUT.
+// The request must stay valid until its completion is delivered; the
+// receiver frees each response with spi_free_response.
+typedef struct spi_async spi_async_t;
+typedef void (*spi_completion_callback_t)(const spi_request_t* request, spi_response_t* response,
+                                          void* user_data);
+
+spi_async_t* spi_async_create(spi_context_t* ctx, uint32_t num_workers,  // 0 workers: one per CPU
+                              spi_completion_callback_t callback, void* user_data);
+void spi_async_destroy(spi_async_t* async);  // Runs what is queued; submitters must have stopped
+bool spi_async_submit(spi_async_t* async, const spi_request_t* request, uint32_t wait_ms);
+size_t spi_async_poll(spi_async_t* async, spi_response_t** responses, size_t max_responses,
+                      uint32_t wait_ms);
+uint32_t spi_async_in_flight(spi_async_t* async);
+
 // Performance monitoring
+spi_stats_t spi_get_stats(spi_context_t* ctx);
 spi_performance_metrics_t spi_get_performance_metrics(spi_context_t* ctx);
 void spi_reset_performance_metrics(spi_context_t* ctx);
 
-// JSON-RPC interface (for web API)
-const char* spi_jsonrpc_process_request(const char* json_request);
+// JSON-RPC 2.0 over the SPI. Methods take named params: create {num_leaves,
+// hash?, data?}, update {tree_id, data, leaf?}, proof {tree_id, leaf},
+// verify {tree_id, leaf, proof}, batch {tree_id, leaves, proofs?} and info
+// {tree_id}; byte strings are hex, or base64 with "encoding":"base64".
+// Batch arrays are supported. The response is appended to out (nothing for
+// notifications) and NUL-terminated; reuse the buffer across calls and
+// release it with spi_json_buffer_free. Returns false only if out could
+// not grow.
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+} spi_json_buffer_t;
+
+bool spi_jsonrpc_process_request(spi_context_t* ctx, const char* json, size_t length, spi_json_buffer_t* out);
+void spi_json_buffer_free(spi_json_buffer_t* buffer);
+
+// Runs count requests in order; the caller frees each response
+bool spi_process_batch(spi_context_t* ctx, spi_request_t* requests, spi_response_t** responses, uint64_t count);
+
+// Binary wire format for the socket server: one length-prefixed frame per
+// request or response, header first, then batch indices/results, then the
+// byte payload, padded to 8 bytes. Native byte order, loopback only.
+#define SPI_WIRE_HEADER_SIZE 48
+#define SPI_WIRE_MAX_FRAME (64u * 1024 * 1024)
+
+size_t spi_wire_frame_size(const uint8_t* header);  // Size of the frame at header, 0 if invalid
+size_t spi_wire_request_size(const spi_request_t* request);
+size_t spi_wire_encode_request(const spi_request_t* request, uint8_t* buffer, size_t capacity);
+bool spi_wire_decode_request(const uint8_t* frame, size_t size, spi_request_t* request);
+size_t spi_wire_response_size(const spi_response_t* response);
+size_t spi_wire_encode_response(const spi_response_t* response, uint8_t* buffer, size_t capacity);
+spi_response_t* spi_wire_decode_response(const uint8_t* frame, size_t size);
+
+// Socket server on a Unix socket or 127.0.0.1. Each reactor thread runs its
+// own epoll loop over the connections it accepted and answers requests
+// inline, in arrival order. Clients may pipeline: every frame read in one
+// wakeup is processed and the responses go out in a single send. A
+// connection whose unsent responses pile up stops being read until they
+// drain; a malformed frame closes it. In JSON-RPC mode each line is one
+// request (or batch) and is answered by one line, unless all notifications.
+typedef struct spi_server spi_server_t;
+typedef struct spi_client spi_client_t;
+
+typedef struct {
+    const char* unix_path;                  // Unix socket path, or NULL for TCP
+    uint16_t port;                          // TCP port when unix_path is NULL; 0 picks a free one
+    uint32_t num_reactors;                  // Server only; 0 means one per CPU
+    bool jsonrpc;                           // Server only; newline-delimited JSON-RPC instead of frames
+} spi_server_config_t;
+
+spi_server_t* spi_server_start(spi_context_t* ctx, const spi_server_config_t* config);
+void spi_server_stop(spi_server_t* server);  // Closes every connection
+uint16_t spi_server_port(const spi_server_t* server);
+
+// Blocking client. Requests queue until flushed (or 64 KB accumulate);
+// receive flushes and returns the next response in request order. Keep the
+// number of unanswered requests bounded, or both ends can block on send.
+spi_client_t* spi_client_connect(const spi_server_config_t* config);
+void spi_client_close(spi_client_t* client);
+bool spi_client_send(spi_client_t* client, const spi_request_t* request);
+bool spi_client_flush(spi_client_t* client);
+spi_response_t* spi_client_receive(spi_client_t* client);
+
+// Tree registry internals. A handle is refcounted: acquire pins it for one
+// request, and a removed tree is destroyed when its last user releases it.
+typedef struct {
+    merkle_mvcc_t* tree;                    // Versioned: read through merkle_mvcc_pin
+    uint64_t tree_id;
+    _Atomic uint32_t refs;
+} spi_tree_handle_t;
+
+spi_tree_registry_t* spi_registry_create(size_t initial_capacity);
+void spi_registry_destroy(spi_tree_registry_t* registry);
+uint64_t spi_registry_add(spi_tree_registry_t* registry, merkle_tree_t* tree);  // Takes a built tree; new ID, 0 on failure
+spi_tree_handle_t* spi_registry_acquire(spi_tree_registry_t* registry, uint64_t tree_id);
+void spi_tree_handle_release(spi_tree_handle_t* handle);
+bool spi_registry_remove(spi_tree_registry_t* registry, uint64_t tree_id);
+size_t spi_registry_count(spi_tree_registry_t* registry);
 
-// gRPC service functions (for high-performance communication)
-bool spi_grpc_server_start(uint16_t port);
-void spi_grpc_server_stop(void);
-bool spi_grpc_process_batch(spi_request_t* requests, spi_response_t* responses, uint64_t count);
+// Proof cache internals. Entries are keyed by (tree_id, leaf_index,
+// version): an update publishes a new version, which changes the root in
+// every proof of the tree, so older entries simply stop matching and are
+// overwritten by the leaf's next proof or reclaimed by CLOCK.
+spi_proof_cache_t* spi_proof_cache_create(size_t entries);
+void spi_proof_cache_destroy(spi_proof_cache_t* cache);
+size_t spi_proof_cache_lookup(spi_proof_cache_t* cache, uint64_t tree_id, uint64_t leaf_index,
+                              uint64_t version, uint8_t* buffer, size_t capacity);
+void spi_proof_cache_insert(spi_proof_cache_t* cache, uint64_t tree_id, uint64_t leaf_index,
+                            uint64_t version, const uint8_t* proof, size_t size);
 
 // Utility functions
 uint32_t spi_calculate_performance_score(const spi_performance_metrics_t* metrics);
@@ -0,0 +1,988 @@
+#include "spi_interface.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define JSON_MAX_DEPTH 64
+#define JSON_BUFFER_MIN_CAPACITY 1024
+
+// JSON-RPC 2.0 error codes. SPI failures map to JSONRPC_SPI_ERROR minus
+// their spi_response_status_t, e.g. -32002 for an unknown tree.
+#define JSONRPC_PARSE_ERROR -32700
+#define JSONRPC_INVALID_REQUEST -32600
+#define JSONRPC_METHOD_NOT_FOUND -32601
+#define JSONRPC_INVALID_PARAMS -32602
+#define JSONRPC_INTERNAL_ERROR -32603
+#define JSONRPC_SPI_ERROR -32000
+
+// Pull tokenizer over the caller's text. Nothing is copied: string tokens
+// point at their contents inside the input, escapes left as written.
+typedef enum {
+    JSON_ERROR = 0,
+    JSON_END,
+    JSON_OBJECT_BEGIN,
+    JSON_OBJECT_END,
+    JSON_ARRAY_BEGIN,
+    JSON_ARRAY_END,
+    JSON_COLON,
+    JSON_COMMA,
+    JSON_STRING,
+    JSON_NUMBER,
+    JSON_TRUE,
+    JSON_FALSE,
+    JSON_NULL
+} json_token_type_t;
+
+typedef struct {
+    json_token_type_t type;
+    const char* start;
+    size_t length;
+} json_token_t;
+
+typedef struct {
+    const char* p;
+    const char* end;
+} json_lexer_t;
+
+// Appends into the caller's buffer; a failed allocation sticks so the
+// writers below need no individual checks
+typedef struct {
+    spi_json_buffer_t* out;
+    bool failed;
+} json_writer_t;
+
+typedef enum {
+    JSONRPC_HEX = 0,
+    JSONRPC_BASE64
+} jsonrpc_encoding_t;
+
+// Named parameters. Their positions are collected in one pass over
+// "params", so members may come in any order.
+typedef enum {
+    PARAM_TREE_ID = 0,
+    PARAM_LEAF,
+    PARAM_NUM_LEAVES,
+    PARAM_HASH,
+    PARAM_DATA,
+    PARAM_ENCODING,
+    PARAM_PROOF,
+    PARAM_LEAVES,
+    PARAM_PROOFS,
+    PARAM_COUNT
+} jsonrpc_param_t;
+
+static const char* const k_param_names[PARAM_COUNT] = {
+    "tree_id", "leaf", "num_leaves", "hash", "data", "encoding", "proof", "leaves", "proofs"
+};
+
+typedef struct {
+    json_lexer_t at[PARAM_COUNT];           // Lexer positioned at each value
+    bool present[PARAM_COUNT];
+} jsonrpc_params_t;
+
+static const char k_hex_digits[] = "0123456789abcdef";
+static const char k_base64_digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Tokenizer
+
+static bool json_match_literal(json_lexer_t* lx, const char* literal, size_t length) {
+    if ((size_t)(lx->end - lx->p) < length || memcmp(lx->p, literal, length) != 0) {
+        return false;
+    }
+    lx->p += length;
+    return true;
+}
+
+static json_token_t json_next(json_lexer_t* lx) {
+    json_token_t token = {JSON_ERROR, NULL, 0};
+    
+    while (lx->p < lx->end && (*lx->p == ' ' || *lx->p == '\t' || *lx->p == '\n' || *lx->p == '\r')) {
+        lx->p++;
+    }
+    if (lx->p >= lx->end) {
+        token.type = JSON_END;
+        return token;
+    }
+    
+    const char* start = lx->p;
+    token.start = start;
+    switch (*start) {
+        case '{': token.type = JSON_OBJECT_BEGIN; lx->p++; break;
+        case '}': token.type = JSON_OBJECT_END; lx->p++; break;
+        case '[': token.type = JSON_ARRAY_BEGIN; lx->p++; break;
+        case ']': token.type = JSON_ARRAY_END; lx->p++; break;
+        case ':': token.type = JSON_COLON; lx->p++; break;
+        case ',': token.type = JSON_COMMA; lx->p++; break;
+        case 't': if (json_match_literal(lx, "true", 4)) token.type = JSON_TRUE; break;
+        case 'f': if (json_match_literal(lx, "false", 5)) token.type = JSON_FALSE; break;
+        case 'n': if (json_match_literal(lx, "null", 4)) token.type = JSON_NULL; break;
+        case '"': {
+            const char* q = start + 1;
+            while (q < lx->end && *q != '"') {
+                if ((unsigned char)*q < 0x20) {
+                    return token;
+                }
+                if (*q == '\\' && ++q >= lx->end) {
+                    return token;
+                }
+                q++;
+            }
+            if (q >= lx->end) {
+                return token;
+            }
+            token.type = JSON_STRING;
+            token.start = start + 1;
+            token.length = (size_t)(q - start - 1);
+            lx->p = q + 1;
+            return token;
+        }
+        default: {
+            const char* q = start;
+            bool digits = false;
+            while (q < lx->end && *q && strchr("-+.eE0123456789", *q)) {
+                digits |= *q >= '0' && *q <= '9';
+                q++;
+            }
+            if (!digits) {
+                return token;
+            }
+            token.type = JSON_NUMBER;
+            lx->p = q;
+            break;
+        }
+    }
+    
+    token.length = (size_t)(lx->p - start);
+    return token;
+}
+
+static json_token_t json_peek(const json_lexer_t* lx) {
+    json_lexer_t copy = *lx;
+    return json_next(&copy);
+}
+
+static bool json_token_is(json_token_t token, const char* text) {
+    size_t length = strlen(text);
+    return token.length == length && memcmp(token.start, text, length) == 0;
+}
+
+// Consume one complete value, checking its syntax
+static bool json_skip_value(json_lexer_t* lx, int depth) {
+    json_token_t token = json_next(lx);
+    
+    switch (token.type) {
+        case JSON_STRING:
+        case JSON_NUMBER:
+        case JSON_TRUE:
+        case JSON_FALSE:
+        case JSON_NULL:
+            return true;
+        
+        case JSON_OBJECT_BEGIN:
+            if (depth >= JSON_MAX_DEPTH) return false;
+            if (json_peek(lx).type == JSON_OBJECT_END) {
+                json_next(lx);
+                return true;
+            }
+            for (;;) {
+                if (json_next(lx).type != JSON_STRING || json_next(lx).type != JSON_COLON ||
+                    !json_skip_value(lx, depth + 1)) {
+                    return false;
+                }
+                token = json_next(lx);
+                if (token.type == JSON_OBJECT_END) return true;
+                if (token.type != JSON_COMMA) return false;
+            }
+        
+        case JSON_ARRAY_BEGIN:
+            if (depth >= JSON_MAX_DEPTH) return false;
+            if (json_peek(lx).type == JSON_ARRAY_END) {
+                json_next(lx);
+                return true;
+            }
+            for (;;) {
+                if (!json_skip_value(lx, depth + 1)) {
+                    return false;
+                }
+                token = json_next(lx);
+                if (token.type == JSON_ARRAY_END) return true;
+                if (token.type != JSON_COMMA) return false;
+            }
+        
+        default:
+            return false;
+    }
+}
+
+// Step to the next object member (after '{' has been read). Returns 1 with
+// the lexer at its value, 0 at the closing brace, -1 on a syntax error.
+static int json_object_next(json_lexer_t* lx, bool* first, json_token_t* key) {
+    json_token_t token = json_next(lx);
+    
+    if (token.type == JSON_OBJECT_END) {
+        return 0;
+    }
+    if (!*first) {
+        if (token.type != JSON_COMMA) return -1;
+        token = json_next(lx);
+    }
+    *first = false;
+    
+    if (token.type != JSON_STRING || json_next(lx).type != JSON_COLON) {
+        return -1;
+    }
+    *key = token;
+    return 1;
+}
+
+// Step to the next array element (after '['); same returns
+static int json_array_next(json_lexer_t* lx, bool* first) {
+    json_token_t token = json_peek(lx);
+    
+    if (token.type == JSON_ARRAY_END) {
+        json_next(lx);
+        return 0;
+    }
+    if (!*first) {
+        if (token.type != JSON_COMMA) return -1;
+        json_next(lx);
+    }
+    *first = false;
+    return 1;
+}
+
+static bool json_parse_u64(json_token_t token, uint64_t* value) {
+    if (token.type != JSON_NUMBER || token.length == 0 || token.length > 20) {
+        return false;
+    }
+    
+    uint64_t result = 0;
+    for (size_t i = 0; i < token.length; i++) {
+        char c = token.start[i];
+        if (c < '0' || c > '9' || result > (UINT64_MAX - (uint64_t)(c - '0')) / 10) {
+            return false;
+        }
+        result = result * 10 + (uint64_t)(c - '0');
+    }
+    *value = result;
+    return true;
+}
+
+// Output
+
+static bool json_reserve(json_writer_t* w, size_t extra) {
+    spi_json_buffer_t* out = w->out;
+    if (w->failed) {
+        return false;
+    }
+    if (out->length + extra + 1 <= out->capacity) {
+        return true;
+    }
+    
+    size_t capacity = out->capacity ? out->capacity : JSON_BUFFER_MIN_CAPACITY;
+    while (capacity < out->length + extra + 1) {
+        capacity *= 2;
+    }
+    
+    char* grown = (char*)realloc(out->data, capacity);
+    if (!grown) {
+        w->failed = true;
+        return false;
+    }
+    out->data = grown;
+    out->capacity = capacity;
+    return true;
+}
+
+static void json_write(json_writer_t* w, const char* text, size_t length) {
+    if (json_reserve(w, length)) {
+        memcpy(w->out->data + w->out->length, text, length);
+        w->out->length += length;
+    }
+}
+
+static void json_write_str(json_writer_t* w, const char* text) {
+    json_write(w, text, strlen(text));
+}
+
+static void json_write_u64(json_writer_t* w, uint64_t value) {
+    char digits[24];
+    int length = snprintf(digits, sizeof(digits), "%llu", (unsigned long long)value);
+    json_write(w, digits, (size_t)length);
+}
+
+// Encode bytes as a JSON string directly into the output
+static void json_write_bytes(json_writer_t* w, const uint8_t* data, size_t size, jsonrpc_encoding_t encoding) {
+    size_t encoded = encoding == JSONRPC_HEX ? size * 2 : (size + 2) / 3 * 4;
+    if (!json_reserve(w, encoded + 2)) {
+        return;
+    }
+    
+    char* p = w->out->data + w->out->length;
+    *p++ = '"';
+    if (encoding == JSONRPC_HEX) {
+        for (size_t i = 0; i < size; i++) {
+            *p++ = k_hex_digits[data[i] >> 4];
+            *p++ = k_hex_digits[data[i] & 15];
+        }
+    } else {
+        size_t i = 0;
+        for (; i + 3 <= size; i += 3) {
+            uint32_t v = (uint32_t)data[i] << 16 | (uint32_t)data[i + 1] << 8 | data[i + 2];
+            *p++ = k_base64_digits[v >> 18];
+            *p++ = k_base64_digits[(v >> 12) & 63];
+            *p++ = k_base64_digits[(v >> 6) & 63];
+            *p++ = k_base64_digits[v & 63];
+        }
+        if (i < size) {
+            uint32_t v = (uint32_t)data[i] << 16 | (i + 1 < size ? (uint32_t)data[i + 1] << 8 : 0);
+            *p++ = k_base64_digits[v >> 18];
+            *p++ = k_base64_digits[(v >> 12) & 63];
+            *p++ = i + 1 < size ? k_base64_digits[(v >> 6) & 63] : '=';
+            *p++ = '=';
+        }
+    }
+    *p++ = '"';
+    w->out->length = (size_t)(p - w->out->data);
+}
+
+// Input decoding
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static int base64_value(char c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
+
+// Upper bound on the decoded size of an encoded string
+static size_t decoded_capacity(size_t length, jsonrpc_encoding_t encoding) {
+    return encoding == JSONRPC_HEX ? length / 2 : length / 4 * 3;
+}
+
+static bool decode_bytes(const char* text, size_t length, jsonrpc_encoding_t encoding, uint8_t* out,
+                         size_t* written) {
+    if (encoding == JSONRPC_HEX) {
+        if (length % 2 != 0) return false;
+        for (size_t i = 0; i < length; i += 2) {
+            int hi = hex_value(text[i]);
+            int lo = hex_value(text[i + 1]);
+            if (hi < 0 || lo < 0) return false;
+            out[i / 2] = (uint8_t)(hi << 4 | lo);
+        }
+        *written = length / 2;
+        return true;
+    }
+    
+    if (length % 4 != 0) return false;
+    size_t n = 0;
+    for (size_t i = 0; i < length; i += 4) {
+        int v[4];
+        int padding = 0;
+        for (int k = 0; k < 4; k++) {
+            char c = text[i + k];
+            if (c == '=' && i + 4 == length && k >= 2) {
+                v[k] = 0;
+                padding++;
+            } else if (padding > 0 || (v[k] = base64_value(c)) < 0) {
+                return false;
+            }
+        }
+        uint32_t bits = (uint32_t)v[0] << 18 | (uint32_t)v[1] << 12 | (uint32_t)v[2] << 6 | (uint32_t)v[3];
+        out[n++] = (uint8_t)(bits >> 16);
+        if (padding < 2) out[n++] = (uint8_t)(bits >> 8);
+        if (padding < 1) out[n++] = (uint8_t)bits;
+    }
+    *written = n;
+    return true;
+}
+
+// Parameters
+
+static int jsonrpc_collect_params(json_lexer_t* lx, jsonrpc_params_t* params) {
+    memset(params, 0, sizeof(*params));
+    if (!lx) {
+        return 0;
+    }
+    if (json_next(lx).type != JSON_OBJECT_BEGIN) {
+        return JSONRPC_INVALID_PARAMS;
+    }
+    
+    bool first = true;
+    json_token_t key;
+    int more;
+    while ((more = json_object_next(lx, &first, &key)) == 1) {
+        for (int p = 0; p < PARAM_COUNT; p++) {
+            if (json_token_is(key, k_param_names[p])) {
+                params->at[p] = *lx;
+                params->present[p] = true;
+            }
+        }
+        if (!json_skip_value(lx, 1)) {
+            return JSONRPC_PARSE_ERROR;
+        }
+    }
+    return more == 0 ? 0 : JSONRPC_PARSE_ERROR;
+}
+
+static bool param_u64(const jsonrpc_params_t* params, jsonrpc_param_t which, uint64_t* value) {
+    if (!params->present[which]) {
+        return false;
+    }
+    json_lexer_t lx = params->at[which];
+    return json_parse_u64(json_next(&lx), value);
+}
+
+// Plain strings only: every string parameter is a name or hex/base64
+static bool param_string(const jsonrpc_params_t* params, jsonrpc_param_t which, json_token_t* token) {
+    if (!params->present[which]) {
+        return false;
+    }
+    json_lexer_t lx = params->at[which];
+    *token = json_next(&lx);
+    return token->type == JSON_STRING && memchr(token->start, '\\', token->length) == NULL;
+}
+
+static bool param_encoding(const jsonrpc_params_t* params, jsonrpc_encoding_t* encoding) {
+    json_token_t token;
+    *encoding = JSONRPC_HEX;
+    if (!params->present[PARAM_ENCODING]) {
+        return true;
+    }
+    if (!param_string(params, PARAM_ENCODING, &token)) {
+        return false;
+    }
+    if (json_token_is(token, "base64")) {
+        *encoding = JSONRPC_BASE64;
+        return true;
+    }
+    return json_token_is(token, "hex");
+}
+
+// Decode an encoded string parameter into a new buffer of exactly
+// expected_size bytes (any size if expected_size is 0)
+static uint8_t* param_bytes(const jsonrpc_params_t* params, jsonrpc_param_t which, jsonrpc_encoding_t encoding,
+                            size_t expected_size, size_t* size) {
+    json_token_t token;
+    if (!param_string(params, which, &token)) {
+        return NULL;
+    }
+    
+    size_t capacity = decoded_capacity(token.length, encoding);
+    uint8_t* data = (uint8_t*)malloc(capacity > 0 ? capacity : 1);
+    if (!data) {
+        return NULL;
+    }
+    if (!decode_bytes(token.start, token.length, encoding, data, size) || *size == 0 ||
+        (expected_size && *size != expected_size)) {
+        free(data);
+        return NULL;
+    }
+    return data;
+}
+
+// Leaf indices from an array parameter; *count is its length
+static uint64_t* param_u64_array(const jsonrpc_params_t* params, jsonrpc_param_t which, uint64_t* count) {
+    if (!params->present[which]) {
+        return NULL;
+    }
+    json_lexer_t lx = params->at[which];
+    if (json_next(&lx).type != JSON_ARRAY_BEGIN) {
+        return NULL;
+    }
+    
+    uint64_t capacity = 64;
+    uint64_t* values = (uint64_t*)malloc(capacity * sizeof(uint64_t));
+    bool first = true;
+    int more = -1;
+    *count = 0;
+    while (values && (more = json_array_next(&lx, &first)) == 1) {
+        if (*count == SPI_MAX_BATCH_SIZE || !json_parse_u64(json_next(&lx), &values[*count])) {
+            break;
+        }
+        if (++*count == capacity) {
+            uint64_t* grown = (uint64_t*)realloc(values, capacity * 2 * sizeof(uint64_t));
+            if (!grown) break;
+            values = grown;
+            capacity *= 2;
+        }
+    }
+    if (!values || more != 0 || *count == 0) {
+        free(values);
+        return NULL;
+    }
+    return values;
+}
+
+// Results
+
+static int jsonrpc_spi_error(spi_response_status_t status) {
+    return JSONRPC_SPI_ERROR - (int)status;
+}
+
+static const char* jsonrpc_error_message(int code) {
+    switch (code) {
+        case JSONRPC_PARSE_ERROR: return "Parse error";
+        case JSONRPC_INVALID_REQUEST: return "Invalid Request";
+        case JSONRPC_METHOD_NOT_FOUND: return "Method not found";
+        case JSONRPC_INVALID_PARAMS: return "Invalid params";
+        case JSONRPC_INTERNAL_ERROR: return "Internal error";
+        default: return spi_error_string((spi_response_status_t)(JSONRPC_SPI_ERROR - code));
+    }
+}
+
+// Unknown tree, or the request was wrong for the tree it names
+static int jsonrpc_tree_error(spi_context_t* ctx, uint64_t tree_id, spi_response_status_t otherwise) {
+    spi_tree_info_t info;
+    return jsonrpc_spi_error(spi_get_tree_info(ctx, tree_id, &info) ? otherwise : SPI_RESPONSE_ERROR_INVALID_TREE);
+}
+
+static void json_write_tree_info(json_writer_t* w, const spi_tree_info_t* info) {
+    json_write_str(w, "{\"tree_id\":");
+    json_write_u64(w, info->tree_id);
+    json_write_str(w, ",\"num_leaves\":");
+    json_write_u64(w, info->num_leaves);
+    json_write_str(w, ",\"depth\":");
+    json_write_u64(w, info->depth);
+    json_write_str(w, info->hash_type == HASH_BLAKE2B ? ",\"hash\":\"blake2b\"" : ",\"hash\":\"sha256\"");
+    json_write_str(w, ",\"root\":");
+    json_write_bytes(w, info->root_hash, SHA256_HASH_SIZE, JSONRPC_HEX);
+    json_write_str(w, ",\"version\":");
+    json_write_u64(w, info->version);
+    json_write_str(w, "}");
+}
+
+// Method handlers write their result value and return 0, or return an
+// error code having written nothing that must be kept
+
+static int jsonrpc_info(spi_context_t* ctx, const jsonrpc_params_t* params, json_writer_t* w) {
+    uint64_t tree_id;
+    spi_tree_info_t info;
+    if (!param_u64(params, PARAM_TREE_ID, &tree_id)) {
+        return JSONRPC_INVALID_PARAMS;
+    }
+    if (!spi_get_tree_info(ctx, tree_id, &info)) {
+        return jsonrpc_spi_error(SPI_RESPONSE_ERROR_INVALID_TREE);
+    }
+    
+    json_write_tree_info(w, &info);
+    return 0;
+}
+
+// {"num_leaves", "hash"?: "sha256"|"blake2b", "data"?, "encoding"?}
+static int jsonrpc_create(spi_context_t* ctx, const jsonrpc_params_t* params, json_writer_t* w) {
+    uint64_t num_leaves;
+    hash_type_t hash_type = HASH_SHA256;
+    jsonrpc_encoding_t encoding;
+    json_token_t hash;
+    
+    if (!param_u64(params, PARAM_NUM_LEAVES, &num_leaves) || num_leaves == 0 ||
+        num_leaves > SPI_MAX_TREE_SIZE || !param_encoding(params, &encoding)) {
+        return JSONRPC_INVALID_PARAMS;
+    }
+    if (params->present[PARAM_HASH]) {
+        if (!param_string(params, PARAM_HASH, &hash)) return JSONRPC_INVALID_PARAMS;
+        if (json_token_is(hash, "blake2b")) hash_type = HASH_BLAKE2B;
+        else if (!json_token_is(hash, "sha256")) return JSONRPC_INVALID_PARAMS;
+    }
+    
+    uint8_t* data = NULL;
+    size_t size = 0;
+    if (params->present[PARAM_DATA]) {
+        data = param_bytes(params, PARAM_DATA, encoding, num_leaves * SHA256_HASH_SIZE, &size);
+        if (!data) return JSONRPC_INVALID_PARAMS;
+    }
+    
+    spi_tree_info_t* info = spi_create_tree(ctx, num_leaves, (uint8_t)hash_type);
+    if (!info) {
+        free(data);
+        return jsonrpc_spi_error(SPI_RESPONSE_ERROR_INVALID_REQUEST);
+    }
+    
+    int code = 0;
+    if (data && (!spi_update_tree_data(ctx, info->tree_id, data, size) ||
+                 !spi_get_tree_info(ctx, info->tree_id, info))) {
+        spi_destroy_tree(ctx, info->tree_id);
+        code = JSONRPC_INTERNAL_ERROR;
+    }
+    if (code == 0) {
+        json_write_tree_info(w, info);
+    }
+    
+    free(data);
+    free(info);
+    return code;
+}
+
+// {"tree_id", "data", "leaf"?, "encoding"?}: the whole tree, or one leaf
+static int jsonrpc_update(spi_context_t* ctx, const jsonrpc_params_t* params, json_writer_t* w) {
+    uint64_t tree_id;
+    uint64_t leaf = 0;
+    jsonrpc_encoding_t encoding;
+    bool single = params->present[PARAM_LEAF];
+    
+    if (!param_u64(params, PARAM_TREE_ID, &tree_id) || !param_encoding(params, &encoding) ||
+        (single && !param_u64(params, PARAM_LEAF, &leaf))) {
+        return JSONRPC_INVALID_PARAMS;
+    }
+    
+    size_t size = 0;
+    uint8_t* data = param_bytes(params, PARAM_DATA, encoding, single ? SHA256_HASH_SIZE : 0, &size);
+    if (!data) {
+        return JSONRPC_INVALID_PARAMS;
+    }
+    
+    bool ok = single ? spi_update_leaf(ctx, tree_id, leaf, data, size)
+                     : spi_update_tree_data(ctx, tree_id, data, size);
+    free(data);
+    
+    spi_tree_info_t info;
+    if (!ok || !spi_get_tree_info(ctx, tree_id, &info)) {
+        return jsonrpc_tree_error(ctx, tree_id, SPI_RESPONSE_ERROR_INVALID_REQUEST);
+    }
+    
+    json_write_tree_info(w, &info);
+    return 0;
+}
+
+// {"tree_id", "leaf", "encoding"?}
+static int jsonrpc_proof(spi_context_t* ctx, const jsonrpc_params_t* params, json_writer_t* w) {
+    uint64_t tree_id;
+    uint64_t leaf;
+    jsonrpc_encoding_t encoding;
+    if (!param_u64(params, PARAM_TREE_ID, &tree_id) || !param_u64(params, PARAM_LEAF, &leaf) ||
+        !param_encoding(params, &encoding)) {
+        return JSONRPC_INVALID_PARAMS;
+    }
+    
+    uint8_t proof[SPI_MAX_PROOF_SIZE];
+    uint64_t size = sizeof(proof);
+    if (!spi_generate_proof(ctx, tree_id, leaf, proof, &size)) {
+        return jsonrpc_tree_error(ctx, tree_id, SPI_RESPONSE_ERROR_INVALID_REQUEST);
+    }
+    
+    json_write_str(w, "{\"leaf\":");
+    json_write_u64(w, leaf);
+    json_write_str(w, ",\"proof\":");
+    json_write_bytes(w, proof, size, encoding);
+    json_write_str(w, "}");
+    return 0;
+}
+
+// {"tree_id", "leaf", "proof", "encoding"?}
+static int jsonrpc_verify(spi_context_t* ctx, const jsonrpc_params_t* params, json_writer_t* w) {
+    uint64_t tree_id;
+    uint64_t leaf;
+    jsonrpc_encoding_t encoding;
+    json_token_t encoded;
+    if (!param_u64(params, PARAM_TREE_ID, &tree_id) || !param_u64(params, PARAM_LEAF, &leaf) ||
+        !param_encoding(params, &encoding) || !param_string(params, PARAM_PROOF, &encoded) ||
+        decoded_capacity(encoded.length, encoding) > SPI_MAX_PROOF_SIZE) {
+        return JSONRPC_INVALID_PARAMS;
+    }
+    
+    uint8_t proof[SPI_MAX_PROOF_SIZE];
+    size_t size = 0;
+    bool valid = false;
+    if (!decode_bytes(encoded.start, encoded.length, encoding, proof, &size)) {
+        return JSONRPC_INVALID_PARAMS;
+    }
+    if (!spi_verify_proof(ctx, tree_id, leaf, proof, size, &valid)) {
+        return jsonrpc_tree_error(ctx, tree_id, SPI_RESPONSE_ERROR_INVALID_PROOF);
+    }
+    
+    json_write_str(w, valid ? "{\"valid\":true}" : "{\"valid\":false}");
+    return 0;
+}
+
+static int jsonrpc_batch_generate(spi_context_t* ctx, uint64_t tree_id, uint64_t* leaves, uint64_t count,
+                                  jsonrpc_encoding_t encoding, json_writer_t* w) {
+    spi_tree_info_t info;
+    if (!spi_get_tree_info(ctx, tree_id, &info)) {
+        return jsonrpc_spi_error(SPI_RESPONSE_ERROR_INVALID_TREE);
+    }
+    
+    uint64_t proof_size = merkle_proof_serialized_size(info.depth * (info.arity - 1));
+    uint64_t total = proof_size * count;
+    uint8_t* proofs = (uint8_t*)malloc(total);
+    if (!proofs) {
+        return jsonrpc_spi_error(SPI_RESPONSE_ERROR_OUT_OF_MEMORY);
+    }
+    if (!spi_generate_proofs_batch(ctx, tree_id, leaves, count, proofs, &total)) {
+        free(proofs);
+        return jsonrpc_tree_error(ctx, tree_id, SPI_RESPONSE_ERROR_INVALID_REQUEST);
+    }
+    
+    // Size the whole array up front rather than growing per proof
+    size_t encoded = encoding == JSONRPC_HEX ? proof_size * 2 : (proof_size + 2) / 3 * 4;
+    json_reserve(w, (encoded + 3) * count + 16);
+    json_write_str(w, "{\"proofs\":[");
+    for (uint64_t i = 0; i < count; i++) {
+        if (i > 0) json_write(w, ",", 1);
+        json_write_bytes(w, proofs + i * proof_size, proof_size, encoding);
+    }
+    json_write_str(w, "]}");
+    
+    free(proofs);
+    return 0;
+}
+
+static int jsonrpc_batch_verify(spi_context_t* ctx, const jsonrpc_params_t* params, uint64_t tree_id,
+                                uint64_t* leaves, uint64_t count, jsonrpc_encoding_t encoding,
+                                json_writer_t* w) {
+    // First pass sizes the decode buffer, second decodes into it
+    json_lexer_t lx = params->at[PARAM_PROOFS];
+    if (json_next(&lx).type != JSON_ARRAY_BEGIN) {
+        return JSONRPC_INVALID_PARAMS;
+    }
+    json_lexer_t elements = lx;
+    bool first = true;
+    uint64_t n = 0;
+    size_t capacity = 0;
+    int more;
+    while ((more = json_array_next(&lx, &first)) == 1) {
+        json_token_t token = json_next(&lx);
+        if (token.type != JSON_STRING || n == count) {
+            return JSONRPC_INVALID_PARAMS;
+        }
+        capacity += decoded_capacity(token.length, encoding);
+        n++;
+    }
+    if (more != 0 || n != count) {
+        return JSONRPC_INVALID_PARAMS;
+    }
+    
+    uint8_t* proofs = (uint8_t*)malloc(capacity > 0 ? capacity : 1);
+    uint64_t* sizes = (uint64_t*)malloc(count * sizeof(uint64_t));
+    bool* results = (bool*)malloc(count * sizeof(bool));
+    int code = proofs && sizes && results ? 0 : jsonrpc_spi_error(SPI_RESPONSE_ERROR_OUT_OF_MEMORY);
+    
+    size_t offset = 0;
+    first = true;
+    for (uint64_t i = 0; code == 0 && i < count; i++) {
+        json_array_next(&elements, &first);
+        json_token_t token = json_next(&elements);
+        size_t size = 0;
+        if (!decode_bytes(token.start, token.length, encoding, proofs + offset, &size)) {
+            code = JSONRPC_INVALID_PARAMS;
+        }
+        sizes[i] = size;
+        offset += size;
+    }
+    
+    if (code == 0 && !spi_verify_proofs_batch(ctx, tree_id, leaves, proofs, sizes, count, results)) {
+        code = jsonrpc_tree_error(ctx, tree_id, SPI_RESPONSE_ERROR_INVALID_PROOF);
+    }
+    if (code == 0) {
+        bool all_valid = true;
+        json_write_str(w, "{\"valid\":[");
+        for (uint64_t i = 0; i < count; i++) {
+            json_write_str(w, i > 0 ? (results[i] ? ",true" : ",false") : (results[i] ? "true" : "false"));
+            all_valid &= results[i];
+        }
+        json_write_str(w, all_valid ? "],\"all_valid\":true}" : "],\"all_valid\":false}");
+    }
+    
+    free(proofs);
+    free(sizes);
+    free(results);
+    return code;
+}
+
+// {"tree_id", "leaves": [...], "proofs"?: [...], "encoding"?}: proofs for
+// every leaf, or checks of the given proofs when "proofs" is present
+static int jsonrpc_batch(spi_context_t* ctx, const jsonrpc_params_t* params, json_writer_t* w) {
+    uint64_t tree_id;
+    uint64_t count = 0;
+    jsonrpc_encoding_t encoding;
+    if (!param_u64(params, PARAM_TREE_ID, &tree_id) || !param_encoding(params, &encoding)) {
+        return JSONRPC_INVALID_PARAMS;
+    }
+    
+    uint64_t* leaves = param_u64_array(params, PARAM_LEAVES, &count);
+    if (!leaves) {
+        return JSONRPC_INVALID_PARAMS;
+    }
+    
+    int code = params->present[PARAM_PROOFS]
+             ? jsonrpc_batch_verify(ctx, params, tree_id, leaves, count, encoding, w)
+             : jsonrpc_batch_generate(ctx, tree_id, leaves, count, encoding, w);
+    free(leaves);
+    return code;
+}
+
+typedef int (*jsonrpc_method_t)(spi_context_t* ctx, const jsonrpc_params_t* params, json_writer_t* w);
+
+static const struct {
+    const char* name;
+    jsonrpc_method_t handler;
+} k_jsonrpc_methods[] = {
+    {"create", jsonrpc_create},
+    {"update", jsonrpc_update},
+    {"proof", jsonrpc_proof},
+    {"verify", jsonrpc_verify},
+    {"batch", jsonrpc_batch},
+    {"info", jsonrpc_info},
+};
+
+// Dispatch
+
+static void jsonrpc_write_envelope(json_writer_t* w, const char* id, size_t id_length) {
+    json_write_str(w, "{\"jsonrpc\":\"2.0\",\"id\":");
+    if (id) {
+        json_write(w, id, id_length);
+    } else {
+        json_write_str(w, "null");
+    }
+}
+
+static void jsonrpc_write_error(json_writer_t* w, const char* id, size_t id_length, int code) {
+    char number[16];
+    jsonrpc_write_envelope(w, id, id_length);
+    json_write_str(w, ",\"error\":{\"code\":");
+    json_write(w, number, (size_t)snprintf(number, sizeof(number), "%d", code));
+    json_write_str(w, ",\"message\":\"");
+    json_write_str(w, jsonrpc_error_message(code));
+    json_write_str(w, "\"}}");
+}
+
+// One request object; the input has already passed json_skip_value
+static void jsonrpc_handle_one(spi_context_t* ctx, json_lexer_t* lx, json_writer_t* w) {
+    if (json_peek(lx).type != JSON_OBJECT_BEGIN) {
+        json_skip_value(lx, 0);
+        jsonrpc_write_error(w, NULL, 0, JSONRPC_INVALID_REQUEST);
+        return;
+    }
+    json_next(lx);
+    
+    const char* id = NULL;
+    size_t id_length = 0;
+    bool version_ok = false;
+    bool id_ok = true;
+    json_token_t method = {JSON_ERROR, NULL, 0};
+    json_lexer_t params_at = {NULL, NULL};
+    bool has_params = false;
+    
+    bool first = true;
+    json_token_t key;
+    while (json_object_next(lx, &first, &key) == 1) {
+        json_lexer_t value = *lx;
+        json_token_t token = json_next(&value);
+        
+        if (json_token_is(key, "jsonrpc")) {
+            version_ok = token.type == JSON_STRING && json_token_is(token, "2.0");
+        } else if (json_token_is(key, "method")) {
+            method = token;
+        } else if (json_token_is(key, "params")) {
+            params_at = *lx;
+            has_params = true;
+        } else if (json_token_is(key, "id")) {
+            // Echoed verbatim, quotes included
+            id_ok = token.type == JSON_STRING || token.type == JSON_NUMBER || token.type == JSON_NULL;
+            id = token.type == JSON_STRING ? token.start - 1 : token.start;
+            id_length = token.type == JSON_STRING ? token.length + 2 : token.length;
+        }
+        json_skip_value(lx, 1);
+    }
+    
+    if (!version_ok || method.type != JSON_STRING || !id_ok) {
+        jsonrpc_write_error(w, id_ok ? id : NULL, id_ok ? id_length : 0, JSONRPC_INVALID_REQUEST);
+        return;
+    }
+    
+    size_t mark = w->out->length;
+    int code = JSONRPC_METHOD_NOT_FOUND;
+    for (size_t m = 0; m < sizeof(k_jsonrpc_methods) / sizeof(k_jsonrpc_methods[0]); m++) {
+        if (json_token_is(method, k_jsonrpc_methods[m].name)) {
+            jsonrpc_params_t params;
+            code = jsonrpc_collect_params(has_params ? &params_at : NULL, &params);
+            if (code == 0) {
+                jsonrpc_write_envelope(w, id, id_length);
+                json_write_str(w, ",\"result\":");
+                code = k_jsonrpc_methods[m].handler(ctx, &params, w);
+            }
+            break;
+        }
+    }
+    
+    if (code != 0) {
+        w->out->length = mark;
+        jsonrpc_write_error(w, id, id_length, code);
+    } else {
+        json_write_str(w, "}");
+    }
+    
+    // Notifications are answered with nothing
+    if (!id) {
+        w->out->length = mark;
+    }
+}
+
+bool spi_jsonrpc_process_request(spi_context_t* ctx, const char* json, size_t length, spi_json_buffer_t* out) {
+    if (!ctx || !json || !out) {
+        return false;
+    }
+    
+    json_writer_t w = {out, false};
+    size_t mark = out->length;
+    json_lexer_t lx = {json, json + length};
+    
+    // Reject malformed input before running any of it
+    json_lexer_t check = lx;
+    if (!json_skip_value(&check, 0) || json_next(&check).type != JSON_END) {
+        jsonrpc_write_error(&w, NULL, 0, JSONRPC_PARSE_ERROR);
+    } else if (json_peek(&lx).type == JSON_ARRAY_BEGIN) {
+        json_next(&lx);
+        json_write(&w, "[", 1);
+        
+        bool first = true;
+        bool answered = false;
+        uint64_t count = 0;
+        while (json_array_next(&lx, &first) == 1) {
+            size_t before = out->length;
+            if (answered) json_write(&w, ",", 1);
+            size_t start = out->length;
+            jsonrpc_handle_one(ctx, &lx, &w);
+            if (out->length == start) {
+                out->length = before;
+            } else {
+                answered = true;
+            }
+            count++;
+        }
+        
+        if (count == 0) {
+            out->length = mark;
+            jsonrpc_write_error(&w, NULL, 0, JSONRPC_INVALID_REQUEST);
+        } else if (!answered) {
+            out->length = mark;
+        } else {
+            json_write(&w, "]", 1);
+        }
+    } else {
+        jsonrpc_handle_one(ctx, &lx, &w);
+    }
+    
+    if (json_reserve(&w, 0)) {
+        out->data[out->length] = '\0';
+    }
+    return !w.failed;
+}
+
+void spi_json_buffer_free(spi_json_buffer_t* buffer) {
+    if (!buffer) return;
+    
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->length = 0;
+    buffer->capacity = 0;
+}
@@ -0,0 +1,241 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "spi_interface.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define SPI_REGISTRY_MIN_CAPACITY 16
+
+// Open-addressing map with linear probing. tree_id 0 marks an empty slot;
+// deletion shifts the rest of the cluster back so no tombstones are needed.
+typedef struct {
+    uint64_t tree_id;
+    spi_tree_handle_t* handle;
+} spi_registry_slot_t;
+
+// The map itself is guarded by a reader-writer lock held only for the
+// lookup; trees are kept alive by their handle's refcount and versioned.
+struct spi_tree_registry {
+    spi_registry_slot_t* slots;
+    size_t capacity;                        // Power of two
+    size_t count;
+    unsigned shift;                         // 64 - log2(capacity)
+    uint64_t next_tree_id;                  // Sequential from 1
+    pthread_rwlock_t lock;
+};
+
+// Fibonacci hashing spreads sequential IDs across the table
+static inline size_t registry_home(const spi_tree_registry_t* registry, uint64_t tree_id) {
+    return (size_t)((tree_id * 0x9E3779B97F4A7C15ULL) >> registry->shift);
+}
+
+static bool registry_alloc_slots(spi_tree_registry_t* registry, size_t capacity) {
+    registry->slots = (spi_registry_slot_t*)calloc(capacity, sizeof(spi_registry_slot_t));
+    if (!registry->slots) {
+        return false;
+    }
+    
+    registry->capacity = capacity;
+    registry->shift = 64 - (unsigned)__builtin_ctzll(capacity);
+    return true;
+}
+
+static void registry_place(spi_tree_registry_t* registry, uint64_t tree_id, spi_tree_handle_t* handle) {
+    size_t mask = registry->capacity - 1;
+    size_t i = registry_home(registry, tree_id);
+    
+    while (registry->slots[i].tree_id != 0) {
+        i = (i + 1) & mask;
+    }
+    registry->slots[i].tree_id = tree_id;
+    registry->slots[i].handle = handle;
+}
+
+static bool registry_grow(spi_tree_registry_t* registry) {
+    spi_registry_slot_t* old_slots = registry->slots;
+    size_t old_capacity = registry->capacity;
+    
+    if (!registry_alloc_slots(registry, old_capacity * 2)) {
+        registry->slots = old_slots;
+        return false;
+    }
+    
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_slots[i].tree_id != 0) {
+            registry_place(registry, old_slots[i].tree_id, old_slots[i].handle);
+        }
+    }
+    
+    free(old_slots);
+    return true;
+}
+
+static spi_tree_handle_t* registry_lookup(const spi_tree_registry_t* registry, uint64_t tree_id) {
+    size_t mask = registry->capacity - 1;
+    for (size_t i = registry_home(registry, tree_id); registry->slots[i].tree_id != 0; i = (i + 1) & mask) {
+        if (registry->slots[i].tree_id == tree_id) {
+            return registry->slots[i].handle;
+        }
+    }
+    
+    return NULL;
+}
+
+static spi_tree_handle_t* tree_handle_create(uint64_t tree_id, merkle_tree_t* tree) {
+    spi_tree_handle_t* handle = (spi_tree_handle_t*)calloc(1, sizeof(spi_tree_handle_t));
+    if (!handle) {
+        return NULL;
+    }
+    
+    handle->tree = merkle_mvcc_create(tree);
+    if (!handle->tree) {
+        free(handle);
+        return NULL;
+    }
+    
+    handle->tree_id = tree_id;
+    atomic_init(&handle->refs, 1);  // The registry's reference
+    return handle;
+}
+
+void spi_tree_handle_release(spi_tree_handle_t* handle) {
+    if (!handle) return;
+    
+    if (atomic_fetch_sub_explicit(&handle->refs, 1, memory_order_acq_rel) == 1) {
+        merkle_mvcc_destroy(handle->tree);
+        free(handle);
+    }
+}
+
+spi_tree_registry_t* spi_registry_create(size_t initial_capacity) {
+    spi_tree_registry_t* registry = (spi_tree_registry_t*)calloc(1, sizeof(spi_tree_registry_t));
+    if (!registry) {
+        return NULL;
+    }
+    
+    size_t capacity = SPI_REGISTRY_MIN_CAPACITY;
+    while (capacity < initial_capacity) {
+        capacity *= 2;
+    }
+    
+    if (!registry_alloc_slots(registry, capacity)) {
+        free(registry);
+        return NULL;
+    }
+    
+    if (pthread_rwlock_init(&registry->lock, NULL) != 0) {
+        free(registry->slots);
+        free(registry);
+        return NULL;
+    }
+    
+    registry->next_tree_id = 1;
+    return registry;
+}
+
+void spi_registry_destroy(spi_tree_registry_t* registry) {
+    if (!registry) return;
+    
+    // Trees still held by in-flight requests go when the last one releases
+    for (size_t i = 0; i < registry->capacity; i++) {
+        if (registry->slots[i].tree_id != 0) {
+            spi_tree_handle_release(registry->slots[i].handle);
+        }
+    }
+    
+    pthread_rwlock_destroy(&registry->lock);
+    free(registry->slots);
+    free(registry);
+}
+
+uint64_t spi_registry_add(spi_tree_registry_t* registry, merkle_tree_t* tree) {
+    if (!registry || !tree) {
+        return 0;
+    }
+    
+    pthread_rwlock_wrlock(&registry->lock);
+    
+    uint64_t tree_id = registry->next_tree_id;
+    spi_tree_handle_t* handle = NULL;
+    
+    // Keep the load factor under 3/4
+    if (((registry->count + 1) * 4 <= registry->capacity * 3 || registry_grow(registry)) &&
+        (handle = tree_handle_create(tree_id, tree)) != NULL) {
+        registry_place(registry, tree_id, handle);
+        registry->count++;
+        registry->next_tree_id++;
+    } else {
+        tree_id = 0;
+    }
+    
+    pthread_rwlock_unlock(&registry->lock);
+    return tree_id;
+}
+
+spi_tree_handle_t* spi_registry_acquire(spi_tree_registry_t* registry, uint64_t tree_id) {
+    if (!registry || tree_id == 0) {
+        return NULL;
+    }
+    
+    pthread_rwlock_rdlock(&registry->lock);
+    spi_tree_handle_t* handle = registry_lookup(registry, tree_id);
+    if (handle) {
+        atomic_fetch_add_explicit(&handle->refs, 1, memory_order_relaxed);
+    }
+    pthread_rwlock_unlock(&registry->lock);
+    
+    return handle;
+}
+
+bool spi_registry_remove(spi_tree_registry_t* registry, uint64_t tree_id) {
+    if (!registry || tree_id == 0) {
+        return false;
+    }
+    
+    pthread_rwlock_wrlock(&registry->lock);
+    
+    size_t mask = registry->capacity - 1;
+    size_t i = registry_home(registry, tree_id);
+    while (registry->slots[i].tree_id != tree_id) {
+        if (registry->slots[i].tree_id == 0) {
+            pthread_rwlock_unlock(&registry->lock);
+            return false;
+        }
+        i = (i + 1) & mask;
+    }
+    
+    spi_tree_handle_t* handle = registry->slots[i].handle;
+    
+    // Backward-shift deletion: pull later cluster members into the hole
+    // unless their home slot lies cyclically in (hole, j]
+    size_t hole = i;
+    for (size_t j = (i + 1) & mask; registry->slots[j].tree_id != 0; j = (j + 1) & mask) {
+        size_t home = registry_home(registry, registry->slots[j].tree_id);
+        bool stays = (hole <= j) ? (hole < home && home <= j) : (hole < home || home <= j);
+        if (!stays) {
+            registry->slots[hole] = registry->slots[j];
+            hole = j;
+        }
+    }
+    registry->slots[hole].tree_id = 0;
+    registry->slots[hole].handle = NULL;
+    registry->count--;
+    
+    pthread_rwlock_unlock(&registry->lock);
+    
+    spi_tree_handle_release(handle);
+    return true;
+}
+
+size_t spi_registry_count(spi_tree_registry_t* registry) {
+    if (!registry) {
+        return 0;
+    }
+    
+    pthread_rwlock_rdlock(&registry->lock);
+    size_t count = registry->count;
+    pthread_rwlock_unlock(&registry->lock);
+    
+    return count;
+}
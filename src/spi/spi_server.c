@@ -0,0 +1,462 @@
+#define _GNU_SOURCE
+
+#include "spi_interface.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define SPI_SERVER_MAX_REACTORS 64
+#define SPI_SERVER_MAX_EVENTS 64
+#define SPI_SERVER_READ_SIZE (64 * 1024)        // Minimum free input space per read
+#define SPI_SERVER_MAX_PENDING (4 * 1024 * 1024) // Unsent output that pauses reading
+
+// One client connection, owned by the reactor that accepted it. Frames are
+// decoded in place from the input buffer; responses queue in the output
+// buffer and go out with one send per wakeup.
+typedef struct spi_connection {
+    int fd;
+    uint32_t events;                        // Current epoll interest
+    uint8_t* in;                            // malloc'd, so frames at 8-byte offsets stay aligned
+    size_t in_len;
+    size_t in_cap;
+    uint8_t* out;
+    size_t out_off;
+    size_t out_len;
+    size_t out_cap;
+    bool closing;                           // Peer finished sending; close once flushed
+    struct spi_connection* prev;
+    struct spi_connection* next;
+} spi_connection_t;
+
+typedef struct {
+    spi_server_t* server;
+    int epoll_fd;
+    pthread_t thread;
+    bool started;
+    spi_connection_t* connections;
+} spi_reactor_t;
+
+// The listener and the stop eventfd sit in every reactor's epoll set; the
+// listener is exclusive so one accept wakes one reactor.
+struct spi_server {
+    spi_context_t* ctx;
+    int listen_fd;
+    int stop_fd;
+    uint16_t port;
+    bool jsonrpc;
+    char unix_path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+    uint32_t num_reactors;
+    spi_reactor_t reactors[];
+};
+
+static bool buffer_reserve(uint8_t** buffer, size_t* capacity, size_t needed) {
+    if (needed <= *capacity) {
+        return true;
+    }
+
+    size_t new_capacity = *capacity ? *capacity : SPI_SERVER_READ_SIZE;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+
+    uint8_t* grown = (uint8_t*)realloc(*buffer, new_capacity);
+    if (!grown) {
+        return false;
+    }
+    *buffer = grown;
+    *capacity = new_capacity;
+    return true;
+}
+
+static void connection_close(spi_reactor_t* reactor, spi_connection_t* conn) {
+    epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+
+    if (conn->prev) conn->prev->next = conn->next;
+    else reactor->connections = conn->next;
+    if (conn->next) conn->next->prev = conn->prev;
+
+    free(conn->in);
+    free(conn->out);
+    free(conn);
+}
+
+static void connection_accept(spi_reactor_t* reactor) {
+    for (;;) {
+        int fd = accept4(reactor->server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;  // EAGAIN: another reactor took it, or the backlog is empty
+        }
+
+        if (!reactor->server->unix_path[0]) {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+
+        spi_connection_t* conn = (spi_connection_t*)calloc(1, sizeof(spi_connection_t));
+        if (!conn) {
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        conn->events = EPOLLIN;
+
+        struct epoll_event event = {.events = conn->events, .data.ptr = conn};
+        if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            close(fd);
+            free(conn);
+            continue;
+        }
+
+        conn->next = reactor->connections;
+        if (conn->next) conn->next->prev = conn;
+        reactor->connections = conn;
+    }
+}
+
+static bool connection_queue_response(spi_connection_t* conn, const spi_response_t* response) {
+    // A valid request can still ask for more than a frame holds (a large
+    // batch on a deep tree); it gets an error, and the requests behind it
+    // on the connection are still answered
+    spi_response_t oversized = {.request_id = response->request_id, .status = SPI_RESPONSE_ERROR_INVALID_REQUEST};
+    size_t size = spi_wire_response_size(response);
+    if (size == 0) {
+        response = &oversized;
+        size = spi_wire_response_size(response);
+    }
+    if (!buffer_reserve(&conn->out, &conn->out_cap, conn->out_len + size)) {
+        return false;
+    }
+
+    conn->out_len += spi_wire_encode_response(response, conn->out + conn->out_len, size);
+    return true;
+}
+
+// JSON-RPC lines are answered straight into the output buffer
+static bool connection_process_lines(spi_server_t* server, spi_connection_t* conn) {
+    size_t offset = 0;
+
+    while (conn->out_len - conn->out_off < SPI_SERVER_MAX_PENDING) {
+        const char* line = (const char*)conn->in + offset;
+        const char* newline = (const char*)memchr(line, '\n', conn->in_len - offset);
+        if (!newline) {
+            if (conn->in_len - offset > SPI_WIRE_MAX_FRAME) return false;
+            break;
+        }
+
+        spi_json_buffer_t out = {(char*)conn->out, conn->out_len, conn->out_cap};
+        bool ok = spi_jsonrpc_process_request(server->ctx, line, (size_t)(newline - line), &out);
+        bool answered = out.length > conn->out_len;
+        conn->out = (uint8_t*)out.data;
+        conn->out_len = out.length;
+        conn->out_cap = out.capacity;
+        if (!ok || (answered && !buffer_reserve(&conn->out, &conn->out_cap, conn->out_len + 1))) {
+            return false;
+        }
+        if (answered) {
+            conn->out[conn->out_len++] = '\n';
+        }
+
+        offset += (size_t)(newline - line) + 1;
+    }
+
+    if (offset > 0) {
+        memmove(conn->in, conn->in + offset, conn->in_len - offset);
+        conn->in_len -= offset;
+    }
+    return true;
+}
+
+// Answer every complete frame in the input buffer, in order, until the
+// output backlog reaches its cap. Returns false on a framing error.
+static bool connection_process(spi_server_t* server, spi_connection_t* conn) {
+    size_t offset = 0;
+
+    if (server->jsonrpc) {
+        return connection_process_lines(server, conn);
+    }
+
+    while (conn->out_len - conn->out_off < SPI_SERVER_MAX_PENDING && conn->in_len - offset >= 8) {
+        size_t size = spi_wire_frame_size(conn->in + offset);
+        if (size == 0) {
+            return false;
+        }
+        if (conn->in_len - offset < size) {
+            break;
+        }
+
+        spi_request_t request;
+        if (!spi_wire_decode_request(conn->in + offset, size, &request)) {
+            return false;
+        }
+
+        spi_response_t* response = spi_process_request(server->ctx, &request);
+        spi_response_t failed = {.request_id = request.request_id, .status = SPI_RESPONSE_ERROR_OUT_OF_MEMORY};
+        bool queued = connection_queue_response(conn, response ? response : &failed);
+        spi_free_response(response);
+        if (!queued) {
+            return false;
+        }
+
+        offset += size;
+    }
+
+    // Offsets stay multiples of 8, so the next frame starts aligned
+    if (offset > 0) {
+        memmove(conn->in, conn->in + offset, conn->in_len - offset);
+        conn->in_len -= offset;
+    }
+    return true;
+}
+
+static bool connection_has_frame(const spi_server_t* server, const spi_connection_t* conn) {
+    if (server->jsonrpc) {
+        return conn->in_len > 0 && memchr(conn->in, '\n', conn->in_len) != NULL;
+    }
+    if (conn->in_len < 8) {
+        return false;
+    }
+    size_t size = spi_wire_frame_size(conn->in);
+    return size == 0 || conn->in_len >= size;  // A bad frame fails in connection_process
+}
+
+static bool connection_flush(spi_connection_t* conn) {
+    while (conn->out_off < conn->out_len) {
+        ssize_t sent = send(conn->fd, conn->out + conn->out_off, conn->out_len - conn->out_off, MSG_NOSIGNAL);
+        if (sent > 0) {
+            conn->out_off += (size_t)sent;
+        } else if (sent < 0 && errno == EINTR) {
+            continue;
+        } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // Keep the unsent tail at the front so the buffer stays bounded
+            memmove(conn->out, conn->out + conn->out_off, conn->out_len - conn->out_off);
+            conn->out_len -= conn->out_off;
+            conn->out_off = 0;
+            return true;
+        } else {
+            return false;
+        }
+    }
+
+    conn->out_off = 0;
+    conn->out_len = 0;
+    return true;
+}
+
+// Read while output is not backed up, answer, flush, then wait for
+// whichever direction is blocked
+static bool connection_service(spi_reactor_t* reactor, spi_connection_t* conn, uint32_t ready) {
+    bool backed_up = conn->out_len - conn->out_off >= SPI_SERVER_MAX_PENDING;
+
+    if ((ready & (EPOLLIN | EPOLLHUP)) && !backed_up && !conn->closing) {
+        if (!buffer_reserve(&conn->in, &conn->in_cap, conn->in_len + SPI_SERVER_READ_SIZE)) {
+            return false;
+        }
+
+        ssize_t received = recv(conn->fd, conn->in + conn->in_len, conn->in_cap - conn->in_len, 0);
+        if (received > 0) {
+            conn->in_len += (size_t)received;
+        } else if (received == 0) {
+            conn->closing = true;
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            return false;
+        }
+    }
+
+    // Frames held back by a full backlog go as soon as it drains
+    do {
+        if (!connection_process(reactor->server, conn) || !connection_flush(conn)) {
+            return false;
+        }
+    } while (conn->out_len == 0 && connection_has_frame(reactor->server, conn));
+
+    bool pending = conn->out_off < conn->out_len;
+    if (conn->closing && !pending) {
+        return false;
+    }
+
+    uint32_t events = 0;
+    if (!conn->closing && conn->out_len - conn->out_off < SPI_SERVER_MAX_PENDING) events |= EPOLLIN;
+    if (pending) events |= EPOLLOUT;
+    if (events != conn->events) {
+        struct epoll_event event = {.events = events, .data.ptr = conn};
+        if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_MOD, conn->fd, &event) != 0) {
+            return false;
+        }
+        conn->events = events;
+    }
+    return true;
+}
+
+static void* spi_reactor_run(void* arg) {
+    spi_reactor_t* reactor = (spi_reactor_t*)arg;
+    spi_server_t* server = reactor->server;
+    struct epoll_event events[SPI_SERVER_MAX_EVENTS];
+
+    for (;;) {
+        int n = epoll_wait(reactor->epoll_fd, events, SPI_SERVER_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            void* source = events[i].data.ptr;
+            if (source == &server->stop_fd) {
+                return NULL;
+            }
+            if (source == &server->listen_fd) {
+                connection_accept(reactor);
+                continue;
+            }
+
+            spi_connection_t* conn = (spi_connection_t*)source;
+            if ((events[i].events & EPOLLERR) || !connection_service(reactor, conn, events[i].events)) {
+                connection_close(reactor, conn);
+            }
+        }
+    }
+    return NULL;
+}
+
+static int spi_server_listen(spi_server_t* server, const spi_server_config_t* config) {
+    int fd;
+
+    if (config->unix_path) {
+        struct sockaddr_un addr = {.sun_family = AF_UNIX};
+        if (strlen(config->unix_path) >= sizeof(addr.sun_path)) {
+            return -1;
+        }
+        strcpy(addr.sun_path, config->unix_path);
+
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            return -1;
+        }
+        unlink(config->unix_path);
+        if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+            close(fd);
+            return -1;
+        }
+        strcpy(server->unix_path, config->unix_path);
+    } else {
+        struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(config->port)};
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            return -1;
+        }
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        socklen_t len = sizeof(addr);
+        if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+            getsockname(fd, (struct sockaddr*)&addr, &len) != 0) {
+            close(fd);
+            return -1;
+        }
+        server->port = ntohs(addr.sin_port);
+    }
+
+    if (listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        if (server->unix_path[0]) unlink(server->unix_path);
+        return -1;
+    }
+    return fd;
+}
+
+spi_server_t* spi_server_start(spi_context_t* ctx, const spi_server_config_t* config) {
+    if (!ctx || !config) {
+        return NULL;
+    }
+
+    uint32_t num_reactors = config->num_reactors;
+    if (num_reactors == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_reactors = cpus > 0 ? (uint32_t)cpus : 1;
+    }
+    if (num_reactors > SPI_SERVER_MAX_REACTORS) {
+        num_reactors = SPI_SERVER_MAX_REACTORS;
+    }
+
+    spi_server_t* server = (spi_server_t*)calloc(1, sizeof(spi_server_t) + num_reactors * sizeof(spi_reactor_t));
+    if (!server) {
+        return NULL;
+    }
+    server->ctx = ctx;
+    server->jsonrpc = config->jsonrpc;
+    server->num_reactors = num_reactors;
+    server->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    server->listen_fd = spi_server_listen(server, config);
+    for (uint32_t r = 0; r < num_reactors; r++) {
+        server->reactors[r].server = server;
+        server->reactors[r].epoll_fd = -1;
+    }
+
+    bool ok = server->stop_fd >= 0 && server->listen_fd >= 0;
+    for (uint32_t r = 0; ok && r < num_reactors; r++) {
+        spi_reactor_t* reactor = &server->reactors[r];
+        reactor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+        struct epoll_event listen_event = {.events = EPOLLIN | EPOLLEXCLUSIVE, .data.ptr = &server->listen_fd};
+        struct epoll_event stop_event = {.events = EPOLLIN, .data.ptr = &server->stop_fd};
+        ok = reactor->epoll_fd >= 0 &&
+             epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, server->listen_fd, &listen_event) == 0 &&
+             epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, server->stop_fd, &stop_event) == 0 &&
+             pthread_create(&reactor->thread, NULL, spi_reactor_run, reactor) == 0;
+        reactor->started = ok;
+    }
+
+    if (!ok) {
+        spi_server_stop(server);
+        return NULL;
+    }
+    return server;
+}
+
+void spi_server_stop(spi_server_t* server) {
+    if (!server) return;
+
+    // The eventfd stays readable, so every reactor sees it
+    if (server->stop_fd >= 0) {
+        uint64_t one = 1;
+        ssize_t written = write(server->stop_fd, &one, sizeof(one));
+        (void)written;
+    }
+
+    for (uint32_t r = 0; r < server->num_reactors; r++) {
+        spi_reactor_t* reactor = &server->reactors[r];
+        if (reactor->started) {
+            pthread_join(reactor->thread, NULL);
+        }
+        while (reactor->connections) {
+            connection_close(reactor, reactor->connections);
+        }
+        if (reactor->epoll_fd >= 0) {
+            close(reactor->epoll_fd);
+        }
+    }
+
+    if (server->listen_fd >= 0) {
+        close(server->listen_fd);
+        if (server->unix_path[0]) unlink(server->unix_path);
+    }
+    if (server->stop_fd >= 0) {
+        close(server->stop_fd);
+    }
+    free(server);
+}
+
+uint16_t spi_server_port(const spi_server_t* server) {
+    return server ? server->port : 0;
+}
@@ -0,0 +1,210 @@
+#include "spi_interface.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Frame layouts (native byte order; both ends share a host). Offsets in
+// bytes, every frame padded to a multiple of 8.
+//
+// Request:  0 frame_size u32 | 4 request_id u32 | 8 request_type u32 |
+//           12 timeout_ms u32 | 16 tree_id | 24 leaf_index | 32 batch_size |
+//           40 leaf_data_size | 48 leaf_indices[batch_size] | leaf_data
+// Response: 0 frame_size u32 | 4 request_id u32 | 8 status u32 |
+//           12 verification_result u32 | 16 processing_time_ns |
+//           24 memory_used | 32 proof_size | 40 batch_size |
+//           48 batch_results[batch_size] | proof_data
+
+static inline size_t wire_pad(uint64_t size) {
+    return (size_t)((size + 7) & ~(uint64_t)7);
+}
+
+static inline void wire_put32(uint8_t* p, uint32_t value) {
+    memcpy(p, &value, sizeof(value));
+}
+
+static inline void wire_put64(uint8_t* p, uint64_t value) {
+    memcpy(p, &value, sizeof(value));
+}
+
+static inline uint32_t wire_get32(const uint8_t* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint64_t wire_get64(const uint8_t* p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// Frame size for a payload, or 0 if it cannot be framed
+static size_t wire_frame_size(uint64_t batch_size, uint64_t data_size) {
+    if (batch_size > SPI_MAX_BATCH_SIZE || data_size > SPI_WIRE_MAX_FRAME) {
+        return 0;
+    }
+    
+    uint64_t size = wire_pad(SPI_WIRE_HEADER_SIZE + batch_size * sizeof(uint64_t) + data_size);
+    return size <= SPI_WIRE_MAX_FRAME ? (size_t)size : 0;
+}
+
+size_t spi_wire_frame_size(const uint8_t* header) {
+    if (!header) {
+        return 0;
+    }
+    
+    uint32_t size = wire_get32(header);
+    if (size < SPI_WIRE_HEADER_SIZE || size > SPI_WIRE_MAX_FRAME || size % 8 != 0) {
+        return 0;
+    }
+    return size;
+}
+
+size_t spi_wire_request_size(const spi_request_t* request) {
+    if (!request || (request->batch_size > 0 && !request->leaf_indices) ||
+        (request->leaf_data_size > 0 && !request->leaf_data)) {
+        return 0;
+    }
+    return wire_frame_size(request->batch_size, request->leaf_data_size);
+}
+
+size_t spi_wire_encode_request(const spi_request_t* request, uint8_t* buffer, size_t capacity) {
+    size_t size = spi_wire_request_size(request);
+    if (size == 0 || !buffer || capacity < size) {
+        return 0;
+    }
+    
+    wire_put32(buffer, (uint32_t)size);
+    wire_put32(buffer + 4, request->request_id);
+    wire_put32(buffer + 8, (uint32_t)request->request_type);
+    wire_put32(buffer + 12, request->timeout_ms);
+    wire_put64(buffer + 16, request->tree_id);
+    wire_put64(buffer + 24, request->leaf_index);
+    wire_put64(buffer + 32, request->batch_size);
+    wire_put64(buffer + 40, request->leaf_data_size);
+    
+    uint8_t* p = buffer + SPI_WIRE_HEADER_SIZE;
+    if (request->batch_size > 0) {
+        memcpy(p, request->leaf_indices, request->batch_size * sizeof(uint64_t));
+        p += request->batch_size * sizeof(uint64_t);
+    }
+    if (request->leaf_data_size > 0) {
+        memcpy(p, request->leaf_data, request->leaf_data_size);
+        p += request->leaf_data_size;
+    }
+    memset(p, 0, (size_t)(buffer + size - p));
+    
+    return size;
+}
+
+// Zero-copy: leaf_indices and leaf_data point into the frame, which must be
+// 8-byte aligned and outlive the request
+bool spi_wire_decode_request(const uint8_t* frame, size_t size, spi_request_t* request) {
+    if (!frame || !request || size < SPI_WIRE_HEADER_SIZE || spi_wire_frame_size(frame) != size ||
+        ((uintptr_t)frame & 7) != 0) {
+        return false;
+    }
+    
+    uint64_t batch_size = wire_get64(frame + 32);
+    uint64_t data_size = wire_get64(frame + 40);
+    if (wire_frame_size(batch_size, data_size) != size) {
+        return false;
+    }
+    
+    memset(request, 0, sizeof(*request));
+    request->request_id = wire_get32(frame + 4);
+    request->request_type = (spi_request_type_t)wire_get32(frame + 8);
+    request->timeout_ms = wire_get32(frame + 12);
+    request->tree_id = wire_get64(frame + 16);
+    request->leaf_index = wire_get64(frame + 24);
+    request->batch_size = batch_size;
+    request->leaf_data_size = data_size;
+    
+    const uint8_t* p = frame + SPI_WIRE_HEADER_SIZE;
+    if (batch_size > 0) {
+        request->leaf_indices = (const uint64_t*)(const void*)p;
+        p += batch_size * sizeof(uint64_t);
+    }
+    if (data_size > 0) {
+        request->leaf_data = p;
+    }
+    
+    return true;
+}
+
+size_t spi_wire_response_size(const spi_response_t* response) {
+    if (!response || (response->batch_size > 0 && !response->batch_results) ||
+        (response->proof_size > 0 && !response->proof_data)) {
+        return 0;
+    }
+    return wire_frame_size(response->batch_size, response->proof_size);
+}
+
+size_t spi_wire_encode_response(const spi_response_t* response, uint8_t* buffer, size_t capacity) {
+    size_t size = spi_wire_response_size(response);
+    if (size == 0 || !buffer || capacity < size) {
+        return 0;
+    }
+    
+    wire_put32(buffer, (uint32_t)size);
+    wire_put32(buffer + 4, response->request_id);
+    wire_put32(buffer + 8, (uint32_t)response->status);
+    wire_put32(buffer + 12, (uint32_t)response->verification_result);
+    wire_put64(buffer + 16, response->processing_time_ns);
+    wire_put64(buffer + 24, response->memory_used);
+    wire_put64(buffer + 32, response->proof_size);
+    wire_put64(buffer + 40, response->batch_size);
+    
+    uint8_t* p = buffer + SPI_WIRE_HEADER_SIZE;
+    if (response->batch_size > 0) {
+        memcpy(p, response->batch_results, response->batch_size * sizeof(uint64_t));
+        p += response->batch_size * sizeof(uint64_t);
+    }
+    if (response->proof_size > 0) {
+        memcpy(p, response->proof_data, response->proof_size);
+        p += response->proof_size;
+    }
+    memset(p, 0, (size_t)(buffer + size - p));
+    
+    return size;
+}
+
+// The decoded response owns copies of the payload; free it with
+// spi_free_response
+spi_response_t* spi_wire_decode_response(const uint8_t* frame, size_t size) {
+    if (!frame || size < SPI_WIRE_HEADER_SIZE || spi_wire_frame_size(frame) != size) {
+        return NULL;
+    }
+    
+    uint64_t proof_size = wire_get64(frame + 32);
+    uint64_t batch_size = wire_get64(frame + 40);
+    if (wire_frame_size(batch_size, proof_size) != size) {
+        return NULL;
+    }
+    
+    spi_response_t* response = spi_response_create(wire_get32(frame + 4), batch_size);
+    if (!response) {
+        return NULL;
+    }
+    
+    response->status = (spi_response_status_t)wire_get32(frame + 8);
+    response->verification_result = wire_get32(frame + 12);
+    response->processing_time_ns = wire_get64(frame + 16);
+    response->memory_used = wire_get64(frame + 24);
+    
+    const uint8_t* p = frame + SPI_WIRE_HEADER_SIZE;
+    if (batch_size > 0) {
+        memcpy(response->batch_results, p, batch_size * sizeof(uint64_t));
+        p += batch_size * sizeof(uint64_t);
+    }
+    if (proof_size > 0) {
+        response->proof_data = (uint8_t*)malloc(proof_size);
+        if (!response->proof_data) {
+            spi_free_response(response);
+            return NULL;
+        }
+        memcpy(response->proof_data, p, proof_size);
+        response->proof_size = proof_size;
+    }
+    
+    return response;
+}